@@ -0,0 +1,99 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Implementation of the Arena class.
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "arena.h"
+
+namespace infact {
+
+Arena::Arena(size_t block_size) :
+    block_size_(block_size), next_(nullptr), end_(nullptr),
+    bytes_reserved_(0), bytes_allocated_(0) { }
+
+Arena::~Arena() {
+  for (vector<char *>::iterator it = blocks_.begin(); it != blocks_.end();
+       ++it) {
+    free(*it);
+  }
+}
+
+void *
+Arena::Allocate(size_t size, size_t alignment) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bytes_allocated_ += size;
+  if (size > block_size_ / 4) {
+    // Give large allocations a block of their own, so as not to waste
+    // the remainder of the current block.  Memory from malloc is
+    // suitably aligned for any type.
+    char *block = static_cast<char *>(malloc(size == 0 ? 1 : size));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    blocks_.push_back(block);
+    bytes_reserved_ += size;
+    return block;
+  }
+  size_t offset = reinterpret_cast<uintptr_t>(next_) % alignment;
+  size_t padding = offset == 0 ? 0 : alignment - offset;
+  if (next_ == nullptr || padding + size > static_cast<size_t>(end_ - next_)) {
+    char *block = static_cast<char *>(malloc(block_size_));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    blocks_.push_back(block);
+    bytes_reserved_ += block_size_;
+    next_ = block;
+    end_ = block + block_size_;
+    padding = 0;
+  }
+  void *result = next_ + padding;
+  next_ += padding + size;
+  return result;
+}
+
+size_t
+Arena::bytes_reserved() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_reserved_;
+}
+
+size_t
+Arena::bytes_allocated() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_allocated_;
+}
+
+}  // namespace infact
@@ -0,0 +1,152 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Provides the \link infact::Arena Arena \endlink class, a region of
+/// memory in which a whole graph of \link infact::Factory
+/// Factory\endlink-constructed objects may be allocated and then freed
+/// at once.
+
+#ifndef INFACT_ARENA_H_
+#define INFACT_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace infact {
+
+using std::shared_ptr;
+using std::vector;
+
+/// A region of memory from which objects are allocated by bumping a
+/// pointer, and which is freed all at once when destroyed.  Individual
+/// deallocations are ignored.
+///
+/// An arena is typically handed to an \link infact::Interpreter
+/// Interpreter \endlink or \link infact::Environment Environment
+/// \endlink (see \link infact::Environment::set_arena
+/// Environment::set_arena\endlink), so that every object constructed
+/// while evaluating a configuration is placed, together with the
+/// control block of its <tt>shared_ptr</tt>, in the arena.  Since each
+/// such object holds a reference to its arena (see \link ArenaAllocator
+/// \endlink), the arena is freed exactly when the last object allocated
+/// from it is destroyed, for example when a configuration is retired.
+///
+/// Allocation is thread-safe.
+class Arena {
+ public:
+  /// Constructs a new, empty arena.
+  ///
+  /// \param block_size the size of each block of memory obtained from
+  ///                   the system; larger allocations are given blocks of
+  ///                   their own
+  explicit Arena(size_t block_size = 64 * 1024);
+
+  /// Frees all memory allocated from this arena.
+  ~Arena();
+
+  /// Returns a pointer to the specified number of bytes of memory with
+  /// the specified alignment, which remains valid until this arena is
+  /// destroyed.
+  ///
+  /// \param size      the number of bytes to allocate
+  /// \param alignment the required alignment, a power of two no greater
+  ///                  than that of <tt>std::max_align_t</tt>
+  void *Allocate(size_t size, size_t alignment);
+
+  /// Returns the total number of bytes obtained from the system.
+  size_t bytes_reserved() const;
+
+  /// Returns the total number of bytes handed out by \link Allocate
+  /// \endlink.
+  size_t bytes_allocated() const;
+
+ private:
+  Arena(const Arena &);
+  void operator=(const Arena &);
+
+  size_t block_size_;
+  mutable std::mutex mutex_;
+  vector<char *> blocks_;
+  char *next_;
+  char *end_;
+  size_t bytes_reserved_;
+  size_t bytes_allocated_;
+};
+
+/// An allocator, for use with <tt>std::allocate_shared</tt> and the
+/// standard containers, that allocates from an \link Arena \endlink and
+/// keeps it alive for as long as any memory allocated through it may
+/// be in use.
+///
+/// \tparam T the type of objects allocated
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  /// Constructs an allocator allocating from the specified arena.
+  explicit ArenaAllocator(const shared_ptr<Arena> &arena) : arena_(arena) { }
+
+  /// Constructs an allocator allocating from the same arena as the
+  /// specified allocator.
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) { }
+
+  /// Allocates memory for the specified number of objects.
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  /// Does nothing, since memory is only freed with the arena.
+  void deallocate(T *, size_t) { }
+
+  /// Returns the arena from which this allocator allocates.
+  const shared_ptr<Arena> &arena() const { return arena_; }
+
+ private:
+  shared_ptr<Arena> arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return !(a == b);
+}
+
+}  // namespace infact
+
+#endif
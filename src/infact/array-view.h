@@ -0,0 +1,196 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::ArrayView ArrayView \endlink class, a
+/// read-only array whose elements may reside in a memory-mapped file.
+
+#ifndef INFACT_ARRAY_VIEW_H_
+#define INFACT_ARRAY_VIEW_H_
+
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "mapped-file.h"
+#include "stream-init.h"
+#include "stream-tokenizer.h"
+
+namespace infact {
+
+using std::ostringstream;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+/// The identifier introducing a memory-mapped array literal, as in
+/// <tt>double_view weights = @mmap("weights.f64");</tt>
+#define INFACT_MMAP_KEYWORD "@mmap"
+
+/// A read-only array of values of type <tt>T</tt>, which may share
+/// the memory of a file mapped into memory instead of holding a copy
+/// of its elements, so that several arrays, or several processes, may
+/// use a single copy of a large array in the page cache.  Copying a
+/// view is cheap and refers to the same elements, which remain valid
+/// for as long as any view of them exists.
+///
+/// In the language of the \link infact::Interpreter Interpreter\endlink,
+/// views have the types <tt>int_view</tt> and <tt>double_view</tt>, and
+/// are read from a file of raw, native-endian values whose size is a
+/// multiple of <tt>sizeof(T)</tt> with the literal
+/// <tt>@mmap("</tt><i>filename</i><tt>")</tt>; a relative filename is
+/// relative to the current working directory.  A
+/// Factory-constructible object may also have a data member of type
+/// <tt>ArrayView\<T\></tt>, initialized in the same way.
+///
+/// \tparam T the type of the elements, which must be trivially copyable
+template <typename T>
+class ArrayView {
+ public:
+  typedef T value_type;
+  typedef const T *const_iterator;
+  typedef const T *iterator;
+
+  /// Constructs an empty view.
+  ArrayView() : data_(nullptr), size_(0) { }
+
+  /// Constructs a view of an array owned by the specified object.
+  ///
+  /// \param owner an object keeping the elements alive
+  /// \param data  the first element
+  /// \param size  the number of elements
+  ArrayView(const shared_ptr<const void> &owner, const T *data, size_t size) :
+      owner_(owner), data_(data), size_(size) { }
+
+  /// Constructs a view of a copy of the specified elements.
+  explicit ArrayView(const vector<T> &values) {
+    shared_ptr<const vector<T> > copy(new vector<T>(values));
+    owner_ = copy;
+    data_ = copy->data();
+    size_ = copy->size();
+  }
+
+  /// Returns a view of the raw values held in the specified file, which
+  /// is memory-mapped.  It is an error if the file cannot be read or
+  /// its size is not a multiple of the size of a value.
+  static ArrayView<T> MapOrDie(const string &filename) {
+    shared_ptr<const MappedFile> file(new MappedFile(filename, false));
+    if (!file->good()) {
+      Error("ArrayView: error: could not read file \"" + filename + "\"");
+    }
+    if (file->size() % sizeof(T) != 0) {
+      ostringstream err_ss;
+      err_ss << "ArrayView: error: size of file \"" << filename << "\" ("
+             << file->size() << " bytes) is not a multiple of the size of "
+             << "an element (" << sizeof(T) << " bytes)";
+      Error(err_ss.str());
+    }
+    return ArrayView<T>(file, reinterpret_cast<const T *>(file->data()),
+                        file->size() / sizeof(T));
+  }
+
+  /// Returns the first element.
+  const T *data() const { return data_; }
+  /// Returns the number of elements.
+  size_t size() const { return size_; }
+  /// Returns whether there are no elements.
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  /// Returns the element at the specified index.
+  const T &operator[](size_t i) const { return data_[i]; }
+
+  /// Returns a copy of the elements.
+  vector<T> ToVector() const { return vector<T>(begin(), end()); }
+
+  /// Returns whether this view refers to exactly the same elements as
+  /// the specified view.
+  bool operator==(const ArrayView<T> &other) const {
+    return data_ == other.data_ && size_ == other.size_;
+  }
+  bool operator!=(const ArrayView<T> &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  shared_ptr<const void> owner_;
+  const T *data_;
+  size_t size_;
+};
+
+/// A partial specialization to read array views, from a literal of the
+/// form <tt>@mmap("</tt><i>filename</i><tt>")</tt>.
+///
+/// \tparam T the type of the elements of the array
+template <typename T>
+class Initializer<ArrayView<T> > : public StreamInitializer {
+ public:
+  Initializer(ArrayView<T> *member) : member_(member) { }
+  virtual ~Initializer() { }
+  virtual void Init(StreamTokenizer &st, Environment *env = nullptr) {
+    if (st.PeekView() != INFACT_MMAP_KEYWORD) {
+      ExpectedError(st, INFACT_MMAP_KEYWORD);
+    }
+    st.Skip();
+    if (st.PeekView() != "(") {
+      ExpectedError(st, "(");
+    }
+    st.Skip();
+    if (st.PeekTokenType() != StreamTokenizer::STRING) {
+      ExpectedError(st, "filename string");
+    }
+    string filename = st.Next();
+    if (st.PeekView() != ")") {
+      ExpectedError(st, ")");
+    }
+    st.Skip();
+    (*member_) = ArrayView<T>::MapOrDie(filename);
+  }
+ private:
+  void ExpectedError(const StreamTokenizer &st, const string &expected) {
+    ostringstream err_ss;
+    err_ss << "ArrayViewInitializer: expected " << expected
+           << " at stream position " << st.PeekTokenStart()
+           << " but found \"" << st.Peek() << "\"";
+    Error(err_ss.str());
+  }
+
+  ArrayView<T> *member_;
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,183 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Implementation of synthetic workloads and measurement utilities
+/// shared by the benchmark programs.
+
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "bench-util.h"
+
+namespace infact {
+
+using std::endl;
+using std::ostringstream;
+
+BenchWorkload
+FlatAssignments(size_t size) {
+  ostringstream oss;
+  for (size_t i = 0; i < size; ++i) {
+    switch (i % 4) {
+      case 0:
+        oss << "i" << i << " = " << i << ";\n";
+        break;
+      case 1:
+        oss << "d" << i << " = " << i << ".25;\n";
+        break;
+      case 2:
+        oss << "b" << i << " = " << (i % 3 == 0 ? "true" : "false") << ";\n";
+        break;
+      default:
+        oss << "s" << i << " = \"value " << i << "\";\n";
+        break;
+    }
+  }
+  BenchWorkload workload = { "flat", oss.str(), size, 0 };
+  return workload;
+}
+
+BenchWorkload
+LargeDoubleArray(size_t size) {
+  ostringstream oss;
+  oss << "d = {";
+  for (size_t i = 0; i < size; ++i) {
+    if (i > 0) {
+      oss << (i % 8 == 0 ? ",\n" : ", ");
+    }
+    // Always write a decimal point so that every element is a double.
+    oss << static_cast<long>(i) - 17 << "." << (i % 10);
+  }
+  oss << "};\n";
+  BenchWorkload workload = { "double-array", oss.str(), 1, 0 };
+  return workload;
+}
+
+// Writes a spec for a single animal, alternating between cows and sheep.
+static void
+WriteAnimal(ostream &os, size_t i) {
+  if (i % 2 == 0) {
+    os << "Cow(name(\"cow" << i << "\"), age(" << (i % 20) << "))";
+  } else {
+    os << "Sheep(name(\"sheep" << i << "\"), counts({" << i << ", "
+       << (i + 1) << ", " << (i + 2) << "}), age(" << (i % 10) << "))";
+  }
+}
+
+BenchWorkload
+NestedPetOwners(size_t size, size_t num_pets) {
+  ostringstream oss;
+  for (size_t i = 0; i < size; ++i) {
+    oss << "owner" << i << " = HumanPetOwner(pets({";
+    for (size_t j = 0; j < num_pets; ++j) {
+      if (j > 0) {
+        oss << ", ";
+      }
+      WriteAnimal(oss, i + j);
+    }
+    oss << "}));\n";
+  }
+  BenchWorkload workload =
+      { "nested", oss.str(), size, size * (num_pets + 1) };
+  return workload;
+}
+
+BenchWorkload
+WideAnimals(size_t size) {
+  ostringstream oss;
+  oss << "animals = {";
+  for (size_t i = 0; i < size; ++i) {
+    oss << (i > 0 ? ",\n  " : "\n  ");
+    WriteAnimal(oss, i);
+  }
+  oss << "\n};\n";
+  BenchWorkload workload = { "wide", oss.str(), 1, size };
+  return workload;
+}
+
+vector<BenchWorkload>
+StandardWorkloads(size_t scale) {
+  vector<BenchWorkload> workloads;
+  workloads.push_back(FlatAssignments(64 * 1024 * scale));
+  workloads.push_back(LargeDoubleArray(128 * 1024 * scale));
+  workloads.push_back(NestedPetOwners(1024 * scale, 16));
+  workloads.push_back(WideAnimals(24 * 1024 * scale));
+  return workloads;
+}
+
+long
+PeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+  // Linux reports ru_maxrss in kilobytes; Mac OS X reports it in bytes.
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+void
+ReportRate(ostream &os, const string &benchmark, const string &workload,
+           size_t count, const string &unit, double seconds) {
+  double rate = seconds > 0.0 ? count / seconds : 0.0;
+  os << std::left << std::setw(24) << benchmark
+     << std::setw(14) << workload
+     << std::right << std::setw(10) << count << " " << std::left
+     << std::setw(11) << unit
+     << std::right << std::fixed << std::setprecision(4) << std::setw(10)
+     << seconds << " s"
+     << std::setprecision(0) << std::setw(14) << rate << " " << unit << "/s"
+     << "  peak RSS " << PeakRssKb() << " KB" << endl;
+  os.unsetf(std::ios_base::floatfield);
+}
+
+size_t
+ParseScale(int argc, char **argv) {
+  if (argc < 2) {
+    return 1;
+  }
+  long scale = strtol(argv[1], nullptr, 10);
+  return scale > 0 ? scale : 1;
+}
+
+bool
+SelectWorkload(int argc, char **argv, const string &name) {
+  return argc < 3 || name == argv[2];
+}
+
+}  // namespace infact
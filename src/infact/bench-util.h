@@ -0,0 +1,128 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Provides synthetic workloads and measurement utilities shared by the
+/// benchmark programs.
+
+#ifndef INFACT_BENCH_UTIL_H_
+#define INFACT_BENCH_UTIL_H_
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace infact {
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+/// A synthetic input to the interpreter, along with the number of
+/// statements and objects it contains.
+struct BenchWorkload {
+  /// The name of this workload, for reporting.
+  string name;
+  /// The text of this workload, in the language of the \link
+  /// infact::Interpreter Interpreter\endlink.
+  string text;
+  /// The number of top-level statements in \link text \endlink.
+  size_t num_statements;
+  /// The number of objects constructed when \link text \endlink is
+  /// evaluated.
+  size_t num_objects;
+};
+
+/// Returns a long flat file of <tt>size</tt> primitive assignments,
+/// cycling through <tt>int</tt>, <tt>double</tt>, <tt>bool</tt> and
+/// <tt>string</tt> values.
+BenchWorkload FlatAssignments(size_t size);
+
+/// Returns a single assignment of a <tt>double[]</tt> literal with
+/// <tt>size</tt> elements.
+BenchWorkload LargeDoubleArray(size_t size);
+
+/// Returns <tt>size</tt> assignments of <tt>HumanPetOwner</tt> specs,
+/// each owning <tt>num_pets</tt> inline <tt>Cow</tt> and
+/// <tt>Sheep</tt> specs with their own data members.
+BenchWorkload NestedPetOwners(size_t size, size_t num_pets);
+
+/// Returns a single assignment of an <tt>Animal[]</tt> vector with
+/// <tt>size</tt> inline <tt>Cow</tt> and <tt>Sheep</tt> specs.
+BenchWorkload WideAnimals(size_t size);
+
+/// Returns all of the above workloads at the specified scale, where a
+/// scale of 1 yields roughly one megabyte of text per workload.
+vector<BenchWorkload> StandardWorkloads(size_t scale);
+
+/// Returns the peak resident set size of this process, in kilobytes.
+long PeakRssKb();
+
+/// A wall-clock stopwatch.
+class BenchTimer {
+ public:
+  /// Constructs a new timer and starts it.
+  BenchTimer() : start_(std::chrono::steady_clock::now()) { }
+
+  /// Returns the number of seconds elapsed since this timer was
+  /// constructed.
+  double Seconds() const {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_;
+    return elapsed.count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+/// Prints a single line reporting the rate at which <tt>count</tt>
+/// <tt>unit</tt>s were processed in <tt>seconds</tt>, along with the
+/// current peak resident set size.
+void ReportRate(ostream &os, const string &benchmark, const string &workload,
+                size_t count, const string &unit, double seconds);
+
+/// Parses the optional scale argument common to all benchmark programs,
+/// returning 1 if there is none.
+size_t ParseScale(int argc, char **argv);
+
+/// Returns whether the workload with the specified name should be run,
+/// given the optional workload name argument common to all benchmark
+/// programs.  Because peak resident set size is a per-process
+/// measurement, it is only meaningful for a single workload when that
+/// workload is run on its own.
+bool SelectWorkload(int argc, char **argv, const string &name);
+
+}  // namespace infact
+
+#endif
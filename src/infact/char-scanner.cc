@@ -0,0 +1,279 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Implementation of the \link infact::CharScanner CharScanner \endlink
+/// class.
+
+#include "char-scanner.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(INFACT_NO_SIMD)
+#define INFACT_VECTOR_SCAN 1
+#include <immintrin.h>
+#endif
+
+namespace infact {
+
+namespace {
+
+enum ScanImplementation { kScalar, kSse2, kAvx2 };
+
+ScanImplementation DetectImplementation() {
+#ifdef INFACT_VECTOR_SCAN
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? kAvx2 : kSse2;
+#else
+  return kScalar;
+#endif
+}
+
+/// Returns the implementation to use, which is chosen the first time
+/// this function is called.
+ScanImplementation GetImplementation() {
+  static const ScanImplementation implementation = DetectImplementation();
+  return implementation;
+}
+
+#ifdef INFACT_VECTOR_SCAN
+/// Returns a mask of the bytes of x that are whitespace.
+inline __m128i WhitespaceMaskSse2(__m128i x) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+  __m128i in_range = _mm_cmpeq_epi8(
+      _mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+  return _mm_or_si128(in_range, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2")))
+inline __m256i WhitespaceMaskAvx2(__m256i x) {
+  __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+  __m256i in_range = _mm256_cmpeq_epi8(
+      _mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+  return _mm256_or_si256(in_range,
+                         _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+const char *SkipWhitespaceSse2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned not_space = ~_mm_movemask_epi8(WhitespaceMaskSse2(x)) & 0xffff;
+    if (not_space != 0) {
+      return p + __builtin_ctz(not_space);
+    }
+  }
+  return p;
+}
+
+__attribute__((target("avx2")))
+const char *SkipWhitespaceAvx2(const char *begin, const char *end) {
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    unsigned not_space =
+        ~static_cast<unsigned>(_mm256_movemask_epi8(WhitespaceMaskAvx2(x)));
+    if (not_space != 0) {
+      return p + __builtin_ctz(not_space);
+    }
+  }
+  return SkipWhitespaceSse2(p, end);
+}
+
+size_t CountSse2(const char *begin, const char *end, char c) {
+  size_t count = 0;
+  const char *p = begin;
+  __m128i target = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, target)));
+  }
+  for (; p < end; ++p) {
+    count += *p == c;
+  }
+  return count;
+}
+
+__attribute__((target("avx2")))
+size_t CountAvx2(const char *begin, const char *end, char c) {
+  size_t count = 0;
+  const char *p = begin;
+  __m256i target = _mm256_set1_epi8(c);
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    count += __builtin_popcount(static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, target))));
+  }
+  return count + CountSse2(p, end, c);
+}
+#endif
+
+}  // namespace
+
+CharScanner::CharScanner() : num_stop_bytes_(0), stop_at_space_(false) {
+  memset(table_, 0, sizeof(table_));
+}
+
+CharScanner::CharScanner(const char *stop_bytes, size_t num_stop_bytes,
+                         bool stop_at_space) :
+    num_stop_bytes_(num_stop_bytes), stop_at_space_(stop_at_space) {
+  memset(table_, 0, sizeof(table_));
+  for (size_t i = 0; i < num_stop_bytes; ++i) {
+    table_[static_cast<unsigned char>(stop_bytes[i])] = true;
+    if (i < kMaxVectorStopBytes) {
+      stop_bytes_[i] = stop_bytes[i];
+    }
+  }
+  if (stop_at_space) {
+    for (int c = 0; c < 256; ++c) {
+      if (IsWhitespace(static_cast<char>(c))) {
+        table_[c] = true;
+      }
+    }
+  }
+}
+
+const char *
+CharScanner::Find(const char *begin, const char *end) const {
+#ifdef INFACT_VECTOR_SCAN
+  if (num_stop_bytes_ <= kMaxVectorStopBytes) {
+    switch (GetImplementation()) {
+      case kAvx2:
+        return FindAvx2(begin, end);
+      case kSse2:
+        return FindSse2(begin, end);
+      default:
+        break;
+    }
+  }
+#endif
+  return FindScalar(begin, end);
+}
+
+const char *
+CharScanner::FindScalar(const char *begin, const char *end) const {
+  for (const char *p = begin; p < end; ++p) {
+    if (Stops(*p)) {
+      return p;
+    }
+  }
+  return end;
+}
+
+#ifdef INFACT_VECTOR_SCAN
+// The vector implementations find candidate bytes, which are the explicit
+// stop bytes and, when stopping at whitespace, every byte no greater than
+// a space; each candidate is then confirmed with the table.
+
+const char *
+CharScanner::FindSse2(const char *begin, const char *end) const {
+  const char *p = begin;
+  __m128i space = _mm_set1_epi8(' ');
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i candidates = stop_at_space_ ?
+        _mm_cmpeq_epi8(_mm_min_epu8(x, space), x) : _mm_setzero_si128();
+    for (size_t i = 0; i < num_stop_bytes_; ++i) {
+      candidates = _mm_or_si128(
+          candidates, _mm_cmpeq_epi8(x, _mm_set1_epi8(stop_bytes_[i])));
+    }
+    for (unsigned bits = _mm_movemask_epi8(candidates); bits != 0;
+         bits &= bits - 1) {
+      const char *candidate = p + __builtin_ctz(bits);
+      if (Stops(*candidate)) {
+        return candidate;
+      }
+    }
+  }
+  return FindScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char *
+CharScanner::FindAvx2(const char *begin, const char *end) const {
+  const char *p = begin;
+  __m256i space = _mm256_set1_epi8(' ');
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i candidates = stop_at_space_ ?
+        _mm256_cmpeq_epi8(_mm256_min_epu8(x, space), x) :
+        _mm256_setzero_si256();
+    for (size_t i = 0; i < num_stop_bytes_; ++i) {
+      candidates = _mm256_or_si256(
+          candidates, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(stop_bytes_[i])));
+    }
+    for (unsigned bits = _mm256_movemask_epi8(candidates); bits != 0;
+         bits &= bits - 1) {
+      const char *candidate = p + __builtin_ctz(bits);
+      if (Stops(*candidate)) {
+        return candidate;
+      }
+    }
+  }
+  return FindSse2(p, end);
+}
+#endif
+
+const char *
+CharScanner::SkipWhitespace(const char *begin, const char *end) {
+  const char *p = begin;
+#ifdef INFACT_VECTOR_SCAN
+  p = GetImplementation() == kAvx2 ?
+      SkipWhitespaceAvx2(begin, end) : SkipWhitespaceSse2(begin, end);
+#endif
+  while (p < end && IsWhitespace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+size_t
+CharScanner::Count(const char *begin, const char *end, char c) {
+#ifdef INFACT_VECTOR_SCAN
+  return GetImplementation() == kAvx2 ?
+      CountAvx2(begin, end, c) : CountSse2(begin, end, c);
+#else
+  size_t count = 0;
+  for (const char *p = begin; p < end; ++p) {
+    count += *p == c;
+  }
+  return count;
+#endif
+}
+
+const char *
+CharScanner::Implementation() {
+  static const char *names[] = { "scalar", "sse2", "avx2" };
+  return names[GetImplementation()];
+}
+
+}  // namespace infact
@@ -0,0 +1,119 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Provides the \link infact::CharScanner CharScanner \endlink class,
+/// for finding bytes of interest in a contiguous buffer a vector
+/// register at a time.
+
+#ifndef INFACT_CHAR_SCANNER_H_
+#define INFACT_CHAR_SCANNER_H_
+
+#include <stddef.h>
+
+namespace infact {
+
+/// Finds the first occurrence of any of a small set of &ldquo;stop
+/// bytes&rdquo; in a contiguous buffer.
+///
+/// When the CPU supports them, AVX2 or SSE2 instructions are used to
+/// examine 32 or 16 bytes at a time; the choice is made once, at run
+/// time.  Otherwise, or when compiled with <tt>INFACT_NO_SIMD</tt>
+/// defined, a scalar loop over a 256-entry table is used.  All
+/// implementations return identical results.
+class CharScanner {
+ public:
+  /// The maximum number of explicit stop bytes that can be searched
+  /// for using vector instructions.  Scanners with more stop bytes than
+  /// this still work, but always use the scalar implementation.
+  static const size_t kMaxVectorStopBytes = 16;
+
+  /// Constructs a scanner that stops at nothing.
+  CharScanner();
+
+  /// Constructs a scanner that stops at each of the specified bytes.
+  ///
+  /// \param stop_bytes     the bytes at which to stop
+  /// \param num_stop_bytes the number of bytes in <tt>stop_bytes</tt>
+  /// \param stop_at_space  whether also to stop at any whitespace byte,
+  ///                       as classified by the &ldquo;C&rdquo; locale
+  CharScanner(const char *stop_bytes, size_t num_stop_bytes,
+              bool stop_at_space);
+
+  /// Returns whether this scanner stops at the specified byte.
+  bool Stops(char c) const { return table_[static_cast<unsigned char>(c)]; }
+
+  /// Returns a pointer to the first byte in <tt>[begin, end)</tt> at
+  /// which this scanner stops, or <tt>end</tt> if there is no such byte.
+  const char *Find(const char *begin, const char *end) const;
+
+  /// Returns a pointer to the first byte in <tt>[begin, end)</tt> that
+  /// is not whitespace, or <tt>end</tt> if there is no such byte.
+  static const char *SkipWhitespace(const char *begin, const char *end);
+
+  /// Returns the number of occurrences of the specified byte in
+  /// <tt>[begin, end)</tt>.
+  static size_t Count(const char *begin, const char *end, char c);
+
+  /// Returns whether the specified byte is whitespace, as classified by
+  /// the &ldquo;C&rdquo; locale.
+  static bool IsWhitespace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+
+  /// Returns the name of the implementation chosen for this CPU:
+  /// <tt>"avx2"</tt>, <tt>"sse2"</tt> or <tt>"scalar"</tt>.
+  static const char *Implementation();
+
+ private:
+  const char *FindScalar(const char *begin, const char *end) const;
+#if defined(__SSE2__) && !defined(INFACT_NO_SIMD)
+  const char *FindSse2(const char *begin, const char *end) const;
+  const char *FindAvx2(const char *begin, const char *end) const;
+#endif
+
+  // data members
+
+  /// Whether each byte is a stop byte.
+  bool table_[256];
+  /// The explicit stop bytes, for use by the vector implementations.
+  char stop_bytes_[kMaxVectorStopBytes];
+  /// The number of explicit stop bytes, or a value greater than
+  /// kMaxVectorStopBytes if only the scalar implementation may be used.
+  size_t num_stop_bytes_;
+  /// Whether this scanner stops at whitespace.
+  bool stop_at_space_;
+};
+
+}  // namespace infact
+
+#endif
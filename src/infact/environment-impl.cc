@@ -33,76 +33,184 @@
 /// Implementation of the Environment class.
 /// \author dbikel@google.com (Dan Bikel)
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 #include "environment-impl.h"
 #include "factory.h"
 
 namespace infact {
 
-EnvironmentImpl::EnvironmentImpl(int debug) {
-  debug_ = debug;
-
-  // Set up VarMap instances for each of the primitive types and their vectors.
-  var_map_["bool"] = new VarMap<bool>("bool", this);
-  var_map_["int"] = new VarMap<int>("int", this);
-  var_map_["double"] = new VarMap<double>("double", this);
-  var_map_["string"] = new VarMap<string>("string", this);
-  var_map_["bool[]"] = new VarMap<vector<bool> >("bool[]", "bool", this);
-  var_map_["int[]"] = new VarMap<vector<int> >("int[]", "int", this);
-  var_map_["double[]"] =
-      new VarMap<vector<double> >("double[]", "double", this);
-  var_map_["string[]"] =
-      new VarMap<vector<string> >("string[]", "string", this);
-
-  // Set up VarMap instances for each of the Factory-constructible types
-  // and their vectors.
-  for (FactoryContainer::iterator factory_it = FactoryContainer::begin();
-       factory_it != FactoryContainer::end(); ++factory_it) {
-    unordered_set<string> registered;
-    (*factory_it)->CollectRegistered(registered);
-    string base_name = (*factory_it)->BaseName();
+namespace {
 
-    // Create type-specific VarMap from the Factory and add to var_map_.
-    VarMapBase *obj_var_map = (*factory_it)->CreateVarMap(this);
-    var_map_[obj_var_map->Name()] = obj_var_map;
+/// Returns the interned name of the type of vectors of the specified
+/// interned type, using the precomputed map when possible.
+Symbol VectorTypeOf(const unordered_map<Symbol, Symbol> &vector_type,
+                    Symbol type) {
+  unordered_map<Symbol, Symbol>::const_iterator it = vector_type.find(type);
+  if (it != vector_type.end()) {
+    return it->second;
+  }
+  return SymbolTable::Intern(SymbolTable::Name(type) + "[]");
+}
 
-    if (debug_ >= 2) {
-      cerr << "Environment: created VarMap for " << obj_var_map->Name()
-           << endl;
-    }
+}  // namespace
+
+EnvironmentImpl::EnvironmentImpl(int debug) :
+    types_version_(0), prototype_(GetPrototype(debug)), debug_(debug),
+    lazy_(false), sweep_threads_(1) {
+}
 
-    // Create VarMap for vectors of shared_object of T and add to var_map_.
-    VarMapBase *obj_vector_var_map = (*factory_it)->CreateVectorVarMap(this);
-    var_map_[obj_vector_var_map->Name()] = obj_vector_var_map;
+shared_ptr<const EnvironmentImpl::Prototype>
+EnvironmentImpl::GetPrototype(int debug) {
+  // Never destroyed, so that environments may be created during static
+  // destruction.
+  static std::mutex *mutex = new std::mutex();
+  static shared_ptr<const Prototype> *prototype =
+      new shared_ptr<const Prototype>();
 
-    if (debug_ >= 2) {
-      cerr << "Environment: created VarMap for " << obj_vector_var_map->Name()
-           << endl;
-    }
+  // Environments are constructed on many threads at once, so the
+  // current prototype is loaded without locking, and the lock is only
+  // taken to build a new one.
+  uint64_t generation = FactoryContainer::generation();
+  shared_ptr<const Prototype> current = std::atomic_load(prototype);
+  if (current != nullptr && current->generation == generation) {
+    return current;
+  }
+  std::lock_guard<std::mutex> lock(*mutex);
+  generation = FactoryContainer::generation();
+  current = std::atomic_load(prototype);
+  if (current != nullptr && current->generation == generation) {
+    return current;
+  }
+
+  Prototype *new_prototype = new Prototype();
+  new_prototype->generation = generation;
+  unordered_map<Symbol, Symbol> &vector_type = new_prototype->vector_type;
+  unordered_map<Symbol, std::function<VarMapBase *(Environment *)> >
+      &creators = new_prototype->var_map_creators;
+
+  // Set up VarMap creators for each of the primitive types and their vectors.
+  Symbol bool_type = SymbolTable::Intern("bool");
+  Symbol int_type = SymbolTable::Intern("int");
+  Symbol double_type = SymbolTable::Intern("double");
+  Symbol string_type = SymbolTable::Intern("string");
+  Symbol bool_vector_type = SymbolTable::Intern("bool[]");
+  Symbol int_vector_type = SymbolTable::Intern("int[]");
+  Symbol double_vector_type = SymbolTable::Intern("double[]");
+  Symbol string_vector_type = SymbolTable::Intern("string[]");
+  creators[bool_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<bool>("bool", env);
+  };
+  creators[int_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<int>("int", env);
+  };
+  creators[double_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<double>("double", env);
+  };
+  creators[string_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<string>("string", env);
+  };
+  creators[bool_vector_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<vector<bool> >("bool[]", "bool", env);
+  };
+  creators[int_vector_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<vector<int> >("int[]", "int", env);
+  };
+  creators[double_vector_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<vector<double> >("double[]", "double", env);
+  };
+  creators[string_vector_type] = [](Environment *env) -> VarMapBase * {
+    return new VarMap<vector<string> >("string[]", "string", env);
+  };
+  // Views of arrays, which may be memory-mapped.
+  creators[SymbolTable::Intern("int_view")] =
+      [](Environment *env) -> VarMapBase * {
+    return new VarMap<ArrayView<int> >("int_view", env);
+  };
+  creators[SymbolTable::Intern("double_view")] =
+      [](Environment *env) -> VarMapBase * {
+    return new VarMap<ArrayView<double> >("double_view", env);
+  };
+  vector_type[bool_type] = bool_vector_type;
+  vector_type[int_type] = int_vector_type;
+  vector_type[double_type] = double_vector_type;
+  vector_type[string_type] = string_vector_type;
+
+  // Set up VarMap creators for each of the Factory-constructible types
+  // and their vectors.
+  unordered_map<Symbol, Symbol> &concrete_to_factory_type =
+      new_prototype->concrete_to_factory_type;
+  shared_ptr<const vector<FactoryBase *> > factories =
+      FactoryContainer::factories();
+  for (FactoryContainer::iterator factory_it = factories->begin();
+       factory_it != factories->end(); ++factory_it) {
+    const FactoryBase *factory = *factory_it;
+    unordered_set<string> registered;
+    factory->CollectRegistered(registered);
+    string base_name = factory->BaseName();
+    Symbol base_type = SymbolTable::Intern(base_name);
+    Symbol base_vector_type = SymbolTable::Intern(base_name + "[]");
+
+    creators[base_type] = [factory](Environment *env) {
+      return factory->CreateVarMap(env);
+    };
+    creators[base_vector_type] = [factory](Environment *env) {
+      return factory->CreateVectorVarMap(env);
+    };
+    vector_type[base_type] = base_vector_type;
 
     for (unordered_set<string>::const_iterator it = registered.begin();
          it != registered.end(); ++it) {
       const string &concrete_type_name = *it;
+      Symbol concrete_type = SymbolTable::Intern(concrete_type_name);
 
-      unordered_map<string, string>::const_iterator concrete_to_factory_it =
-          concrete_to_factory_type_.find(concrete_type_name);
-      if (concrete_to_factory_it != concrete_to_factory_type_.end()) {
+      unordered_map<Symbol, Symbol>::const_iterator concrete_to_factory_it =
+          concrete_to_factory_type.find(concrete_type);
+      if (concrete_to_factory_it != concrete_to_factory_type.end()) {
         // Warn user that there are two entries for the same concrete type
         // (presumably due to different abstract factory types).
         cerr << "Environment: WARNING: trying to override existing "
              << "concrete-to-factory type mapping ["
-             << concrete_type_name << " --> " << concrete_to_factory_it->second
+             << concrete_type_name << " --> "
+             << SymbolTable::Name(concrete_to_factory_it->second)
              << "] with [" << concrete_type_name << " --> " << base_name
              << endl;
       }
-      concrete_to_factory_type_[concrete_type_name] = base_name;
+      concrete_to_factory_type[concrete_type] = base_type;
 
-      if (debug_ >= 2) {
+      if (debug >= 2) {
         cerr << "Environment: associating concrete typename "
              << concrete_type_name
              << " with factory for " << base_name << endl;
       }
     }
   }
+
+  current.reset(new_prototype);
+  std::atomic_store(prototype, current);
+  return current;
+}
+
+VarMapBase *
+EnvironmentImpl::GetOrCreateVarMap(Symbol type) {
+  unordered_map<Symbol, VarMapBase *>::const_iterator var_map_it =
+      var_map_.find(type);
+  if (var_map_it != var_map_.end()) {
+    return var_map_it->second;
+  }
+  unordered_map<Symbol, std::function<VarMapBase *(Environment *)> >
+      ::const_iterator creator_it = prototype_->var_map_creators.find(type);
+  if (creator_it == prototype_->var_map_creators.end()) {
+    return nullptr;
+  }
+  VarMapBase *var_map = creator_it->second(this);
+  var_map_[type] = var_map;
+  if (debug_ >= 2) {
+    cerr << "Environment: created VarMap for " << var_map->Name() << endl;
+  }
+  return var_map;
 }
 
 void
@@ -110,15 +218,15 @@ EnvironmentImpl::ReadAndSet(const string &varname, StreamTokenizer &st,
                             const string type) {
   bool is_vector =
       st.PeekTokenType() == StreamTokenizer::RESERVED_CHAR &&
-      st.Peek() == "{";
+      st.PeekView() == "{";
 
   if (is_vector) {
     // Consume open brace.
     st.Next();
   } else if (st.PeekTokenType() == StreamTokenizer::RESERVED_CHAR ||
              (st.PeekTokenType() == StreamTokenizer::RESERVED_WORD &&
-              st.Peek() != "true" && st.Peek() != "false" &&
-	      st.Peek() != "nullptr" && st.Peek() != "NULL")) {
+              st.PeekView() != "true" && st.PeekView() != "false" &&
+	      st.PeekView() != "nullptr" && st.PeekView() != "NULL")) {
     ostringstream err_ss;
     err_ss << "Environment: error: expected literal or Factory-constructible "
 	   << "type but found token \"" << st.Peek() << "\" of type "
@@ -126,108 +234,145 @@ EnvironmentImpl::ReadAndSet(const string &varname, StreamTokenizer &st,
     Error(err_ss.str());
   }
 
-  string next_tok = st.Peek();
   bool is_object_type = false;
 
-  string inferred_type = InferType(varname, st, is_vector, &is_object_type);
+  Symbol inferred_type = InferType(varname, st, is_vector, &is_object_type);
 
   if (is_vector) {
     st.Putback();
-    next_tok = st.Peek();
   }
 
+  Symbol explicit_type =
+      type == "" ? SymbolTable::kNoSymbol : SymbolTable::Intern(type);
+
   if (debug_ >= 1) {
-    cerr << "Environment::ReadAndSet: next_tok=\"" << next_tok
+    cerr << "Environment::ReadAndSet: next_tok=\"" << st.PeekView()
          << "\"; explicit type=\"" << type << "\"; "
-         << "inferred_type=\"" << inferred_type << "\"" << endl;
+         << "inferred_type=\""
+         << (inferred_type == SymbolTable::kNoSymbol ?
+             "" : SymbolTable::Name(inferred_type))
+         << "\"" << endl;
   }
 
-  if (type == "" && inferred_type == "") {
+  if (explicit_type == SymbolTable::kNoSymbol &&
+      inferred_type == SymbolTable::kNoSymbol) {
     ostringstream err_ss;
     err_ss << "Environment: error: no explicit type specifier and could not "
            << "infer type for variable " << varname;
     Error(err_ss.str());
   }
-  if (type != "" && inferred_type != "" && type != inferred_type) {
+  if (explicit_type != SymbolTable::kNoSymbol &&
+      inferred_type != SymbolTable::kNoSymbol &&
+      explicit_type != inferred_type) {
     ostringstream err_ss;
     err_ss << "Environment: error: explicit type " << type
-           << " and inferred type " << inferred_type
+           << " and inferred type " << SymbolTable::Name(inferred_type)
            << " disagree for variable " << varname;
     Error(err_ss.str());
   }
 
   // If no explicit type specifier, then the inferred_type is the type.
-  string varmap_type = type == "" ? inferred_type : type;
+  Symbol varmap_type =
+      explicit_type == SymbolTable::kNoSymbol ? inferred_type : explicit_type;
 
-  // Check that varmap_type is a key in var_map_.
-  var_map_[varmap_type]->ReadAndSet(varname, st);
-  types_[varname] = varmap_type;
+  // Check that there is a VarMap for varmap_type.
+  VarMapBase *var_map = GetOrCreateVarMap(varmap_type);
+  if (var_map == nullptr) {
+    ostringstream err_ss;
+    err_ss << "Environment: error: no VarMap for type "
+           << SymbolTable::Name(varmap_type) << " of variable " << varname;
+    Error(err_ss.str());
+  }
+  var_map->ReadAndSet(varname, st);
+  types_.Set(SymbolTable::Intern(varname), varmap_type);
+  ++types_version_;
 }
 
-string
+Symbol
 EnvironmentImpl::InferType(const string &varname,
-                           const StreamTokenizer &st, bool is_vector,
+                           StreamTokenizer &st, bool is_vector,
                            bool *is_object_type) {
   *is_object_type = false;
-  string next_tok = st.Peek();
+  StringPiece next_tok = st.PeekView();
   switch (st.PeekTokenType()) {
     case StreamTokenizer::RESERVED_WORD:
       if (next_tok == "true" || next_tok == "false") {
-        return is_vector ? "bool[]" : "bool";
+        return SymbolTable::Intern(is_vector ? "bool[]" : "bool");
       } else {
-        return "";
+        return SymbolTable::kNoSymbol;
       }
       break;
     case StreamTokenizer::STRING:
-      return is_vector ? "string[]" : "string";
+      return SymbolTable::Intern(is_vector ? "string[]" : "string");
       break;
     case StreamTokenizer::NUMBER:
       {
         // If a token is a NUMBER, it is a double iff it contains a
         // decimal point.
-        size_t dot_pos = next_tok.find('.');
-        if (dot_pos != string::npos) {
-          return is_vector ? "double[]" : "double";
+        bool has_dot = false;
+        for (const char *it = next_tok.begin();
+             it != next_tok.end(); ++it) {
+          if (*it == '.') {
+            has_dot = true;
+            break;
+          }
+        }
+        if (has_dot) {
+          return SymbolTable::Intern(is_vector ? "double[]" : "double");
         } else {
-          return is_vector ? "int[]" : "int";
+          return SymbolTable::Intern(is_vector ? "int[]" : "int");
         }
       }
       break;
     case StreamTokenizer::IDENTIFIER:
       {
-        string type = "";
+        Symbol type = SymbolTable::kNoSymbol;
+        Symbol next_symbol = st.PeekSymbol();
 
         // Find out if next_tok is a concrete typename or a variable.
-        unordered_map<string, string>::const_iterator factory_type_it =
-            concrete_to_factory_type_.find(next_tok);
-        unordered_map<string, string>::const_iterator var_type_it =
-            types_.find(next_tok);
-        if (factory_type_it != concrete_to_factory_type_.end()) {
+        unordered_map<Symbol, Symbol>::const_iterator factory_type_it =
+            prototype_->concrete_to_factory_type.find(next_symbol);
+        const Symbol *var_type = types_.Find(next_symbol);
+        if (factory_type_it != prototype_->concrete_to_factory_type.end()) {
           // Set type to be abstract factory type.
           if (debug_ >= 1) {
             cerr << "Environment::InferType: concrete type is " << next_tok
                  << "; mapping to abstract Factory type "
-                 << factory_type_it->second << endl;
+                 << SymbolTable::Name(factory_type_it->second) << endl;
           }
           type = factory_type_it->second;
           *is_object_type = true;
-          type = is_vector ? type + "[]" : type;
+          type = is_vector ? VectorTypeOf(prototype_->vector_type, type) : type;
 
           if (debug_ >= 1) {
             cerr << "Environment::InferType: type "
                  << (is_vector ? "is" : "isn't")
-                 << " a vector, so final inferred type is " << type << endl;
+                 << " a vector, so final inferred type is "
+                 << SymbolTable::Name(type) << endl;
           }
-        } else if (var_type_it != types_.end()) {
+        } else if (var_type != nullptr) {
           // Could be a variable, in which case we need not only to return
           // the variable's type, but also set is_object_type and is_vector
           // based on the variable's type string.
-          string append = is_vector ? "[]" : "";
-          type = var_type_it->second + append;
+          type = is_vector ?
+              VectorTypeOf(prototype_->vector_type, *var_type) : *var_type;
           if (debug_ >= 1) {
             cerr << "Environment::InferType: found variable "
-                 << var_type_it->first << " of type " << var_type_it->second
-                 << "; type is " << type << endl;
+                 << next_tok << " of type " << SymbolTable::Name(*var_type)
+                 << "; type is " << SymbolTable::Name(type) << endl;
+          }
+        } else if (next_tok == INFACT_MMAP_KEYWORD && !is_vector) {
+          // A mapped array has whatever view type is specified.
+          if (debug_ >= 1) {
+            cerr << "Environment::InferType: mapped array needs an explicit "
+                 << "view type" << endl;
+          }
+        } else if (next_tok == "for" && is_vector) {
+          // A sweep has whatever vector type is specified (see
+          // infact::Sweep).
+          if (debug_ >= 1) {
+            cerr << "Environment::InferType: sweep needs an explicit "
+                 << "vector type" << endl;
           }
         } else {
           ostringstream err_ss;
@@ -239,9 +384,9 @@ EnvironmentImpl::InferType(const string &varname,
       }
       break;
     default:
-      return "";
+      return SymbolTable::kNoSymbol;
   }
-  return "";
+  return SymbolTable::kNoSymbol;
 }
 
 void
@@ -37,6 +37,9 @@
 #ifndef INFACT_ENVIRONMENT_IMPL_H_
 #define INFACT_ENVIRONMENT_IMPL_H_
 
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -45,14 +48,115 @@
 
 #include "environment.h"
 #include "error.h"
+#include "layered-map.h"
+#include "stats.h"
+#include "symbol-table.h"
 
 namespace infact {
 
 using std::ostringstream;
+using std::shared_ptr;
 using std::string;
 using std::unordered_map;
 using std::unordered_set;
 
+class EnvironmentImpl;
+
+/// A handle to a variable of type <tt>T</tt> in an \link
+/// EnvironmentImpl\endlink, obtained via \link
+/// EnvironmentImpl::GetHandle \endlink, that resolves the variable's
+/// VarMap once and for all.  Reading the variable through a handle
+/// costs a pointer dereference and two version checks, rather than a
+/// type lookup, a VarMap lookup, a <tt>dynamic_cast</tt> and a value
+/// lookup, and the value need not be copied.
+///
+/// A handle sees subsequent assignments to its variable made in its
+/// environment; it must not outlive that environment.  Because a handle
+/// caches the location of its variable's value, a single handle must not
+/// be used by several threads concurrently, but any number of handles to
+/// the same frozen environment (see \link Environment::Freeze
+/// Environment::Freeze\endlink) may be.
+///
+/// \tparam T the type of the variable
+template <typename T>
+class VarHandle {
+ public:
+  /// Constructs a handle that refers to no variable.
+  VarHandle() :
+      env_(nullptr), var_map_(nullptr), varname_(SymbolTable::kNoSymbol),
+      value_(nullptr), types_version_(0), var_map_version_(0) { }
+
+  /// Returns whether this handle refers to a variable of type
+  /// <tt>T</tt>, which is the case if the variable was defined with
+  /// that type when this handle was obtained.
+  bool valid() const { return var_map_ != nullptr; }
+
+  /// Returns a pointer to the current value of the variable, or
+  /// <tt>nullptr</tt> if this handle is invalid or the variable no
+  /// longer has type <tt>T</tt>.  The returned pointer is valid until
+  /// the environment is next modified or frozen.
+  const T *Find() const {
+    if (var_map_ == nullptr) {
+      return nullptr;
+    }
+    if (types_version_ != TypesVersion() ||
+        var_map_version_ != var_map_->version()) {
+      Resolve();
+    }
+    return value_;
+  }
+
+  /// Returns a reference to the current value of the variable.  It is
+  /// an error to invoke this method if \link Find \endlink would
+  /// return <tt>nullptr</tt>.
+  const T &operator*() const {
+    const T *value = Find();
+    if (value == nullptr) {
+      ostringstream err_ss;
+      err_ss << "VarHandle: error: no value for variable "
+             << (varname_ == SymbolTable::kNoSymbol ?
+                 string() : SymbolTable::Name(varname_))
+             << " of type " << typeid(T).name();
+      Error(err_ss.str());
+    }
+    return *value;
+  }
+
+  /// Returns a pointer to the current value of the variable.
+  ///
+  /// \see operator*
+  const T *operator->() const { return &**this; }
+
+  /// Assigns the current value of the variable to the object pointed to
+  /// by the <tt>value</tt> parameter.
+  ///
+  /// \return whether the variable has a value of type <tt>T</tt>
+  bool Get(T *value) const {
+    const T *stored_value = Find();
+    if (stored_value == nullptr) {
+      return false;
+    }
+    *value = *stored_value;
+    return true;
+  }
+
+ private:
+  friend class EnvironmentImpl;
+
+  inline uint64_t TypesVersion() const;
+
+  /// Looks up the value of the variable afresh, and records the versions
+  /// of the environment and VarMap at which it was looked up.
+  inline void Resolve() const;
+
+  const EnvironmentImpl *env_;
+  const VarMap<T> *var_map_;
+  Symbol varname_;
+  mutable const T *value_;
+  mutable uint64_t types_version_;
+  mutable uint64_t var_map_version_;
+};
+
 /// Provides a set of named variables and their types, as well as the values
 /// for those variables.
 ///
@@ -67,7 +171,7 @@ class EnvironmentImpl : public Environment {
 
   /// Destroys this environment.
   virtual ~EnvironmentImpl() {
-    for (unordered_map<string, VarMapBase *>::iterator it = var_map_.begin();
+    for (unordered_map<Symbol, VarMapBase *>::iterator it = var_map_.begin();
          it != var_map_.end(); ++it) {
       delete it->second;
     }
@@ -76,8 +180,8 @@ class EnvironmentImpl : public Environment {
   /// Returns whether the specified variable has been defined in this
   /// environment.
   virtual bool Defined(const string &varname) const {
-    unordered_map<string, string>::const_iterator it = types_.find(varname);
-    return it != types_.end();
+    Symbol symbol = SymbolTable::Find(varname);
+    return symbol != SymbolTable::kNoSymbol && types_.Contains(symbol);
   }
 
   /// Sets the specified variable to the value obtained from the following
@@ -86,54 +190,120 @@ class EnvironmentImpl : public Environment {
                           const string type);
 
   virtual const string &GetType(const string &varname) const {
-    unordered_map<string, string>::const_iterator type_it =
-        types_.find(varname);
-    if (type_it == types_.end()) {
+    static const string no_type;
+    Symbol type = GetTypeSymbol(SymbolTable::Find(varname));
+    if (type == SymbolTable::kNoSymbol) {
       // Error or warning.
+      return no_type;
     }
-    return type_it->second;
+    return SymbolTable::Name(type);
+  }
+
+  /// Returns the interned type name of the variable with the specified
+  /// interned name, or \link infact::SymbolTable::kNoSymbol
+  /// SymbolTable::kNoSymbol \endlink if there is no such variable.
+  Symbol GetTypeSymbol(Symbol varname) const {
+    const Symbol *type = varname == SymbolTable::kNoSymbol ?
+        nullptr : types_.Find(varname);
+    return type == nullptr ? SymbolTable::kNoSymbol : *type;
+  }
+
+  /// \copydoc infact::Environment::SetType
+  virtual void SetType(const string &varname, const string &type) {
+    types_.Set(SymbolTable::Intern(varname), SymbolTable::Intern(type));
+    ++types_version_;
   }
 
   virtual VarMapBase *GetVarMap(const string &varname) {
-    return GetVarMapForType(GetType(varname));
+    return GetVarMapForType(GetTypeSymbol(SymbolTable::Find(varname)));
   }
 
   /// Retrieves the VarMap instance for the specified type.
   virtual VarMapBase *GetVarMapForType(const string &type) {
-    string lookup_type = type;
+    return GetVarMapForType(SymbolTable::Find(type));
+  }
+
+  /// Retrieves the VarMap instance for the specified interned type
+  /// name, or <tt>nullptr</tt> if there is no such VarMap.
+  ///
+  /// \see GetVarMapForType(const string&)
+  VarMapBase *GetVarMapForType(Symbol type) {
+    if (type == SymbolTable::kNoSymbol) {
+      return nullptr;
+    }
+    Symbol lookup_type = type;
     // First, check if this is a concrete Factory-constructible type.
     // If so, map to its abstract type name.
-    unordered_map<string, string>::const_iterator factory_type_it =
-        concrete_to_factory_type_.find(type);
-    if (factory_type_it != concrete_to_factory_type_.end()) {
+    unordered_map<Symbol, Symbol>::const_iterator factory_type_it =
+        prototype_->concrete_to_factory_type.find(type);
+    if (factory_type_it != prototype_->concrete_to_factory_type.end()) {
       lookup_type = factory_type_it->second;
     }
-
-    unordered_map<string, VarMapBase *>::const_iterator var_map_it =
-        var_map_.find(lookup_type);
-    if (var_map_it == var_map_.end()) {
-      return nullptr;
-    }
-    return var_map_it->second;
+    return GetOrCreateVarMap(lookup_type);
   }
 
   /// \copydoc infact::Environment::Print
+  ///
+  /// Variables are printed in the order in which they were first
+  /// defined, whatever their types.
   virtual void Print(ostream &os) const {
-    for (unordered_map<string, VarMapBase *>::const_iterator var_map_it =
+    vector<std::pair<std::pair<uint64_t, Symbol>, const VarMapBase *> >
+        definitions;
+    for (unordered_map<Symbol, VarMapBase *>::const_iterator var_map_it =
              var_map_.begin();
          var_map_it != var_map_.end(); ++var_map_it) {
-      var_map_it->second->Print(os);
+      vector<std::pair<uint64_t, Symbol> > var_map_definitions;
+      var_map_it->second->GetDefinitions(&var_map_definitions);
+      for (size_t i = 0; i < var_map_definitions.size(); ++i) {
+        definitions.push_back(
+            std::make_pair(var_map_definitions[i], var_map_it->second));
+      }
     }
+    std::sort(definitions.begin(), definitions.end());
+    for (size_t i = 0; i < definitions.size(); ++i) {
+      definitions[i].second->PrintVariable(definitions[i].first.second, os);
+    }
+    os.flush();
   }
 
   /// \copydoc infact::Environment::PrintFactories
   virtual void PrintFactories(ostream &os) const;
 
+  /// \copydoc infact::Environment::arena
+  virtual const shared_ptr<Arena> &arena() const { return arena_; }
+
+  /// \copydoc infact::Environment::set_arena
+  virtual void set_arena(const shared_ptr<Arena> &arena) { arena_ = arena; }
+
+  /// \copydoc infact::Environment::lazy
+  virtual bool lazy() const { return lazy_; }
+
+  /// \copydoc infact::Environment::set_lazy
+  virtual void set_lazy(bool lazy) { lazy_ = lazy; }
+
+  /// \copydoc infact::Environment::sweep_threads
+  virtual size_t sweep_threads() const { return sweep_threads_; }
+
+  /// \copydoc infact::Environment::set_sweep_threads
+  virtual void set_sweep_threads(size_t sweep_threads) {
+    sweep_threads_ = sweep_threads;
+  }
+
   /// \copydoc infact::Environment::Copy
+  ///
+  /// The copy shares the variables of this environment and those of
+  /// each of its VarMap instances in a copy-on-write fashion, so that
+  /// copying takes time independent of the number of variables
+  /// defined, and the copy stores only the bindings subsequently made
+  /// in it.
   virtual Environment *Copy() const {
+    Stats *stats = Stats::Current();
+    if (stats != nullptr) {
+      stats->RecordEnvironmentCopy();
+    }
     EnvironmentImpl *new_env = new EnvironmentImpl(*this);
     // Now go through and create copies of each VarMap.
-    for (unordered_map<string, VarMapBase *>::iterator new_env_var_map_it =
+    for (unordered_map<Symbol, VarMapBase *>::iterator new_env_var_map_it =
              new_env->var_map_.begin();
          new_env_var_map_it != new_env->var_map_.end(); ++new_env_var_map_it) {
       new_env_var_map_it->second = new_env_var_map_it->second->Copy(new_env);
@@ -141,6 +311,95 @@ class EnvironmentImpl : public Environment {
     return new_env;
   }
 
+  /// Sets the specified variable in this environment to the type and
+  /// value it has in the specified environment, such as a copy of this
+  /// environment in which the variable was assigned.
+  ///
+  /// \return whether the variable is defined in the specified environment
+  ///         and has a type known to this environment
+  bool CopyVariable(const string &varname, EnvironmentImpl *other) {
+    Symbol symbol = SymbolTable::Find(varname);
+    Symbol type = other->GetTypeSymbol(symbol);
+    VarMapBase *other_var_map = other->GetVarMapForType(type);
+    if (other_var_map == nullptr ||
+        !other_var_map->CopyValue(symbol, GetVarMapForType(type))) {
+      return false;
+    }
+    types_.Set(symbol, type);
+    ++types_version_;
+    return true;
+  }
+
+  /// Sets every variable of the specified environment in this
+  /// environment to the type and value it has there, sharing the
+  /// storage of each value rather than copying it, so that importing
+  /// takes time proportional to the number of variables and not to the
+  /// size of their values.  The specified environment is only read, and
+  /// may therefore be imported by several threads at once once frozen.
+  ///
+  /// \param other the environment whose variables are to be imported
+  void Import(const EnvironmentImpl &other) {
+    other.types_.ForEach([this, &other](Symbol varname, Symbol type) {
+        const VarMapBase *other_var_map = other.FindVarMap(type);
+        if (other_var_map != nullptr &&
+            other_var_map->CopyValue(varname, GetOrCreateVarMap(type))) {
+          types_.Set(varname, type);
+        }
+      });
+    ++types_version_;
+  }
+
+  /// Appends the interned names of all variables defined in this
+  /// environment to the specified vector, in no particular order.
+  void GetVariables(vector<Symbol> *variables) const {
+    types_.ForEach([variables](Symbol varname, Symbol type) {
+        variables->push_back(varname);
+      });
+  }
+
+  /// \copydoc infact::Environment::Freeze
+  virtual void Freeze() const {
+    types_.Freeze();
+    ++types_version_;
+    for (unordered_map<Symbol, VarMapBase *>::const_iterator it =
+             var_map_.begin();
+         it != var_map_.end(); ++it) {
+      it->second->Freeze();
+    }
+  }
+
+  /// Returns an estimate of the number of bytes used by this environment
+  /// for the names and types of its variables, and appends an estimate
+  /// of the memory used by the variables of each type to the specified
+  /// vector.  Storage shared with copies of this environment is counted
+  /// in full.
+  size_t MemoryUsage(vector<VarMapUsage> *var_maps) const {
+    size_t bytes = types_.BytesUsed() +
+        var_map_.size() * (sizeof(std::pair<const Symbol, VarMapBase *>) +
+                           2 * sizeof(void *)) +
+        var_map_.bucket_count() * sizeof(void *);
+    for (unordered_map<Symbol, VarMapBase *>::const_iterator it =
+             var_map_.begin();
+         it != var_map_.end(); ++it) {
+      var_maps->push_back(it->second->MemoryUsage());
+    }
+    return bytes;
+  }
+
+  /// Releases the storage held for variables that have since been
+  /// assigned again, and any storage shared with copies of this
+  /// environment that is no longer needed, without changing the type or
+  /// value of any variable.  Handles to variables (see \link GetHandle
+  /// \endlink) remain valid.
+  void Compact() {
+    types_.Compact();
+    ++types_version_;
+    for (unordered_map<Symbol, VarMapBase *>::iterator it = var_map_.begin();
+         it != var_map_.end(); ++it) {
+      it->second->Compact();
+    }
+  }
+
   /// Retrieves the value of the variable with the specified name and puts
   /// into into the object pointed to by the <tt>value</tt> parameter.
   ///
@@ -152,32 +411,105 @@ class EnvironmentImpl : public Environment {
   template<typename T>
   bool Get(const string &varname, T *value) const;
 
+  /// Returns a handle to the variable with the specified name, through
+  /// which its value may be read repeatedly without repeating the
+  /// lookups performed by \link Get\endlink.  The handle is invalid
+  /// (see \link VarHandle::valid\endlink) if the variable is not
+  /// currently defined with type <tt>T</tt>.
+  ///
+  /// \tparam T the type of the variable
+  template<typename T>
+  VarHandle<T> GetHandle(const string &varname) const;
+
+  /// Returns the immutable storage holding the value of the variable
+  /// with the specified name, so that a large value may be retained
+  /// without copying it, or <tt>nullptr</tt> if the variable is not
+  /// currently defined with type <tt>T</tt>.
+  ///
+  /// \tparam T the type of the variable
+  template<typename T>
+  shared_ptr<const T> GetShared(const string &varname) const;
+
  private:
-  /// Infer the type based on the next token and its token type.
-  string InferType(const string &varname,
-                   const StreamTokenizer &st, bool is_vector,
+  template<typename T> friend class VarHandle;
+
+  /// Returns the VarMap holding the variables of the specified interned
+  /// type name.
+  const VarMapBase *FindVarMap(Symbol type) const {
+    unordered_map<Symbol, VarMapBase *>::const_iterator var_map_it =
+        type == SymbolTable::kNoSymbol ? var_map_.end() : var_map_.find(type);
+    return var_map_it == var_map_.end() ? nullptr : var_map_it->second;
+  }
+
+  /// Infer the type based on the next token and its token type,
+  /// returning the interned type name, or \link
+  /// infact::SymbolTable::kNoSymbol SymbolTable::kNoSymbol \endlink
+  /// if no type can be inferred.
+  Symbol InferType(const string &varname,
+                   StreamTokenizer &st, bool is_vector,
                    bool *is_object_type);
 
-  /// A map from all variable names to their types.
-  unordered_map<string, string> types_;
+  /// Returns the VarMap holding the variables of the specified interned
+  /// (non-concrete) type name, creating it if this is the first time it
+  /// is needed, or <tt>nullptr</tt> if there is no such type.
+  VarMapBase *GetOrCreateVarMap(Symbol type);
+
+  /// The tables describing every type for which an environment can hold
+  /// variables.  These depend only on the types registered with the
+  /// \link infact::FactoryContainer FactoryContainer\endlink, and so a
+  /// single, immutable instance is shared by all environments.
+  struct Prototype {
+    /// The \link infact::FactoryContainer::generation generation\endlink
+    /// of the registered types described.
+    uint64_t generation;
+    /// A map from interned concrete Factory-constructible type names to
+    /// their interned abstract Factory type names.
+    unordered_map<Symbol, Symbol> concrete_to_factory_type;
+    /// A map from the interned name of each type that has a VarMap to the
+    /// interned name of the type of vectors of that type.
+    unordered_map<Symbol, Symbol> vector_type;
+    /// A map from the interned name of each type that has a VarMap to a
+    /// function creating an empty VarMap for that type.
+    unordered_map<Symbol, std::function<VarMapBase *(Environment *)> >
+    var_map_creators;
+  };
+
+  /// Returns the prototype for the types currently registered, building
+  /// it only if types have been registered since it was last built.
+  static shared_ptr<const Prototype> GetPrototype(int debug);
+
+  /// A map from all interned variable names to their interned types.
+  LayeredMap<Symbol, Symbol> types_;
 
-  /// A map from type name strings (as returned by the \link TypeName \endlink
-  /// method) to VarMap instances for those types.
-  unordered_map<string, VarMapBase *> var_map_;
+  /// Incremented whenever types_ is modified or frozen.
+  mutable uint64_t types_version_;
 
-  /// A map from concrete Factory-constructible type names to their abstract
-  /// Factory type names.
-  unordered_map<string, string> concrete_to_factory_type_;
+  /// A map from interned type names (as returned by the \link TypeName
+  /// \endlink method) to VarMap instances for those types.  Only the
+  /// VarMap instances that have been needed so far are present.
+  unordered_map<Symbol, VarMapBase *> var_map_;
+
+  /// The type tables, shared by all environments and never modified.
+  shared_ptr<const Prototype> prototype_;
+
+  /// The arena in which objects are allocated, or <tt>nullptr</tt>.
+  shared_ptr<Arena> arena_;
 
   int debug_;
+
+  /// Whether objects are constructed only once they are first needed.
+  bool lazy_;
+
+  /// The number of threads with which to construct the objects of a sweep.
+  size_t sweep_threads_;
 };
 
 template<typename T>
 bool
 EnvironmentImpl::Get(const string &varname, T *value) const {
-  unordered_map<string, string>::const_iterator type_it =
-      types_.find(varname);
-  if (type_it == types_.end()) {
+  Symbol symbol = SymbolTable::Find(varname);
+  Symbol type = GetTypeSymbol(symbol);
+  if (type == SymbolTable::kNoSymbol) {
     if (debug_ >= 1) {
       ostringstream err_ss;
       err_ss << "Environment::Get: error: no value for variable "
@@ -188,8 +520,7 @@ EnvironmentImpl::Get(const string &varname, T *value) const {
   }
 
   // Now that we have the type, look up the VarMap.
-  const string &type = type_it->second;
-  unordered_map<string, VarMapBase*>::const_iterator var_map_it =
+  unordered_map<Symbol, VarMapBase*>::const_iterator var_map_it =
       var_map_.find(type);
 
   if (var_map_it == var_map_.end()) {
@@ -207,11 +538,11 @@ EnvironmentImpl::Get(const string &varname, T *value) const {
     ostringstream err_ss;
     err_ss << "Environment::Get: error: no value for variable "
            << varname << " of type " << typeid(*value).name()
-           << "; perhaps you meant " << type << "?";
+           << "; perhaps you meant " << SymbolTable::Name(type) << "?";
     cerr << err_ss.str() << endl;
     return false;
   }
-  bool success = typed_var_map->Get(varname, value);
+  bool success = typed_var_map->Get(symbol, value);
   if (!success) {
     ostringstream err_ss;
     err_ss << "Environment::Get: error: no value for variable "
@@ -220,7 +551,48 @@ EnvironmentImpl::Get(const string &varname, T *value) const {
     Error(err_ss.str());
   }
   return success;
+}
+
+template<typename T>
+VarHandle<T>
+EnvironmentImpl::GetHandle(const string &varname) const {
+  VarHandle<T> handle;
+  handle.env_ = this;
+  handle.varname_ = SymbolTable::Find(varname);
+  handle.var_map_ =
+      dynamic_cast<const VarMap<T> *>(FindVarMap(GetTypeSymbol(
+          handle.varname_)));
+  if (handle.var_map_ != nullptr) {
+    handle.Resolve();
   }
+  return handle;
+}
+
+template<typename T>
+shared_ptr<const T>
+EnvironmentImpl::GetShared(const string &varname) const {
+  Symbol symbol = SymbolTable::Find(varname);
+  const VarMap<T> *typed_var_map =
+      dynamic_cast<const VarMap<T> *>(FindVarMap(GetTypeSymbol(symbol)));
+  return typed_var_map == nullptr ?
+      shared_ptr<const T>() : typed_var_map->GetShared(symbol);
+}
+
+template<typename T>
+uint64_t
+VarHandle<T>::TypesVersion() const {
+  return env_->types_version_;
+}
+
+template<typename T>
+void
+VarHandle<T>::Resolve() const {
+  types_version_ = env_->types_version_;
+  var_map_version_ = var_map_->version();
+  // The variable may since have been assigned a value of another type.
+  value_ = env_->FindVarMap(env_->GetTypeSymbol(varname_)) == var_map_ ?
+      var_map_->Find(varname_) : nullptr;
+}
 
 }  // namespace infact
 
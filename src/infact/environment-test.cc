@@ -33,16 +33,172 @@
 /// \author dbikel@google.com (Dan Bikel)
 
 #include <iostream>
+#include <map>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "environment-impl.h"
+#include "layered-map.h"
 
 using namespace std;
 using namespace infact;
 
+namespace {
+
+/// The number of hard-coded tests that have failed.
+int num_failures = 0;
+
+/// Reports the outcome of a hard-coded test.
+void
+Check(bool passed, const string &description) {
+  cout << (passed ? "passed: " : "FAILED: ") << description << endl;
+  if (!passed) {
+    ++num_failures;
+  }
+}
+
+/// Sets the specified variable of the specified environment to the
+/// value read from the specified text.
+void
+Set(Environment *env, const string &varname, const string &value) {
+  StreamTokenizer st(value);
+  env->ReadAndSet(varname, st);
+}
+
+/// Returns the visible bindings of the specified map.
+map<int, int>
+Contents(const LayeredMap<int, int> &layered_map) {
+  map<int, int> contents;
+  layered_map.ForEach([&contents](const int &key, const int &value) {
+      contents[key] = value;
+    });
+  return contents;
+}
+
+/// Tests that a copy of a LayeredMap shares the bindings of the
+/// original, rather than copying them, and that writes to either
+/// afterwards are invisible to the other.
+void
+TestLayeredMap() {
+  const int kSize = 10000;
+  LayeredMap<int, int> original;
+  for (int i = 0; i < kSize; ++i) {
+    original.Set(i, i);
+  }
+  LayeredMap<int, int> copy(original);
+  LayeredMap<int, int> copy_of_copy;
+  copy_of_copy = copy;
+  bool shared = true;
+  for (int i = 0; i < kSize; ++i) {
+    const int *binding = original.Find(i);
+    shared = shared && binding != nullptr && *binding == i &&
+        copy.Find(i) == binding && copy_of_copy.Find(i) == binding;
+  }
+  Check(shared && copy.BytesUsed() == original.BytesUsed(),
+        "copies of a layered map share its bindings");
+
+  copy.Set(0, -1);
+  copy.Set(kSize, kSize);
+  original.Set(1, -2);
+  map<int, int> original_contents = Contents(original);
+  map<int, int> copy_contents = Contents(copy);
+  Check(*original.Find(0) == 0 && !original.Contains(kSize) &&
+        *copy.Find(0) == -1 && *copy.Find(kSize) == kSize &&
+        *copy.Find(1) == 1 && *original.Find(1) == -2 &&
+        *copy_of_copy.Find(0) == 0 && *copy_of_copy.Find(1) == 1 &&
+        original_contents.size() == static_cast<size_t>(kSize) &&
+        copy_contents.size() == static_cast<size_t>(kSize + 1) &&
+        copy_contents[0] == -1 && original_contents[1] == -2,
+        "writes to a copy of a layered map and to the original are isolated");
+
+  // A chain of copies, each with one new binding, stays correct as its
+  // layers are merged.
+  LayeredMap<int, int> chain;
+  vector<LayeredMap<int, int> > copies;
+  for (int i = 0; i < 100; ++i) {
+    chain.Set(i % 10, i);
+    copies.push_back(chain);
+  }
+  bool isolated = true;
+  for (int i = 0; i < 100; ++i) {
+    map<int, int> contents = Contents(copies[i]);
+    isolated = isolated &&
+        contents.size() == static_cast<size_t>(min(i + 1, 10)) &&
+        contents[i % 10] == i;
+  }
+  chain.Compact();
+  Check(isolated && Contents(chain) == Contents(copies.back()),
+        "each of a chain of copies keeps the bindings it had when copied");
+}
+
+/// Tests that a copy of an environment shares the values of the
+/// original, and that writes to either afterwards are invisible to the
+/// other.
+void
+TestEnvironmentCopy() {
+  unique_ptr<EnvironmentImpl> env(new EnvironmentImpl());
+  for (int i = 0; i < 1000; ++i) {
+    ostringstream varname;
+    varname << "n" << i;
+    Set(env.get(), varname.str(), "1");
+  }
+  Set(env.get(), "big", "{1.0, 2.0, 3.0}");
+  Set(env.get(), "s", "\"original\"");
+  shared_ptr<const vector<double> > big =
+      env->GetShared<vector<double> >("big");
+
+  unique_ptr<EnvironmentImpl> copy(
+      dynamic_cast<EnvironmentImpl *>(env->Copy()));
+  vector<VarMapUsage> env_usage;
+  vector<VarMapUsage> copy_usage;
+  env->MemoryUsage(&env_usage);
+  copy->MemoryUsage(&copy_usage);
+  bool same_usage = env_usage.size() == copy_usage.size();
+  for (size_t i = 0; same_usage && i < env_usage.size(); ++i) {
+    same_usage = env_usage[i].num_variables == copy_usage[i].num_variables &&
+        env_usage[i].bytes == copy_usage[i].bytes;
+  }
+  Check(copy->GetShared<vector<double> >("big") == big && same_usage,
+        "a copy of an environment shares the values of the original");
+
+  Set(copy.get(), "s", "\"copy\"");
+  Set(copy.get(), "n0", "2");
+  Set(copy.get(), "added", "true");
+  Set(env.get(), "n1", "3");
+  string s;
+  int n = 0;
+  Check(env->Get("s", &s) && s == "original" &&
+        env->Get("n0", &n) && n == 1 && !env->Defined("added") &&
+        copy->Get("s", &s) && s == "copy" &&
+        copy->Get("n0", &n) && n == 2 && copy->Defined("added") &&
+        copy->GetType("added") == "bool" &&
+        copy->Get("n1", &n) && n == 1 && env->Get("n1", &n) && n == 3 &&
+        copy->GetShared<vector<double> >("big") == big,
+        "writes to a copy of an environment and to the original are "
+        "isolated");
+
+  unique_ptr<EnvironmentImpl> copy_of_copy(
+      dynamic_cast<EnvironmentImpl *>(copy->Copy()));
+  Set(copy_of_copy.get(), "big", "{4.0}");
+  vector<double> values;
+  Check(copy_of_copy->Get("s", &s) && s == "copy" &&
+        copy_of_copy->Get("big", &values) && values.size() == 1 &&
+        *big == vector<double>({1.0, 2.0, 3.0}) &&
+        copy->GetShared<vector<double> >("big") == big,
+        "a copy of a copy starts out with the bindings of the copy");
+}
+
+}  // namespace
+
 int
 main(int argc, char **argv) {
   int debug = 1;
   Environment *env = new EnvironmentImpl(debug);
   delete env;
+
+  TestLayeredMap();
+  TestEnvironmentCopy();
+  return num_failures == 0 ? 0 : 1;
 }
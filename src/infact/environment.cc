@@ -34,11 +34,19 @@
 /// Environment instance.
 /// \author dbikel@google.com (Dan Bikel)
 
+#include <atomic>
+
 #include "environment.h"
 #include "environment-impl.h"
 
 namespace infact {
 
+uint64_t
+VarMapBase::NextDefinition() {
+  static std::atomic<uint64_t> next_definition(0);
+  return next_definition.fetch_add(1, std::memory_order_relaxed);
+}
+
 Environment *
 Environment::CreateEmpty() {
   return new EnvironmentImpl();
@@ -41,12 +41,22 @@
 
 #define VAR_MAP_DEBUG 0
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 
+#include "arena.h"
+#include "array-view.h"
 #include "error.h"
+#include "layered-map.h"
 #include "stream-init.h"
 #include "stream-tokenizer.h"
+#include "symbol-table.h"
 
 namespace infact {
 
@@ -61,6 +71,24 @@ using std::vector;
 
 class Environment;
 
+/// An estimate of the memory used by the variables of one type in an
+/// environment.
+///
+/// \see infact::VarMapBase::MemoryUsage
+struct VarMapUsage {
+  /// The type name of the variables.
+  string type;
+  /// The number of variables of this type.
+  size_t num_variables;
+  /// The number of distinct Factory-constructible objects held by the
+  /// variables, for variables of object or object vector type.
+  size_t num_objects;
+  /// The estimated number of bytes used by the bindings and values of
+  /// the variables, not counting the objects themselves.  A value
+  /// shared by several variables is only counted once.
+  size_t bytes;
+};
+
 /// A base class for a mapping from variables of a specific type to their
 /// values.
 class VarMapBase {
@@ -100,10 +128,48 @@ class VarMapBase {
   /// their values.
   virtual void Print(ostream &os) const = 0;
 
+  /// Prints the specified variable of this instance, exactly as \link
+  /// Print \endlink does.
+  virtual void PrintVariable(Symbol varname, ostream &os) const = 0;
+
+  /// Appends the interned name of each variable of this instance to the
+  /// specified vector, along with the number ordering its first
+  /// definition among the variables of all instances (see \link
+  /// NextDefinition\endlink).
+  virtual void GetDefinitions(
+      vector<std::pair<uint64_t, Symbol> > *definitions) const = 0;
+
   /// Returns a newly constructed copy of this VarMap.
   virtual VarMapBase *Copy(Environment *env) const = 0;
 
+  /// Sets the variable with the specified interned name in the
+  /// specified VarMap to the value it has in this instance.
+  ///
+  /// \return whether the variable has a value in this instance and
+  ///         <tt>dest</tt> holds variables of the same type as this
+  ///         instance
+  virtual bool CopyValue(Symbol varname, VarMapBase *dest) const = 0;
+
+  /// Prepares this instance to be copied concurrently by several
+  /// threads, provided it is not modified in the meantime.
+  virtual void Freeze() const = 0;
+
+  /// Returns an estimate of the memory used by the variables of this
+  /// instance, including any storage shared with copies of it.
+  virtual VarMapUsage MemoryUsage() const = 0;
+
+  /// Releases the storage held for bindings that have since been
+  /// replaced, and any storage shared with copies of this instance
+  /// that is no longer needed, without changing any value.
+  virtual void Compact() = 0;
+
  protected:
+  /// Returns a number greater than any returned before by any thread,
+  /// to order the first definition of a variable, so that environments
+  /// may be printed in the order in which their variables were defined,
+  /// however the environments came to hold them.
+  static uint64_t NextDefinition();
+
   /// To allow proper implementation of Copy in VarMapBase implementation,
   /// since we don't get copying of base class' members for free.
   void SetMembers(const string &name, Environment *env, bool is_primitive) {
@@ -139,6 +205,11 @@ class Environment {
   /// Retrieves the type name of the specified variable.
   virtual const string &GetType(const string &varname) const = 0;
 
+  /// Sets the type name of the specified variable.  This is how a
+  /// variable whose value is set directly in the VarMap for its type,
+  /// rather than via \link ReadAndSet \endlink, becomes defined.
+  virtual void SetType(const string &varname, const string &type) = 0;
+
   /// Retrieves the VarMap instance for the specified variable.
   virtual VarMapBase *GetVarMap(const string &varname) = 0;
 
@@ -169,11 +240,56 @@ class Environment {
   /// Returns a copy of this environment.
   virtual Environment *Copy() const = 0;
 
+  /// Prepares this environment to be copied concurrently by several
+  /// threads.  Until this method has been invoked, copying an
+  /// environment modifies its internal representation; afterwards,
+  /// concurrent invocations of \link Copy \endlink are safe for as
+  /// long as this environment is not modified.
+  virtual void Freeze() const = 0;
+
   /// Prints out a human-readable string with the names of all abstract base
   /// types and their concrete implementations that may be constructed.
   /// \see infact::FactoryContainer::Print
   virtual void PrintFactories(ostream &os) const = 0;
 
+  /// Returns the arena in which objects constructed in this environment
+  /// are allocated, or <tt>nullptr</tt> if they are allocated on the heap
+  /// (the default).
+  virtual const shared_ptr<Arena> &arena() const = 0;
+
+  /// Sets the arena in which objects subsequently constructed in this
+  /// environment, and in copies of it made subsequently, are allocated,
+  /// or <tt>nullptr</tt> to allocate them on the heap.
+  virtual void set_arena(const shared_ptr<Arena> &arena) = 0;
+
+  /// Returns whether objects assigned to variables in this environment
+  /// are constructed only once they are first needed (the default is
+  /// <tt>false</tt>).
+  virtual bool lazy() const = 0;
+
+  /// Sets whether each object subsequently assigned to a variable in
+  /// this environment, and in copies of it made subsequently, by a
+  /// spec such as <tt>Model m = PerceptronModel(name("foo"));</tt> is
+  /// constructed only once it is first needed: when the value of the
+  /// variable is first retrieved, including by the construction of
+  /// another object.  The spec is compiled, checking the syntax of the
+  /// spec, the concrete type and the names of its members, when it is
+  /// read, but variables referred to by the spec are only looked up,
+  /// in this environment as it was when the spec was read, when the
+  /// object is constructed.  An error constructing the object is
+  /// therefore reported by whatever first retrieves the variable.
+  virtual void set_lazy(bool lazy) = 0;
+
+  /// Returns the number of threads with which the objects of a sweep
+  /// (see \link infact::Sweep Sweep\endlink) are constructed in this
+  /// environment, where 0 or 1 means one after another (the default).
+  virtual size_t sweep_threads() const = 0;
+
+  /// Sets the number of threads with which the objects of each sweep
+  /// subsequently read in this environment, and in copies of it made
+  /// subsequently, are constructed.
+  virtual void set_sweep_threads(size_t sweep_threads) = 0;
+
   /// A static factory method to create a new, empty Environment instance.
   static Environment *CreateEmpty();
 };
@@ -249,6 +365,130 @@ class ValueString<vector<T> > {
   }
 };
 
+/// A partial specialization of the ValueString class to support
+/// printing of array views, by their sizes rather than their possibly
+/// very many elements.
+///
+/// \tparam T the element type of an array view
+template <typename T>
+class ValueString<ArrayView<T> > {
+ public:
+  string ToString(const ArrayView<T> &value) const {
+    ostringstream oss;
+    oss << "<" << value.size() << " elements at "
+        << static_cast<const void *>(value.data()) << ">";
+    return oss.str();
+  }
+};
+
+/// A template class that helps estimate the memory used by values, and
+/// that finds the Factory-constructible objects they hold.
+///
+/// \tparam T the type of value
+template <typename T>
+class ValueMemory {
+ public:
+  /// Returns the estimated number of bytes used by the specified value,
+  /// not counting any Factory-constructible objects it holds.
+  size_t Bytes(const T &value) const { return sizeof(T); }
+
+  /// Inserts the addresses of the Factory-constructible objects held by
+  /// the specified value into the specified set.
+  void CollectObjects(const T &value,
+                      unordered_set<const void *> *objects) const { }
+};
+
+/// A specialization of the ValueMemory class for string values, which
+/// own their characters.
+template<>
+class ValueMemory<string> {
+ public:
+  size_t Bytes(const string &value) const {
+    return sizeof(string) + value.capacity();
+  }
+
+  void CollectObjects(const string &value,
+                      unordered_set<const void *> *objects) const { }
+};
+
+/// A partial specialization of the ValueMemory class for shared_ptr's
+/// to objects.
+template<typename T>
+class ValueMemory<shared_ptr<T> > {
+ public:
+  size_t Bytes(const shared_ptr<T> &value) const {
+    return sizeof(shared_ptr<T>);
+  }
+
+  void CollectObjects(const shared_ptr<T> &value,
+                      unordered_set<const void *> *objects) const {
+    if (value != nullptr) {
+      objects->insert(value.get());
+    }
+  }
+};
+
+/// A partial specialization of the ValueMemory class for vectors of
+/// values.
+///
+/// \tparam T the element type of a vector
+template <typename T>
+class ValueMemory<vector<T> > {
+ public:
+  size_t Bytes(const vector<T> &value) const {
+    ValueMemory<T> element_memory;
+    size_t bytes = sizeof(vector<T>) +
+        (value.capacity() - value.size()) * sizeof(T);
+    for (typename vector<T>::const_iterator it = value.begin();
+         it != value.end(); ++it) {
+      bytes += element_memory.Bytes(*it);
+    }
+    return bytes;
+  }
+
+  void CollectObjects(const vector<T> &value,
+                      unordered_set<const void *> *objects) const {
+    ValueMemory<T> element_memory;
+    for (typename vector<T>::const_iterator it = value.begin();
+         it != value.end(); ++it) {
+      element_memory.CollectObjects(*it, objects);
+    }
+  }
+};
+
+/// A value of type <tt>T</tt> produced only once it is first needed,
+/// and then only once, even if it is needed by several threads at once.
+///
+/// \tparam T the type of the value
+template <typename T>
+class LazyValue {
+ public:
+  /// Constructs a value to be produced by the specified function.
+  explicit LazyValue(const std::function<T()> &make) :
+      make_(make), forced_(false) { }
+
+  /// Returns the value, producing it if it has not yet been produced.
+  /// If producing the value fails by throwing an exception, the
+  /// exception is propagated, and the next invocation tries again.
+  const T &Force() const {
+    std::call_once(once_, [this]() {
+        value_ = make_();
+        make_ = nullptr;
+        forced_ = true;
+      });
+    return value_;
+  }
+
+  /// Returns whether the value has been produced.
+  bool forced() const { return forced_; }
+
+ private:
+  mutable std::once_flag once_;
+  mutable std::function<T()> make_;
+  mutable T value_;
+  mutable std::atomic<bool> forced_;
+};
+
 /// A partial implementation of the VarMapBase interface that is common
 /// to both VarMap<T> and the VarMap<vector<T> > partial specialization.
 ///
@@ -266,7 +506,7 @@ template <typename T, typename Derived>
 class VarMapImpl : public VarMapBase {
  public:
   VarMapImpl(const string &name, Environment *env, bool is_primitive = true) :
-      VarMapBase(name, env, is_primitive) { }
+      VarMapBase(name, env, is_primitive), version_(0) { }
 
   virtual ~VarMapImpl() { }
 
@@ -278,41 +518,134 @@ class VarMapImpl : public VarMapBase {
   /// \return whether the specified variable exists and the assignment
   ///         was successful
   bool Get(const string &varname, T *value) const {
-    typename unordered_map<string, T>::const_iterator it = vars_.find(varname);
-    if (it == vars_.end()) {
+    return Get(SymbolTable::Find(varname), value);
+  }
+
+  /// Assigns the value of the variable with the specified interned
+  /// name to the object pointed to by the <tt>value</tt> parameter.
+  ///
+  /// \return whether the specified variable exists and the assignment
+  ///         was successful
+  bool Get(Symbol varname, T *value) const {
+    const T *stored_value = Find(varname);
+    if (stored_value == nullptr) {
       return false;
     } else {
-      *value = it->second;
+      *value = *stored_value;
       return true;
     }
   }
 
+  /// Returns a pointer to the value of the variable with the specified
+  /// interned name, or <tt>nullptr</tt> if there is no such variable,
+  /// without copying the value.  The returned pointer is valid for as
+  /// long as \link version \endlink is unchanged.
+  const T *Find(Symbol varname) const {
+    const Slot *slot = FindSlot(varname);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    return slot->lazy != nullptr ? &slot->lazy->Force() : slot->value.get();
+  }
+
+  /// Returns the immutable storage of the value of the variable with the
+  /// specified interned name, or <tt>nullptr</tt> if there is no such
+  /// variable.  Every variable assigned from another, and every copy of
+  /// this variable map, shares this storage.
+  shared_ptr<const T> GetShared(Symbol varname) const {
+    const Slot *slot = FindSlot(varname);
+    if (slot == nullptr) {
+      return shared_ptr<const T>();
+    }
+    return slot->lazy != nullptr ?
+        shared_ptr<const T>(slot->lazy, &slot->lazy->Force()) : slot->value;
+  }
+
+  /// Returns a number that changes whenever a pointer previously
+  /// returned by \link Find \endlink may have been invalidated.
+  uint64_t version() const { return version_; }
+
   /// \copydoc VarMapBase::Defined
   virtual bool Defined(const string &varname) const {
-    return vars_.find(varname) != vars_.end();
+    Symbol symbol = SymbolTable::Find(varname);
+    return symbol != SymbolTable::kNoSymbol && vars_.Contains(symbol);
   }
 
-  /// Sets the specified variable to the specified value.
+  /// Sets the specified variable to the specified value, which is
+  /// moved into immutable storage.
   void Set(const string &varname, T value) {
-    vars_[varname] = value;
+    Set(SymbolTable::Intern(varname), std::move(value));
+  }
+
+  /// Sets the variable with the specified interned name to the
+  /// specified value, which is moved into immutable storage.
+  void Set(Symbol varname, T value) {
+    SetShared(varname, std::make_shared<T>(std::move(value)));
+  }
+
+  /// Sets the variable with the specified interned name to the value
+  /// held in the specified immutable storage, without copying it.
+  void SetShared(Symbol varname, shared_ptr<const T> value) {
+    Slot slot = Slot();
+    slot.value = std::move(value);
+    SetSlot(varname, slot);
+  }
+
+  /// Sets the variable with the specified interned name to the
+  /// specified lazy value, to be produced when the variable is first
+  /// retrieved.
+  void SetLazy(Symbol varname, shared_ptr<const LazyValue<T> > value) {
+    Slot slot = Slot();
+    slot.lazy = std::move(value);
+    SetSlot(varname, slot);
   }
 
   /// \copydoc VarMapBase::Print
+  ///
+  /// Variables are printed in the order in which they were first
+  /// defined, however this instance came to hold them.
   virtual void Print(ostream &os) const {
-    ValueString<T> value_string;
-    for (typename unordered_map<string, T>::const_iterator it = vars_.begin();
-         it != vars_.end(); ++it) {
-      const T& value = it->second;
-      os << Name() << " "
-         << it->first
-         << " = "
-         << value_string.ToString(value)
-         << ";\n";
+    vector<std::pair<uint64_t, Symbol> > definitions;
+    GetDefinitions(&definitions);
+    std::sort(definitions.begin(), definitions.end());
+    for (size_t i = 0; i < definitions.size(); ++i) {
+      PrintVariable(definitions[i].second, os);
     }
     os.flush();
   }
 
+  /// \copydoc VarMapBase::PrintVariable
+  virtual void PrintVariable(Symbol varname, ostream &os) const {
+    const Slot *slot = FindSlot(varname);
+    if (slot == nullptr) {
+      return;
+    }
+    os << Name() << " " << SymbolTable::Name(varname) << " = ";
+    // Printing does not construct a lazy value.
+    ValueString<T> value_string;
+    if (slot->lazy == nullptr) {
+      os << value_string.ToString(*slot->value);
+    } else if (slot->lazy->forced()) {
+      os << value_string.ToString(slot->lazy->Force());
+    } else {
+      os << "<lazy>";
+    }
+    os << ";\n";
+  }
+
+  /// \copydoc VarMapBase::GetDefinitions
+  virtual void GetDefinitions(
+      vector<std::pair<uint64_t, Symbol> > *definitions) const {
+    vars_.ForEach([definitions](Symbol varname, const Slot &slot) {
+        definitions->push_back(std::make_pair(slot.defined, varname));
+      });
+  }
+
   /// \copydoc VarMapBase::Copy
+  ///
+  /// The copy shares all existing bindings with this instance (see
+  /// \link infact::LayeredMap LayeredMap\endlink), so copying takes
+  /// constant time regardless of the number of variables.
   virtual VarMapBase *Copy(Environment *env) const {
     // Invoke Derived class' copy constructor.
     const Derived *derived = dynamic_cast<const Derived *>(this);
@@ -323,6 +656,63 @@ class VarMapImpl : public VarMapBase {
     var_map_copy->SetMembers(name_, env, is_primitive_);
     return var_map_copy;
   }
+
+  /// \copydoc VarMapBase::CopyValue
+  virtual bool CopyValue(Symbol varname, VarMapBase *dest) const {
+    Derived *typed_dest = dynamic_cast<Derived *>(dest);
+    const Slot *slot = FindSlot(varname);
+    if (typed_dest == nullptr || slot == nullptr) {
+      return false;
+    }
+    // The copy shares this variable's storage, or its lazy value.
+    typed_dest->SetSlot(varname, *slot);
+    return true;
+  }
+
+  /// \copydoc VarMapBase::Freeze
+  virtual void Freeze() const {
+    vars_.Freeze();
+    ++version_;
+  }
+
+  /// \copydoc VarMapBase::MemoryUsage
+  ///
+  /// A lazily assigned variable that has yet to be retrieved is counted
+  /// without constructing its value.
+  virtual VarMapUsage MemoryUsage() const {
+    VarMapUsage usage = { Name(), 0, 0, vars_.BytesUsed() };
+    ValueMemory<T> value_memory;
+    unordered_set<const void *> values;
+    unordered_set<const void *> objects;
+    vars_.ForEach([&usage, &value_memory, &values, &objects](
+        Symbol varname, const Slot &slot) {
+        ++usage.num_variables;
+        const T *value = slot.value.get();
+        if (slot.lazy != nullptr) {
+          if (!values.insert(slot.lazy.get()).second) {
+            return;
+          }
+          usage.bytes += sizeof(LazyValue<T>) - sizeof(T);
+          if (!slot.lazy->forced()) {
+            usage.bytes += sizeof(T);
+            return;
+          }
+          value = &slot.lazy->Force();
+        } else if (!values.insert(value).second) {
+          return;
+        }
+        usage.bytes += value_memory.Bytes(*value);
+        value_memory.CollectObjects(*value, &objects);
+      });
+    usage.num_objects = objects.size();
+    return usage;
+  }
+
+  /// \copydoc VarMapBase::Compact
+  virtual void Compact() {
+    vars_.Compact();
+    ++version_;
+  }
  protected:
   /// Checks if the next token is an identifier and is a variable in
   /// the environment, and, if so, sets varname to the variable&rsquo;s value.
@@ -334,9 +724,11 @@ class VarMapImpl : public VarMapBase {
       if (typed_var_map != nullptr) {
         // Finally consume variable.
         string rhs_variable = st.Next();
-        T value = T();
-        // Retrieve rhs variable's value.
-        bool success = typed_var_map->Get(rhs_variable, &value);
+        // Retrieve rhs variable's value, which is shared rather than
+        // copied.
+        const Slot *value =
+            typed_var_map->FindSlot(SymbolTable::Find(rhs_variable));
+        bool success = value != nullptr;
         // Set varname to the same value.
         if (VAR_MAP_DEBUG >= 1) {
           cerr << "VarMap<" << Name() << ">::ReadAndSet: "
@@ -345,7 +737,7 @@ class VarMapImpl : public VarMapBase {
                << endl;
         }
         if (success) {
-          Set(varname, value);
+          SetSlot(SymbolTable::Intern(varname), *value);
         } else {
           // Error: we couldn't find the varname in this VarMap.
           if (VAR_MAP_DEBUG >= 1) {
@@ -373,7 +765,88 @@ class VarMapImpl : public VarMapBase {
   Environment *env() { return VarMapBase::env_; }
 
  private:
-  unordered_map<string, T> vars_;
+  /// The storage of the value of a variable: either the value itself or,
+  /// for a variable assigned lazily (see \link
+  /// infact::Environment::set_lazy Environment::set_lazy\endlink), the
+  /// lazy value producing it.
+  struct Slot {
+    shared_ptr<const T> value;
+    shared_ptr<const LazyValue<T> > lazy;
+    /// The order of the first definition of the variable (see \link
+    /// VarMapBase::NextDefinition NextDefinition\endlink).
+    uint64_t defined;
+  };
+
+  /// Returns a pointer to the storage of the variable with the specified
+  /// interned name, or <tt>nullptr</tt> if there is no such variable.
+  const Slot *FindSlot(Symbol varname) const {
+    return varname == SymbolTable::kNoSymbol ? nullptr : vars_.Find(varname);
+  }
+
+  /// Sets the storage of the variable with the specified interned name,
+  /// keeping the position of the variable among the others if it is
+  /// already defined.
+  void SetSlot(Symbol varname, const Slot &slot) {
+    const Slot *old_slot = FindSlot(varname);
+    Slot new_slot(slot);
+    new_slot.defined =
+        old_slot == nullptr ? NextDefinition() : old_slot->defined;
+    vars_.Set(varname, new_slot);
+    ++version_;
+  }
+
+  /// The values of the variables of this instance, keyed by the
+  /// interned names of the variables.  Values are immutable once set,
+  /// so that copies of this map and variables assigned from other
+  /// variables share storage rather than duplicating it.
+  LayeredMap<Slot, Symbol> vars_;
+  /// Incremented whenever vars_ is modified or frozen.
+  mutable uint64_t version_;
+};
+
+/// Reads a value of type <tt>T</tt> whose construction is to be
+/// deferred, for an environment assigning variables lazily (see \link
+/// infact::Environment::set_lazy Environment::set_lazy\endlink).  This
+/// implementation is for types whose values are never deferred; the
+/// partial specialization for <tt>shared_ptr</tt> to a \link
+/// infact::Factory Factory\endlink-constructible type defers the
+/// construction of objects.
+///
+/// \tparam T the type of value
+template <typename T>
+struct DeferredReader {
+  /// Reads the tokens of a value from the specified tokenizer, returning
+  /// a lazy value producing it, or <tt>nullptr</tt>, having read
+  /// nothing, if the value is not to be deferred.
+  ///
+  /// \param st  the tokenizer from which to read the value
+  /// \param env the environment in which the value is read
+  static shared_ptr<const LazyValue<T> > Read(StreamTokenizer &st,
+                                              Environment *env) {
+    return shared_ptr<const LazyValue<T> >();
+  }
+};
+
+/// Reads a sweep specifying every element of a vector at once (see
+/// \link infact::Sweep Sweep\endlink).  This implementation is for
+/// element types that cannot be swept; the partial specialization for
+/// <tt>shared_ptr</tt> to a \link infact::Factory
+/// Factory\endlink-constructible type constructs one object per
+/// combination of values of the sweep.
+///
+/// \tparam T the element type
+template <typename T>
+struct SweepReader {
+  /// Reads a sweep and its spec from the specified tokenizer, just
+  /// after the open brace of a vector, up to but not including the
+  /// close brace, returning whether there was a sweep to read.
+  ///
+  /// \param st     the tokenizer from which to read the sweep
+  /// \param env    the environment in which the sweep is read
+  /// \param values the vector to which to append each element
+  static bool Read(StreamTokenizer &st, Environment *env, vector<T> *values) {
+    return false;
+  }
 };
 
 /// A container to hold the mapping between named variables of a specific
@@ -408,17 +881,119 @@ class VarMap : public VarMapImpl<T, VarMap<T> > {
     }
 
     if (!Base::ReadAndSetFromExistingVariable(varname, st)) {
+      if (Base::env()->lazy()) {
+        shared_ptr<const LazyValue<T> > lazy_value =
+            DeferredReader<T>::Read(st, Base::env());
+        if (lazy_value != nullptr) {
+          this->SetLazy(SymbolTable::Intern(varname), lazy_value);
+          return;
+        }
+      }
       T value;
       Initializer<T> initializer(&value);
       initializer.Init(st, Base::env());
-      this->Set(varname, value);
 
       if (VAR_MAP_DEBUG >= 1) {
         ValueString<T> value_string;
         cerr << "VarMap<" << Base::Name() << ">::ReadAndSet: set varname "
              << varname << " to value " << value_string.ToString(value)<< endl;
       }
+      this->Set(varname, std::move(value));
+    }
+  }
+};
+
+/// Reads a vector element that is a literal of a primitive type
+/// directly from a token stream, so that a vector of literals can be
+/// read without the per-element environment machinery of \link
+/// infact::VarMap<vector<T>>::ReadAndSet VarMap<vector<T>>::ReadAndSet
+/// \endlink.  Any other element, including an erroneous one, is left
+/// to that method.
+///
+/// \tparam T the element type
+template <typename T>
+struct LiteralElementReader {
+  /// Reads the next token into the specified element if it is a literal
+  /// of type <tt>T</tt> and does not name a variable.
+  ///
+  /// \return whether the element was read
+  static bool Read(StreamTokenizer &st, Environment *env, T *element) {
+    return false;
+  }
+};
+
+/// Reads <tt>int</tt> literal vector elements.
+template <>
+struct LiteralElementReader<int> {
+  /// \copydoc LiteralElementReader::Read
+  static bool Read(StreamTokenizer &st, Environment *env, int *element) {
+    if (st.PeekTokenType() != StreamTokenizer::NUMBER) {
+      return false;
+    }
+    // A number with a decimal point is a double.
+    StringPiece token = st.PeekView();
+    if (std::find(token.begin(), token.end(), '.') != token.end()) {
+      return false;
+    }
+    *element = ParseInt(token);
+    st.Skip();
+    return true;
+  }
+};
+
+/// Reads <tt>double</tt> literal vector elements.
+template <>
+struct LiteralElementReader<double> {
+  /// \copydoc LiteralElementReader::Read
+  static bool Read(StreamTokenizer &st, Environment *env, double *element) {
+    if (st.PeekTokenType() != StreamTokenizer::NUMBER) {
+      return false;
+    }
+    // A number without a decimal point is an int.
+    StringPiece token = st.PeekView();
+    if (std::find(token.begin(), token.end(), '.') == token.end()) {
+      return false;
     }
+    *element = ParseDouble(token);
+    st.Skip();
+    return true;
+  }
+};
+
+/// Reads <tt>bool</tt> literal vector elements.
+template <>
+struct LiteralElementReader<bool> {
+  /// \copydoc LiteralElementReader::Read
+  static bool Read(StreamTokenizer &st, Environment *env, bool *element) {
+    if (st.PeekTokenType() != StreamTokenizer::RESERVED_WORD) {
+      return false;
+    }
+    StringPiece token = st.PeekView();
+    if (token != "true" && token != "false") {
+      return false;
+    }
+    *element = token == "true";
+    st.Skip();
+    return true;
+  }
+};
+
+/// Reads <tt>string</tt> literal vector elements.
+template <>
+struct LiteralElementReader<string> {
+  /// \copydoc LiteralElementReader::Read
+  static bool Read(StreamTokenizer &st, Environment *env, string *element) {
+    if (st.PeekTokenType() != StreamTokenizer::STRING) {
+      return false;
+    }
+    // As for any other value, a string whose text is the name of a
+    // variable is read as that variable.
+    *element = st.Peek();
+    if (env->Defined(*element)) {
+      return false;
+    }
+    st.Skip();
+    return true;
   }
 };
 
@@ -478,33 +1053,51 @@ class VarMap<vector<T> > : public VarMapImpl<vector<T>, VarMap<vector<T> > > {
       }
 
       vector<T> value;
+      // A sweep specifies every element at once (see infact::Sweep).
+      SweepReader<T>::Read(st, Base::env(), &value);
       int element_idx = 0;
-      while (st.Peek() != "}") {
-        // Copy the environment, since we create fake names for each element.
-        shared_ptr<Environment> env_ptr(Base::env()->Copy());
-        ostringstream element_name_oss;
-        element_name_oss << "____" << varname << "_" << (element_idx++)
-                         << "____";
-        string element_name = element_name_oss.str();
-
-        env_ptr->ReadAndSet(element_name, st, element_typename_);
-        VarMapBase *element_var_map =
-            env_ptr->GetVarMapForType(element_typename_);
-        VarMap<T> *typed_element_var_map =
-            dynamic_cast<VarMap<T> *>(element_var_map);
-        T element;
-        if (typed_element_var_map->Get(element_name, &element)) {
-          value.push_back(element);
-        } else {
-          ostringstream err_ss;
-          err_ss << "VarMap<" << Base::Name() << ">::ReadAndSet: trouble "
-                 << "initializing element " << (element_idx - 1)
-                 << " of variable " << varname;
-          Error(err_ss.str());
+      // Every element is read into its own copy of the environment, and
+      // so all elements can share the same fake name.
+      string element_name = "____" + varname + "____";
+      while (st.PeekView() != "}") {
+        ++element_idx;
+        T element = T();
+        // Literals of primitive types are read directly.
+        if (!LiteralElementReader<T>::Read(st, Base::env(), &element)) {
+          // Copy the environment, since we create a fake name for each
+          // element.
+          shared_ptr<Environment> env_ptr(Base::env()->Copy());
+#ifdef INFACT_THROW_EXCEPTIONS
+          try {
+            env_ptr->ReadAndSet(element_name, st, element_typename_);
+          } catch (const std::runtime_error &e) {
+            // All elements share the same fake name, so the error is
+            // reported with the index of the offending element.
+            ostringstream err_ss;
+            err_ss << "VarMap<" << Base::Name() << ">::ReadAndSet: error "
+                   << "reading element " << (element_idx - 1)
+                   << " of variable " << varname << ": " << e.what();
+            Error(err_ss.str());
+          }
+#else
+          env_ptr->ReadAndSet(element_name, st, element_typename_);
+#endif
+          VarMapBase *element_var_map =
+              env_ptr->GetVarMapForType(element_typename_);
+          VarMap<T> *typed_element_var_map =
+              dynamic_cast<VarMap<T> *>(element_var_map);
+          if (!typed_element_var_map->Get(element_name, &element)) {
+            ostringstream err_ss;
+            err_ss << "VarMap<" << Base::Name() << ">::ReadAndSet: trouble "
+                   << "initializing element " << (element_idx - 1)
+                   << " of variable " << varname;
+            Error(err_ss.str());
+          }
         }
+        value.push_back(element);
         // Each vector element initializer must be followed by a comma
         // or the final closing parenthesis.
-        if (st.Peek() != ","  && st.Peek() != "}") {
+        if (st.PeekView() != ","  && st.PeekView() != "}") {
           ostringstream err_ss;
           err_ss << "Initializer<vector<T>>: "
                  << "error: expected ',' or '}' at stream position "
@@ -512,16 +1105,16 @@ class VarMap<vector<T> > : public VarMapImpl<vector<T>, VarMap<vector<T> > > {
           Error(err_ss.str());
         }
         // Read comma, if present.
-        if (st.Peek() == ",") {
-          st.Next();
+        if (st.PeekView() == ",") {
+          st.Skip();
         }
       }
       // Consume close brace.
-      st.Next();
+      st.Skip();
 
 
       // Finally, set the newly-constructed value.
-      this->Set(varname, value);
+      this->Set(varname, std::move(value));
     }
   }
  private:
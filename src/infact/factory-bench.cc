@@ -0,0 +1,132 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Benchmark for the \link infact::Factory::CreateOrDie
+/// Factory::CreateOrDie \endlink method, repeatedly constructing nested
+/// and wide object graphs from the classes declared in example.h.
+///
+/// Usage: <tt>factory-bench [scale [workload]]</tt>
+
+#include <iostream>
+#include <sstream>
+
+#include "bench-util.h"
+#include "example.h"
+#include "factory.h"
+
+using namespace std;
+using namespace infact;
+
+// Returns the text of the value of the single assignment statement that
+// makes up each line of the specified workload.
+static vector<string>
+Specs(const BenchWorkload &workload) {
+  vector<string> specs;
+  istringstream is(workload.text);
+  string line;
+  while (getline(is, line)) {
+    size_t begin = line.find(" = ");
+    size_t end = line.rfind(';');
+    if (begin != string::npos && end != string::npos) {
+      specs.push_back(line.substr(begin + 3, end - begin - 3));
+    }
+  }
+  return specs;
+}
+
+int
+main(int argc, char **argv) {
+  size_t scale = ParseScale(argc, argv);
+
+  if (SelectWorkload(argc, argv, "nested")) {
+    BenchWorkload workload = NestedPetOwners(1024 * scale, 16);
+    vector<string> specs = Specs(workload);
+    Factory<PetOwner> factory;
+    BenchTimer timer;
+    for (vector<string>::const_iterator it = specs.begin();
+         it != specs.end(); ++it) {
+      StreamTokenizer st(it->data(), it->size());
+      factory.CreateOrDie(st);
+    }
+    ReportRate(cout, "factory/create", workload.name, workload.num_objects,
+               "objects", timer.Seconds());
+  }
+
+  if (SelectWorkload(argc, argv, "nested")) {
+    // Construct the same graphs in an arena, keeping them all alive
+    // until the arena is retired at once.
+    BenchWorkload workload = NestedPetOwners(1024 * scale, 16);
+    vector<string> specs = Specs(workload);
+    Factory<PetOwner> factory;
+    shared_ptr<Environment> env(Environment::CreateEmpty());
+    env->set_arena(shared_ptr<Arena>(new Arena()));
+    BenchTimer timer;
+    {
+      vector<shared_ptr<PetOwner> > owners;
+      for (vector<string>::const_iterator it = specs.begin();
+           it != specs.end(); ++it) {
+        StreamTokenizer st(it->data(), it->size());
+        owners.push_back(factory.CreateOrDie(st, env.get()));
+      }
+      env->set_arena(shared_ptr<Arena>());
+    }
+    ReportRate(cout, "factory/arena", workload.name, workload.num_objects,
+               "objects", timer.Seconds());
+  }
+
+  if (SelectWorkload(argc, argv, "animals")) {
+    BenchWorkload workload = WideAnimals(24 * 1024 * scale);
+    vector<string> specs;
+    istringstream is(workload.text);
+    string line;
+    while (getline(is, line)) {
+      size_t begin = line.find_first_not_of(' ');
+      if (begin != string::npos &&
+          (line.compare(begin, 4, "Cow(") == 0 ||
+           line.compare(begin, 6, "Sheep(") == 0)) {
+        size_t end = line[line.size() - 1] == ',' ? line.size() - 1 :
+            line.size();
+        specs.push_back(line.substr(begin, end - begin));
+      }
+    }
+    Factory<Animal> factory;
+    BenchTimer timer;
+    for (vector<string>::const_iterator it = specs.begin();
+         it != specs.end(); ++it) {
+      StreamTokenizer st(it->data(), it->size());
+      factory.CreateOrDie(st);
+    }
+    ReportRate(cout, "factory/create", "animals", specs.size(), "objects",
+               timer.Seconds());
+  }
+}
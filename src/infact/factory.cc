@@ -37,10 +37,22 @@
 
 namespace infact {
 
-int
-FactoryContainer::initialized_ = 0;
+std::atomic<uint64_t> FactoryContainer::generation_(0);
 
-vector<FactoryBase *> *
-FactoryContainer::factories_ = 0;
+std::mutex &
+FactoryContainer::registry_mutex() {
+  // Never destroyed, so that registration and clearing remain possible
+  // during static destruction.
+  static std::mutex *mutex = new std::mutex();
+  return *mutex;
+}
+
+shared_ptr<const vector<FactoryBase *> > &
+FactoryContainer::snapshot_ptr() {
+  // Never destroyed, for the same reason.
+  static shared_ptr<const vector<FactoryBase *> > *snapshot =
+      new shared_ptr<const vector<FactoryBase *> >(EmptySnapshot());
+  return *snapshot;
+}
 
 }  // namespace infact
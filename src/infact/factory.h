@@ -36,17 +36,30 @@
 #ifndef INFACT_FACTORY_H_
 #define INFACT_FACTORY_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <stdexcept>
 
+#include "array-view.h"
 #include "environment.h"
 #include "error.h"
+#include "nesting.h"
+#include "stats.h"
 #include "stream-tokenizer.h"
+#include "string-piece.h"
+#include "sweep.h"
+#include "value-plan.h"
 
 /// A macro to make it easy to register a parameter for initialization
 /// inside a <tt>RegisterInitializers</tt> implementation, in a very
@@ -225,6 +238,159 @@ class TypeName<vector<T> > {
   }
 };
 
+/// A partial specialization so that an object of type
+/// <tt>ArrayView\<T\></tt> gets converted to the type name of
+/// <tt>T</tt> followed by the string <tt>"_view"</tt>.
+template <typename T>
+class TypeName<ArrayView<T> > {
+ public:
+  string ToString() {
+    return TypeName<T>().ToString() + "_view";
+  }
+};
+
+/// Appends an unambiguous encoding of values of type <tt>T</tt> to a
+/// string, so that two values have the same encoding if and only if
+/// they are equal.  This is used to recognize repeated specs of \link
+/// infact::Factory Factory\endlink-constructible types registered as
+/// shareable (see \link REGISTER_SHAREABLE_NAMED \endlink).
+///
+/// The basic implementation here works for <tt>bool</tt>,
+/// <tt>int</tt> and <tt>double</tt>.
+template <typename T>
+class ValueKey {
+ public:
+  void Append(const T &value, string *key) const {
+    ostringstream oss;
+    oss << std::setprecision(std::numeric_limits<T>::max_digits10) << value;
+    key->append(oss.str());
+    key->push_back(';');
+  }
+};
+
+/// A specialization so that strings are encoded along with their
+/// lengths, since they may contain any character.
+template <>
+class ValueKey<string> {
+ public:
+  void Append(const string &value, string *key) const {
+    ostringstream oss;
+    oss << value.size() << ':';
+    key->append(oss.str());
+    key->append(value);
+  }
+};
+
+/// A partial specialization so that an object is encoded by its
+/// address: two objects are only equal if they are the same object.
+template <typename T>
+class ValueKey<shared_ptr<T> > {
+ public:
+  void Append(const shared_ptr<T> &value, string *key) const {
+    ostringstream oss;
+    oss << static_cast<const void *>(value.get()) << ';';
+    key->append(oss.str());
+  }
+};
+
+/// A partial specialization so that array views are encoded by the
+/// address and number of their elements: two views are only equal if
+/// they refer to the same elements.
+template <typename T>
+class ValueKey<ArrayView<T> > {
+ public:
+  void Append(const ArrayView<T> &value, string *key) const {
+    ostringstream oss;
+    oss << static_cast<const void *>(value.data()) << ':' << value.size()
+        << ';';
+    key->append(oss.str());
+  }
+};
+
+/// A partial specialization so that vectors are encoded as their
+/// sizes followed by the encodings of their elements.
+template <typename T>
+class ValueKey<vector<T> > {
+ public:
+  void Append(const vector<T> &value, string *key) const {
+    ostringstream oss;
+    oss << value.size() << '{';
+    key->append(oss.str());
+    ValueKey<T> element_key;
+    for (typename vector<T>::const_iterator it = value.begin();
+         it != value.end(); ++it) {
+      element_key.Append(*it, key);
+    }
+    key->push_back('}');
+  }
+};
+
+class MemberInitializer;
+template <typename T> class TypedMemberInitializer;
+
+/// An immutable plan for initializing a single data member of a \link
+/// infact::Factory Factory\endlink-constructible object, produced by
+/// \link infact::MemberInitializer::Compile MemberInitializer::Compile
+/// \endlink.
+class MemberPlan {
+ public:
+  /// Constructs a plan for the member with the specified name.
+  MemberPlan(const string &name) : name_(name) { }
+
+  /// Destroys this instance.
+  virtual ~MemberPlan() { }
+
+  /// Returns the name of the member initialized by this plan.
+  const string &name() const { return name_; }
+
+  /// Initializes a member of a new object according to this plan.
+  ///
+  /// \param initializer the initializer for the member, as registered by
+  ///                    an object of the same type
+  /// \param member      the address of the member of the new object, or
+  ///                    <tt>nullptr</tt> if the initializer only modifies
+  ///                    the environment
+  /// \param env         the current environment, to be modified by this
+  ///                    member&rsquo;s initialization
+  virtual void Apply(const MemberInitializer *initializer, void *member,
+                     Environment *env) const = 0;
+
+ private:
+  string name_;
+};
+
+/// A concrete, typed implementation of the MemberPlan base class.
+///
+/// \tparam T the type of the member initialized by this plan
+template <typename T>
+class TypedMemberPlan : public MemberPlan {
+ public:
+  /// Constructs a plan for the member with the specified name.
+  ///
+  /// \param name  the name of the member
+  /// \param value a plan for the member&rsquo;s value
+  TypedMemberPlan(const string &name, shared_ptr<const ValuePlan<T> > value) :
+      MemberPlan(name), value_(value) { }
+  virtual ~TypedMemberPlan() { }
+
+  /// \copydoc MemberPlan::Apply
+  virtual void Apply(const MemberInitializer *initializer, void *member,
+                     Environment *env) const {
+    const TypedMemberInitializer<T> *typed_initializer =
+        dynamic_cast<const TypedMemberInitializer<T> *>(initializer);
+    if (typed_initializer == nullptr) {
+      ostringstream err_ss;
+      err_ss << "TypedMemberPlan: error: member " << name()
+             << " is not of type " << TypeName<T>().ToString();
+      Error(err_ss.str());
+    }
+    typed_initializer->InitMember(*value_, env, member);
+  }
+
+ private:
+  shared_ptr<const ValuePlan<T> > value_;
+};
+
 /// \class MemberInitializer
 ///
 /// An interface for data member initializers of members of a \link
@@ -261,6 +427,45 @@ class MemberInitializer {
   ///            initialization
   virtual void Init(StreamTokenizer &st, Environment *env) = 0;
 
+  /// Returns the address of the member initialized by this instance, or
+  /// <tt>nullptr</tt> if this instance only modifies the environment.
+  virtual void *member() const = 0;
+
+  /// Initializes the member at the specified address, which must be a
+  /// member of the same type as this instance&rsquo;s member, exactly as
+  /// \link Init \endlink initializes this instance&rsquo;s own member,
+  /// but without modifying this instance.
+  ///
+  /// \param st     the stream tokenizer whose next tokens contain the
+  ///               information to initialize the data member
+  /// \param env    the current environment, to be modified by this
+  ///               member&rsquo;s initialization
+  /// \param member the address of the member to initialize, or
+  ///               <tt>nullptr</tt> to modify only the environment
+  /// \return whether the member was initialized
+  virtual bool InitMember(StreamTokenizer &st, Environment *env,
+                          void *member) const = 0;
+
+  /// Reads the following tokens obtained from the specified \link
+  /// StreamTokenizer\endlink, exactly as \link Init \endlink would,
+  /// and returns a plan for initializing this member from them.
+  ///
+  /// \param st the stream tokenizer whose next tokens contain the
+  ///           information to initialize this data member
+  virtual shared_ptr<const MemberPlan> Compile(StreamTokenizer &st) const = 0;
+
+  /// Appends an encoding of the value to which this member was last
+  /// initialized in the specified environment to the specified key (see
+  /// \link ValueKey\endlink).
+  ///
+  /// \return whether the environment holds a value for this member
+  virtual bool AppendValueKey(Environment *env, string *key) const = 0;
+
+  /// Returns the name of the type of this member, as used by the
+  /// \link infact::Environment Environment\endlink (see \link
+  /// infact::TypeName TypeName\endlink).
+  virtual string MemberTypeName() const = 0;
+
   /// Returns the number of times this member initializer&rsquo;s
   /// \link Init \endlink method has been invoked.
   virtual int Initialized() const { return initialized_; }
@@ -304,28 +509,104 @@ class TypedMemberInitializer : public MemberInitializer {
   /// \param required whether this member is required to be initialized in a
   ///                 spec string
   TypedMemberInitializer(const string &name, T *member, bool required = false) :
-      MemberInitializer(name, required), member_(member) { }
+      MemberInitializer(name, required), member_(member),
+      symbol_(SymbolTable::Intern(name)) { }
   virtual ~TypedMemberInitializer() { }
   virtual void Init(StreamTokenizer &st, Environment *env) {
-    env->ReadAndSet(Name(), st, TypeName<T>().ToString());
-    if (member_ != nullptr) {
-      VarMapBase *var_map = env->GetVarMap(Name());
+    if (InitMember(st, env, member_)) {
+      ++initialized_;
+    }
+  }
+
+  /// \copydoc MemberInitializer::member
+  virtual void *member() const { return member_; }
+
+  /// \copydoc MemberInitializer::InitMember
+  virtual bool InitMember(StreamTokenizer &st, Environment *env,
+                          void *member) const {
+    static const string type_name = TypeName<T>().ToString();
+    env->ReadAndSet(name_, st, type_name);
+    if (member != nullptr) {
+      // Having just been set with an explicit type, the variable lives in
+      // the VarMap for that type.
+      VarMapBase *var_map = env->GetVarMapForType(type_name);
       VarMap<T> *typed_var_map = dynamic_cast<VarMap<T> *>(var_map);
-      if (typed_var_map != nullptr) {
-        bool success = typed_var_map->Get(Name(), member_);
-        if (success) {
-          ++initialized_;
-        }
-      }
+      return typed_var_map != nullptr &&
+          typed_var_map->Get(symbol_, static_cast<T *>(member));
     } else {
       // When the goal is simply to modify the environment, we say that this
       // "non-member" has been successfully initialized when we've modified
       // the environment.
-      ++initialized_;
+      return true;
+    }
+  }
+
+  /// \copydoc MemberInitializer::Compile
+  virtual shared_ptr<const MemberPlan> Compile(StreamTokenizer &st) const {
+    return shared_ptr<const MemberPlan>(
+        new TypedMemberPlan<T>(name_, ValuePlanCompiler<T>::Compile(st)));
+  }
+
+  /// \copydoc MemberInitializer::MemberTypeName
+  virtual string MemberTypeName() const { return TypeName<T>().ToString(); }
+
+  /// \copydoc MemberInitializer::AppendValueKey
+  virtual bool AppendValueKey(Environment *env, string *key) const {
+    static const string type_name = TypeName<T>().ToString();
+    VarMap<T> *typed_var_map =
+        dynamic_cast<VarMap<T> *>(env->GetVarMapForType(type_name));
+    const T *value =
+        typed_var_map == nullptr ? nullptr : typed_var_map->Find(symbol_);
+    if (value == nullptr) {
+      return false;
     }
+    ValueKey<T>().Append(*value, key);
+    return true;
+  }
+
+  /// Initializes this instance from the specified plan, setting the
+  /// variable with this member&rsquo;s name in the specified environment,
+  /// just as \link Init \endlink does.
+  ///
+  /// \param plan a plan for the value of this member
+  /// \param env  the current environment, to be modified by this
+  ///             member&rsquo;s initialization
+  void Init(const ValuePlan<T> &plan, Environment *env) {
+    InitMember(plan, env, member_);
+    ++initialized_;
+  }
+
+  /// Initializes the member at the specified address from the specified
+  /// plan, exactly as \link Init(const ValuePlan<T>&,Environment*) Init
+  /// \endlink initializes this instance&rsquo;s own member, but without
+  /// modifying this instance.
+  ///
+  /// \param plan   a plan for the value of the member
+  /// \param env    the current environment, to be modified by this
+  ///               member&rsquo;s initialization
+  /// \param member the address of the member to initialize, or
+  ///               <tt>nullptr</tt> to modify only the environment
+  void InitMember(const ValuePlan<T> &plan, Environment *env,
+                  void *member) const {
+    T value = plan.Evaluate(env);
+    static const string type = TypeName<T>().ToString();
+    VarMap<T> *typed_var_map =
+        dynamic_cast<VarMap<T> *>(env->GetVarMapForType(type));
+    if (typed_var_map == nullptr) {
+      ostringstream err_ss;
+      err_ss << "TypedMemberInitializer: error: no VarMap for type " << type;
+      Error(err_ss.str());
+    }
+    if (member != nullptr) {
+      *static_cast<T *>(member) = value;
+    }
+    typed_var_map->Set(symbol_, std::move(value));
+    env->SetType(name_, type);
   }
  protected:
   T *member_;
+  /// The interned name of the member.
+  Symbol symbol_;
 };
 
 /// \class Initializers
@@ -345,7 +626,7 @@ class Initializers {
   typedef unordered_map<string, MemberInitializer *>::iterator iterator;
 
   /// Constructs a new instance.
-  Initializers() { }
+  Initializers() : per_instance_(false) { }
   /// Destroys this instance.
   virtual ~Initializers() {
     for (iterator init_it = initializers_.begin();
@@ -383,6 +664,20 @@ class Initializers {
     initializers_[name] = new TypedMemberInitializer<T>(name, member, required);
   }
 
+  /// Declares whether the initializers registered by one instance of
+  /// a type may differ from those registered by another, or
+  /// registering them has effects beyond registration, so that every
+  /// instance must register its own rather than being initialized as
+  /// described by the \link MemberSchema \endlink of its type.
+  /// Invoke this method from a <tt>RegisterInitializers</tt>
+  /// implementation to opt out of sharing one description among all
+  /// instances.
+  void set_per_instance(bool per_instance) { per_instance_ = per_instance; }
+
+  /// Returns whether every instance must register its own initializers
+  /// (see \link set_per_instance\endlink).
+  bool per_instance() const { return per_instance_; }
+
   /// Returns a const iterator pointing to the beginning of the map
   /// from member names to pointers to \link infact::TypedMemberInitializer
   /// TypedMemberInitializer \endlink instances.
@@ -421,6 +716,198 @@ class Initializers {
   }
  private:
   unordered_map<string, MemberInitializer *> initializers_;
+  bool per_instance_;
+};
+
+/// \class MemberSchema
+///
+/// The names, types and required flags of the members of a concrete
+/// \link Factory\endlink-constructible type, as registered by its
+/// <tt>RegisterInitializers</tt> method, along with the initializer
+/// of each member.  A \link Factory \endlink learns the schema of
+/// each concrete type once, from a prototype instance, recording the
+/// offset of each registered data member within the prototype, so
+/// that it may initialize the same member of every new object of
+/// that type at the same offset, without that object having to
+/// register initializers of its own.  The schema keeps the prototype,
+/// to which its initializers point, alive.
+///
+/// A type whose <tt>RegisterInitializers</tt> method registers
+/// different members for different instances, does other work or
+/// registers addresses outside the object is described per instance
+/// instead (see \link Initializers::set_per_instance
+/// Initializers::set_per_instance\endlink): every new instance then
+/// registers its own initializers, and a schema of those initializers
+/// initializes each member at the address registered for it.
+class MemberSchema {
+ public:
+  /// The index returned by \link Find \endlink for an unknown member.
+  static const size_t kNoMember = static_cast<size_t>(-1);
+
+  /// Constructs the schema of the members registered with the specified
+  /// initializers, which must outlive this schema, initializing each
+  /// member at the address registered for it.
+  ///
+  /// \param initializers the member initializers registered by an
+  ///                     instance
+  explicit MemberSchema(const Initializers &initializers) :
+      per_instance_(true) {
+    for (Initializers::const_iterator it = initializers.begin();
+         it != initializers.end(); ++it) {
+      Member member;
+      member.name = it->first;
+      member.type_name = it->second->MemberTypeName();
+      member.required = it->second->Required();
+      member.initializer = it->second;
+      member.has_offset = false;
+      member.offset = 0;
+      members_.push_back(member);
+    }
+  }
+
+  /// Constructs the schema of a concrete type from the initializers
+  /// registered by a prototype instance of that type, or, if they may
+  /// not describe every instance, the schema of those initializers
+  /// alone.
+  ///
+  /// \param prototype    the prototype instance, kept alive by this
+  ///                     schema
+  /// \param object       the address from which the offsets of the
+  ///                     members of the prototype are measured, which
+  ///                     must be the address of the prototype relative
+  ///                     to which the address of each new object is
+  ///                     passed to \link member \endlink
+  /// \param initializers the member initializers registered by the
+  ///                     prototype, of which this schema takes ownership
+  /// \param contains     a function returning whether the specified
+  ///                     address lies within the prototype
+  template <typename Contains>
+  MemberSchema(const shared_ptr<void> &prototype, const void *object,
+               std::unique_ptr<Initializers> initializers,
+               Contains contains) :
+      MemberSchema(*initializers) {
+    prototype_ = prototype;
+    initializers_ = std::move(initializers);
+    if (initializers_->per_instance()) {
+      return;
+    }
+    const char *base = static_cast<const char *>(object);
+    for (size_t i = 0; i < members_.size(); ++i) {
+      const void *address = members_[i].initializer->member();
+      if (address == nullptr) {
+        continue;
+      }
+      if (!contains(address)) {
+        return;
+      }
+      members_[i].has_offset = true;
+      members_[i].offset = static_cast<const char *>(address) - base;
+    }
+    per_instance_ = false;
+  }
+
+  /// Returns the number of members.
+  size_t size() const { return members_.size(); }
+
+  /// Returns the index of the member with the specified name, or \link
+  /// kNoMember \endlink if there is no such member.
+  size_t Find(const StringPiece &name) const {
+    for (size_t i = 0; i < members_.size(); ++i) {
+      if (name == members_[i].name) {
+        return i;
+      }
+    }
+    return kNoMember;
+  }
+
+  /// Returns the name of the member with the specified index.
+  const string &name(size_t i) const { return members_[i].name; }
+
+  /// Returns the name of the type of the member with the specified
+  /// index (see \link infact::TypeName TypeName\endlink).
+  const string &type_name(size_t i) const { return members_[i].type_name; }
+
+  /// Returns whether the member with the specified index is required to
+  /// be initialized in a spec.
+  bool required(size_t i) const { return members_[i].required; }
+
+  /// Returns whether every instance of the type of this schema must
+  /// register its own initializers, in which case this schema cannot
+  /// initialize the members of any object but the one whose
+  /// initializers it holds.
+  bool per_instance() const { return per_instance_; }
+
+  /// Returns the initializer of the member with the specified index,
+  /// whose const methods may be used to initialize that member of any
+  /// object described by this schema.
+  const MemberInitializer *initializer(size_t i) const {
+    return members_[i].initializer;
+  }
+
+  /// Returns the address of the member with the specified index within
+  /// the specified object, or <tt>nullptr</tt> if the member only
+  /// modifies the environment.
+  ///
+  /// \param i      the index of the member
+  /// \param object the address of a new object of the type of this
+  ///               schema, measured exactly as the prototype&rsquo;s
+  ///               was when this schema was constructed; ignored if
+  ///               this schema is \link per_instance\endlink
+  void *member(size_t i, void *object) const {
+    const Member &member = members_[i];
+    return member.has_offset ?
+        static_cast<char *>(object) + member.offset :
+        member.initializer->member();
+  }
+
+ private:
+  /// A member of a type.
+  struct Member {
+    /// The name of the member.
+    string name;
+    /// The name of the type of the member.
+    string type_name;
+    /// Whether the member is required to be initialized.
+    bool required;
+    /// The initializer of the member.
+    const MemberInitializer *initializer;
+    /// Whether the member lies at a fixed offset within every object.
+    bool has_offset;
+    /// The offset of the member within every object, if it has one.
+    ptrdiff_t offset;
+  };
+
+  vector<Member> members_;
+  bool per_instance_;
+  shared_ptr<void> prototype_;
+  std::unique_ptr<Initializers> initializers_;
+};
+
+/// A set of indices of members of a \link MemberSchema \endlink, which
+/// only allocates memory for schemas with more than 64 members.
+class MemberSet {
+ public:
+  /// Constructs an empty set of indices less than the specified size.
+  MemberSet(size_t size) : bits_(0), more_bits_(size > 64 ? size - 64 : 0) { }
+
+  /// Adds the specified index to this set.
+  void Insert(size_t i) {
+    if (i < 64) {
+      bits_ |= static_cast<uint64_t>(1) << i;
+    } else {
+      more_bits_[i - 64] = true;
+    }
+  }
+
+  /// Returns whether the specified index is in this set.
+  bool Contains(size_t i) const {
+    return i < 64 ? (bits_ & (static_cast<uint64_t>(1) << i)) != 0 :
+        more_bits_[i - 64];
+  }
+
+ private:
+  uint64_t bits_;
+  vector<bool> more_bits_;
 };
 
 /// An interface for all \link Factory \endlink instances, specifying a few
@@ -447,63 +934,80 @@ class FactoryBase {
   virtual VarMapBase *CreateVarMap(Environment *env) const = 0;
 
   virtual VarMapBase *CreateVectorVarMap(Environment *env) const = 0;
+
+  /// Returns the schema of the members of the specified concrete type
+  /// registered with this factory, or <tt>nullptr</tt> if there is no
+  /// such type.
+  virtual const MemberSchema *GetMemberSchema(const string &type) const = 0;
 };
 
 /// A class to hold all \link Factory \endlink instances that have been created.
+///
+/// The set of factories, like the set of types registered with each
+/// factory, is kept as an immutable snapshot that is replaced
+/// atomically whenever a factory is added, so that it may be read
+/// without locking while new types are being registered, e.g., by a
+/// plugin loaded with <tt>dlopen</tt> after <tt>main</tt> has started.
+/// Replaced snapshots are kept until \link Clear \endlink is invoked,
+/// since readers may still be using them.
+///
+/// A plugin shares the registry of the executable that loads it only
+/// if the executable exports its symbols (e.g., when it is linked with
+/// <tt>-rdynamic</tt>); otherwise, the plugin&rsquo;s
+/// <tt>REGISTER_NAMED</tt> declarations register types with a private
+/// copy of each factory.
 class FactoryContainer {
  public:
-  typedef vector<FactoryBase *>::iterator iterator;
+  typedef vector<FactoryBase *>::const_iterator iterator;
 
   /// Adds the specified factory to this container of factories.
   ///
   /// \param factory the factory to add to this container
   static void Add(FactoryBase *factory) {
-    if (!initialized_) {
-      factories_ = new vector<FactoryBase *>();
-      initialized_ = 1;
-    }
-    factories_->push_back(factory);
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    AddLocked(factory);
   }
-  /// Clears this container of factories.
+  /// Clears this container of factories.  This method must not be
+  /// invoked concurrently with any other use of any factory.
   static void Clear() {
-    if (initialized_) {
-      for (vector<FactoryBase *>::iterator it = factories_->begin();
-           it != factories_->end();
-           ++it) {
-        (*it)->Clear();
-        delete *it;
-      }
-      delete factories_;
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    shared_ptr<const vector<FactoryBase *> > snapshot =
+        std::atomic_load(&snapshot_ptr());
+    for (iterator it = snapshot->begin(); it != snapshot->end(); ++it) {
+      (*it)->Clear();
+      delete *it;
     }
+    std::atomic_store(&snapshot_ptr(), EmptySnapshot());
+    generation_.fetch_add(1, std::memory_order_release);
   }
 
-  // Provide two methods to iterate over the FactoryBase instances
-  // held by this FactoryContainer.
-  static iterator begin() {
-    if (factories_ == nullptr) {
-      cerr << "FactoryContainer::begin: error: no FactoryBase instances!"
-           << endl;
-    }
-    return factories_->begin();
+  /// Returns a number that changes whenever a factory is added to this
+  /// container or a type is registered with any factory, so that
+  /// information derived from the registered types may be cached.
+  static uint64_t generation() {
+    return generation_.load(std::memory_order_acquire);
   }
-  static iterator end() {
-    if (factories_ == nullptr) {
-      cerr << "FactoryContainer::begin: error: no FactoryBase instances!"
-           << endl;
-    }
-    return factories_->end();
+
+  /// Returns the current snapshot of the factories held by this
+  /// container, which remains unchanged, and valid for as long as it is
+  /// held, even while new factories are being added.  Iterate over the
+  /// factories of a single snapshot, since each invocation may return a
+  /// different one.
+  static shared_ptr<const vector<FactoryBase *> > factories() {
+    return std::atomic_load(&snapshot_ptr());
   }
 
   /// Prints the base typenames for all factories along with a list of all
   /// concrete subtypes those factories can construct, in a human-readable
   /// form, to the specified output stream.
   static void Print(ostream &os) {
-    if (!initialized_) {
+    shared_ptr<const vector<FactoryBase *> > all_factories = factories();
+    if (all_factories->empty()) {
       return;
     }
-    cerr << "Number of factories: " << factories_->size() << "." << endl;
-    for (vector<FactoryBase *>::iterator factory_it = factories_->begin();
-         factory_it != factories_->end();
+    cerr << "Number of factories: " << all_factories->size() << "." << endl;
+    for (iterator factory_it = all_factories->begin();
+         factory_it != all_factories->end();
          ++factory_it) {
       unordered_set<string> registered;
       (*factory_it)->CollectRegistered(registered);
@@ -517,8 +1021,36 @@ class FactoryContainer {
     os.flush();
   }
  private:
-  static int initialized_;
-  static vector<FactoryBase *> *factories_;
+  template <typename T> friend class Factory;
+
+  /// Returns the mutex serializing all modifications of this container
+  /// and of every factory&rsquo;s registered types.
+  static std::mutex &registry_mutex();
+
+  /// Returns the current snapshot of the factories, which is only
+  /// accessed atomically, and is reclaimed once no longer held by any
+  /// reader.
+  static shared_ptr<const vector<FactoryBase *> > &snapshot_ptr();
+
+  /// Returns a new, empty snapshot.
+  static shared_ptr<const vector<FactoryBase *> > EmptySnapshot() {
+    return std::make_shared<const vector<FactoryBase *> >();
+  }
+
+  /// Adds the specified factory, with \link registry_mutex \endlink held.
+  static void AddLocked(FactoryBase *factory) {
+    shared_ptr<const vector<FactoryBase *> > snapshot =
+        std::atomic_load(&snapshot_ptr());
+    shared_ptr<vector<FactoryBase *> > new_snapshot =
+        std::make_shared<vector<FactoryBase *> >(*snapshot);
+    new_snapshot->push_back(factory);
+    std::atomic_store(&snapshot_ptr(),
+                      shared_ptr<const vector<FactoryBase *> >(new_snapshot));
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// The value returned by \link generation\endlink.
+  static std::atomic<uint64_t> generation_;
 };
 
 /// \class Constructor
@@ -532,8 +1064,58 @@ class Constructor {
  public:
   virtual ~Constructor() { }
   virtual T *NewInstance() const = 0;
+
+  /// Constructs a concrete instance owned by a <tt>shared_ptr</tt>.
+  ///
+  /// \param arena the arena in which to allocate the instance and its
+  ///              <tt>shared_ptr</tt> control block, or <tt>nullptr</tt>
+  ///              to allocate them on the heap; implementations that do
+  ///              not support arenas may ignore it
+  virtual shared_ptr<T> NewShared(const shared_ptr<Arena> &arena) const {
+    return shared_ptr<T>(NewInstance());
+  }
+
+  /// Returns whether the specified address lies within the specified
+  /// instance, constructed by this constructor.  A \link Factory
+  /// \endlink initializes the members of instances at the offsets of
+  /// the members of a prototype only when they lie within it; the
+  /// default implementation knows nothing of the size of instances, and
+  /// so makes every instance register its own member initializers.
+  ///
+  /// \param instance an instance constructed by this constructor
+  /// \param address  an address registered for a member of the instance
+  virtual bool Contains(const T *instance, const void *address) const {
+    return false;
+  }
 };
 
+/// Returns the address of the complete object of which the specified
+/// instance of a polymorphic type is a subobject.
+template <typename TYPE, typename BASE>
+const void *CompleteObject(const BASE *instance, std::true_type) {
+  return dynamic_cast<const void *>(instance);
+}
+
+/// Returns the address of the complete object of type <tt>TYPE</tt> of
+/// which the specified instance of a non-polymorphic type is a
+/// subobject.
+template <typename TYPE, typename BASE>
+const void *CompleteObject(const BASE *instance, std::false_type) {
+  return static_cast<const TYPE *>(instance);
+}
+
+/// Returns whether the specified address lies within the complete
+/// object of type <tt>TYPE</tt> of which the specified instance is a
+/// subobject.
+template <typename TYPE, typename BASE>
+bool ObjectContains(const BASE *instance, const void *address) {
+  const char *begin = static_cast<const char *>(
+      CompleteObject<TYPE>(instance, std::is_polymorphic<BASE>()));
+  const char *byte = static_cast<const char *>(address);
+  std::less<const char *> less;
+  return !less(byte, begin) && less(byte, begin + sizeof(TYPE));
+}
+
 /// An interface simply to make it easier to implement \link
 /// infact::Factory Factory\endlink-constructible types by
 /// implementing both required methods to do nothing (use of
@@ -560,6 +1142,17 @@ class FactoryConstructible {
   /// infact::PersonImpl::RegisterInitializers \endlink for an example
   /// implementation.
   ///
+  /// A \link infact::Factory Factory \endlink invokes this method once
+  /// per concrete type, on a prototype instance from which it learns
+  /// the members of its type and their offsets (see \link
+  /// infact::MemberSchema MemberSchema\endlink), and initializes the
+  /// members of every instance it constructs at those offsets.  An
+  /// implementation that registers different members for different
+  /// instances, or does anything but register initializers, must
+  /// invoke \link infact::Initializers::set_per_instance
+  /// Initializers::set_per_instance \endlink, so that this method is
+  /// invoked on every instance instead.
+  ///
   /// \param initializers an object that stores the initializers for
   ///                     various data members of this class that can
   ///                     be initialized by the \link
@@ -581,6 +1174,185 @@ class FactoryConstructible {
   /// \param init_str the entire string used to initialize this object
   ///                 (for example, <tt>PersonImpl(name("Fred"))</tt>)
   virtual void PostInit(const Environment *env, const string &init_str) { }
+
+  /// Identical to \link PostInit \endlink, but receives a view of the
+  /// initialization string directly from the underlying \link
+  /// infact::StreamTokenizer StreamTokenizer\endlink; this is the
+  /// method invoked by \link infact::Factory::CreateOrDie
+  /// Factory::CreateOrDie \endlink.  The view is only valid for the
+  /// duration of this call.  The default implementation copies the
+  /// viewed characters to a string and invokes \link PostInit
+  /// \endlink; classes that care about the cost of that copy should
+  /// override this method instead.  Its name differs from that of
+  /// \link PostInit \endlink so that overriding one does not hide the
+  /// other.
+  ///
+  /// \param env      the environment in use during construction by the
+  ///                 \link infact::Factory::CreateOrDie
+  ///                 Factory::CreateOrDie \endlink method
+  /// \param init_str a view of the entire string used to initialize this
+  ///                 object
+  virtual void PostInitView(const Environment *env,
+                            const StringPiece &init_str) {
+    PostInit(env, init_str.ToString());
+  }
+};
+
+/// Invokes the view-based <tt>PostInitView</tt> method of the specified
+/// instance when its type provides one.
+template <typename T>
+auto InvokePostInit(T *instance, const Environment *env,
+                    const StringPiece &init_str, int)
+    -> decltype(instance->PostInitView(env, init_str), void()) {
+  instance->PostInitView(env, init_str);
+}
+
+/// Invokes the string-based <tt>PostInit</tt> method of the specified
+/// instance, for types that do not provide a <tt>PostInitView</tt>.
+template <typename T>
+void InvokePostInit(T *instance, const Environment *env,
+                    const StringPiece &init_str, long) {
+  instance->PostInit(env, init_str.ToString());
+}
+
+/// An immutable, compiled form of a specification string for an
+/// object of type <tt>T</tt>, produced by \link infact::Factory::Compile
+/// Factory::Compile\endlink.  A compiled spec holds the resolved
+/// constructor for the concrete type, a plan for each member
+/// initializer (with literals already parsed and nested specs already
+/// compiled) and the text of the spec, for <tt>PostInit</tt>.  It can
+/// therefore construct any number of objects via \link Instantiate
+/// \endlink without reading any tokens.
+///
+/// Since a compiled spec is never modified after construction, a
+/// single instance may be shared by many threads, each invoking \link
+/// Instantiate \endlink concurrently.
+///
+/// \tparam T the abstract base type of objects constructed by this spec
+template <typename T>
+class CompiledSpec {
+ public:
+  /// Constructs a compiled spec.  This constructor is invoked by \link
+  /// infact::Factory::Compile Factory::Compile\endlink.
+  ///
+  /// \param constructor the constructor for the concrete type, or
+  ///                    <tt>nullptr</tt> if the spec is <tt>nullptr</tt>
+  /// \param type        the name of the concrete type
+  /// \param spec        the entire specification string
+  /// \param schema      the schema of the members of the concrete type, or
+  ///                    <tt>nullptr</tt> if the spec is <tt>nullptr</tt>
+  /// \param members     plans for the member initializers, in the order in
+  ///                    which they appear in the spec
+  CompiledSpec(const Constructor<T> *constructor, const string &type,
+               const string &spec, const MemberSchema *schema,
+               const vector<shared_ptr<const MemberPlan> > &members) :
+      constructor_(constructor), type_(type), spec_(spec), schema_(schema),
+      members_(members) {
+    if (schema_ != nullptr && !schema_->per_instance()) {
+      for (typename vector<shared_ptr<const MemberPlan> >::const_iterator it =
+               members_.begin();
+           it != members_.end();
+           ++it) {
+        member_indices_.push_back(schema_->Find((*it)->name()));
+      }
+    }
+  }
+
+  /// Destroys this compiled spec.  Destroying the plans for its members
+  /// destroys any nested compiled specs in turn, so for a deeply nested
+  /// spec they are destroyed on a fresh stack segment when necessary.
+  ~CompiledSpec() {
+    if (!members_.empty() && Nesting::StackLow()) {
+      vector<shared_ptr<const MemberPlan> > members;
+      members.swap(members_);
+      try {
+        Nesting::RunOnNewStack([&members]() { members.clear(); });
+      } catch (...) {
+        // There was no new stack segment, so destroy the plans here.
+      }
+    }
+  }
+
+  /// Returns the name of the concrete type of objects constructed by
+  /// this spec, or the empty string if this spec is <tt>nullptr</tt>.
+  const string &type() const { return type_; }
+
+  /// Returns the entire specification string that was compiled.
+  const string &spec() const { return spec_; }
+
+  /// Constructs a new object according to this spec, exactly as \link
+  /// infact::Factory::CreateOrDie Factory::CreateOrDie \endlink would
+  /// have when reading the original spec.  Variables referred to by the
+  /// spec are looked up each time an object is constructed.
+  ///
+  /// \param env the \link infact::Environment Environment \endlink in
+  ///            which to look up variables, or <tt>nullptr</tt> if there
+  ///            is none; if this method is invoked concurrently with the
+  ///            same environment, that environment must have been frozen
+  ///            (see \link infact::Environment::Freeze
+  ///            Environment::Freeze\endlink) and must not be modified
+  shared_ptr<T> Instantiate(const Environment *env = nullptr) const {
+    if (constructor_ == nullptr) {
+      return shared_ptr<T>();
+    }
+    if (Nesting::StackLow()) {
+      shared_ptr<T> instance;
+      Nesting::RunOnNewStack([&]() { instance = Instantiate(env); });
+      return instance;
+    }
+    Nesting::Scope nesting;
+    Stats::Timer timer(Stats::Current(), Stats::CONSTRUCTION, type_);
+    shared_ptr<Environment> env_ptr(env == nullptr ?
+                                    Environment::CreateEmpty() : env->Copy());
+    shared_ptr<T> instance(constructor_->NewShared(env_ptr->arena()));
+
+    if (!schema_->per_instance()) {
+      // Initialize each member at its offset within the new instance, as
+      // described by the schema of its type, by the index resolved when
+      // compiling.
+      void *object = instance.get();
+      for (size_t i = 0; i < members_.size(); ++i) {
+        size_t index = member_indices_[i];
+        members_[i]->Apply(schema_->initializer(index),
+                           schema_->member(index, object), env_ptr.get());
+      }
+      InvokePostInit(instance.get(), env_ptr.get(), StringPiece(spec_), 0);
+      return instance;
+    }
+
+    // Ask new instance to set up member initializers, since they point
+    // to its data members.
+    Initializers initializers;
+    instance->RegisterInitializers(initializers);
+
+    for (typename vector<shared_ptr<const MemberPlan> >::const_iterator it =
+             members_.begin();
+         it != members_.end();
+         ++it) {
+      Initializers::iterator init_it = initializers.find((*it)->name());
+      if (init_it == initializers.end()) {
+        ostringstream err_ss;
+        err_ss << "CompiledSpec<" << TypeName<T>().ToString() << ">: "
+               << "error: unknown member name \"" << (*it)->name()
+               << "\" for type " << type_;
+        Error(err_ss.str());
+      }
+      (*it)->Apply(init_it->second, init_it->second->member(), env_ptr.get());
+    }
+
+    InvokePostInit(instance.get(), env_ptr.get(), StringPiece(spec_), 0);
+    return instance;
+  }
+
+ private:
+  const Constructor<T> *constructor_;
+  string type_;
+  string spec_;
+  const MemberSchema *schema_;
+  vector<shared_ptr<const MemberPlan> > members_;
+  /// The index within schema_ of the member initialized by each plan in
+  /// members_, or empty if every instance registers its own initializers.
+  vector<size_t> member_indices_;
 };
 
 /// Factory for dynamically created instance of the specified type.
@@ -758,15 +1530,32 @@ class Factory : public FactoryBase {
   /// </tr>
   /// </table>
   ///
+  /// Specs may be nested at most \link infact::Nesting::max_depth
+  /// Nesting::max_depth \endlink levels deep; deeply nested specs are
+  /// read on fresh stack segments, as described for \link
+  /// infact::Nesting Nesting\endlink.
+  ///
   /// \param st  the stream tokenizer providing tokens according to the
   ///            grammar shown above
   /// \param env the \link infact::Environment Environment \endlink in
   ///            this method was called, or <tt>nullptr</tt> if there is
-  ///            no calling environment
+  ///            no calling environment; objects are allocated in its
+  ///            arena, if it has one (see \link
+  ///            infact::Environment::set_arena Environment::set_arena
+  ///            \endlink)
   shared_ptr<T> CreateOrDie(StreamTokenizer &st, Environment *env = nullptr) {
+    if (Nesting::StackLow()) {
+      // Continue this deeply nested spec on a fresh stack segment.
+      shared_ptr<T> obj;
+      Nesting::RunOnNewStack([&]() { obj = CreateOrDie(st, env); });
+      return obj;
+    }
+    Nesting::Scope nesting;
     shared_ptr<Environment> env_ptr(env == nullptr ?
                                     Environment::CreateEmpty() : env->Copy());
     size_t start = st.PeekTokenStart();
+    // Make sure the bytes of this spec are retained, for PostInit.
+    StreamTokenizer::ScopedMark mark(st);
     StreamTokenizer::TokenType token_type = st.PeekTokenType();
     if (token_type == StreamTokenizer::RESERVED_WORD &&
         (st.Peek() == "nullptr" || st.Peek() == "NULL")) {
@@ -784,6 +1573,7 @@ class Factory : public FactoryBase {
 
     // Read the concrete type of object to be created.
     string type = st.Next();
+    Stats::Timer timer(Stats::Current(), Stats::CONSTRUCTION, type);
 
     // Read the open parenthesis token.
     if (st.Peek() != "(") {
@@ -796,19 +1586,29 @@ class Factory : public FactoryBase {
     st.Next();
 
     // Attempt to create an instance of type.
-    typename unordered_map<string, const Constructor<T> *>::iterator cons_it =
-        cons_table_->find(type);
-    if (cons_it == cons_table_->end()) {
+    ConsEntry entry;
+    if (!FindEntry(type, &entry)) {
       ostringstream err_ss;
       err_ss << "Factory<" << BaseName() << ">: "
              << "error: unknown type: \"" << type << "\"";
       Error(err_ss.str());
     }
-    shared_ptr<T> instance(cons_it->second->NewInstance());
+    shared_ptr<T> instance(
+        entry.constructor->NewShared(env_ptr->arena()));
 
-    // Ask new instance to set up member initializers.
+    // Initialize the members of the new instance as described by the
+    // schema of its type, learned once from a prototype instance, unless
+    // the instance must set up member initializers of its own.
+    const MemberSchema *schema = GetSchema(entry);
     Initializers initializers;
-    instance->RegisterInitializers(initializers);
+    std::unique_ptr<MemberSchema> instance_schema;
+    if (schema->per_instance()) {
+      instance->RegisterInitializers(initializers);
+      instance_schema.reset(new MemberSchema(initializers));
+      schema = instance_schema.get();
+    }
+    void *object = instance.get();
+    MemberSet initialized(schema->size());
 
     // Parse initializer list.
     while (st.Peek() != ")") {
@@ -823,22 +1623,22 @@ class Factory : public FactoryBase {
         Error(err_ss.str());
       }
       size_t member_name_start = st.PeekTokenStart();
-      string member_name = st.Next();
-      typename Initializers::iterator init_it = initializers.find(member_name);
-      if (init_it == initializers.end()) {
+      size_t member_index = schema->Find(st.PeekView());
+      if (member_index == MemberSchema::kNoMember) {
         ostringstream err_ss;
         err_ss << "Factory<" << BaseName() << ">: "
-               << "error: unknown member name \"" << member_name
+               << "error: unknown member name \"" << st.Peek()
                << "\" in initializer list for type " << type << " at stream "
                << "position " << member_name_start;
         Error(err_ss.str());
       }
-      MemberInitializer *member_initializer = init_it->second;
+      st.Next();
+      const string &member_name = schema->name(member_index);
 
       // Read open parenthesis or equals sign.
       size_t member_init_start = st.PeekTokenStart();
-      bool saw_member_init_open_paren = st.Peek() == "(";
-      bool saw_member_init_equals_sign = st.Peek() == "=";
+      bool saw_member_init_open_paren = st.PeekView() == "(";
+      bool saw_member_init_equals_sign = st.PeekView() == "=";
       if (!saw_member_init_open_paren && !saw_member_init_equals_sign) {
         ostringstream err_ss;
         err_ss << "Factory<" << BaseName() << ">: "
@@ -850,7 +1650,10 @@ class Factory : public FactoryBase {
       st.Next();
 
       // Initialize member based on following token(s).
-      member_initializer->Init(st, env_ptr.get());
+      if (schema->initializer(member_index)->InitMember(
+              st, env_ptr.get(), schema->member(member_index, object))) {
+        initialized.Insert(member_index);
+      }
 
       // If an open parenthesis was seen, read close parenthesis.
       if (saw_member_init_open_paren) {
@@ -895,36 +1698,279 @@ class Factory : public FactoryBase {
 
     // Run through all member initializers: if any are required but haven't
     // been invoked, it is an error.
-    for (typename Initializers::const_iterator init_it = initializers.begin();
-         init_it != initializers.end();
-         ++init_it) {
-      MemberInitializer *member_initializer = init_it->second;
-      if (member_initializer->Required() &&
-          member_initializer->Initialized() == 0) {
+    for (size_t i = 0; i < schema->size(); ++i) {
+      if (schema->required(i) && !initialized.Contains(i)) {
         ostringstream err_ss;
         err_ss << "Factory<" << BaseName() << ">: "
                << "error: initialization for member with name \""
-               << init_it->first << "\" required but not found (current "
+               << schema->name(i) << "\" required but not found (current "
                << "stream position: " << st.tellg() << ")";
         Error(err_ss.str());
       }
     }
 
+    // If instances of this type are shareable, look for an existing
+    // instance with the same member values, before paying for PostInit.
+    string key;
+    if (entry.shareable) {
+      key = type;
+      key.push_back('(');
+      for (size_t i = 0; i < schema->size(); ++i) {
+        if (initialized.Contains(i)) {
+          ValueKey<string>().Append(schema->name(i), &key);
+          schema->initializer(i)->AppendValueKey(env_ptr.get(), &key);
+        }
+      }
+      key.push_back(')');
+      shared_ptr<T> existing = FindSharedInstance(key);
+      if (existing != nullptr) {
+        return existing;
+      }
+    }
+
     size_t end = st.tellg();
-    // Invoke new instance's Init method.
-    string stream_str = st.str();
-    //cerr << "Full stream string is: \"" << stream_str << "\"" << endl;
-    string init_str = stream_str.substr(start, end - start);
+    // Invoke new instance's PostInit method, handing it a view of its
+    // spec rather than a copy.
+    StringPiece init_str = st.View(start, end);
     //cerr << "PostInit string is: \"" << init_str << "\"" << endl;
-    instance->PostInit(env_ptr.get(), init_str);
-
+    InvokePostInit(instance.get(), env_ptr.get(), init_str, 0);
+
+    if (entry.shareable) {
+      // Another thread may have constructed an identical instance
+      // in the meantime.
+      shared_ptr<T> existing = ShareInstance(key, instance);
+      if (existing != nullptr) {
+        return existing;
+      }
+    }
     return instance;
   }
 
   shared_ptr<T> CreateOrDie(const string &spec, const string err_msg,
                             Environment *env = nullptr) {
-    StreamTokenizer st(spec);
-    return CreateOrDie(st, env);
+    StreamTokenizer::Recycled st(spec);
+    return CreateOrDie(*st, env);
+  }
+
+  /// Reads a specification string from the specified \link
+  /// StreamTokenizer\endlink, in exactly the form accepted by \link
+  /// CreateOrDie \endlink, and compiles it so that objects may be
+  /// constructed from it repeatedly via \link
+  /// infact::CompiledSpec::Instantiate CompiledSpec::Instantiate
+  /// \endlink, without any further tokenizing, constructor lookup or
+  /// parsing of literals.
+  ///
+  /// Unlike \link CreateOrDie\endlink, this method does not consult an
+  /// environment: an identifier where a value is expected denotes a
+  /// variable, to be looked up at instantiation time, unless it is the
+  /// name of a type constructible by the appropriate factory.
+  ///
+  /// \param st the stream tokenizer providing tokens according to the
+  ///           grammar described for \link CreateOrDie \endlink
+  shared_ptr<const CompiledSpec<T> > Compile(StreamTokenizer &st) {
+    if (Nesting::StackLow()) {
+      shared_ptr<const CompiledSpec<T> > spec;
+      Nesting::RunOnNewStack([&]() { spec = Compile(st); });
+      return spec;
+    }
+    Nesting::Scope nesting;
+    size_t start = st.PeekTokenStart();
+    // Make sure the bytes of this spec are retained, for PostInit.
+    StreamTokenizer::ScopedMark mark(st);
+    vector<shared_ptr<const MemberPlan> > members;
+    StreamTokenizer::TokenType token_type = st.PeekTokenType();
+    if (token_type == StreamTokenizer::RESERVED_WORD &&
+        (st.Peek() == "nullptr" || st.Peek() == "NULL")) {
+      // Consume the nullptr.
+      st.Next();
+      return shared_ptr<const CompiledSpec<T> >(
+          new CompiledSpec<T>(nullptr, "", st.str(start, st.tellg()),
+                              nullptr, members));
+    }
+    if (token_type != StreamTokenizer::IDENTIFIER) {
+      ostringstream err_ss;
+      err_ss << "Factory<" << BaseName() << ">: "
+             << "error: expected type specifier token but found "
+             << StreamTokenizer::TypeName(token_type);
+      Error(err_ss.str());
+    }
+
+    // Read the concrete type of object to be created.
+    string type = st.Next();
+
+    // Read the open parenthesis token.
+    if (st.Peek() != "(") {
+      ostringstream err_ss;
+      err_ss << "Factory<" << BaseName() << ">: "
+             << "error: expected '(' at stream position "
+             << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    st.Next();
+
+    // Resolve the constructor and member schema once and for all.
+    ConsEntry entry;
+    if (!FindEntry(type, &entry)) {
+      ostringstream err_ss;
+      err_ss << "Factory<" << BaseName() << ">: "
+             << "error: unknown type: \"" << type << "\"";
+      Error(err_ss.str());
+    }
+    // Member plans are compiled by the initializers of the schema of the
+    // type or, if every instance registers its own, by those of a
+    // prototype instance, which is not retained.
+    const MemberSchema *schema = GetSchema(entry);
+    shared_ptr<T> prototype;
+    Initializers initializers;
+    std::unique_ptr<MemberSchema> prototype_schema;
+    if (schema->per_instance()) {
+      prototype.reset(entry.constructor->NewInstance());
+      prototype->RegisterInitializers(initializers);
+      prototype_schema.reset(new MemberSchema(initializers));
+    }
+    const MemberSchema *parse_schema =
+        prototype_schema != nullptr ? prototype_schema.get() : schema;
+    MemberSet initialized(parse_schema->size());
+
+    // Parse initializer list.
+    while (st.Peek() != ")") {
+      token_type = st.PeekTokenType();
+      if (token_type != StreamTokenizer::IDENTIFIER) {
+        ostringstream err_ss;
+        err_ss << "Factory<" << BaseName() << ">: "
+               << "error: expected token of type IDENTIFIER at "
+               << "stream position " << st.PeekTokenStart() << " but found "
+               << StreamTokenizer::TypeName(token_type) << ": \""
+               << st.Peek() << "\"";
+        Error(err_ss.str());
+      }
+      size_t member_name_start = st.PeekTokenStart();
+      size_t member_index = parse_schema->Find(st.PeekView());
+      if (member_index == MemberSchema::kNoMember) {
+        ostringstream err_ss;
+        err_ss << "Factory<" << BaseName() << ">: "
+               << "error: unknown member name \"" << st.Peek()
+               << "\" in initializer list for type " << type << " at stream "
+               << "position " << member_name_start;
+        Error(err_ss.str());
+      }
+      st.Next();
+      const string &member_name = parse_schema->name(member_index);
+
+      // Read open parenthesis or equals sign.
+      size_t member_init_start = st.PeekTokenStart();
+      bool saw_member_init_open_paren = st.Peek() == "(";
+      bool saw_member_init_equals_sign = st.Peek() == "=";
+      if (!saw_member_init_open_paren && !saw_member_init_equals_sign) {
+        ostringstream err_ss;
+        err_ss << "Factory<" << BaseName() << ">: "
+               << "error initializing member " << member_name << ": "
+               << "expected '(' or '=' at stream position "
+               << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+        Error(err_ss.str());
+      }
+      st.Next();
+
+      // Compile member initializer from following token(s).
+      members.push_back(parse_schema->initializer(member_index)->Compile(st));
+      initialized.Insert(member_index);
+
+      // If an open parenthesis was seen, read close parenthesis.
+      if (saw_member_init_open_paren) {
+        if (st.Peek() != ")") {
+          ostringstream err_ss;
+          err_ss << "Factory<" << BaseName() << ">: "
+              << "error initializing member " << member_name << ": "
+              << "saw '(' at stream position " << member_init_start
+              << "; expected ')' at stream position "
+              << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+          Error(err_ss.str());
+        }
+        st.Next();
+      }
+
+      // Each member initializer must be followed by a comma or the final
+      // closing parenthesis.
+      if (st.Peek() != ","  && st.Peek() != ")") {
+        ostringstream err_ss;
+        err_ss << "Factory<" << BaseName() << ">: "
+               << "error initializing member " << member_name << ": "
+               << "expected ',' or ')' at stream position "
+               << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+        Error(err_ss.str());
+      }
+      // Read comma, if present.
+      if (st.Peek() == ",") {
+        st.Next();
+      }
+    }
+
+    // Read the close parenthesis token for this factory type specification.
+    if (st.Peek() != ")") {
+      ostringstream err_ss;
+      err_ss << "Factory<" << BaseName() << ">: "
+             << "error at initializer list end: "
+             << "expected ')' at stream position "
+             << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    st.Next();
+
+    // Run through all member initializers: if any are required but don't
+    // appear in the spec, it is an error.
+    for (size_t i = 0; i < parse_schema->size(); ++i) {
+      if (parse_schema->required(i) && !initialized.Contains(i)) {
+        ostringstream err_ss;
+        err_ss << "Factory<" << BaseName() << ">: "
+               << "error: initialization for member with name \""
+               << parse_schema->name(i) << "\" required but not found "
+               << "(current stream position: " << st.tellg() << ")";
+        Error(err_ss.str());
+      }
+    }
+
+    return shared_ptr<const CompiledSpec<T> >(
+        new CompiledSpec<T>(entry.constructor, type,
+                            st.str(start, st.tellg()), schema, members));
+  }
+
+  /// Compiles the specified specification string.
+  ///
+  /// \see Compile(StreamTokenizer&)
+  shared_ptr<const CompiledSpec<T> > Compile(const string &spec) {
+    StreamTokenizer::Recycled st(spec);
+    return Compile(*st);
+  }
+
+  /// Constructs one object per combination of values of the specified
+  /// sweep, by instantiating the specified compiled spec in the
+  /// environment of each combination (see \link
+  /// infact::Sweep::environments Sweep::environments\endlink).
+  ///
+  /// \param spec        the compiled spec of every object to construct
+  /// \param sweep       the combinations of values of the variables to
+  ///                    which the spec refers
+  /// \param num_threads the number of threads with which to construct
+  ///                    the objects
+  /// \return the objects constructed, in the order of the combinations
+  ///         of values of the sweep
+  vector<shared_ptr<T> > CreateMany(const CompiledSpec<T> &spec,
+                                    const Sweep &sweep,
+                                    size_t num_threads = 1) {
+    vector<shared_ptr<T> > objects(sweep.size());
+    sweep.ForEach(num_threads, [&](size_t i) {
+        objects[i] = spec.Instantiate(sweep.environments()[i].get());
+      });
+    return objects;
+  }
+
+  /// Compiles the specified specification string and constructs one
+  /// object per combination of values of the specified sweep.
+  ///
+  /// \see CreateMany(const CompiledSpec<T>&, const Sweep&, size_t)
+  vector<shared_ptr<T> > CreateMany(const string &spec, const Sweep &sweep,
+                                    size_t num_threads = 1) {
+    return CreateMany(*Compile(spec), sweep, num_threads);
   }
 
 
@@ -939,15 +1985,16 @@ class Factory : public FactoryBase {
   /// \return whether the specified type has been registered with this
   ///         factory
   static bool IsRegistered(const string &type) {
-    return initialized_ && cons_table_->find(type) != cons_table_->end();
+    ConsEntry entry;
+    return FindEntry(type, &entry);
   }
 
   /// \copydoc FactoryBase::CollectRegistered
   virtual void CollectRegistered(unordered_set<string> &registered) const {
-    if (initialized_) {
-      for (typename unordered_map<string, const Constructor<T> *>::iterator it =
-               cons_table_->begin();
-           it != cons_table_->end();
+    shared_ptr<const ConsTable> table = std::atomic_load(&cons_table());
+    if (table != nullptr) {
+      for (typename ConsMap::const_iterator it = table->constructors.begin();
+           it != table->constructors.end();
            ++it) {
         registered.insert(it->first);
       }
@@ -959,6 +2006,12 @@ class Factory : public FactoryBase {
     return new VarMap<shared_ptr<T> >(BaseName(), env, is_primitive);
   }
 
+  /// \copydoc FactoryBase::GetMemberSchema
+  virtual const MemberSchema *GetMemberSchema(const string &type) const {
+    ConsEntry entry;
+    return FindEntry(type, &entry) ? GetSchema(entry) : nullptr;
+  }
+
   virtual VarMapBase *CreateVectorVarMap(Environment *env) const {
     string name = BaseName() + "[]";
     bool is_primitive = false;
@@ -967,26 +2020,48 @@ class Factory : public FactoryBase {
   }
 
   /// The method used by the \link REGISTER_NAMED \endlink macro to ensure
-  /// that subclasses add themselves to the factory.
+  /// that subclasses add themselves to the factory.  Registration may
+  /// happen at any time, concurrently with lookups and construction:
+  /// each registration publishes a new immutable table of constructors,
+  /// so that lookups never lock, and the table it replaces is reclaimed
+  /// once no thread uses it any more.
   ///
-  /// \param type the type to be registered
-  /// \param p    the constructor for the specified type
+  /// \param type      the type to be registered
+  /// \param p         the constructor for the specified type
+  /// \param shareable whether instances of the specified type are
+  ///                  immutable once constructed, such that \link
+  ///                  CreateOrDie \endlink may return the same instance
+  ///                  for every spec with the same member values (see
+  ///                  \link REGISTER_SHAREABLE_NAMED\endlink)
   static const Constructor<T> *Register(const string &type,
-                                        const Constructor<T> *p) {
+                                        const Constructor<T> *p,
+                                        bool shareable = false) {
+    std::lock_guard<std::mutex> lock(FactoryContainer::registry_mutex());
+    shared_ptr<const ConsTable> table = std::atomic_load(&cons_table());
+    if (table != nullptr) {
+      typename ConsMap::const_iterator cons_it =
+          table->constructors.find(type);
+      if (cons_it != table->constructors.end()) {
+        delete p;
+        return cons_it->second.constructor;
+      }
+    }
+    shared_ptr<ConsTable> new_table = std::make_shared<ConsTable>();
+    if (table != nullptr) {
+      new_table->constructors = table->constructors;
+    }
+    ConsEntry &entry = new_table->constructors[type];
+    entry.constructor = p;
+    entry.shareable = shareable;
+    entry.schema = new std::atomic<const MemberSchema *>(nullptr);
+    std::atomic_store(&cons_table(), shared_ptr<const ConsTable>(new_table));
     if (!initialized_) {
-      cons_table_ = new unordered_map<string, const Constructor<T> *>();
       initialized_ = 1;
-      FactoryContainer::Add(new Factory<T>());
-    }
-    typename unordered_map<string, const Constructor<T> *>::iterator cons_it =
-        cons_table_->find(type);
-    if (cons_it == cons_table_->end()) {
-      (*cons_table_)[type] = p;
-      return p;
+      FactoryContainer::AddLocked(new Factory<T>());
     } else {
-      delete p;
-      return cons_it->second;
+      FactoryContainer::generation_.fetch_add(1, std::memory_order_release);
     }
+    return p;
   }
 
   /// Clears all static data associated with this class.
@@ -995,31 +2070,215 @@ class Factory : public FactoryBase {
   /// It should only be invoked when the factory is no longer needed by
   /// the current process.
   static void ClearStatic() {
-    if (initialized_) {
-      for (typename unordered_map<string, const Constructor<T> *>::iterator it =
-               cons_table_->begin();
-           it != cons_table_->end();
+    shared_ptr<const ConsTable> table = std::atomic_load(&cons_table());
+    if (table != nullptr) {
+      for (typename ConsMap::const_iterator it = table->constructors.begin();
+           it != table->constructors.end();
            ++it) {
-        delete it->second;
+        delete it->second.constructor;
+        delete it->second.schema->load(std::memory_order_relaxed);
+        delete it->second.schema;
       }
-      delete cons_table_;
-      initialized_ = 0;
     }
+    std::atomic_store(&cons_table(), shared_ptr<const ConsTable>());
+    // Makes every thread drop the table it last used.
+    FactoryContainer::generation_.fetch_add(1, std::memory_order_release);
+    initialized_ = 0;
+    SharedInstances &shared = shared_instances();
+    std::lock_guard<std::mutex> shared_lock(shared.mutex);
+    shared.instances.clear();
   }
  private:
+  /// The constructor registered for a concrete type, along with the
+  /// schema of the members of that type, built when first needed.
+  struct ConsEntry {
+    /// The constructor for the concrete type.
+    const Constructor<T> *constructor;
+    /// Whether instances of the concrete type may be shared among all
+    /// identical specs.
+    bool shareable;
+    /// The schema of the members of the concrete type, or
+    /// <tt>nullptr</tt> if it has yet to be built; the slot itself is
+    /// shared by every table containing this entry.
+    std::atomic<const MemberSchema *> *schema;
+  };
+
+  typedef unordered_map<string, ConsEntry> ConsMap;
+
+  /// An immutable table of the constructors registered with this factory.
+  struct ConsTable {
+    /// The constructors, keyed by the names of their concrete types.
+    ConsMap constructors;
+  };
+
+  /// The table of constructors a thread last used, which the thread
+  /// keeps alive until the registered types change, so that lookups
+  /// need neither lock nor modify the reference count of the table.
+  struct TableCache {
+    constexpr TableCache() : generation(~static_cast<uint64_t>(0)) { }
+    ~TableCache() { table_cache_alive() = false; }
+
+    /// The \link FactoryContainer::generation generation\endlink of the
+    /// registry when the table was loaded.
+    uint64_t generation;
+    /// The table.
+    shared_ptr<const ConsTable> table;
+  };
+
+  /// The instances of shareable types constructed so far, keyed by the
+  /// encodings of their types and member values.
+  struct SharedInstances {
+    SharedInstances() : prune_size(64) { }
+    std::mutex mutex;
+    unordered_map<string, std::weak_ptr<T> > instances;
+    /// The number of instances at which expired ones are next removed.
+    size_t prune_size;
+  };
+
+  /// Returns the instances of shareable types, which are never destroyed
+  /// so that objects may be constructed during static destruction.
+  static SharedInstances &shared_instances() {
+    static SharedInstances *shared = new SharedInstances();
+    return *shared;
+  }
+
+  /// Returns the instance previously constructed with the specified key,
+  /// if it is still in use, or else a null pointer.
+  static shared_ptr<T> FindSharedInstance(const string &key) {
+    SharedInstances &shared = shared_instances();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    typename unordered_map<string, std::weak_ptr<T> >::const_iterator it =
+        shared.instances.find(key);
+    return it == shared.instances.end() ? shared_ptr<T>() : it->second.lock();
+  }
+
+  /// Returns the instance previously constructed with the specified key,
+  /// if it is still in use, or else records the specified new instance
+  /// under that key and returns a null pointer.
+  static shared_ptr<T> ShareInstance(const string &key,
+                                     const shared_ptr<T> &instance) {
+    SharedInstances &shared = shared_instances();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    std::weak_ptr<T> &slot = shared.instances[key];
+    shared_ptr<T> existing = slot.lock();
+    if (existing != nullptr) {
+      return existing;
+    }
+    slot = instance;
+    if (shared.instances.size() >= shared.prune_size) {
+      for (typename unordered_map<string, std::weak_ptr<T> >::iterator it =
+               shared.instances.begin();
+           it != shared.instances.end(); ) {
+        if (it->second.expired()) {
+          it = shared.instances.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      shared.prune_size = 2 * shared.instances.size() + 64;
+    }
+    return shared_ptr<T>();
+  }
+
+  /// Finds the entry registered for the specified concrete type,
+  /// without locking.  The entry is copied, since the table holding it
+  /// may be reclaimed once a later lookup loads a newer table.
+  ///
+  /// \param type  the concrete type
+  /// \param entry the entry to which to copy the entry found
+  /// \return whether the specified type is registered
+  static bool FindEntry(const string &type, ConsEntry *entry) {
+    shared_ptr<const ConsTable> loaded_table;
+    const ConsTable *table;
+    if (table_cache_alive()) {
+      TableCache &cache = table_cache();
+      uint64_t generation = FactoryContainer::generation();
+      if (cache.generation != generation) {
+        cache.table = std::atomic_load(&cons_table());
+        cache.generation = generation;
+      }
+      table = cache.table.get();
+    } else {
+      // The calling thread is exiting.
+      loaded_table = std::atomic_load(&cons_table());
+      table = loaded_table.get();
+    }
+    if (table == nullptr) {
+      return false;
+    }
+    typename ConsMap::const_iterator cons_it = table->constructors.find(type);
+    if (cons_it == table->constructors.end()) {
+      return false;
+    }
+    *entry = cons_it->second;
+    return true;
+  }
+
+  /// Returns the current table of constructors, or <tt>nullptr</tt> if
+  /// no type has been registered, which is only accessed atomically.
+  /// It is never destroyed, so that objects may be constructed during
+  /// static destruction.
+  static shared_ptr<const ConsTable> &cons_table() {
+    static shared_ptr<const ConsTable> *table =
+        new shared_ptr<const ConsTable>();
+    return *table;
+  }
+
+  /// Returns the table of constructors the calling thread last used.
+  static TableCache &table_cache() {
+    static thread_local TableCache cache;
+    return cache;
+  }
+
+  /// Returns whether the \link table_cache\endlink of the calling
+  /// thread has yet to be destroyed as the thread exits.
+  static bool &table_cache_alive() {
+    static thread_local bool alive = true;
+    return alive;
+  }
+
+  /// Returns the schema of the members of the concrete type of the
+  /// specified entry, building it if this is the first time it is needed.
+  static const MemberSchema *GetSchema(const ConsEntry &entry) {
+    const MemberSchema *schema =
+        entry.schema->load(std::memory_order_acquire);
+    if (schema != nullptr) {
+      return schema;
+    }
+    MemberSchema *new_schema = BuildSchema(entry.constructor);
+    if (entry.schema->compare_exchange_strong(schema, new_schema,
+                                              std::memory_order_acq_rel)) {
+      return new_schema;
+    }
+    // Another thread built the schema first.
+    delete new_schema;
+    return schema;
+  }
+
+  /// Builds the schema of the members of instances constructed by the
+  /// specified constructor, from the initializers registered by a
+  /// prototype instance.  Offsets of members are measured from the
+  /// address of the <tt>T</tt> subobject of the prototype.
+  static MemberSchema *BuildSchema(const Constructor<T> *constructor) {
+    shared_ptr<T> prototype(constructor->NewInstance());
+    std::unique_ptr<Initializers> initializers(new Initializers());
+    prototype->RegisterInitializers(*initializers);
+    const T *object = prototype.get();
+    return new MemberSchema(
+        prototype, object, std::move(initializers),
+        [constructor, object](const void *address) {
+          return constructor->Contains(object, address);
+        });
+  }
+
   // data members
-  /// Initialization flag.
+  /// Whether this factory has been added to the \link FactoryContainer
+  /// \endlink; only accessed with the registry mutex held.
   static int initialized_;
-  /// Factory map of prototype objects.
-  static unordered_map<string, const Constructor<T> *> *cons_table_;
   static const char *base_name_;
 };
 
-// Initialize the templated static data member cons_table_ right here,
-// since the compiler will happily remove the duplicate definitions.
-template <typename T>
-unordered_map<string, const Constructor<T> *> *
-Factory<T>::cons_table_ = 0;
+
 
 /// A macro to define a subclass of \link infact::Constructor
 /// Constructor \endlink whose NewInstance method constructs an
@@ -1029,7 +2288,15 @@ Factory<T>::cons_table_ = 0;
 /// This is a helper macro used only by the <tt>REGISTER</tt> macro.
 #define DEFINE_CONS_CLASS(TYPE,NAME,BASE) \
   class NAME ## Constructor : public infact::Constructor<BASE> { \
-   public: virtual BASE *NewInstance() const { return new TYPE(); } };
+   public: virtual BASE *NewInstance() const { return new TYPE(); } \
+    virtual std::shared_ptr<BASE> NewShared( \
+        const std::shared_ptr<infact::Arena> &arena) const { \
+      if (arena == nullptr) { return std::shared_ptr<BASE>(new TYPE()); } \
+      return std::allocate_shared<TYPE>(infact::ArenaAllocator<TYPE>(arena)); \
+    } \
+    virtual bool Contains(const BASE *instance, const void *address) const { \
+      return infact::ObjectContains<TYPE>(instance, address); \
+    } };
 
 /// This macro registers the concrete subtype \a TYPE with the
 /// specified factory for instances of type \a BASE; the \a TYPE is
@@ -1046,6 +2313,23 @@ Factory<T>::cons_table_ = 0;
   static const infact::Constructor<BASE> *NAME ## _my_protoype = \
       infact::Factory<BASE>::Register(string(#NAME), new NAME ## Constructor());
 
+/// This macro registers the concrete subtype \a TYPE exactly as \link
+/// REGISTER_NAMED \endlink does, additionally declaring that instances
+/// of \a TYPE are immutable once constructed (including by their
+/// <tt>PostInit</tt> methods) and depend only on their member values.
+/// \link infact::Factory::CreateOrDie Factory::CreateOrDie \endlink
+/// then returns the same instance for every spec of \a TYPE whose
+/// members are initialized to the same values, for as long as that
+/// instance is in use, rather than constructing a new one each time.
+/// Members that are themselves objects have the same value only if they
+/// are the same object, so shareable subtrees of a spec are shared as a
+/// whole.
+#define REGISTER_SHAREABLE_NAMED(TYPE,NAME,BASE)  \
+  DEFINE_CONS_CLASS(TYPE,NAME,BASE) \
+  static const infact::Constructor<BASE> *NAME ## _my_protoype = \
+      infact::Factory<BASE>::Register(string(#NAME), \
+                                      new NAME ## Constructor(), true);
+
 /// Provides the necessary implementation for a factory for the specified
 /// <tt>BASE</tt> class type.
 #define IMPLEMENT_FACTORY(BASE) \
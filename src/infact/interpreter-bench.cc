@@ -0,0 +1,112 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Benchmark for the \link infact::Interpreter Interpreter \endlink
+/// class, evaluating synthetic workloads.
+///
+/// Usage: <tt>interpreter-bench [scale [workload]]</tt>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "bench-util.h"
+#include "interpreter.h"
+
+using namespace std;
+using namespace infact;
+
+int
+main(int argc, char **argv) {
+  vector<BenchWorkload> workloads = StandardWorkloads(ParseScale(argc, argv));
+  size_t num_threads = std::max(2u, thread::hardware_concurrency());
+  for (vector<BenchWorkload>::const_iterator it = workloads.begin();
+       it != workloads.end(); ++it) {
+    if (!SelectWorkload(argc, argv, it->name)) {
+      continue;
+    }
+    {
+      Interpreter interpreter;
+      BenchTimer timer;
+      interpreter.EvalString(it->text);
+      double seconds = timer.Seconds();
+      ReportRate(cout, "interpreter/eval", it->name, it->num_statements,
+                 "statements", seconds);
+      if (it->num_objects > 0) {
+        ReportRate(cout, "interpreter/eval", it->name, it->num_objects,
+                   "objects", seconds);
+      }
+    }
+    {
+      Interpreter interpreter;
+      interpreter.set_num_threads(num_threads);
+      BenchTimer timer;
+      interpreter.EvalString(it->text);
+      ReportRate(cout, "interpreter/parallel", it->name, it->num_statements,
+                 "statements", timer.Seconds());
+    }
+  }
+
+  // Repeatedly read a variable, as a request handler would, both by name
+  // and through a handle.
+  if (SelectWorkload(argc, argv, "lookup")) {
+    Interpreter interpreter;
+    interpreter.EvalString(FlatAssignments(1000).text +
+                           "double[] weights = {1.0, 2.0, 3.0, 4.0};");
+    size_t num_reads = 1000000 * ParseScale(argc, argv);
+    double sum = 0.0;
+    {
+      BenchTimer timer;
+      vector<double> weights;
+      for (size_t i = 0; i < num_reads; ++i) {
+        interpreter.Get("weights", &weights);
+        sum += weights[i % weights.size()];
+      }
+      ReportRate(cout, "interpreter/get", "lookup", num_reads, "reads",
+                 timer.Seconds());
+    }
+    {
+      BenchTimer timer;
+      VarHandle<vector<double> > weights =
+          interpreter.GetHandle<vector<double> >("weights");
+      for (size_t i = 0; i < num_reads; ++i) {
+        sum += (*weights)[i % weights->size()];
+      }
+      ReportRate(cout, "interpreter/handle", "lookup", num_reads, "reads",
+                 timer.Seconds());
+    }
+    if (sum < 0.0) {
+      cout << sum << endl;
+    }
+  }
+}
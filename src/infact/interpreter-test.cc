@@ -32,14 +32,1576 @@
 /// Test driver for the Interpreter class.
 /// \author dbikel@google.com (Dan Bikel)
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <sstream>
+#include <thread>
 
+#include "example.h"
 #include "interpreter.h"
+#include "nesting.h"
+#include "stats.h"
+#include "sweep.h"
+
+namespace infact {
+
+/// A list of nodes, whose specs are nested as deeply as the list is
+/// long, for testing deeply nested specs.
+class Node : public FactoryConstructible {
+ public:
+  /// Destroys this node and, one after another rather than
+  /// recursively, the nodes following it that no one else refers to.
+  virtual ~Node() {
+    while (next_ != nullptr && next_.unique()) {
+      shared_ptr<Node> next = std::move(next_->next_);
+      next_ = std::move(next);
+    }
+  }
+
+  virtual void RegisterInitializers(Initializers &initializers) {
+    INFACT_ADD_PARAM_(next);
+  }
+
+  /// Returns the node following this one, or <tt>nullptr</tt>.
+  const shared_ptr<Node> &next() const { return next_; }
+
+ private:
+  shared_ptr<Node> next_;
+};
+
+/// The only concrete type of Node.
+class Link : public Node { };
+
+IMPLEMENT_FACTORY(Node)
+REGISTER_NAMED(Link, Link, Node)
+
+/// A gauge, which counts how often gauges register their members, for
+/// testing that objects are initialized without registering them.
+class Gauge : public FactoryConstructible {
+ public:
+  virtual ~Gauge() { }
+
+  virtual void RegisterInitializers(Initializers &initializers) {
+    ++registrations;
+    initializers.set_per_instance(PerInstance());
+    INFACT_ADD_PARAM_(level);
+    INFACT_ADD_TEMPORARY(string, unit);
+  }
+
+  /// Returns the level of this gauge.
+  virtual int level() const { return level_; }
+
+  /// The number of times any gauge has registered its members.
+  static int registrations;
+
+ protected:
+  /// Returns whether every gauge of this type registers its members.
+  virtual bool PerInstance() const { return false; }
+
+  int level_ = 0;
+};
+
+int Gauge::registrations = 0;
+
+/// A gauge described once for all instances.
+class Dial : public Gauge { };
+
+/// A gauge every instance of which registers its members.
+class Knob : public Gauge {
+ protected:
+  virtual bool PerInstance() const { return true; }
+};
+
+IMPLEMENT_FACTORY(Gauge)
+REGISTER_NAMED(Dial, Dial, Gauge)
+REGISTER_NAMED(Knob, Knob, Gauge)
+
+/// A tag, which keeps the view of the spec with which each tag is
+/// initialized, for testing the views received by <tt>PostInitView</tt>.
+class Tag : public FactoryConstructible {
+ public:
+  virtual ~Tag() { }
+
+  virtual void RegisterInitializers(Initializers &initializers) {
+    INFACT_ADD_PARAM_(label);
+    INFACT_ADD_PARAM_(inner);
+  }
+
+  virtual void PostInitView(const Environment *env,
+                            const StringPiece &init_str) {
+    views.push_back(init_str.ToString());
+  }
+
+  /// The views received by every tag, in the order they were received.
+  static vector<string> views;
+
+ private:
+  string label_;
+  shared_ptr<Tag> inner_;
+};
+
+vector<string> Tag::views;
+
+/// The only concrete type of Tag.
+class NamedTag : public Tag { };
+
+IMPLEMENT_FACTORY(Tag)
+REGISTER_NAMED(NamedTag, NamedTag, Tag)
+
+/// Dates constructed once for every distinct spec.
+REGISTER_SHAREABLE_NAMED(DateImpl, SharedDate, Date)
+
+/// Constructs links, for registering types of nodes at run time.
+class RuntimeLinkConstructor : public Constructor<Node> {
+ public:
+  virtual Node *NewInstance() const { return new Link(); }
+};
+
+}  // namespace infact
 
 using namespace std;
 using namespace infact;
 
+namespace {
+
+/// The number of hard-coded tests that have failed.
+int num_failures = 0;
+
+/// Reports the outcome of a hard-coded test.
+void
+Check(bool passed, const string &description) {
+  cout << (passed ? "passed: " : "FAILED: ") << description << endl;
+  if (!passed) {
+    ++num_failures;
+  }
+}
+
+/// Replaces the contents of the specified file.
+void
+WriteFile(const string &filename, const string &contents) {
+  ofstream file(filename.c_str(), ios::binary);
+  file << contents;
+}
+
+/// Returns the environment of the specified interpreter as printed by
+/// \link infact::Interpreter::PrintEnv PrintEnv\endlink, without the
+/// addresses of its objects, which differ from one evaluation to the
+/// next.
+string
+PrintedEnv(const Interpreter &interpreter) {
+  ostringstream oss;
+  interpreter.PrintEnv(oss);
+  string printed = oss.str();
+  for (size_t pos = printed.find(":0x"); pos != string::npos;
+       pos = printed.find(":0x", pos + 1)) {
+    size_t end = printed.find('>', pos);
+    printed.erase(pos, end - pos);
+  }
+  return printed;
+}
+
+/// Evaluates the specified statements with the specified interpreter,
+/// returning what it reports of any error rather than printing it.
+string
+EvalReportingErrors(Interpreter &interpreter, const string &input) {
+  ostringstream errors;
+  streambuf *cerr_buf = cerr.rdbuf(errors.rdbuf());
+  interpreter.EvalString(input);
+  cerr.rdbuf(cerr_buf);
+  return errors.str();
+}
+
+/// Returns the name of the animal held by the specified variable, or the
+/// empty string if there is no such animal.
+string
+AnimalName(Interpreter &interpreter, const string &varname) {
+  shared_ptr<Animal> animal;
+  return interpreter.Get(varname, &animal) && animal ? animal->name() : "";
+}
+
+/// Tests that \link infact::Interpreter::EvalWithSnapshot
+/// EvalWithSnapshot\endlink loads exactly what evaluating a file would
+/// produce, and only from a valid snapshot of that file.
+void
+TestSnapshots() {
+  const string filename = "interpreter-test-snapshot.infact";
+  const string snapshot_filename = "interpreter-test-snapshot.snap";
+  WriteFile(filename, "int i = 7;\n"
+            "double[] ds = {1.5, -2.0};\n"
+            "string s = \"x\\\"y\";\n"
+            "bool[] bs = {true, false};\n"
+            "Animal c = Cow(name(s), age(i));\n"
+            "Animal[] as = {c, Sheep(name(\"z\"))};\n");
+  remove(snapshot_filename.c_str());
+
+  Interpreter evaluated;
+  bool loaded = evaluated.EvalWithSnapshot(filename, snapshot_filename);
+  Check(!loaded && AnimalName(evaluated, "c") == "x\"y",
+        "EvalWithSnapshot evaluates a file without a snapshot");
+  Interpreter restored;
+  loaded = restored.EvalWithSnapshot(filename, snapshot_filename);
+  Check(loaded && PrintedEnv(restored) == PrintedEnv(evaluated),
+        "EvalWithSnapshot restores the results of evaluating a file");
+
+  // A snapshot of a file is not valid for the file once modified.
+  WriteFile(filename, "int i = 8;\n");
+  Interpreter modified;
+  loaded = modified.EvalWithSnapshot(filename, snapshot_filename);
+  int i = 0;
+  Check(!loaded && modified.Get("i", &i) && i == 8,
+        "EvalWithSnapshot evaluates a file modified since its snapshot");
+
+  // Nor is a truncated snapshot.
+  string snapshot;
+  {
+    ifstream file(snapshot_filename.c_str(), ios::binary);
+    snapshot.assign(istreambuf_iterator<char>(file),
+                    istreambuf_iterator<char>());
+  }
+  WriteFile(snapshot_filename, snapshot.substr(0, snapshot.size() / 2));
+  Interpreter truncated;
+  Check(!truncated.LoadSnapshot(filename, snapshot_filename) &&
+        !truncated.Get("i", &i),
+        "LoadSnapshot rejects a truncated snapshot");
+
+  // No snapshot is written of a file whose evaluation fails, even if
+  // its statements are evaluated concurrently.
+  WriteFile(filename, "int i = 1;\nint j = 2;\nint k = ;\nint l = 4;\n");
+  remove(snapshot_filename.c_str());
+  for (size_t num_threads = 0; num_threads <= 4; num_threads += 4) {
+    Interpreter failed;
+    failed.set_num_threads(num_threads);
+    failed.EvalWithSnapshot(filename, snapshot_filename);
+    Interpreter again;
+    again.set_num_threads(num_threads);
+    loaded = again.EvalWithSnapshot(filename, snapshot_filename);
+    Check(!loaded && !ifstream(snapshot_filename.c_str()).good(),
+          string("EvalWithSnapshot writes no snapshot after an error with ") +
+          (num_threads == 0 ? "one thread" : "several threads"));
+  }
+
+  remove(filename.c_str());
+  remove(snapshot_filename.c_str());
+}
+
+/// Tests that evaluating statements concurrently (see \link
+/// infact::Interpreter::set_num_threads set_num_threads\endlink) has
+/// exactly the results of evaluating them one after another, errors
+/// included.
+void
+TestParallelEval() {
+  const char *inputs[] = {
+    "int a = 1; int b = a; string c = \"x\"; int d = b; a = 5;\n"
+    "Animal e = Cow(name(c), age(a)); Animal[] f = {e, Sheep(name(c))};\n"
+    "c = \"y\"; Animal g = Cow(name(c)); PetOwner h = "
+    "HumanPetOwner(pets(f));\n",
+    "int a = 1;\nint b = 2\nint c = 3;\n",
+    "int a = 1;\nAnimal c = Cow(age(3));\nint d = a;\n",
+    "int a = 1;\nint b = ;\n",
+    "int a = 1;\nint b = a 3;\n",
+    "int a = 1;\nint b = \"x\";\nint c = a;\n",
+    "int a = 1;\nint b = 2",
+    "int a = 1;\nstring s = \"unterminated",
+  };
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    Interpreter sequential;
+    string sequential_errors = EvalReportingErrors(sequential, inputs[i]);
+    bool matches = true;
+    for (size_t num_threads = 2; num_threads <= 8; num_threads *= 2) {
+      Interpreter parallel;
+      parallel.set_num_threads(num_threads);
+      string parallel_errors = EvalReportingErrors(parallel, inputs[i]);
+      matches = matches && parallel_errors == sequential_errors &&
+          PrintedEnv(parallel) == PrintedEnv(sequential);
+    }
+    ostringstream description;
+    description << "evaluating input " << i << " with 2, 4 and 8 threads "
+                << "matches evaluating it sequentially";
+    Check(matches, description.str());
+  }
+}
+
+/// Tests that \link infact::Validator Validator\endlink accepts what
+/// evaluates without error, and reports every problem of what does not
+/// just as evaluating it would report it.
+void
+TestValidator() {
+  Validator validator;
+  vector<Diagnostic> diagnostics;
+  bool valid = validator.ValidateString(
+      "int i = 1; double[] ds = {1.5, 2.0}; string s = \"x\";\n"
+      "Animal c = Cow(name(s), age(i)); Animal[] as = {c, nullptr};\n"
+      "PetOwner p = HumanPetOwner(pets(as));\n", &diagnostics);
+  Check(valid && diagnostics.empty(), "Validator accepts a valid input");
+
+  // Each message is that of the error evaluating the statement reports.
+  const char *invalid_statements[] = {
+    "double b = 2;",
+    "int a = {1};",
+    "int[] a = 1;",
+    "double[] v = {1, 2};",
+    "int[] d = {1, 2.5};",
+    "v = {1, \"x\"};",
+  };
+  for (size_t i = 0;
+       i < sizeof(invalid_statements) / sizeof(invalid_statements[0]); ++i) {
+    diagnostics.clear();
+    valid = validator.ValidateString(invalid_statements[i], &diagnostics);
+    Interpreter interpreter;
+    string errors = EvalReportingErrors(interpreter, invalid_statements[i]);
+    Check(!valid && diagnostics.size() == 1 &&
+          errors.find(diagnostics[0].message) != string::npos,
+          string("Validator reports the error of ") + invalid_statements[i]);
+  }
+
+  // Validation resumes after each erroneous statement.
+  diagnostics.clear();
+  valid = validator.ValidateString("int a = 1;\n"
+                                   "double b = a;\n"
+                                   "c = undefined;\n"
+                                   "d = Goat(name(\"g\"));\n"
+                                   "e = a;\n", &diagnostics);
+  Check(!valid && diagnostics.size() == 3 &&
+        diagnostics[0].line_number == 2 && diagnostics[1].line_number == 3 &&
+        diagnostics[2].line_number == 4,
+        "Validator reports every erroneous statement");
+
+  // Validating interns none of the names of the input.
+  size_t num_symbols = SymbolTable::size();
+  diagnostics.clear();
+  valid = validator.ValidateString(
+      "int validator_fresh_i = 1;\n"
+      "validator_fresh_j = validator_fresh_i;\n"
+      "Animal[] validator_fresh_h = {\n"
+      "  for validator_fresh_n in {\"a\"} Cow(name(validator_fresh_n))\n"
+      "};\n"
+      "validator_fresh_type validator_fresh_k = 1;\n"
+      "validator_fresh_l = validator_fresh_undefined;\n"
+      "validator_fresh_m = Cow(validator_fresh_member(1));\n",
+      &diagnostics);
+  Check(!valid && diagnostics.size() == 3 && diagnostics[0].line_number == 6 &&
+        SymbolTable::size() == num_symbols,
+        "Validator interns no names");
+}
+
+/// Feeds the specified statements to the specified interpreter the
+/// specified number of bytes at a time (see \link
+/// infact::Interpreter::Feed Feed\endlink), returning what it reports
+/// of any error rather than printing it.
+string
+FeedReportingErrors(Interpreter &interpreter, const string &input,
+                    size_t chunk_size) {
+  ostringstream errors;
+  streambuf *cerr_buf = cerr.rdbuf(errors.rdbuf());
+  for (size_t pos = 0; pos < input.size(); pos += chunk_size) {
+    interpreter.Feed(input.data() + pos,
+                     std::min(chunk_size, input.size() - pos));
+  }
+  interpreter.Finish();
+  cerr.rdbuf(cerr_buf);
+  return errors.str();
+}
+
+/// Tests that feeding statements to an interpreter piece by piece has
+/// exactly the results of evaluating them at once, errors included.
+void
+TestFeed() {
+  const char *inputs[] = {
+    "int a = 1; string b = \"x;y\\\"; // c;\"; // not; a statement\n"
+    "int c = a; double[] d = {1.5, 2.5};\n"
+    "Animal e = Cow(name(b)); Animal[] f = {e, Sheep(name(\"s\"))};\n",
+    "int a = 1;\nint b = 2\nint c = 3;\n",
+    "int a = 1;\nint b = 2;\nAnimal c = Cow(age(3));\n",
+    "int a = 1;\nint b = 2",
+    "int a = 1;\nstring s = \"unterminated",
+  };
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    Interpreter evaluated;
+    string eval_errors = EvalReportingErrors(evaluated, inputs[i]);
+    bool matches = true;
+    const size_t chunk_sizes[] = { 1, 2, 3, 7, 1000 };
+    for (size_t j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+         ++j) {
+      Interpreter fed;
+      string feed_errors = FeedReportingErrors(fed, inputs[i], chunk_sizes[j]);
+      matches = matches && feed_errors == eval_errors &&
+          PrintedEnv(fed) == PrintedEnv(evaluated);
+    }
+    ostringstream description;
+    description << "feeding input " << i << " matches evaluating it";
+    Check(matches, description.str());
+  }
+
+  // Statements are evaluated as soon as they are complete, and an error
+  // stops evaluation until the stream is finished.
+  Interpreter interpreter;
+  const string input = "int a = 1; int b";
+  bool fed = interpreter.Feed(input.data(), input.size());
+  int value = 0;
+  Check(fed && interpreter.Get("a", &value) && value == 1 &&
+        !interpreter.Get("b", &value),
+        "Feed evaluates complete statements only");
+  const string erroneous = " = 2; int c = ;";
+  ostringstream errors;
+  streambuf *cerr_buf = cerr.rdbuf(errors.rdbuf());
+  fed = interpreter.Feed(erroneous.data(), erroneous.size());
+  cerr.rdbuf(cerr_buf);
+  const string more = "int d = 4;";
+  bool fed_more = interpreter.Feed(more.data(), more.size());
+  bool finished = interpreter.Finish();
+  Check(!fed && !fed_more && !finished && interpreter.Get("b", &value) &&
+        value == 2 && !interpreter.Get("d", &value),
+        "Feed evaluates nothing once it reports an error");
+  fed = interpreter.Feed(more.data(), more.size());
+  finished = interpreter.Finish();
+  Check(fed && finished && interpreter.Get("d", &value) && value == 4,
+        "Feed evaluates a new stream once the last one is finished");
+}
+
+/// Tests that memory-mapped arrays (see \link infact::ArrayView
+/// ArrayView\endlink) hold exactly the contents of their files, which
+/// must be of a whole number of elements.
+void
+TestMappedArrays() {
+  const string filename = "interpreter-test-mapped.f64";
+  const string odd_filename = "interpreter-test-mapped.odd";
+  vector<double> values;
+  for (int i = 0; i < 100; ++i) {
+    values.push_back(i * 0.5);
+  }
+  WriteFile(filename, string(reinterpret_cast<const char *>(values.data()),
+                             values.size() * sizeof(double)));
+  WriteFile(odd_filename, "abc");
+
+  Interpreter interpreter;
+  interpreter.EvalString("double_view w = @mmap(\"" + filename + "\");\n"
+                         "double_view w2 = w;\n"
+                         "int_view iv = @mmap(\"" + filename + "\");\n");
+  ArrayView<double> w, w2;
+  ArrayView<int> iv;
+  Check(interpreter.Get("w", &w) && w.ToVector() == values,
+        "a double_view holds the contents of its file");
+  Check(interpreter.Get("w2", &w2) && w2 == w && w2.data() == w.data(),
+        "assigning a view shares its mapping");
+  Check(interpreter.Get("iv", &iv) &&
+        iv.size() == values.size() * sizeof(double) / sizeof(int),
+        "an int_view holds as many ints as fit in its file");
+
+  const string invalid_statements[] = {
+    "x = @mmap(\"" + filename + "\");",
+    "int x = @mmap(\"" + filename + "\");",
+    "double_view x = @mmap(\"" + odd_filename + "\");",
+    "double_view x = @mmap(\"interpreter-test-nonexistent.f64\");",
+  };
+  for (size_t i = 0;
+       i < sizeof(invalid_statements) / sizeof(invalid_statements[0]); ++i) {
+    Interpreter invalid_interpreter;
+    string errors =
+        EvalReportingErrors(invalid_interpreter, invalid_statements[i]);
+    ArrayView<double> x;
+    Check(!errors.empty() && !invalid_interpreter.Get("x", &x),
+          "mapping fails for " + invalid_statements[i]);
+  }
+
+  remove(filename.c_str());
+  remove(odd_filename.c_str());
+}
+
+/// Tests that an imported file is evaluated once for all its importers,
+/// again once changed, and on its own.
+void
+TestImport() {
+  const string common_filename = "interpreter-test-common.infact";
+  const string importer_filename = "interpreter-test-importer.infact";
+  const string circular_filename = "interpreter-test-circular.infact";
+  WriteFile(common_filename, "string n = \"shared\";\nint k = 3;\n"
+            "Animal cow = Cow(name(n));\n");
+  WriteFile(importer_filename, "import \"" + common_filename + "\";\n"
+            "int j = k;\nAnimal a = cow;\nint import = 4;\n");
+  WriteFile(circular_filename, "import \"" + circular_filename + "\";\n"
+            "int x = 1;\n");
+
+  ModuleCache::Global().Clear();
+  Interpreter first, second, parallel;
+  first.Eval(importer_filename);
+  second.Eval(importer_filename);
+  parallel.set_num_threads(4);
+  parallel.Eval(importer_filename);
+  shared_ptr<Animal> first_cow, second_cow, first_a;
+  first.Get("cow", &first_cow);
+  second.Get("cow", &second_cow);
+  first.Get("a", &first_a);
+  int j = 0, import = 0;
+  Check(ModuleCache::Global().size() == 1 && first_cow != nullptr &&
+        first_cow == second_cow && first_cow == first_a,
+        "importers of a file share the objects it defines");
+  Check(first.Get("j", &j) && j == 3 && first.Get("import", &import) &&
+        import == 4, "importers refer to the variables of imported files");
+  Check(PrintedEnv(parallel) == PrintedEnv(first),
+        "importing with several threads matches importing sequentially");
+
+  WriteFile(common_filename, "string n = \"changed\";\nint k = 5;\n"
+            "Animal cow = Cow(name(n));\n");
+  Interpreter changed;
+  changed.Eval(importer_filename);
+  Check(changed.Get("j", &j) && j == 5 &&
+        AnimalName(changed, "cow") == "changed",
+        "a changed file is evaluated again");
+
+  Interpreter timed;
+  timed.set_collect_stats(true);
+  timed.Eval(importer_filename);
+  vector<StatementStats> statements = timed.stats().statements();
+  Check(!statements.empty() &&
+        statements[0].varname == "import " + common_filename &&
+        statements[0].line_number == 0,
+        "statistics name each import statement");
+
+  Interpreter isolated;
+  string errors = EvalReportingErrors(
+      isolated, "string n = \"mine\"; import \"" + common_filename + "\";");
+  Check(errors.empty() && AnimalName(isolated, "cow") == "changed",
+        "imported files do not see the variables of their importers");
+
+  Interpreter circular;
+  errors = EvalReportingErrors(circular,
+                               "import \"" + circular_filename + "\";");
+  int x = 0;
+  Check(!errors.empty() && !circular.Get("x", &x), "circular imports fail");
+
+  // Threads importing a file at once share a single evaluation of it.
+  ModuleCache::Global().Clear();
+  string herd = "int k = 1;\nAnimal cow = Cow(name(\"first\"));\n";
+  for (int i = 0; i < 500; ++i) {
+    herd += "Animal cow = Cow(name(\"herd\"));\n";
+  }
+  WriteFile(common_filename, herd);
+  vector<shared_ptr<Animal> > cows(8);
+  vector<thread> threads;
+  for (size_t i = 0; i < cows.size(); ++i) {
+    threads.push_back(thread([&cows, &importer_filename, i]() {
+          Interpreter importer;
+          importer.Eval(importer_filename);
+          importer.Get("cow", &cows[i]);
+        }));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  bool shared = ModuleCache::Global().size() == 1;
+  for (size_t i = 0; i < cows.size(); ++i) {
+    shared = shared && cows[i] != nullptr && cows[i] == cows[0];
+  }
+  Check(shared, "threads importing a file at once share its objects");
+
+  ModuleCache::Global().Clear();
+  remove(common_filename.c_str());
+  remove(importer_filename.c_str());
+  remove(circular_filename.c_str());
+}
+
+/// Tests that \link infact::Interpreter::EvalBatch EvalBatch\endlink
+/// evaluates each file exactly as an interpreter of its own starting
+/// with the base environment would.
+void
+TestEvalBatch() {
+  Interpreter base;
+  base.EvalString("string n = \"base\"; Animal shared = Cow(name(n));");
+  shared_ptr<Animal> shared;
+  base.Get("shared", &shared);
+
+  vector<string> filenames;
+  for (int i = 0; i < 6; ++i) {
+    ostringstream filename;
+    filename << "interpreter-test-batch-" << i << ".infact";
+    filenames.push_back(filename.str());
+    ostringstream contents;
+    contents << "int i = " << i << ";\nAnimal c = Cow(name(n), age(i));\n";
+    if (i == 3) {
+      contents << "int x = ;\n";
+    }
+    WriteFile(filename.str(), contents.str());
+  }
+  filenames.push_back("interpreter-test-batch-nonexistent.infact");
+
+  vector<Interpreter::BatchResult> results;
+  ostringstream errors;
+  streambuf *cerr_buf = cerr.rdbuf(errors.rdbuf());
+  bool success = Interpreter::EvalBatch(filenames, base.env(), 3, &results);
+  cerr.rdbuf(cerr_buf);
+  bool results_match = !success && results.size() == filenames.size();
+  for (size_t i = 0; results_match && i < filenames.size(); ++i) {
+    Interpreter::BatchResult &result = results[i];
+    results_match = result.filename == filenames[i];
+    if (i == filenames.size() - 1) {
+      results_match = results_match && !result.success &&
+          !result.error.empty();
+      continue;
+    }
+    // Evaluate the file on its own, in an interpreter that imports the
+    // base environment.
+    ifstream file(filenames[i].c_str());
+    string contents((istreambuf_iterator<char>(file)),
+                    istreambuf_iterator<char>());
+    Interpreter alone;
+    alone.env()->Import(*base.env());
+    string alone_errors = EvalReportingErrors(alone, contents);
+    if (!alone_errors.empty()) {
+      results_match = results_match && !result.success &&
+          "threw exception: " + result.error + "\n" == alone_errors;
+      continue;
+    }
+    int value = -1;
+    shared_ptr<Animal> result_shared;
+    results_match = results_match && result.success &&
+        result.interpreter->Get("i", &value) && value == static_cast<int>(i) &&
+        result.interpreter->Get("shared", &result_shared) &&
+        result_shared == shared &&
+        AnimalName(*result.interpreter, "c") == AnimalName(alone, "c");
+  }
+  Check(results_match, "EvalBatch evaluates each file from the base");
+
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    remove(filenames[i].c_str());
+  }
+}
+
+/// Tests that an error in an element of a vector reports the index of
+/// the element.
+void
+TestVectorElementErrors() {
+  Interpreter interpreter;
+  string errors = EvalReportingErrors(
+      interpreter, "Animal[] v = {Cow(name(\"____v____\")), Cow(nme(\"x\"))};");
+  Check(errors.find("element 1 of variable v") != string::npos,
+        "errors in vector elements name the offending element");
+}
+
+/// Returns whether the specified literal of the specified type has the
+/// same value, or is an error alike, whether assigned on its own or
+/// read as the elements of a vector literal, and in that case assigns
+/// its value, if any, to the specified variable.
+template <typename T>
+bool
+LiteralsAgree(const string &type, const string &literal, T *value) {
+  Interpreter scalar_interpreter;
+  EvalReportingErrors(scalar_interpreter, "string a = \"z\";\n" + type +
+                      " x = " + literal + ";");
+  Interpreter vector_interpreter;
+  EvalReportingErrors(vector_interpreter, "string a = \"z\";\n" + type +
+                      "[] v = {" + literal + ", " + literal + "};");
+  T scalar = T();
+  vector<T> elements;
+  bool scalar_ok = scalar_interpreter.Get("x", &scalar);
+  bool vector_ok = vector_interpreter.Get("v", &elements);
+  if (!scalar_ok || !vector_ok) {
+    return !scalar_ok && !vector_ok;
+  }
+  *value = scalar;
+  return elements.size() == 2 && elements[0] == scalar &&
+      elements[1] == scalar;
+}
+
+/// Tests that literals of primitive types, which are read directly
+/// when they are the elements of vectors, have exactly the values they
+/// have when assigned on their own.
+void
+TestVectorLiterals() {
+  const char *int_literals[] = {
+    "0", "7", "-7", "+7", "-", "2147483647", "-2147483648", "2147483648",
+    "99999999999999999999", "-99999999999999999999", "1e3",
+  };
+  for (size_t i = 0; i < sizeof(int_literals) / sizeof(int_literals[0]);
+       ++i) {
+    // Out of range values are clamped, as by atoi.  An erroneous literal
+    // leaves the value unmodified.
+    int value = atoi(int_literals[i]);
+    bool agree = LiteralsAgree("int", int_literals[i], &value);
+    Check(agree && value == atoi(int_literals[i]),
+          string("int literals agree for ") + int_literals[i]);
+  }
+  const char *double_literals[] = {
+    "1.5", "-2.5", "+0.5", "1.0e3", "-.5", "3", "1e400",
+  };
+  for (size_t i = 0;
+       i < sizeof(double_literals) / sizeof(double_literals[0]); ++i) {
+    double value = 0.0;
+    Check(LiteralsAgree("double", double_literals[i], &value),
+          string("double literals agree for ") + double_literals[i]);
+  }
+  const char *string_literals[] = {
+    "\"x\"", "\"\"", "\"q\\\"uote\"", "\"a\"", "1",
+  };
+  for (size_t i = 0;
+       i < sizeof(string_literals) / sizeof(string_literals[0]); ++i) {
+    string value;
+    Check(LiteralsAgree("string", string_literals[i], &value),
+          string("string literals agree for ") + string_literals[i]);
+  }
+  const char *bool_literals[] = { "true", "false", "nullptr", "1" };
+  for (size_t i = 0; i < sizeof(bool_literals) / sizeof(bool_literals[0]);
+       ++i) {
+    bool value = false;
+    Check(LiteralsAgree("bool", bool_literals[i], &value),
+          string("bool literals agree for ") + bool_literals[i]);
+  }
+
+  // Literals may be mixed with variables.
+  Interpreter interpreter;
+  interpreter.EvalString("int i = 4; int[] v = {1, i, -3};");
+  vector<int> v;
+  Check(interpreter.Get("v", &v) && v.size() == 3 && v[0] == 1 &&
+        v[1] == 4 && v[2] == -3,
+        "vector literals may refer to variables");
+}
+
+/// Tests that \link infact::Interpreter::Reload Reload\endlink keeps
+/// exactly the values that would not change by evaluating a file anew.
+void
+TestReload() {
+  const string filename = "interpreter-test-reload.infact";
+  Interpreter interpreter;
+  interpreter.EvalString("string n = \"base\";");
+
+  WriteFile(filename, "Animal a = Cow(name(n));\n"
+            "Animal b = Cow(name(\"b\"));\n");
+  vector<string> rebound;
+  bool reloaded = interpreter.Reload(filename, &rebound);
+  Check(reloaded && rebound.size() == 2 &&
+        AnimalName(interpreter, "a") == "base",
+        "Reload evaluates a new file");
+  shared_ptr<Animal> old_b;
+  interpreter.Get("b", &old_b);
+
+  // Assigning n in the file shadows the n of the environment, so a must
+  // be evaluated again, even though its statement is unchanged.
+  WriteFile(filename, "string n = \"new\";\n"
+            "Animal a = Cow(name(n));\n"
+            "Animal b = Cow(name(\"b\"));\n");
+  reloaded = interpreter.Reload(filename, &rebound);
+  shared_ptr<Animal> new_b;
+  interpreter.Get("b", &new_b);
+  Check(reloaded && AnimalName(interpreter, "a") == "new",
+        "Reload re-evaluates statements whose variables become assigned");
+  Check(new_b == old_b, "Reload keeps unchanged statements");
+
+  // An erroneous file leaves the interpreter unmodified.
+  WriteFile(filename, "Animal a = Cow(name(n)) oops;\n");
+  reloaded = interpreter.Reload(filename, &rebound);
+  Check(!reloaded && rebound.empty() && AnimalName(interpreter, "a") == "new",
+        "Reload of an erroneous file has no effect");
+
+  remove(filename.c_str());
+}
+
+/// Returns the number of objects constructed as recorded by the
+/// specified statistics.
+uint64_t
+NumConstructions(const Stats &stats) {
+  uint64_t count = 0;
+  for (const auto &entry : stats.constructions()) {
+    count += entry.second.count;
+  }
+  return count;
+}
+
+/// Returns a description of the specified person, or the empty string
+/// if there is no such person.
+string
+DescribePerson(const shared_ptr<Person> &person) {
+  if (person == nullptr) {
+    return "";
+  }
+  ostringstream oss;
+  oss << person->name() << " " << person->cm_height();
+  shared_ptr<const Date> birthday = person->birthday();
+  if (birthday != nullptr) {
+    oss << " " << birthday->year() << "-" << birthday->month() << "-"
+        << birthday->day();
+  }
+  return oss.str();
+}
+
+/// Returns a description of the pets of the specified pet owner.
+string
+DescribePets(const shared_ptr<PetOwner> &owner) {
+  ostringstream oss;
+  for (int i = 0; i < owner->GetNumberOfPets(); ++i) {
+    shared_ptr<Animal> pet = owner->GetPet(i);
+    oss << (pet == nullptr ? "nullptr" : pet->name()) << " ";
+  }
+  return oss.str();
+}
+
+/// Tests that a spec compiled once constructs, every time it is
+/// instantiated, exactly what \link infact::Factory::CreateOrDie
+/// CreateOrDie \endlink constructs from the spec, and that errors are
+/// reported when compiling or instantiating.
+void
+TestCompiledSpecs() {
+  Interpreter interpreter;
+  interpreter.EvalString("string n = \"Fred\";\nint y = 1999;\n");
+  EnvironmentImpl *env = interpreter.env();
+
+  const string person_spec =
+      "PersonImpl(name(n), cm_height(180), "
+      "birthday(DateImpl(year(y), month(2), day(3))))";
+  Factory<Person> person_factory;
+  shared_ptr<const CompiledSpec<Person> > compiled_person =
+      person_factory.Compile(person_spec);
+  string created = DescribePerson(
+      person_factory.CreateOrDie(person_spec, "person", env));
+  bool agree = created == "Fred 180 1999-2-3";
+  for (int i = 0; i < 10; ++i) {
+    agree = agree &&
+        DescribePerson(compiled_person->Instantiate(env)) == created;
+  }
+  Check(agree, "instantiating a compiled spec matches CreateOrDie");
+
+  const string owner_spec =
+      "HumanPetOwner(pets({Cow(name(\"a\"), age(4)), "
+      "Sheep(name(\"s\"), counts({1, 2})), nullptr}))";
+  Factory<PetOwner> owner_factory;
+  shared_ptr<const CompiledSpec<PetOwner> > compiled_owner =
+      owner_factory.Compile(owner_spec);
+  shared_ptr<PetOwner> first = compiled_owner->Instantiate();
+  shared_ptr<PetOwner> second = compiled_owner->Instantiate();
+  Check(compiled_owner->type() == "HumanPetOwner" &&
+        DescribePets(first) == "a s nullptr " &&
+        DescribePets(first) ==
+        DescribePets(owner_factory.CreateOrDie(owner_spec, "owner")) &&
+        DescribePets(second) == DescribePets(first) &&
+        first->GetPet(0) != second->GetPet(0),
+        "each instantiation of a compiled spec constructs new objects");
+  Check(person_factory.Compile("nullptr")->Instantiate() == nullptr,
+        "a compiled nullptr instantiates nullptr");
+
+  // A variable is looked up whenever a spec is instantiated.
+  interpreter.EvalString("n = \"Barney\";\n");
+  Check(DescribePerson(compiled_person->Instantiate(env)) ==
+        "Barney 180 1999-2-3",
+        "instantiating a compiled spec looks up variables anew");
+  bool threw = false;
+  try {
+    compiled_person->Instantiate();
+  } catch (const runtime_error &) {
+    threw = true;
+  }
+  Check(threw, "instantiating a compiled spec reports unbound variables");
+
+  const char *invalid_specs[] = {
+    "PersonImpl(cm_height(180))",
+    "PersonImpl(name(\"x\"), cm_height(1.5))",
+    "PersonImpl(name(\"x\"), height(180))",
+    "NoSuchPerson(name(\"x\"))",
+    "PersonImpl(name(\"x\")",
+  };
+  for (size_t i = 0; i < sizeof(invalid_specs) / sizeof(invalid_specs[0]);
+       ++i) {
+    threw = false;
+    try {
+      person_factory.Compile(invalid_specs[i]);
+    } catch (const runtime_error &) {
+      threw = true;
+    }
+    Check(threw, string("compiling fails for ") + invalid_specs[i]);
+  }
+}
+
+/// Tests that a \link infact::VarHandle VarHandle \endlink reads the
+/// current value of its variable, following reassignments and freezing,
+/// and stops reading it once the variable has another type.
+void
+TestHandles() {
+  Interpreter interpreter;
+  interpreter.EvalString("int x = 3;\nstring s = \"hi\";\n"
+                         "int[] v = {1, 2, 3};\n"
+                         "Animal a = Cow(name(\"a\"));\n");
+  VarHandle<int> x = interpreter.GetHandle<int>("x");
+  VarHandle<string> s = interpreter.GetHandle<string>("s");
+  VarHandle<vector<int> > v = interpreter.GetHandle<vector<int> >("v");
+  VarHandle<shared_ptr<Animal> > a =
+      interpreter.GetHandle<shared_ptr<Animal> >("a");
+  Check(x.valid() && *x == 3 && *s == "hi" && s->size() == 2 &&
+        v->size() == 3 && (*a)->name() == "a",
+        "handles read the values of their variables");
+
+  interpreter.EvalString("x = 7;\nint y = 1;\nv = {4};\n"
+                         "a = Sheep(name(\"b\"));\n");
+  Check(*x == 7 && v->size() == 1 && (*v)[0] == 4 && (*a)->name() == "b",
+        "handles read the values of reassigned variables");
+  interpreter.env()->Freeze();
+  interpreter.EvalString("x = 8;\n");
+  int value = 0;
+  Check(x.Get(&value) && value == 8 && *s == "hi",
+        "handles read variables reassigned after freezing");
+
+  VarHandle<string> wrong_type = interpreter.GetHandle<string>("x");
+  VarHandle<int> undefined = interpreter.GetHandle<int>("undefined");
+  VarHandle<int> unresolved;
+  Check(!wrong_type.valid() && wrong_type.Find() == nullptr &&
+        !undefined.valid() && undefined.Find() == nullptr &&
+        !unresolved.valid() && !unresolved.Get(&value),
+        "handles to variables of other types or none are invalid");
+  bool threw = false;
+  try {
+    *undefined;
+  } catch (const runtime_error &) {
+    threw = true;
+  }
+  Check(threw, "dereferencing an invalid handle is an error");
+
+  interpreter.EvalString("string x = \"now a string\";\n");
+  Check(x.Find() == nullptr && !x.Get(&value) &&
+        *interpreter.GetHandle<string>("x") == "now a string",
+        "a handle reads nothing once its variable has another type");
+}
+
+/// Tests that specs of a shareable type with the same member values
+/// construct one instance, for as long as it is in use, and specs with
+/// different member values do not.
+void
+TestShareable() {
+  Interpreter interpreter;
+  interpreter.EvalString(
+      "Date s1 = SharedDate(year(1), month(1), day(1));\n"
+      "Date s2 = SharedDate(day(1), month = 1, year(1));\n"
+      "Date s3 = SharedDate(year(1), month(2), day(1));\n"
+      "Date d1 = DateImpl(year(1), month(1), day(1));\n"
+      "Date d2 = DateImpl(year(1), month(1), day(1));\n"
+      "Person a = PersonImpl(name(\"a\"), "
+      "birthday(SharedDate(year(2010), month(11), day(15))));\n"
+      "Person b = PersonImpl(name(\"b\"), "
+      "birthday(SharedDate(year(2010), month(11), day(15))));\n");
+  shared_ptr<Date> s1, s2, s3, d1, d2;
+  interpreter.Get("s1", &s1);
+  interpreter.Get("s2", &s2);
+  interpreter.Get("s3", &s3);
+  interpreter.Get("d1", &d1);
+  interpreter.Get("d2", &d2);
+  Check(s1 != nullptr && s1 == s2,
+        "identical specs of a shareable type construct one instance");
+  Check(s3 != nullptr && s3 != s1 && s3->month() == 2,
+        "specs of a shareable type with other values construct another");
+  Check(d1 != nullptr && d1 != d2,
+        "identical specs of other types construct distinct instances");
+  shared_ptr<Person> a, b;
+  interpreter.Get("a", &a);
+  interpreter.Get("b", &b);
+  Check(a != b && a->birthday() == b->birthday(),
+        "shareable members of distinct objects are shared");
+
+  Factory<Date> factory;
+  const string spec = "SharedDate(year(7), month(1), day(1))";
+  shared_ptr<Date> x = factory.CreateOrDie(spec, "x");
+  std::weak_ptr<Date> weak_x = x;
+  Check(factory.CreateOrDie(spec, "y") == x,
+        "CreateOrDie shares instances of a shareable type");
+  x.reset();
+  Check(weak_x.expired() && factory.CreateOrDie(spec, "z")->year() == 7,
+        "shared instances are not kept once no longer in use");
+}
+
+/// Tests that objects constructed by an interpreter with an arena are
+/// allocated in the arena, which lives for as long as any of them.
+void
+TestArena() {
+  std::weak_ptr<Arena> weak_arena;
+  shared_ptr<Animal> kept;
+  {
+    shared_ptr<Arena> arena(new Arena(4096));
+    weak_arena = arena;
+    Interpreter interpreter;
+    interpreter.set_arena(arena);
+    size_t allocated = arena->bytes_allocated();
+    interpreter.EvalString("Animal c = Cow(name(\"a\"), age(2));\n");
+    size_t cow_bytes = arena->bytes_allocated() - allocated;
+    allocated = arena->bytes_allocated();
+    interpreter.EvalString(
+        "Animal[] v = {Cow(name(\"b\")), Sheep(name(\"s\"), counts({1}))};\n"
+        "PetOwner o = HumanPetOwner(pets(v));\n"
+        "int x = 3;\n");
+    shared_ptr<Animal> c;
+    shared_ptr<PetOwner> o;
+    Check(cow_bytes >= sizeof(Cow) &&
+          arena->bytes_allocated() - allocated >=
+          2 * sizeof(Cow) + sizeof(HumanPetOwner) &&
+          arena->bytes_reserved() >= arena->bytes_allocated() &&
+          interpreter.Get("c", &c) && c->name() == "a" && c->age() == 2 &&
+          interpreter.Get("o", &o) && o->GetPet(1)->name() == "s",
+          "objects are constructed in the arena of an interpreter");
+
+    Factory<Animal> factory;
+    shared_ptr<const CompiledSpec<Animal> > spec =
+        factory.Compile("Cow(name(\"d\"))");
+    allocated = arena->bytes_allocated();
+    Check(spec->Instantiate(interpreter.env())->name() == "d" &&
+          arena->bytes_allocated() - allocated >= sizeof(Cow),
+          "compiled specs are instantiated in the arena of an environment");
+    kept = c;
+  }
+  Check(!weak_arena.expired() && kept->name() == "a",
+        "an arena outlives the interpreter while its objects are in use");
+  kept.reset();
+  Check(weak_arena.expired(),
+        "an arena is destroyed once its objects no longer are in use");
+
+  Arena arena(256);
+  bool aligned = true;
+  for (size_t i = 0; i < 100; ++i) {
+    size_t alignment = static_cast<size_t>(1) << (i % 5);
+    void *allocation = arena.Allocate(i % 7 + 1, alignment);
+    aligned = aligned && allocation != nullptr &&
+        reinterpret_cast<uintptr_t>(allocation) % alignment == 0;
+  }
+  Check(aligned && arena.Allocate(1000, 16) != nullptr,
+        "an arena allocates aligned memory, including large blocks");
+}
+
+/// Tests that the statistics of an interpreter record each statement
+/// and each constructed object, and that they may be written as a
+/// Chrome trace.
+void
+TestStats() {
+  Interpreter interpreter;
+  interpreter.set_collect_stats(true);
+  interpreter.EvalString(
+      "a = PersonImpl(name(\"a\"),\n"
+      "               birthday(DateImpl(year(2010), month(11), day(15))));\n"
+      "int x = 3;\n"
+      "b = {PersonImpl(name(\"b\")),\n"
+      "     PersonImpl(name(\"c\"),\n"
+      "                birthday(DateImpl(year(1), month(1), day(1))))};\n");
+  const Stats &stats = interpreter.stats();
+  vector<StatementStats> statements = stats.statements();
+  Check(statements.size() == 3 &&
+        statements[0].varname == "a" && statements[0].line_number == 0 &&
+        statements[1].varname == "x" && statements[1].line_number == 2 &&
+        statements[2].varname == "b" && statements[2].line_number == 3 &&
+        statements[0].nanos >= 0,
+        "statistics record each statement and the line on which it starts");
+
+  unordered_map<string, ConstructionStats> constructions =
+      stats.constructions();
+  const ConstructionStats &people = constructions["PersonImpl"];
+  const ConstructionStats &dates = constructions["DateImpl"];
+  Check(constructions.size() == 2 && people.count == 3 && dates.count == 2 &&
+        people.self_nanos <= people.nanos &&
+        people.max_nanos <= people.nanos &&
+        people.nanos - people.self_nanos >= dates.nanos &&
+        dates.self_nanos == dates.nanos,
+        "statistics count the objects of each type, apart from their members");
+  Check(stats.tokens_read() > 40 && stats.bytes_read() > 100,
+        "statistics count the bytes and tokens read");
+
+  vector<TraceEvent> trace = stats.trace();
+  size_t num_statements = 0;
+  for (size_t i = 0; i < trace.size(); ++i) {
+    if (string(trace[i].category) == "statement") {
+      ++num_statements;
+    }
+  }
+  ostringstream json;
+  stats.WriteChromeTrace(json);
+  const string written = json.str();
+  size_t num_events = 0;
+  for (size_t pos = written.find("{\"name\":"); pos != string::npos;
+       pos = written.find("{\"name\":", pos + 1)) {
+    ++num_events;
+  }
+  Check(trace.size() == 8 && num_statements == 3 && num_events == 8 &&
+        written.compare(0, 16, "{\"traceEvents\":[") == 0 &&
+        written.find("\"name\":\"b\",\"cat\":\"statement\"") != string::npos &&
+        written.find("\"name\":\"DateImpl\",\"cat\":\"construct\"") !=
+        string::npos &&
+        written.find("\n],\"displayTimeUnit\":\"ms\"}") != string::npos,
+        "statistics are written as a Chrome trace, one event per record");
+
+  Stats totals;
+  totals.set_record_trace(false);
+  Factory<Date> factory;
+  {
+    Stats::Scope scope(&totals);
+    factory.CreateOrDie("DateImpl(year(1), month(1), day(1))", "d");
+  }
+  factory.CreateOrDie("DateImpl(year(1), month(1), day(2))", "d");
+  Check(totals.constructions()["DateImpl"].count == 1 &&
+        totals.trace().empty() && totals.statements().empty(),
+        "a factory records statistics only within a scope");
+
+  Interpreter parallel;
+  parallel.set_num_threads(2);
+  parallel.set_collect_stats(true);
+  parallel.EvalString("a = DateImpl(year(1), month(1), day(1));\n"
+                      "b = DateImpl(year(1), month(1), day(2));\n"
+                      "c = {a, b};\n");
+  Check(parallel.stats().statements().size() == 3 &&
+        parallel.stats().constructions()["DateImpl"].count == 2,
+        "statistics record every statement evaluated in parallel");
+}
+
+/// Tests that variables assigned from one another, and copies of an
+/// environment, share the storage of a value, which outlives later
+/// reassignment of the variable.
+void
+TestSharedValues() {
+  Interpreter interpreter;
+  interpreter.EvalString("double[] big = {1.0, 2.0, 3.0};\n"
+                         "double[] alias = big;\n"
+                         "int n = 7;\n");
+  shared_ptr<const vector<double> > big =
+      interpreter.GetShared<vector<double> >("big");
+  shared_ptr<const vector<double> > alias =
+      interpreter.GetShared<vector<double> >("alias");
+  vector<double> copied;
+  Check(big != nullptr && big == alias &&
+        *big == vector<double>({1.0, 2.0, 3.0}) &&
+        interpreter.Get("alias", &copied) && copied == *big &&
+        &copied[0] != &(*big)[0],
+        "a variable assigned from another shares its storage");
+  Check(interpreter.GetShared<vector<int> >("big") == nullptr &&
+        interpreter.GetShared<double>("missing") == nullptr,
+        "there is no shared storage for a variable of another type");
+
+  unique_ptr<EnvironmentImpl> copy(
+      dynamic_cast<EnvironmentImpl *>(interpreter.env()->Copy()));
+  Check(copy->GetShared<vector<double> >("big") == big,
+        "a copy of an environment shares the storage of its values");
+
+  interpreter.EvalString("double[] big = {4.0};\n"
+                         "int n = 8;\n");
+  shared_ptr<const int> n = copy->GetShared<int>("n");
+  Check(*big == vector<double>({1.0, 2.0, 3.0}) && big == alias &&
+        *interpreter.GetShared<vector<double> >("big") ==
+        vector<double>({4.0}) &&
+        interpreter.GetShared<vector<double> >("alias") == alias &&
+        copy->GetShared<vector<double> >("big") == big &&
+        n != nullptr && *n == 7 && *interpreter.GetShared<int>("n") == 8,
+        "reassigning a variable leaves its earlier shared values intact");
+}
+
+/// Tests that the memory report of an interpreter counts its variables
+/// and objects, and that compacting it releases memory while keeping
+/// every value and handle.
+void
+TestMemoryUsage() {
+  const string filename = "interpreter-test-memory.infact";
+  Interpreter interpreter;
+  // Copy the environment after each statement, so that the storage of
+  // reassigned variables builds up.
+  for (int i = 0; i < 500; ++i) {
+    ostringstream statement;
+    statement << "string s = \"" << string(100, 'a' + i % 26) << "\";\n"
+              << "int n" << i % 10 << " = " << i << ";\n";
+    interpreter.EvalString(statement.str());
+    delete interpreter.env()->Copy();
+  }
+  WriteFile(filename, "Cow c = Cow(name(\"Bessie\"));\n"
+            "Animal[] zoo = {c, Sheep(name(\"Dolly\")), c};\n"
+            "s2 = s;\n");
+  interpreter.Reload(filename);
+  VarHandle<string> handle = interpreter.GetHandle<string>("s");
+  shared_ptr<Animal> cow;
+  interpreter.Get("c", &cow);
+
+  Interpreter::MemoryReport before = interpreter.MemoryUsage();
+  size_t num_objects = 0;
+  bool counted = true;
+  for (size_t i = 0; i < before.var_maps.size(); ++i) {
+    const VarMapUsage &usage = before.var_maps[i];
+    num_objects += usage.num_objects;
+    if (usage.type == "Animal[]") {
+      counted = counted && usage.num_variables == 1 && usage.num_objects == 2;
+    } else if (usage.type == "Cow") {
+      counted = counted && usage.num_variables == 1 && usage.num_objects == 1;
+    } else if (usage.type == "string") {
+      counted = counted && usage.num_variables == 2 && usage.bytes > 100;
+    } else if (usage.type == "int") {
+      counted = counted && usage.num_variables == 10;
+    }
+  }
+  Check(counted && num_objects == 3 && before.statement_bytes > 0 &&
+        before.environment_bytes > 0 &&
+        before.total_bytes() > before.statement_bytes,
+        "the memory report counts the variables and objects of each type");
+
+  interpreter.Compact();
+  Interpreter::MemoryReport after = interpreter.MemoryUsage();
+  Check(after.total_bytes() < before.total_bytes() &&
+        after.statement_bytes == 0,
+        "compacting an interpreter releases memory");
+
+  const string last(100, 'a' + 499 % 26);
+  string s, s2;
+  int n = 0;
+  vector<shared_ptr<Animal> > zoo;
+  shared_ptr<Animal> compacted_cow;
+  Check(interpreter.Get("s", &s) && s == last &&
+        interpreter.Get("s2", &s2) && s2 == last &&
+        interpreter.Get("n3", &n) && n == 493 &&
+        interpreter.Get("zoo", &zoo) && zoo.size() == 3 &&
+        zoo[0] == zoo[2] && zoo[0] == cow &&
+        interpreter.Get("c", &compacted_cow) && compacted_cow == cow &&
+        handle.valid() && *handle == last,
+        "compacting an interpreter keeps every value and handle");
+
+  interpreter.EvalString("string s = \"changed\";\n"
+                         "int n3 = 7;\n");
+  Check(*handle == "changed" && interpreter.Get("n3", &n) && n == 7 &&
+        interpreter.Reload(filename) &&
+        AnimalName(interpreter, "c") == "Bessie",
+        "a compacted interpreter evaluates and reloads as before");
+  remove(filename.c_str());
+}
+
+/// Tests that the view received by <tt>PostInitView</tt> holds exactly
+/// the text of the spec of an object, whether the object is nested in
+/// another and whether its spec is read from a buffer or a stream.
+void
+TestPostInitViews() {
+  const string inner = "NamedTag(label(\"in\"))";
+  const string outer =
+      "NamedTag(label(\"out\"),\n"
+      "         // The inner tag.\n"
+      "         inner(" + inner + "))";
+  const vector<string> expected = { inner, outer };
+
+  Factory<Tag> factory;
+  Tag::views.clear();
+  factory.CreateOrDie(outer, "tag");
+  Check(Tag::views == expected,
+        "PostInitView receives the spec of an object and of its members");
+
+  const string input = "x = 1;\nTag t = " + outer + "; y = 2;";
+  Tag::views.clear();
+  StreamTokenizer in_place(input.data(), input.size());
+  // Skips the tokens before the spec: x = 1 ; Tag t =
+  for (int i = 0; i < 7; ++i) {
+    in_place.Skip();
+  }
+  factory.CreateOrDie(in_place);
+  Check(Tag::views == expected && in_place.Peek() == ";",
+        "PostInitView receives the spec of an object read from a buffer");
+
+  Tag::views.clear();
+  Interpreter from_stream;
+  istringstream is(input);
+  from_stream.Eval(is);
+  Check(Tag::views == expected,
+        "PostInitView receives the spec of an object read from a stream");
+
+  Tag::views.clear();
+  factory.Compile(outer)->Instantiate();
+  Check(Tag::views == expected,
+        "PostInitView receives the spec of an object of a compiled spec");
+}
+
+/// Tests that lazy values are constructed only on retrieval, and then
+/// exactly as they would have been constructed by eager evaluation.
+void
+TestLazy() {
+  const string input =
+      "string n = \"first\";\n"
+      "Animal a = Cow(name(n));\n"
+      "Animal b = Cow(name(\"b\"));\n"
+      "n = \"second\";\n"
+      "PetOwner o = HumanPetOwner(pets({a}));\n"
+      "Animal c = a;\n"
+      "Animal z = nullptr;\n"
+      "Animal[] v = {b};\n";
+  Interpreter eager;
+  eager.EvalString(input);
+
+  Stats stats;
+  Stats::Scope scope(&stats);
+  Interpreter lazy;
+  lazy.set_lazy(true);
+  lazy.EvalString(input);
+  Check(NumConstructions(stats) == 1,
+        "lazy evaluation constructs only the elements of vectors");
+  Check(PrintedEnv(lazy).find("<lazy>") != string::npos,
+        "unretrieved lazy values are printed as such");
+
+  shared_ptr<Animal> a, c, z;
+  shared_ptr<PetOwner> o;
+  vector<shared_ptr<Animal> > v;
+  bool retrieved = lazy.Get("o", &o) && lazy.Get("a", &a) &&
+                   lazy.Get("c", &c) && lazy.Get("z", &z) &&
+                   lazy.Get("v", &v);
+  Check(retrieved && a == c && a->name() == "first" && z == nullptr &&
+        NumConstructions(stats) == 3,
+        "lazy values are constructed once, on retrieval");
+  Check(PrintedEnv(lazy) == PrintedEnv(eager),
+        "retrieved lazy values equal eagerly evaluated ones");
+
+  // Errors in constructing a lazy value are reported on its retrieval,
+  // but syntax errors are still found when reading it.
+  Interpreter erroneous;
+  erroneous.set_lazy(true);
+  EvalReportingErrors(erroneous, "Animal bad = Cow(name(missing));\n"
+                      "Animal typo = Cow(nam(\"t\"));\n");
+  bool threw = false;
+  try {
+    shared_ptr<Animal> bad;
+    erroneous.Get("bad", &bad);
+  } catch (const runtime_error &) {
+    threw = true;
+  }
+  Check(threw, "errors in lazy values are reported on retrieval");
+  shared_ptr<Animal> typo;
+  Check(!erroneous.Get("typo", &typo),
+        "syntax errors in lazy values are found when reading");
+}
+
+/// Tests that sweeps construct every combination of the values of
+/// their variables, in order, with any number of threads, and that
+/// erroneous sweeps are reported as such.
+void
+TestSweeps() {
+  const string input =
+      "string base = \"x\";\n"
+      "Animal[] herd = {\n"
+      "  for n in {\"a\", \"b\", base}\n"
+      "  for a in range(0, 4)\n"
+      "  Cow(name(n), age(a))\n"
+      "};\n"
+      "Animal[] countdown = {\n"
+      "  for a in range(3, -3, -2) Cow(name(\"c\"), age(a))\n"
+      "};\n";
+  Interpreter sequential;
+  sequential.EvalString(input);
+  vector<shared_ptr<Animal> > herd, countdown;
+  bool ordered = sequential.Get("herd", &herd) && herd.size() == 12 &&
+                 sequential.Get("countdown", &countdown) &&
+                 countdown.size() == 3;
+  const char *names[] = {"a", "b", "x"};
+  for (size_t i = 0; ordered && i < herd.size(); ++i) {
+    ordered = herd[i]->name() == names[i / 4] && herd[i]->age() == int(i % 4);
+  }
+  ordered = ordered && countdown[0]->age() == 3 &&
+            countdown[1]->age() == 1 && countdown[2]->age() == -1;
+  Check(ordered, "a sweep constructs every combination in order");
+
+  Interpreter parallel;
+  parallel.set_num_threads(4);
+  parallel.EvalString(input);
+  Check(PrintedEnv(parallel) == PrintedEnv(sequential),
+        "sweeping with several threads matches sweeping sequentially");
+
+  Interpreter lazy;
+  lazy.set_lazy(true);
+  lazy.EvalString(input);
+  lazy.Get("herd", &herd);
+  lazy.Get("countdown", &countdown);
+  Check(PrintedEnv(lazy) == PrintedEnv(sequential),
+        "a lazy sweep matches an eager one");
+
+  vector<Diagnostic> diagnostics;
+  Validator validator;
+  Check(validator.ValidateString(input, &diagnostics) && diagnostics.empty(),
+        "Validator accepts valid sweeps");
+
+  // The same sweep, specified through the C++ API.
+  Sweep sweep;
+  sweep.Add("n", {"\"p\"", "\"q\""});
+  sweep.AddRange("a", 10, 20, 5);
+  Factory<Animal> factory;
+  vector<shared_ptr<Animal> > many =
+      factory.CreateMany("Cow(name(n), age(a))", sweep, 4);
+  Check(sweep.size() == 4 && many.size() == 4 &&
+        many[1]->name() == "p" && many[1]->age() == 15 &&
+        many[2]->name() == "q" && many[2]->age() == 10,
+        "CreateMany constructs every combination of a Sweep in order");
+  bool threw = false;
+  try {
+    factory.CreateMany("Cow(name(n))", Sweep(), 4);
+  } catch (const runtime_error &) {
+    threw = true;
+  }
+  Check(threw, "CreateMany reports unbound variables");
+
+  // A sweep may specify the elements of a vector member of a spec.
+  const string nested_input =
+      "string base = \"x\";\n"
+      "PetOwner o = HumanPetOwner(pets({\n"
+      "  for n in {\"a\", base} for a in range(0, 2) Cow(name(n), age(a))\n"
+      "}));\n";
+  Interpreter nested;
+  nested.EvalString(nested_input);
+  Interpreter nested_lazy;
+  nested_lazy.set_lazy(true);
+  nested_lazy.EvalString(nested_input);
+  shared_ptr<PetOwner> owner, lazy_owner;
+  Check(nested.Get("o", &owner) && owner->GetNumberOfPets() == 4 &&
+        owner->GetPet(2)->name() == "x" && owner->GetPet(3)->age() == 1 &&
+        nested_lazy.Get("o", &lazy_owner) &&
+        PrintedEnv(nested_lazy) == PrintedEnv(nested),
+        "a lazy sweep in a member matches an eager one");
+
+  Factory<PetOwner> owner_factory;
+  shared_ptr<const CompiledSpec<PetOwner> > owner_spec =
+      owner_factory.Compile("HumanPetOwner(pets({\n"
+                            "  for n in {m, \"z\"} Cow(name(n))\n"
+                            "}))");
+  Sweep owner_sweep;
+  owner_sweep.Add("m", {"\"p\"", "\"q\""});
+  vector<shared_ptr<PetOwner> > owners =
+      owner_factory.CreateMany(*owner_spec, owner_sweep, 2);
+  Check(owners.size() == 2 && owners[1]->GetNumberOfPets() == 2 &&
+        owners[1]->GetPet(0)->name() == "q" &&
+        owners[1]->GetPet(1)->name() == "z",
+        "compiled specs sweep the elements of a member");
+
+  const char *invalid_statements[] = {
+    "Animal[] h = { for n in {\"a\"} Cow(name(m)) };",
+    "Animal[] h = { for n in range(0, 3, 0) Cow(name(\"a\")) };",
+    "Animal[] h = { for n in {\"a\"} Cow(name(n)), Cow(name(n)) };",
+    "Animal[] h = { for n in {} Cow(name(n)) };",
+  };
+  for (size_t i = 0;
+       i < sizeof(invalid_statements) / sizeof(invalid_statements[0]); ++i) {
+    Interpreter interpreter;
+    string errors = EvalReportingErrors(interpreter, invalid_statements[i]);
+    vector<shared_ptr<Animal> > h;
+    Check(!errors.empty() && !interpreter.Get("h", &h),
+          string("sweeping fails for ") + invalid_statements[i]);
+  }
+  diagnostics.clear();
+  Check(!validator.ValidateString(
+            "Animal[] h = { for n in range(0, 3) Cow(name(n)) };",
+            &diagnostics) && diagnostics.size() == 1,
+        "Validator reports ill-typed sweep variables");
+}
+
+/// Tests that types may be registered at run time while other threads
+/// construct objects.
+void
+TestRuntimeRegistration() {
+  const int num_types = 200;
+  std::atomic<bool> done(false);
+  std::atomic<int> num_errors(0);
+  vector<thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(thread([&done, &num_errors]() {
+          Factory<Node> factory;
+          while (!done.load()) {
+            shared_ptr<Node> node =
+                factory.CreateOrDie("Link(next(Link()))", "node");
+            if (node == nullptr || node->next() == nullptr) {
+              ++num_errors;
+            }
+          }
+        }));
+  }
+  for (int i = 0; i < num_types; ++i) {
+    ostringstream type;
+    type << "RuntimeLink" << i;
+    Factory<Node>::Register(type.str(), new RuntimeLinkConstructor());
+  }
+  done = true;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  Factory<Node> factory;
+  bool constructible = true;
+  for (int i = 0; i < num_types; ++i) {
+    ostringstream spec;
+    spec << "RuntimeLink" << i << "(next(Link()))";
+    shared_ptr<Node> node = factory.CreateOrDie(spec.str(), "node");
+    constructible = constructible && node != nullptr &&
+        node->next() != nullptr;
+  }
+  shared_ptr<const vector<FactoryBase *> > factories =
+      FactoryContainer::factories();
+  Check(num_errors == 0 && constructible &&
+        Factory<Node>::IsRegistered("RuntimeLink0") &&
+        std::count_if(factories->begin(), factories->end(),
+                      [](const FactoryBase *f) {
+                        return f->BaseName() == "Node";
+                      }) == 1,
+        "types registered at run time are constructible at once");
+}
+
+/// Returns a statement assigning a list of the specified number of
+/// nodes to the variable n.
+string
+NodeListStatement(size_t length) {
+  string statement = "Node n = ";
+  for (size_t i = 0; i < length; ++i) {
+    statement += "Link(next(";
+  }
+  statement += "nullptr";
+  for (size_t i = 0; i < length; ++i) {
+    statement += "))";
+  }
+  return statement + ";";
+}
+
+/// Tests that a factory registers the members of a type once, on a
+/// prototype, rather than for every object it constructs, unless the
+/// type opts out.
+void
+TestMemberDescriptors() {
+  Factory<Gauge> factory;
+  shared_ptr<const CompiledSpec<Gauge> > dial_spec =
+      factory.Compile("Dial(level(3))");
+  int registrations = Gauge::registrations;
+  bool initialized = true;
+  for (int i = 0; i < 100; ++i) {
+    shared_ptr<Gauge> created =
+        factory.CreateOrDie("Dial(level(7), unit(\"cm\"))", "dial");
+    initialized = initialized && created->level() == 7 &&
+                  dial_spec->Instantiate()->level() == 3;
+  }
+  Check(initialized && Gauge::registrations == registrations,
+        "objects are initialized without registering their members");
+
+  shared_ptr<const CompiledSpec<Gauge> > knob_spec =
+      factory.Compile("Knob(level(3))");
+  registrations = Gauge::registrations;
+  initialized = true;
+  for (int i = 0; i < 10; ++i) {
+    shared_ptr<Gauge> created =
+        factory.CreateOrDie("Knob(level(7), unit(\"cm\"))", "knob");
+    initialized = initialized && created->level() == 7 &&
+                  knob_spec->Instantiate()->level() == 3;
+  }
+  Check(initialized && Gauge::registrations == registrations + 20,
+        "objects of types that opt out register their own members");
+}
+
+/// Tests that specs nested so deeply that they need several stack
+/// segments may be evaluated, up to the maximum nesting depth.
+void
+TestNesting() {
+  size_t length = Nesting::kDefaultMaxDepth / 2;
+  Interpreter interpreter;
+  interpreter.EvalString(NodeListStatement(length));
+  shared_ptr<Node> node;
+  interpreter.Get("n", &node);
+  size_t count = 0;
+  for (Node *link = node.get(); link != nullptr; link = link->next().get()) {
+    ++count;
+  }
+  Check(count == length, "deeply nested specs are evaluated");
+
+  Interpreter too_deep_interpreter;
+  too_deep_interpreter.EvalString(
+      NodeListStatement(Nesting::kDefaultMaxDepth + 1));
+  Check(!too_deep_interpreter.Get("n", &node) && Nesting::depth() == 0,
+        "specs nested more than the maximum depth are errors");
+}
+
+}  // namespace
+
 int
 main(int argc, char **argv) {
   cout << "Here is a list of abstract types and the concrete implementations\n"
@@ -75,7 +1637,33 @@ main(int argc, char **argv) {
   cout << "\n\nEnvironment: " << endl;
   interpreter.PrintEnv(cout);
 
+  cout << "\nNow running the remaining hard-coded tests." << endl;
+  TestSnapshots();
+  TestParallelEval();
+  TestValidator();
+  TestVectorElementErrors();
+  TestVectorLiterals();
+  TestReload();
+  TestMemoryUsage();
+  TestLazy();
+  TestCompiledSpecs();
+  TestHandles();
+  TestShareable();
+  TestSharedValues();
+  TestArena();
+  TestStats();
+  TestMappedArrays();
+  TestImport();
+  TestEvalBatch();
+  TestFeed();
+  TestSweeps();
+  TestNesting();
+  TestRuntimeRegistration();
+  TestMemberDescriptors();
+  TestPostInitViews();
+
   cout << "\nHave a nice day!\n" << endl;
+  return num_failures == 0 ? 0 : 1;
 }
 
 /// \mainpage InFact Framework
@@ -33,10 +33,22 @@
 /// Interpreter implementation.
 /// Author: dbikel@google.com (Dan Bikel)
 
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "error.h"
 #include "interpreter.h"
+#include "snapshot.h"
 
 using namespace std;
 
@@ -46,62 +58,58 @@ using std::ostringstream;
 
 void
 Interpreter::Eval(StreamTokenizer &st) {
+  Stats *stats = collect_stats_ ? &stats_ : Stats::Current();
+  Stats::Scope stats_scope(stats);
+  eval_failed_ = false;
+  eval_error_.clear();
+  size_t bytes_start = st.tellg();
+  size_t tokens_start = st.num_tokens();
+  if (num_threads_ > 1) {
+    EvalParallel(st);
+  } else {
+    EvalSequential(st);
+  }
+  if (stats != nullptr) {
+    stats->RecordTokens(st.tellg() - bytes_start,
+                        st.num_tokens() - tokens_start);
+  }
+}
+
+void
+Interpreter::EvalSequential(StreamTokenizer &st) {
   // Keeps reading assignment statements until there are no more tokens.
   while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
 #ifdef INFACT_THROW_EXCEPTIONS
     try {
 #endif
-    // Read variable name or type specifier.
-    StreamTokenizer::TokenType token_type = st.PeekTokenType();
-    VarMapBase *varmap = env_->GetVarMapForType(st.Peek());
-    bool is_type_specifier =  varmap != nullptr;
-    if (token_type != StreamTokenizer::IDENTIFIER && !is_type_specifier) {
-      string expected_type =
-          string(StreamTokenizer::TypeName(StreamTokenizer::IDENTIFIER)) +
-          " or type specifier";
-      string found_type = StreamTokenizer::TypeName(token_type);
-      WrongTokenTypeError(st.PeekTokenStart(), expected_type, found_type,
-                          st.Peek());
-    }
-
-    string type = "";
-    if (is_type_specifier) {
-      // Consume and remember the type specifier.
-      st.Next();              // Explicit type could be a concrete type.
-      type = varmap->Name();  // Remember the abstract type.
-
-      // Check that next token is a variable name.
-      StreamTokenizer::TokenType token_type = st.PeekTokenType();
-      if (token_type != StreamTokenizer::IDENTIFIER) {
-        WrongTokenTypeError(st.PeekTokenStart(), StreamTokenizer::IDENTIFIER,
-                            token_type, st.Peek());
-      }
-    }
-
-    string varname = st.Next();
-
-    // Next, read equals sign.
-    token_type = st.PeekTokenType();
-    if (st.Peek() != "=") {
-      WrongTokenError(st.PeekTokenStart(), "=", st.Peek(), st.PeekTokenType());
-    }
-
-    // Consume equals sign.
-    st.Next();
-
-    if (st.PeekTokenType() == StreamTokenizer::EOF_TYPE) {
-      ostringstream err_ss;
-      err_ss << "Interpreter:" << filename_
-             << ": error: unexpected EOF at stream position "
-             << st.tellg();
-      Error(err_ss.str());
+    size_t line_number = st.PeekTokenLineNumber();
+    string import_filename;
+    if (ReadImport(st, &import_filename)) {
+      // The timer refers to its name, which must outlive it.
+      const string timer_name = "import " + import_filename;
+      Stats::Timer timer(Stats::Current(), Stats::STATEMENT, timer_name,
+                         line_number);
+      env_->Import(LoadModule(import_filename)->env());
+      recorded_import_ = recorded_import_ || recording_;
+      continue;
     }
+    string type;
+    string varname;
+    ReadAssignmentPrefix(st, &type, &varname);
+    Stats::Timer timer(Stats::Current(), Stats::STATEMENT, varname,
+                       st.PeekTokenLineNumber());
 
     // Consume and set the value for this variable in the environment.
+    size_t value_start = st.PeekTokenStart();
     env_->ReadAndSet(varname, st, type);
+    if (recording_) {
+      Statement statement = {
+        varname, env_->GetType(varname), value_start, st.PeekTokenStart()
+      };
+      statements_.push_back(statement);
+    }
 
-    token_type = st.PeekTokenType();
-    if (st.Peek() != ";") {
+    if (st.PeekView() != ";") {
       WrongTokenError(st.PeekTokenStart(), ";", st.Peek(), st.PeekTokenType());
     }
     // Consume semicolon.
@@ -110,6 +118,8 @@ Interpreter::Eval(StreamTokenizer &st) {
     }
     catch (std::runtime_error &e) {
       cerr << "threw exception: " << e.what() << endl;
+      eval_failed_ = true;
+      eval_error_ = e.what();
       // For now, we simply give up.
       break;
     }
@@ -117,6 +127,1012 @@ Interpreter::Eval(StreamTokenizer &st) {
   }
 }
 
+void
+Interpreter::ReadAssignmentPrefix(StreamTokenizer &st, string *type,
+                                  string *varname) const {
+  // Read variable name or type specifier.
+  StreamTokenizer::TokenType token_type = st.PeekTokenType();
+  VarMapBase *varmap = env_->GetVarMapForType(st.PeekSymbol());
+  bool is_type_specifier =  varmap != nullptr;
+  if (token_type != StreamTokenizer::IDENTIFIER && !is_type_specifier) {
+    string expected_type =
+        string(StreamTokenizer::TypeName(StreamTokenizer::IDENTIFIER)) +
+        " or type specifier";
+    string found_type = StreamTokenizer::TypeName(token_type);
+    WrongTokenTypeError(st.PeekTokenStart(), expected_type, found_type,
+                        st.Peek());
+  }
+
+  type->clear();
+  if (is_type_specifier) {
+    // Consume and remember the type specifier.
+    st.Next();              // Explicit type could be a concrete type.
+    *type = varmap->Name();  // Remember the abstract type.
+
+    // Check that next token is a variable name.
+    StreamTokenizer::TokenType token_type = st.PeekTokenType();
+    if (token_type != StreamTokenizer::IDENTIFIER) {
+      WrongTokenTypeError(st.PeekTokenStart(), StreamTokenizer::IDENTIFIER,
+                          token_type, st.Peek());
+    }
+  }
+
+  *varname = st.Next();
+
+  // Next, read equals sign.
+  if (st.PeekView() != "=") {
+    WrongTokenError(st.PeekTokenStart(), "=", st.Peek(), st.PeekTokenType());
+  }
+
+  // Consume equals sign.
+  st.Next();
+
+  if (st.PeekTokenType() == StreamTokenizer::EOF_TYPE) {
+    ostringstream err_ss;
+    err_ss << "Interpreter:" << filename_
+           << ": error: unexpected EOF at stream position "
+           << st.tellg();
+    Error(err_ss.str());
+  }
+}
+
+bool
+Interpreter::ReadImport(StreamTokenizer &st, string *filename) const {
+  // An identifier "import" followed by a string literal cannot begin an
+  // assignment, so that "import" remains a valid variable name.
+  if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER ||
+      st.PeekView() != "import") {
+    return false;
+  }
+  st.Next();
+  if (st.PeekTokenType() != StreamTokenizer::STRING) {
+    st.Putback();
+    return false;
+  }
+  *filename = st.Next();
+  if (st.PeekView() != ";") {
+    WrongTokenError(st.PeekTokenStart(), ";", st.Peek(), st.PeekTokenType());
+  }
+  // Consume semicolon.
+  st.Next();
+  return true;
+}
+
+shared_ptr<const Module>
+Interpreter::LoadModule(const string &filename) const {
+  return ModuleCache::Global().Load(ModuleCache::Resolve(filename, filename_));
+}
+
+void
+Interpreter::ReadStatementValue(StreamTokenizer &st, string *text,
+                                 vector<Symbol> *identifiers) const {
+  size_t start = st.PeekTokenStart();
+  StreamTokenizer::ScopedMark mark(st);
+  size_t end = start;
+  while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE &&
+         !(st.PeekTokenType() == StreamTokenizer::RESERVED_CHAR &&
+           st.PeekView() == ";")) {
+    if (st.PeekTokenType() == StreamTokenizer::IDENTIFIER) {
+      identifiers->push_back(st.PeekSymbol());
+    }
+    st.Next();
+    end = st.tellg();
+  }
+  *text = st.str(start, end);
+}
+
+namespace {
+
+// A statement read by Interpreter::EvalParallel that has not yet been
+// committed to the interpreter's environment.
+struct PendingStatement {
+  // The name of the variable assigned.
+  string varname;
+  // The explicit type of the variable, or the empty string.
+  string type;
+  // The text of the value assigned, including the semicolon following
+  // it, if any.
+  string text;
+  // The byte range of the value in the underlying stream.
+  size_t start;
+  size_t end;
+  // The line of the underlying stream on which the value starts.
+  size_t line_number;
+  // The indices of the statements that refer to the variable assigned
+  // by this statement before it is next assigned.
+  vector<size_t> dependents;
+  // The number of statements referred to by this statement that have
+  // not yet been committed.
+  size_t num_dependencies;
+  // The copy of the interpreter's environment in which this statement
+  // was evaluated.
+  unique_ptr<EnvironmentImpl> env;
+  // The module imported by this statement, or nullptr if this
+  // statement is an assignment.
+  shared_ptr<const Module> module;
+  // Whether this statement has been evaluated.
+  bool done;
+  // Whether this statement assigned its variable, which it may have
+  // done even if it failed.
+  bool assigned;
+  // The error encountered while evaluating this statement, if any.
+  bool failed;
+  string error;
+};
+
+}  // namespace
+
+void
+Interpreter::EvalParallel(StreamTokenizer &st) {
+  // First, split the stream into statements, making each statement
+  // depend on the most recent earlier statements assigning the
+  // variables it refers to.  Since a statement only ever refers to
+  // variables by identifier tokens, this never misses a dependency,
+  // though it may find spurious ones (e.g., a member whose name is
+  // also the name of a variable).
+  vector<PendingStatement> statements;
+  unordered_map<Symbol, size_t> last_assignment;
+  bool parse_failed = false;
+  string parse_error;
+  try {
+    while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+      PendingStatement statement;
+      statement.num_dependencies = 0;
+      statement.done = false;
+      statement.assigned = false;
+      statement.failed = false;
+      size_t idx = statements.size();
+
+      // An import statement is loaded right away, and assigns every
+      // variable of its module.
+      statement.line_number = st.PeekTokenLineNumber();
+      string import_filename;
+      if (ReadImport(st, &import_filename)) {
+        statement.module = LoadModule(import_filename);
+        statement.varname = "import " + import_filename;
+        statement.start = statement.end = st.PeekTokenStart();
+        const vector<Symbol> &variables = statement.module->variables();
+        for (vector<Symbol>::const_iterator it = variables.begin();
+             it != variables.end(); ++it) {
+          last_assignment[*it] = idx;
+        }
+        statements.push_back(std::move(statement));
+        continue;
+      }
+
+      ReadAssignmentPrefix(st, &statement.type, &statement.varname);
+      statement.start = st.PeekTokenStart();
+      statement.line_number = st.PeekTokenLineNumber();
+
+      vector<Symbol> identifiers;
+      {
+        // The text of the value includes its semicolon, so that reading
+        // the value on its own ends exactly as reading it from the
+        // stream would, and an unterminated final statement is still
+        // evaluated before the missing semicolon is reported, as it
+        // would be by Eval.
+        StreamTokenizer::ScopedMark mark(st);
+        ReadStatementValue(st, &statement.text, &identifiers);
+        statement.end = st.PeekTokenStart();
+        if (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+          // Consume semicolon.
+          st.Next();
+          statement.text = st.str(statement.start, st.tellg());
+        }
+      }
+      unordered_set<size_t> dependencies;
+      for (vector<Symbol>::const_iterator id_it = identifiers.begin();
+           id_it != identifiers.end(); ++id_it) {
+        unordered_map<Symbol, size_t>::const_iterator it =
+            last_assignment.find(*id_it);
+        if (it != last_assignment.end() &&
+            dependencies.insert(it->second).second) {
+          statements[it->second].dependents.push_back(idx);
+          ++statement.num_dependencies;
+        }
+      }
+      last_assignment[SymbolTable::Intern(statement.varname)] = idx;
+      statements.push_back(std::move(statement));
+    }
+  }
+  catch (std::runtime_error &e) {
+    // The statements before the erroneous one are still evaluated, as
+    // they would have been by Eval.
+    parse_failed = true;
+    parse_error = e.what();
+  }
+
+  // Next, evaluate every statement in its own copy of the environment
+  // as soon as the statements it depends on have been committed, and
+  // commit the statements in order, so that every copy reflects exactly
+  // the statements preceding some point in the stream.
+  std::mutex mu;
+  std::condition_variable cv;
+  priority_queue<size_t, vector<size_t>, greater<size_t> > ready;
+  size_t num_committed = 0;
+  size_t first_failed = statements.size();
+  for (size_t i = 0; i < statements.size(); ++i) {
+    if (statements[i].num_dependencies == 0) {
+      ready.push(i);
+    }
+  }
+
+  // Sets the variable assigned by the specified statement in this
+  // interpreter's environment, optionally recording the statement.
+  auto commit = [&](PendingStatement &statement, bool record) {
+    if (statement.module != nullptr) {
+      env_->Import(statement.module->env());
+      recorded_import_ = recorded_import_ || (record && recording_);
+      return;
+    }
+    env_->CopyVariable(statement.varname, statement.env.get());
+    statement.env.reset();
+    statement.assigned = false;
+    if (record && recording_) {
+      Statement recorded = {
+        statement.varname, env_->GetType(statement.varname),
+        statement.start, statement.end
+      };
+      statements_.push_back(recorded);
+    }
+  };
+
+  // Workers record statistics wherever the calling thread does.
+  Stats *stats = Stats::Current();
+  auto worker = [&]() {
+    Stats::Scope stats_scope(stats);
+    std::unique_lock<std::mutex> lock(mu);
+    while (true) {
+      cv.wait(lock, [&]() {
+          return num_committed >= first_failed || !ready.empty();
+        });
+      if (num_committed >= first_failed) {
+        break;
+      }
+      size_t idx = ready.top();
+      ready.pop();
+      if (idx > first_failed) {
+        continue;
+      }
+      PendingStatement &statement = statements[idx];
+      // An import has nothing left to evaluate, its module having been
+      // loaded with its statement.
+      bool is_import = statement.module != nullptr;
+      if (!is_import) {
+        statement.env.reset(dynamic_cast<EnvironmentImpl *>(env_->Copy()));
+      }
+      lock.unlock();
+
+      try {
+        if (is_import) {
+          statement.assigned = true;
+        } else {
+          Stats::Timer timer(stats, Stats::STATEMENT, statement.varname,
+                             statement.line_number);
+          // The value is read as the part of the stream that it is, so
+          // that any error is reported exactly as Eval would report it.
+          StreamTokenizer::Recycled recycled_st(statement.text,
+                                                statement.start,
+                                                statement.line_number);
+          StreamTokenizer &statement_st = *recycled_st;
+          statement.env->ReadAndSet(statement.varname, statement_st,
+                                    statement.type);
+          statement.assigned = true;
+          if (statement_st.PeekView() != ";") {
+            WrongTokenError(statement_st.PeekTokenStart(), ";",
+                            statement_st.Peek(), statement_st.PeekTokenType());
+          }
+        }
+      }
+      catch (std::runtime_error &e) {
+        statement.failed = true;
+        statement.error = e.what();
+      }
+
+      lock.lock();
+      statement.done = true;
+      if (statement.failed && idx < first_failed) {
+        first_failed = idx;
+      }
+      while (num_committed < first_failed && statements[num_committed].done) {
+        PendingStatement &committed = statements[num_committed];
+        commit(committed, true);
+        for (vector<size_t>::const_iterator it = committed.dependents.begin();
+             it != committed.dependents.end(); ++it) {
+          if (--statements[*it].num_dependencies == 0) {
+            ready.push(*it);
+          }
+        }
+        ++num_committed;
+      }
+      if (num_committed == first_failed &&
+          first_failed < statements.size() &&
+          statements[first_failed].assigned) {
+        // As in Eval, a statement whose value was read successfully
+        // assigns its variable even if it is not properly terminated.
+        commit(statements[first_failed], false);
+      }
+      cv.notify_all();
+    }
+  };
+
+  vector<std::thread> threads;
+  size_t num_threads = std::min(num_threads_, statements.size());
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  // Finally, report the first error in the stream, exactly as Eval would.
+  if (first_failed < statements.size()) {
+    cerr << "threw exception: " << statements[first_failed].error << endl;
+    eval_failed_ = true;
+    eval_error_ = statements[first_failed].error;
+  } else if (parse_failed) {
+    cerr << "threw exception: " << parse_error << endl;
+    eval_failed_ = true;
+    eval_error_ = parse_error;
+  }
+}
+
+bool
+Interpreter::EvalBatch(const vector<string> &filenames,
+                       const EnvironmentImpl *base, size_t num_threads,
+                       vector<BatchResult> *results) {
+  results->clear();
+  results->resize(filenames.size());
+  // Copying a frozen environment only reads it, so that every thread
+  // may copy the base environment at once.
+  if (base != nullptr) {
+    base->Freeze();
+  }
+
+  // Evaluate the largest files first, so that no thread is left with a
+  // large file once the others are done.
+  vector<std::pair<off_t, size_t> > order;
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    struct stat file_stat;
+    off_t size = stat(filenames[i].c_str(), &file_stat) == 0 ?
+        file_stat.st_size : 0;
+    order.push_back(std::make_pair(-size, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::atomic<size_t> next(0);
+  std::atomic<bool> all_succeeded(true);
+  // Workers record statistics wherever the calling thread does.
+  Stats *stats = Stats::Current();
+  auto worker = [&]() {
+    Stats::Scope stats_scope(stats);
+    for (size_t i = next++; i < order.size(); i = next++) {
+      BatchResult &result = (*results)[order[i].second];
+      result.filename = filenames[order[i].second];
+      result.interpreter.reset(new Interpreter());
+      Interpreter &interpreter = *result.interpreter;
+      if (base != nullptr) {
+        delete interpreter.env_;
+        interpreter.env_ = dynamic_cast<EnvironmentImpl *>(base->Copy());
+      }
+      interpreter.filename_ = result.filename;
+      MappedFile file(result.filename);
+      if (file.good()) {
+        StreamTokenizer st(file.data(), file.size());
+        interpreter.Eval(st);
+        result.success = !interpreter.eval_failed_;
+        result.error = interpreter.eval_error_;
+      } else {
+        result.success = false;
+        result.error = "Interpreter: error: could not read file " +
+            result.filename;
+      }
+      if (!result.success) {
+        all_succeeded = false;
+      }
+    }
+  };
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_threads, filenames.size()); ++i) {
+    threads.push_back(std::thread(worker));
+  }
+  // The calling thread takes part in the evaluation.
+  worker();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  return all_succeeded;
+}
+
+bool
+Interpreter::Feed(const char *data, size_t size) {
+  if (feed_failed_) {
+    return false;
+  }
+  feed_buffer_.append(data, size);
+
+  // Find the end of the last statement completed by the new bytes: a
+  // semicolon outside any comment or string literal.
+  size_t end = 0;
+  for (size_t i = feed_scanned_; i < feed_buffer_.size(); ++i) {
+    char c = feed_buffer_[i];
+    switch (feed_state_) {
+      case FEED_SLASH:
+        if (c == '/') {
+          feed_state_ = FEED_COMMENT;
+          break;
+        }
+        // The slash was a token by itself, so read this byte as code.
+        feed_state_ = FEED_CODE;
+      case FEED_CODE:
+        if (c == ';') {
+          end = i + 1;
+        } else if (c == '/') {
+          feed_state_ = FEED_SLASH;
+        } else if (c == '"') {
+          feed_state_ = FEED_STRING;
+        }
+        break;
+      case FEED_COMMENT:
+        if (c == '\n') {
+          feed_state_ = FEED_CODE;
+        }
+        break;
+      case FEED_STRING:
+        if (c == '\\') {
+          feed_state_ = FEED_ESCAPE;
+        } else if (c == '"') {
+          feed_state_ = FEED_CODE;
+        }
+        break;
+      case FEED_ESCAPE:
+        feed_state_ = FEED_STRING;
+        break;
+    }
+  }
+  feed_scanned_ = feed_buffer_.size();
+  if (end == 0) {
+    return true;
+  }
+
+  // Evaluate the completed statements in place, as the part of the
+  // stream that they are.
+  StreamTokenizer st;
+  st.Reset(StringPiece(feed_buffer_.data(), end), feed_position_,
+           feed_line_number_);
+  st.set_max_history(max_history_);
+  Eval(st);
+  feed_failed_ = eval_failed_;
+  feed_position_ += end;
+  feed_line_number_ += std::count(feed_buffer_.begin(),
+                                  feed_buffer_.begin() + end, '\n');
+  feed_buffer_.erase(0, end);
+  feed_scanned_ -= end;
+  return !feed_failed_;
+}
+
+bool
+Interpreter::Finish() {
+  bool success = !feed_failed_;
+  if (success) {
+    StreamTokenizer st;
+    st.Reset(feed_buffer_, feed_position_, feed_line_number_);
+    st.set_max_history(max_history_);
+    Eval(st);
+    success = !eval_failed_;
+  }
+  feed_buffer_.clear();
+  feed_position_ = 0;
+  feed_line_number_ = 0;
+  feed_scanned_ = 0;
+  feed_state_ = FEED_CODE;
+  feed_failed_ = false;
+  return success;
+}
+
+namespace {
+
+// The first eight bytes of every snapshot file.
+const char kSnapshotMagic[] = "INFACTSS";
+
+// A marker written in native byte order, identifying the byte order of
+// the snapshot.
+const uint32_t kByteOrderMark = 0x01020304;
+
+// The kinds of records in a snapshot.
+enum RecordKind {
+  // The binary value of a primitive or primitive vector variable.
+  VALUE_RECORD = 0,
+  // The text of the value of some other assignment, to be evaluated.
+  STATEMENT_RECORD = 1
+};
+
+// Writes the fingerprint of the current process and of the specified
+// source text that must match for a snapshot to be valid.
+void
+WriteSnapshotHeader(const MappedFile &source, SnapshotWriter &writer) {
+  writer.WriteBytes(kSnapshotMagic, sizeof(kSnapshotMagic) - 1);
+  writer.WriteUint32(kSnapshotVersion);
+  writer.WriteUint32(kByteOrderMark);
+  writer.WriteUint8(sizeof(int));
+  writer.WriteUint8(sizeof(double));
+  writer.WriteUint64(source.size());
+  writer.WriteUint64(FingerprintBytes(source.data(), source.size()));
+  writer.WriteUint64(FingerprintFactories());
+}
+
+// Returns whether the header read from the specified reader is the one
+// that would be written for the specified source text.
+bool
+ReadSnapshotHeader(const MappedFile &source, SnapshotReader &reader) {
+  std::string expected;
+  {
+    ostringstream oss;
+    SnapshotWriter writer(oss);
+    WriteSnapshotHeader(source, writer);
+    expected = oss.str();
+  }
+  std::string actual(expected.size(), '\0');
+  return reader.ReadBytes(&actual[0], actual.size()) && actual == expected;
+}
+
+template <typename T>
+void
+WriteValue(const EnvironmentImpl *env, const string &varname,
+           SnapshotWriter &writer) {
+  T value = T();
+  env->Get(varname, &value);
+  SnapshotCodec<T>::Write(writer, value);
+}
+
+template <typename T>
+bool
+ReadValue(SnapshotReader &reader, const string &varname, const string &type,
+          Environment *env) {
+  T value;
+  if (!SnapshotCodec<T>::Read(reader, &value)) {
+    return false;
+  }
+  VarMap<T> *var_map = dynamic_cast<VarMap<T> *>(env->GetVarMapForType(type));
+  if (var_map == nullptr) {
+    return false;
+  }
+  var_map->Set(varname, std::move(value));
+  env->SetType(varname, type);
+  return true;
+}
+
+// Writes the binary value of the specified variable, if it is of a
+// primitive or primitive vector type, returning whether it was written.
+bool
+WriteValue(const EnvironmentImpl *env, const string &varname,
+           const string &type, SnapshotWriter &writer) {
+  if (type == "bool") {
+    WriteValue<bool>(env, varname, writer);
+  } else if (type == "int") {
+    WriteValue<int>(env, varname, writer);
+  } else if (type == "double") {
+    WriteValue<double>(env, varname, writer);
+  } else if (type == "string") {
+    WriteValue<string>(env, varname, writer);
+  } else if (type == "bool[]") {
+    WriteValue<vector<bool> >(env, varname, writer);
+  } else if (type == "int[]") {
+    WriteValue<vector<int> >(env, varname, writer);
+  } else if (type == "double[]") {
+    WriteValue<vector<double> >(env, varname, writer);
+  } else if (type == "string[]") {
+    WriteValue<vector<string> >(env, varname, writer);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Reads the binary value of the specified variable of a primitive or
+// primitive vector type and sets it in the specified environment.
+bool
+ReadValue(SnapshotReader &reader, const string &varname, const string &type,
+          Environment *env) {
+  if (type == "bool") {
+    return ReadValue<bool>(reader, varname, type, env);
+  } else if (type == "int") {
+    return ReadValue<int>(reader, varname, type, env);
+  } else if (type == "double") {
+    return ReadValue<double>(reader, varname, type, env);
+  } else if (type == "string") {
+    return ReadValue<string>(reader, varname, type, env);
+  } else if (type == "bool[]") {
+    return ReadValue<vector<bool> >(reader, varname, type, env);
+  } else if (type == "int[]") {
+    return ReadValue<vector<int> >(reader, varname, type, env);
+  } else if (type == "double[]") {
+    return ReadValue<vector<double> >(reader, varname, type, env);
+  } else if (type == "string[]") {
+    return ReadValue<vector<string> >(reader, varname, type, env);
+  }
+  return false;
+}
+
+}  // namespace
+
+bool
+Interpreter::EvalWithSnapshot(const string &filename,
+                              const string &snapshot_filename) {
+  if (LoadSnapshot(filename, snapshot_filename)) {
+    return true;
+  }
+  filename_ = filename;
+  MappedFile source(filename_);
+  if (!source.good()) {
+    Eval(filename);
+    return false;
+  }
+  StreamTokenizer st(source.data(), source.size());
+  st.set_max_history(max_history_);
+  statements_.clear();
+  recorded_import_ = false;
+  recording_ = true;
+  Eval(st);
+  recording_ = false;
+  // Only write a snapshot if evaluation did not stop at an error.
+  if (!eval_failed_ && !recorded_import_ &&
+      !SaveSnapshot(source, snapshot_filename)) {
+    cerr << "Interpreter: warning: could not write snapshot file "
+         << snapshot_filename << endl;
+  }
+  statements_.clear();
+  return false;
+}
+
+bool
+Interpreter::SaveSnapshot(const MappedFile &source,
+                          const string &snapshot_filename) const {
+  // Only the final assignment to each variable may be written as a
+  // binary value, since a statement replayed from its text may refer to
+  // an earlier value.
+  unordered_map<string, size_t> last_assignment;
+  for (size_t i = 0; i < statements_.size(); ++i) {
+    last_assignment[statements_[i].varname] = i;
+  }
+
+  // Write to a temporary file and rename it, so that readers never see
+  // a partially written snapshot.
+  string tmp_filename = snapshot_filename + ".tmp";
+  {
+    std::ofstream os(tmp_filename.c_str(), std::ios::binary);
+    SnapshotWriter writer(os);
+    WriteSnapshotHeader(source, writer);
+    writer.WriteUint64(statements_.size());
+    for (size_t i = 0; i < statements_.size(); ++i) {
+      const Statement &statement = statements_[i];
+      ostringstream value_oss;
+      SnapshotWriter value_writer(value_oss);
+      bool is_value = last_assignment[statement.varname] == i &&
+          WriteValue(env_, statement.varname, statement.type, value_writer);
+      writer.WriteUint8(is_value ? VALUE_RECORD : STATEMENT_RECORD);
+      writer.WriteString(statement.varname);
+      writer.WriteString(statement.type);
+      if (is_value) {
+        string value = value_oss.str();
+        writer.WriteBytes(value.data(), value.size());
+      } else {
+        writer.WriteString(string(source.data() + statement.start,
+                                  statement.end - statement.start));
+      }
+    }
+    os.close();
+    if (!writer.good() || os.fail()) {
+      remove(tmp_filename.c_str());
+      return false;
+    }
+  }
+  return rename(tmp_filename.c_str(), snapshot_filename.c_str()) == 0;
+}
+
+bool
+Interpreter::LoadSnapshot(const string &filename,
+                          const string &snapshot_filename) {
+  MappedFile snapshot(snapshot_filename);
+  if (!snapshot.good()) {
+    return false;
+  }
+  MappedFile source(filename);
+  if (!source.good()) {
+    return false;
+  }
+  SnapshotReader reader(snapshot.data(), snapshot.size());
+  uint64_t num_records;
+  if (!ReadSnapshotHeader(source, reader) || !reader.ReadUint64(&num_records)) {
+    return false;
+  }
+
+  // Replay the snapshot into a copy of the current environment, so that
+  // this interpreter is unmodified if the snapshot turns out to be bad.
+  std::unique_ptr<EnvironmentImpl> env(
+      dynamic_cast<EnvironmentImpl *>(env_->Copy()));
+  for (uint64_t i = 0; i < num_records; ++i) {
+    uint8_t kind;
+    string varname;
+    string type;
+    if (!reader.ReadUint8(&kind) || !reader.ReadString(&varname) ||
+        !reader.ReadString(&type)) {
+      return false;
+    }
+    if (kind == VALUE_RECORD) {
+      if (!ReadValue(reader, varname, type, env.get())) {
+        return false;
+      }
+    } else if (kind == STATEMENT_RECORD) {
+      string text;
+      if (!reader.ReadString(&text)) {
+        return false;
+      }
+      try {
+        StreamTokenizer::Recycled st(text);
+        env->ReadAndSet(varname, *st, type);
+      } catch (std::runtime_error &e) {
+        cerr << "Interpreter: warning: snapshot file " << snapshot_filename
+             << " has bad statement for variable " << varname << ": "
+             << e.what() << endl;
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  if (reader.remaining() != 0) {
+    return false;
+  }
+
+  delete env_;
+  env_ = env.release();
+  filename_ = filename;
+  return true;
+}
+
+bool
+Interpreter::Reload(const string &filename, vector<string> *rebound) {
+  if (rebound != nullptr) {
+    rebound->clear();
+  }
+  MappedFile source(filename);
+  if (!source.good()) {
+    cerr << "Interpreter: error: could not read file " << filename << endl;
+    return false;
+  }
+  const size_t kNoStatement = static_cast<size_t>(-1);
+  // Sets the reaching assignments of each statement: for each identifier
+  // in its value, the index of the most recent earlier statement
+  // assigning that identifier, or kNoStatement.  Also sets the index of
+  // the last statement assigning each variable.
+  auto find_assignments = [kNoStatement](
+      const vector<ReloadStatement> &statements,
+      vector<vector<size_t> > *reaching,
+      unordered_map<Symbol, size_t> *last_assignment) {
+    reaching->resize(statements.size());
+    for (size_t i = 0; i < statements.size(); ++i) {
+      if (statements[i].module != nullptr) {
+        // An import assigns every variable of its module.
+        const vector<Symbol> &variables = statements[i].module->variables();
+        for (size_t j = 0; j < variables.size(); ++j) {
+          (*last_assignment)[variables[j]] = i;
+        }
+        continue;
+      }
+      const vector<Symbol> &identifiers = statements[i].identifiers;
+      for (size_t j = 0; j < identifiers.size(); ++j) {
+        unordered_map<Symbol, size_t>::const_iterator it =
+            last_assignment->find(identifiers[j]);
+        (*reaching)[i].push_back(it == last_assignment->end() ?
+                                 kNoStatement : it->second);
+      }
+      (*last_assignment)[SymbolTable::Intern(statements[i].varname)] = i;
+    }
+  };
+
+  string old_filename = filename_;
+  filename_ = filename;
+  Stats *stats = collect_stats_ ? &stats_ : Stats::Current();
+  Stats::Scope stats_scope(stats);
+  vector<ReloadStatement> statements;
+  std::unique_ptr<EnvironmentImpl> env;
+  vector<string> new_values;
+  try {
+    // Read all the statements of the new version of the file.
+    StreamTokenizer st(source.data(), source.size());
+    while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+      ReloadStatement statement;
+      string import_filename;
+      statement.line_number = st.PeekTokenLineNumber();
+      if (ReadImport(st, &import_filename)) {
+        statement.module = LoadModule(import_filename);
+        statements.push_back(std::move(statement));
+        continue;
+      }
+      ReadAssignmentPrefix(st, &statement.type, &statement.varname);
+      statement.start = st.PeekTokenStart();
+      statement.line_number = st.PeekTokenLineNumber();
+      ReadStatementValue(st, &statement.text, &statement.identifiers);
+      if (st.PeekTokenType() == StreamTokenizer::EOF_TYPE) {
+        WrongTokenError(st.PeekTokenStart(), ";", "",
+                        StreamTokenizer::EOF_TYPE);
+      }
+      // Consume semicolon.
+      st.Next();
+      statements.push_back(std::move(statement));
+    }
+    if (stats != nullptr) {
+      stats->RecordTokens(st.tellg(), st.num_tokens());
+    }
+
+    vector<vector<size_t> > old_reaching;
+    unordered_map<Symbol, size_t> old_last_assignment;
+    find_assignments(reload_statements_, &old_reaching, &old_last_assignment);
+    vector<vector<size_t> > reaching;
+    unordered_map<Symbol, size_t> last_assignment;
+    find_assignments(statements, &reaching, &last_assignment);
+
+    // Evaluate the new statements in order, keeping the value of each
+    // statement identical to the last assignment of its variable in the
+    // old version, provided that every variable it refers to has been
+    // kept and holds the value from the same old statement.
+    if (reload_base_ == nullptr) {
+      reload_base_.reset(dynamic_cast<EnvironmentImpl *>(env_->Copy()));
+    }
+    env.reset(dynamic_cast<EnvironmentImpl *>(reload_base_->Copy()));
+    vector<size_t> kept(statements.size(), kNoStatement);
+    vector<bool> old_import_kept(reload_statements_.size(), false);
+    for (size_t i = 0; i < statements.size(); ++i) {
+      const ReloadStatement &statement = statements[i];
+      if (statement.module != nullptr) {
+        // Importing is cheap, so an import is always evaluated again, but
+        // it is kept, as far as the statements referring to its
+        // variables are concerned, if an old import had the same module.
+        env->Import(statement.module->env());
+        for (size_t j = 0; j < reload_statements_.size(); ++j) {
+          if (!old_import_kept[j] &&
+              reload_statements_[j].module == statement.module) {
+            old_import_kept[j] = true;
+            kept[i] = j;
+            break;
+          }
+        }
+        const vector<Symbol> &variables = statement.module->variables();
+        for (size_t j = 0; kept[i] == kNoStatement && j < variables.size();
+             ++j) {
+          if (last_assignment[variables[j]] == i) {
+            new_values.push_back(SymbolTable::Name(variables[j]));
+          }
+        }
+        continue;
+      }
+      Symbol varname = SymbolTable::Intern(statement.varname);
+      bool is_last = last_assignment[varname] == i;
+      unordered_map<Symbol, size_t>::const_iterator old_it =
+          old_last_assignment.find(varname);
+      size_t old_idx =
+          old_it == old_last_assignment.end() ? kNoStatement : old_it->second;
+      bool keep = is_last && old_idx != kNoStatement &&
+          reload_statements_[old_idx].module == nullptr &&
+          reload_statements_[old_idx].type == statement.type &&
+          reload_statements_[old_idx].text == statement.text;
+      for (size_t j = 0; keep && j < reaching[i].size(); ++j) {
+        size_t dependency = reaching[i][j];
+        keep = dependency == kNoStatement ?
+            old_reaching[old_idx][j] == kNoStatement :
+            kept[dependency] != kNoStatement &&
+            kept[dependency] == old_reaching[old_idx][j];
+      }
+      if (keep && env->CopyVariable(statement.varname, env_)) {
+        kept[i] = old_idx;
+        continue;
+      }
+      try {
+        Stats::Timer timer(stats, Stats::STATEMENT, statement.varname,
+                           statement.line_number);
+        StreamTokenizer::Recycled recycled_st(statement.text);
+        StreamTokenizer &statement_st = *recycled_st;
+        env->ReadAndSet(statement.varname, statement_st, statement.type);
+        if (statement_st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+          WrongTokenError(statement.start + statement_st.PeekTokenStart(),
+                          ";", statement_st.Peek(),
+                          statement_st.PeekTokenType());
+        }
+      }
+      catch (std::runtime_error &e) {
+        ostringstream err_ss;
+        err_ss << "Interpreter:" << filename_ << ": in statement assigning "
+               << statement.varname << " at line "
+               << (statement.line_number + 1) << ": " << e.what();
+        Error(err_ss.str());
+      }
+      if (is_last) {
+        new_values.push_back(statement.varname);
+      }
+    }
+    if (rebound != nullptr) {
+      *rebound = new_values;
+      for (size_t i = 0; i < reload_statements_.size(); ++i) {
+        vector<Symbol> variables;
+        if (reload_statements_[i].module != nullptr) {
+          variables = reload_statements_[i].module->variables();
+        } else {
+          variables.push_back(
+              SymbolTable::Intern(reload_statements_[i].varname));
+        }
+        for (size_t j = 0; j < variables.size(); ++j) {
+          if (old_last_assignment[variables[j]] == i &&
+              last_assignment.find(variables[j]) == last_assignment.end()) {
+            rebound->push_back(SymbolTable::Name(variables[j]));
+          }
+        }
+      }
+    }
+  }
+  catch (std::runtime_error &e) {
+    cerr << "threw exception: " << e.what() << endl;
+    filename_ = old_filename;
+    if (rebound != nullptr) {
+      rebound->clear();
+    }
+    return false;
+  }
+
+  delete env_;
+  env_ = env.release();
+  reload_statements_.swap(statements);
+  reload_fingerprint_ = FingerprintBytes(source.data(), source.size());
+  return true;
+}
+
+bool
+Interpreter::ReloadIfModified(const string &filename,
+                              vector<string> *rebound) {
+  if (rebound != nullptr) {
+    rebound->clear();
+  }
+  if (reload_base_ != nullptr && filename == filename_) {
+    MappedFile source(filename);
+    if (source.good() &&
+        FingerprintBytes(source.data(), source.size()) ==
+        reload_fingerprint_) {
+      return false;
+    }
+  }
+  return Reload(filename, rebound);
+}
+
+Interpreter::MemoryReport
+Interpreter::MemoryUsage() const {
+  MemoryReport report;
+  report.statement_bytes =
+      reload_statements_.capacity() * sizeof(ReloadStatement);
+  for (size_t i = 0; i < reload_statements_.size(); ++i) {
+    const ReloadStatement &statement = reload_statements_[i];
+    report.statement_bytes += statement.varname.capacity() +
+        statement.type.capacity() + statement.text.capacity() +
+        statement.identifiers.capacity() * sizeof(Symbol);
+  }
+  report.input_bytes = feed_buffer_.capacity();
+  report.environment_bytes = env_->MemoryUsage(&report.var_maps);
+  return report;
+}
+
+void
+Interpreter::Compact() {
+  vector<ReloadStatement>().swap(reload_statements_);
+  feed_buffer_.shrink_to_fit();
+  env_->Compact();
+  if (reload_base_ != nullptr) {
+    reload_base_->Compact();
+  }
+}
+
 void
 Interpreter::WrongTokenError(size_t pos,
                              const string &expected,
@@ -39,16 +39,23 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "environment-impl.h"
+#include "mapped-file.h"
+#include "module-cache.h"
+#include "stats.h"
+#include "validator.h"
 
 namespace infact {
 
 using std::iostream;
 using std::ifstream;
+using std::vector;
 
 class EnvironmentImpl;
 
@@ -128,7 +135,8 @@ class EnvironmentImpl;
 ///   <td><tt>\<statement\></tt></td>
 ///   <td><tt>::=</tt></td>
 ///   <td>
-///     <tt>[ \<type_specifier\> ] \<variable_name\> '=' \<value\> ';' </tt>
+///     <tt>[ \<type_specifier\> ] \<variable_name\> '=' \<value\> ';' |<br>
+///         'import' \<filename_string\> ';'</tt>
 ///   </td>
 /// </tr>
 /// <tr>
@@ -137,7 +145,8 @@ class EnvironmentImpl;
 ///   <td valign=top>
 ///     <table border="0">
 ///       <tr><td><tt>"bool" | "int" | "string" | "double" | "bool[]" | "int[]"
-///                   "string[]" | "double[]" | T | T[]</tt></td></tr>
+///                   "string[]" | "double[]" | "int_view" |
+///                   "double_view" | T | T[]</tt></td></tr>
 ///       <tr><td>where <tt>T</tt> is any \link infact::Factory
 ///               Factory\endlink-constructible type.</td></tr>
 ///     </table>
@@ -152,7 +161,30 @@ class EnvironmentImpl;
 ///   <td valign=top><tt>\<value\></tt></td>
 ///   <td valign=top><tt>::=</tt></td>
 ///   <td valign=top><tt>\<literal\> | '{' \<literal_list\> '}' |<br>
-///                      \<spec_or_null\> | '{' \<spec_list\> '}'</tt>
+///                      \<spec_or_null\> | '{' \<spec_list\> '}' |<br>
+///                      '{' \<sweep\> '}' |<br>
+///                      '@mmap' '(' \<filename_string\> ')'</tt><br>
+///       where the last form is a memory-mapped array of raw values, for a
+///       variable of a view type (see \link infact::ArrayView
+///       ArrayView\endlink)
+///   </td>
+/// </tr>
+/// <tr>
+///   <td valign=top><tt>\<sweep\></tt></td>
+///   <td valign=top><tt>::=</tt></td>
+///   <td valign=top><tt>[ 'for' \<variable_name\> 'in'
+///                        \<sweep_values\> ]+ \<spec\></tt><br>
+///       where the spec is of the element type of an explicitly-typed
+///       vector, and may refer to the variables of the sweep (see \link
+///       infact::Sweep Sweep\endlink)
+///   </td>
+/// </tr>
+/// <tr>
+///   <td valign=top><tt>\<sweep_values\></tt></td>
+///   <td valign=top><tt>::=</tt></td>
+///   <td valign=top><tt>'{' \<value\> [ ',' \<value\> ]* [','] '}' |<br>
+///                      'range' '(' \<int_literal\> ',' \<int_literal\>
+///                      [ ',' \<int_literal\> ] ')'</tt>
 ///   </td>
 /// </tr>
 /// </table>
@@ -162,12 +194,29 @@ class EnvironmentImpl;
 /// they do in C++, i.e., everything after the <tt>//</tt> to the end
 /// of the current line is treated as a comment and ignored.  There
 /// are no C-style comments in this language.
+///
+/// An <tt>import</tt> statement, such as
+/// \code
+/// import "common.infact";
+/// \endcode
+/// defines every variable defined by the specified file, with the
+/// same value, as if the statements of the file had been evaluated in
+/// place.  A relative filename is relative to the directory of the
+/// importing file, if any.  The file is evaluated on its own, without
+/// access to the variables of its importer, and only once per process
+/// for as long as it is unchanged (see \link infact::ModuleCache
+/// ModuleCache\endlink), so that every importer shares the values,
+/// including the objects, it defines.
 class Interpreter {
  public:
   /// Constructs a new instance with the specified debug level.  The
   /// wrapped \link infact::Environment Environment \endlink will
   /// also have the specified debug level.
-  Interpreter(int debug = 0) {
+  Interpreter(int debug = 0) :
+      max_history_(0), num_threads_(0), recording_(false),
+      recorded_import_(false), reload_fingerprint_(0), collect_stats_(false),
+      eval_failed_(false), feed_position_(0), feed_line_number_(0),
+      feed_scanned_(0), feed_state_(FEED_CODE), feed_failed_(false) {
     env_ = new EnvironmentImpl(debug);
   }
 
@@ -176,25 +225,378 @@ class Interpreter {
     delete env_;
   }
 
-  /// Evaluates the statements in the specified text file.
+  /// Puts every \link infact::StreamTokenizer StreamTokenizer \endlink
+  /// subsequently created by this interpreter into bounded history
+  /// mode, so that memory used while evaluating a stream does not grow
+  /// with the length of the stream.
+  ///
+  /// \param num_tokens the number of consumed tokens each tokenizer keeps
+  ///                   for rewinding, or 0 to keep all tokens (the
+  ///                   default)
+  ///
+  /// \see StreamTokenizer::set_max_history
+  void set_max_history(size_t num_tokens) { max_history_ = num_tokens; }
+
+  /// Makes this interpreter evaluate independent statements
+  /// concurrently, using the specified number of threads.
+  ///
+  /// In this mode, all the statements of a stream are read before any
+  /// is evaluated.  A statement depends on the most recent earlier
+  /// statement assigning each variable it refers to, and is evaluated
+  /// once those statements have been evaluated, so that, for example,
+  /// several expensive objects that do not refer to one another are
+  /// constructed at the same time.  The resulting environment is
+  /// identical to the one resulting from sequential evaluation.  If
+  /// any statement causes an error, the environment holds the results
+  /// of exactly the statements preceding the first such statement in
+  /// the stream, and only that error is reported, with exactly the
+  /// message sequential evaluation would report.
+  ///
+  /// The objects of each sweep (see \link infact::Sweep Sweep\endlink)
+  /// are likewise constructed using the specified number of threads.
+  ///
+  /// Objects constructed concurrently must not share unsynchronized
+  /// state, for instance in their \link
+  /// infact::FactoryConstructible::PostInit PostInit \endlink methods.
+  ///
+  /// \param num_threads the number of threads with which to evaluate
+  ///                    statements, or 0 or 1 to evaluate them one after
+  ///                    another (the default)
+  void set_num_threads(size_t num_threads) {
+    num_threads_ = num_threads;
+    env_->set_sweep_threads(num_threads);
+    if (reload_base_ != nullptr) {
+      reload_base_->set_sweep_threads(num_threads);
+    }
+  }
+
+  /// Makes this interpreter allocate every object it subsequently
+  /// constructs, along with its <tt>shared_ptr</tt> control block, in
+  /// the specified arena, so that the objects of a configuration are
+  /// close together in memory and their memory is freed at once, when
+  /// the last of them is destroyed.
+  ///
+  /// \param arena the arena in which to allocate objects, or
+  ///              <tt>nullptr</tt> to allocate them on the heap (the
+  ///              default)
+  ///
+  /// \see infact::Environment::set_arena
+  void set_arena(const shared_ptr<Arena> &arena) {
+    env_->set_arena(arena);
+    if (reload_base_ != nullptr) {
+      reload_base_->set_arena(arena);
+    }
+  }
+
+  /// Makes this interpreter construct each object it subsequently
+  /// assigns to a variable by a spec only once the object is first
+  /// needed, so that objects that are never retrieved are never
+  /// constructed.  Each object is constructed at most once, even if
+  /// retrieved by several threads at once.  Errors constructing an
+  /// object are reported by whatever first retrieves it, such as \link
+  /// Get\endlink, which then throws.
+  ///
+  /// \see infact::Environment::set_lazy
+  void set_lazy(bool lazy) {
+    env_->set_lazy(lazy);
+    if (reload_base_ != nullptr) {
+      reload_base_->set_lazy(lazy);
+    }
+  }
+
+  /// Makes this interpreter record, in \link stats\endlink, the time
+  /// spent on each statement it subsequently evaluates, the objects
+  /// constructed and the time spent constructing them, the bytes and
+  /// tokens read and the environments copied.  The overhead is a few
+  /// clock readings per object constructed.
+  ///
+  /// When not collecting its own statistics (the default), this
+  /// interpreter records them in the current \link infact::Stats Stats
+  /// \endlink instance of the calling thread, if there is one (see
+  /// \link infact::Stats::Scope Stats::Scope\endlink).
+  void set_collect_stats(bool collect_stats) {
+    collect_stats_ = collect_stats;
+  }
+
+  /// Returns the statistics recorded by this interpreter (see \link
+  /// set_collect_stats\endlink).
+  Stats &stats() { return stats_; }
+
+  /// \copydoc stats()
+  const Stats &stats() const { return stats_; }
+
+  /// An estimate of the memory held by an interpreter.
+  ///
+  /// \see MemoryUsage
+  struct MemoryReport {
+    /// The bytes held for the statements last evaluated by \link Reload
+    /// \endlink, which it compares with the statements of the next
+    /// version of the file.
+    size_t statement_bytes;
+    /// The bytes held for input fed to the interpreter (see \link Feed
+    /// \endlink) that has yet to be evaluated.
+    size_t input_bytes;
+    /// The bytes held by the environment for the names and types of its
+    /// variables.
+    size_t environment_bytes;
+    /// The memory used by the variables of each type, including the
+    /// number of objects held by the variables of each Factory type.
+    vector<VarMapUsage> var_maps;
+
+    /// Returns the total estimated number of bytes.
+    size_t total_bytes() const {
+      size_t bytes = statement_bytes + input_bytes + environment_bytes;
+      for (size_t i = 0; i < var_maps.size(); ++i) {
+        bytes += var_maps[i].bytes;
+      }
+      return bytes;
+    }
+  };
+
+  /// Returns an estimate of the memory held by this interpreter.  Values
+  /// shared with other interpreters, such as those of imported
+  /// variables, are counted in full; the memory owned by objects is not
+  /// counted, only their number.
+  MemoryReport MemoryUsage() const;
+
+  /// Releases the memory held by this interpreter that is not needed to
+  /// hold the current values of its variables: the statements kept for
+  /// \link Reload\endlink, spare capacity for fed input, and the storage
+  /// of variables that have since been assigned again.  Every variable
+  /// keeps its type and value, and handles to variables remain valid.
+  /// The next invocation of \link Reload \endlink evaluates every
+  /// statement of the file again.
+  ///
+  /// This method must not be invoked concurrently with any other method
+  /// of this interpreter.
+  void Compact();
+
+  /// Evaluates the statements in the specified text file.  The file is
+  /// memory-mapped and tokenized in place when possible.
   void Eval(const string &filename) {
     filename_ = filename;
-    ifstream file(filename_.c_str());
-    Eval(file);
+    MappedFile mapped_file(filename_);
+    if (mapped_file.good()) {
+      StreamTokenizer st(mapped_file.data(), mapped_file.size());
+      st.set_max_history(max_history_);
+      Eval(st);
+    } else {
+      ifstream file(filename_.c_str());
+      Eval(file);
+    }
   }
 
+  /// Evaluates the statements in the specified text file, exactly as
+  /// \link Eval(const string&) Eval \endlink does, unless the specified
+  /// snapshot file holds a valid snapshot of the results of evaluating
+  /// that file, in which case the snapshot is loaded instead (see \link
+  /// LoadSnapshot \endlink).  Otherwise, after the file has been
+  /// evaluated without error, a new snapshot is written to the snapshot
+  /// file, to be used by subsequent invocations.
+  ///
+  /// A snapshot holds the values of all primitive and primitive vector
+  /// variables in binary form, along with the text of the statements
+  /// that assigned \link infact::Factory Factory\endlink-constructible
+  /// objects, which are evaluated again when the snapshot is loaded.
+  /// No snapshot is written of a file containing an <tt>import</tt>
+  /// statement, since the snapshot could not be checked against the
+  /// contents of the imported file.
+  ///
+  /// \param filename          the name of the text file to evaluate
+  /// \param snapshot_filename the name of the snapshot file to read or
+  ///                          write
+  /// \return whether the results of evaluating the file were loaded from
+  ///         the snapshot file
+  bool EvalWithSnapshot(const string &filename,
+                        const string &snapshot_filename);
+
+  /// Loads the specified snapshot of the results of evaluating the
+  /// specified text file, as written by \link EvalWithSnapshot
+  /// \endlink.  A snapshot is only valid if the contents of the text
+  /// file, the registered \link infact::Factory Factory \endlink
+  /// types and the snapshot format are all the same as when it was
+  /// written.  Loading replaces the environment of this interpreter
+  /// (see \link env \endlink) with a new one.
+  ///
+  /// \param filename          the name of the text file of which the
+  ///                          snapshot was made
+  /// \param snapshot_filename the name of the snapshot file
+  /// \return whether the snapshot was valid and was loaded; if not, this
+  ///         interpreter is left unmodified
+  bool LoadSnapshot(const string &filename, const string &snapshot_filename);
+
+  /// Evaluates the statements in the specified text file incrementally,
+  /// re-evaluating only what has changed since the file was last
+  /// evaluated by this method.
+  ///
+  /// The first invocation evaluates every statement.  Each subsequent
+  /// invocation compares the statements of the file with those it
+  /// evaluated last time, and re-evaluates only the statements that
+  /// have changed, along with every statement that refers, directly
+  /// or transitively, to a variable assigned by a re-evaluated
+  /// statement.  The value of every other variable, such as a
+  /// previously constructed object, is kept as it is.  The resulting
+  /// environment is the one that would result from evaluating the new
+  /// file with \link Eval(const string&) Eval \endlink in the
+  /// environment this interpreter had before the first invocation.
+  ///
+  /// A statement is only ever kept if it is the last assignment of its
+  /// variable in both versions of the file; the environment must not be
+  /// otherwise modified between invocations.
+  ///
+  /// The new environment is built separately and replaces this
+  /// interpreter&rsquo;s environment (see \link env \endlink) only once
+  /// every statement has been evaluated without error; otherwise the
+  /// error is reported and this interpreter is left unmodified.
+  /// Replacing the environment invalidates any \link
+  /// infact::VarHandle VarHandle \endlink obtained from this interpreter.
+  ///
+  /// \param filename the name of the text file to evaluate
+  /// \param rebound  if not <tt>nullptr</tt>, set to the names of the
+  ///                 variables whose values are new, followed by those no
+  ///                 longer defined by the file
+  /// \return whether the file was evaluated without error
+  bool Reload(const string &filename, vector<string> *rebound = nullptr);
+
+  /// Invokes \link Reload \endlink on the specified file if its contents
+  /// have changed since it was last evaluated by \link Reload\endlink,
+  /// for use by a caller that polls the file for changes.
+  ///
+  /// \param filename the name of the text file to evaluate
+  /// \param rebound  if not <tt>nullptr</tt>, set as by \link Reload
+  ///                 \endlink, or cleared if the file was not evaluated
+  /// \return whether the file had changed and was evaluated without error
+  bool ReloadIfModified(const string &filename,
+                        vector<string> *rebound = nullptr);
+
+  /// The result of evaluating one of the files of a batch (see \link
+  /// EvalBatch\endlink).
+  struct BatchResult {
+    /// The name of the file evaluated.
+    string filename;
+    /// The interpreter that evaluated the file, whose environment holds
+    /// the variables the file defined, along with those of the base
+    /// environment.
+    std::unique_ptr<Interpreter> interpreter;
+    /// Whether the file was read and evaluated without error.
+    bool success;
+    /// The error that stopped evaluation, if any.
+    string error;
+  };
+
+  /// Evaluates each of the specified files in its own interpreter,
+  /// evaluating many files at once, as when loading the configurations
+  /// of many independent tenants of a server.  Every interpreter starts
+  /// with a copy of the specified base environment, made in constant
+  /// time (see \link infact::EnvironmentImpl::Copy
+  /// EnvironmentImpl::Copy\endlink), so that the variables of the base
+  /// environment are shared rather than evaluated again for each file.
+  ///
+  /// Each thread evaluates one file at a time, taking the next
+  /// unevaluated file, largest first, as soon as it is done with the
+  /// last, so that threads are kept busy until every file has been
+  /// taken.  The files must not share unsynchronized state, as with
+  /// \link set_num_threads\endlink.
+  ///
+  /// \param filenames   the names of the files to evaluate
+  /// \param base        the environment from which each interpreter
+  ///                    starts, or <tt>nullptr</tt> to start with an
+  ///                    empty one; it is frozen by this method, and must
+  ///                    not be modified while it runs
+  /// \param num_threads the number of threads with which to evaluate
+  ///                    files, or 0 to use one per hardware thread
+  /// \param results     set to the result of each file, in the order of
+  ///                    <tt>filenames</tt>
+  /// \return whether every file was evaluated without error
+  static bool EvalBatch(const vector<string> &filenames,
+                        const EnvironmentImpl *base, size_t num_threads,
+                        vector<BatchResult> *results);
+
   /// Evaluates the statements in the specified string.
   void EvalString(const string& input) {
-    StreamTokenizer st(input);
-    Eval(st);
+    StreamTokenizer::Recycled st(input);
+    st->set_max_history(max_history_);
+    Eval(*st);
   }
 
   /// Evaluates the statements in the specified stream.
   void Eval(istream &is) {
     StreamTokenizer st(is);
+    st.set_max_history(max_history_);
     Eval(st);
   }
 
+  /// Feeds the specified bytes of a stream of statements to this
+  /// interpreter, which evaluates every statement they complete, so
+  /// that a stream arriving piece by piece, for example from a
+  /// non-blocking socket, is evaluated as it arrives without a thread
+  /// waiting for the rest of it.  The bytes of an unfinished final
+  /// statement, even one ending within a token, are kept until a later
+  /// invocation completes it.  Once the stream has ended, \link Finish
+  /// \endlink must be invoked.
+  ///
+  /// As with \link Eval(istream&) Eval\endlink, evaluation stops at the
+  /// first error: this and every subsequent invocation then return
+  /// <tt>false</tt>, ignoring their bytes, until \link Finish \endlink
+  /// is invoked.  Stream positions and line numbers in error messages
+  /// are those of the whole stream, exactly as \link Eval(istream&) Eval
+  /// \endlink would report them.
+  ///
+  /// \param data the next bytes of the stream
+  /// \param size the number of bytes
+  /// \return whether every statement of the stream evaluated so far was
+  ///         evaluated without error
+  bool Feed(const char *data, size_t size);
+
+  /// Ends the stream fed to this interpreter by \link Feed\endlink,
+  /// evaluating what remains of it, which is an unfinished statement
+  /// unless it consists only of whitespace and comments, so that a new
+  /// stream may be fed.
+  ///
+  /// \return whether every statement of the stream was evaluated
+  ///         without error
+  bool Finish();
+
+  /// Checks the statements in the specified text file without
+  /// evaluating them or constructing any objects, reporting every
+  /// problem found instead of stopping at the first; statements may
+  /// refer to variables already defined in this interpreter.  Never
+  /// throws.  To check many files, reuse a single \link
+  /// infact::Validator Validator \endlink instead.
+  ///
+  /// \param filename    the name of the text file to check
+  /// \param diagnostics if non-null, the vector to which to append a
+  ///                    diagnostic for each problem found
+  /// \return whether the file exists and is free of problems
+  bool Validate(const string &filename,
+                vector<Diagnostic> *diagnostics) const {
+    Validator validator(env_);
+    validator.set_filename(filename);
+    MappedFile mapped_file(filename);
+    if (mapped_file.good()) {
+      StreamTokenizer st(mapped_file.data(), mapped_file.size());
+      return validator.Validate(st, diagnostics);
+    }
+    ifstream file(filename.c_str());
+    if (!file) {
+      if (diagnostics != nullptr) {
+        Diagnostic diagnostic = { 0, 0, "could not open file " + filename };
+        diagnostics->push_back(diagnostic);
+      }
+      return false;
+    }
+    return validator.Validate(file, diagnostics);
+  }
+
+  /// Checks the statements in the specified string, exactly as \link
+  /// Validate \endlink checks those of a file.
+  bool ValidateString(const string &input,
+                      vector<Diagnostic> *diagnostics) const {
+    Validator validator(env_);
+    validator.set_filename(filename_);
+    return validator.ValidateString(input, diagnostics);
+  }
+
 
   void PrintEnv(ostream &os) const {
     env_->Print(os);
@@ -218,6 +620,33 @@ class Interpreter {
     return env_->Get(varname, value);
   }
 
+  /// Returns a handle through which the value of the specified variable
+  /// may be read repeatedly and cheaply, without copying it.  The
+  /// handle remains valid for as long as this interpreter&rsquo;s
+  /// environment, and so is invalidated by \link LoadSnapshot
+  /// \endlink.
+  ///
+  /// \tparam T the type of the variable
+  ///
+  /// \see infact::EnvironmentImpl::GetHandle
+  template<typename T>
+  VarHandle<T> GetHandle(const string &varname) const {
+    return env_->GetHandle<T>(varname);
+  }
+
+  /// Returns the immutable storage holding the value of the specified
+  /// variable, which outlives any later reassignment of the variable,
+  /// or <tt>nullptr</tt> if the variable is not defined with type
+  /// <tt>T</tt>.
+  ///
+  /// \tparam T the type of the variable
+  ///
+  /// \see infact::EnvironmentImpl::GetShared
+  template<typename T>
+  shared_ptr<const T> GetShared(const string &varname) const {
+    return env_->GetShared<T>(varname);
+  }
+
   /// Returns a pointer to the environment of this interpreter.
   /// Crucially, this method returns a pointer to the Environment
   /// implementation class, \link infact::EnvironmentImpl
@@ -227,9 +656,89 @@ class Interpreter {
   EnvironmentImpl *env() { return env_; }
 
  private:
+  friend class ModuleCache;
+
+  /// A statement evaluated while recording, for snapshots.
+  struct Statement {
+    /// The name of the variable assigned.
+    string varname;
+    /// The type of the variable after the assignment.
+    string type;
+    /// The byte range of the value assigned in the underlying stream.
+    size_t start;
+    size_t end;
+  };
+
+  /// A statement evaluated by \link Reload\endlink.
+  struct ReloadStatement {
+    /// The name of the variable assigned.
+    string varname;
+    /// The explicit type of the variable, or the empty string.
+    string type;
+    /// The text of the value assigned.
+    string text;
+    /// The interned identifiers appearing in the value.
+    vector<Symbol> identifiers;
+    /// The byte offset in the file at which the value starts.
+    size_t start;
+    /// The line of the file on which the value starts.
+    size_t line_number;
+    /// The module imported by this statement, or <tt>nullptr</tt> if
+    /// this statement is an assignment.
+    shared_ptr<const Module> module;
+  };
+
   /// Evalutes the expressions contained in the specified token stream.
   void Eval(StreamTokenizer &st);
 
+  /// Evaluates the expressions contained in the specified token stream
+  /// concurrently (see \link set_num_threads \endlink).
+  void EvalParallel(StreamTokenizer &st);
+
+  /// Evaluates the statements in the specified token stream one after
+  /// another.
+  void EvalSequential(StreamTokenizer &st);
+
+  /// Reads the optional type specifier, the variable name and the
+  /// equals sign of the next assignment statement from the specified
+  /// token stream.
+  ///
+  /// \param st      the token stream from which to read
+  /// \param type    set to the abstract type of the type specifier, or to
+  ///                the empty string if there is none
+  /// \param varname set to the name of the variable assigned
+  void ReadAssignmentPrefix(StreamTokenizer &st, string *type,
+                            string *varname) const;
+
+  /// Reads an import statement from the specified token stream, if the
+  /// next statement is one, including its terminating semicolon.
+  ///
+  /// \param st       the token stream from which to read
+  /// \param filename set to the name of the imported file
+  /// \return whether the next statement was an import statement
+  bool ReadImport(StreamTokenizer &st, string *filename) const;
+
+  /// Returns the module of the specified imported file, resolved
+  /// against the directory of the file being interpreted.
+  shared_ptr<const Module> LoadModule(const string &filename) const;
+
+  /// Reads the tokens of the value of an assignment statement from the
+  /// specified token stream, up to but not including the terminating
+  /// semicolon (or the end of the stream).
+  ///
+  /// \param st          the token stream from which to read
+  /// \param text        set to the text of the value
+  /// \param identifiers the interned identifiers appearing in the value,
+  ///                    which include every variable the value refers
+  ///                    to, are appended to this vector
+  void ReadStatementValue(StreamTokenizer &st, string *text,
+                          vector<Symbol> *identifiers) const;
+
+  /// Writes a snapshot of the results of evaluating the specified
+  /// source text, whose statements were recorded by \link Eval \endlink.
+  bool SaveSnapshot(const MappedFile &source,
+                    const string &snapshot_filename) const;
+
   void WrongTokenError(size_t pos,
                        const string &expected,
                        const string &found,
@@ -251,6 +760,72 @@ class Interpreter {
   /// The name of the file being interpreted, or the empty string if there
   /// is no file associated with the stream being interpreted.
   string filename_;
+
+  /// The number of consumed tokens kept by each tokenizer, or 0 for all.
+  size_t max_history_;
+
+  /// The number of threads with which to evaluate statements.
+  size_t num_threads_;
+
+  /// Whether statements are being recorded in statements_.
+  bool recording_;
+
+  /// The statements recorded while evaluating, for snapshots.
+  vector<Statement> statements_;
+
+  /// Whether an import statement was evaluated while recording.
+  bool recorded_import_;
+
+  /// The environment in which \link Reload \endlink evaluates files,
+  /// or <tt>nullptr</tt> if it has not been invoked.
+  std::unique_ptr<EnvironmentImpl> reload_base_;
+
+  /// The statements of the file last evaluated by \link Reload\endlink.
+  vector<ReloadStatement> reload_statements_;
+
+  /// The fingerprint of the file last evaluated by \link Reload\endlink.
+  uint64_t reload_fingerprint_;
+
+  /// Whether to record statistics in stats_.
+  bool collect_stats_;
+
+  /// The statistics recorded by this interpreter.
+  Stats stats_;
+
+  /// Whether the last invocation of Eval reported an error.
+  bool eval_failed_;
+
+  /// The error reported by the last invocation of Eval, if any.
+  string eval_error_;
+
+  /// The lexical states of the bytes fed to this interpreter, as they
+  /// affect whether a semicolon terminates a statement.
+  enum FeedState {
+    FEED_CODE,     ///< Outside any comment or string literal.
+    FEED_SLASH,    ///< Just after a slash, possibly starting a comment.
+    FEED_COMMENT,  ///< Within a comment.
+    FEED_STRING,   ///< Within a string literal.
+    FEED_ESCAPE    ///< Just after a backslash within a string literal.
+  };
+
+  /// The bytes fed to this interpreter not yet evaluated.
+  string feed_buffer_;
+
+  /// The stream position of the first byte of feed_buffer_.
+  size_t feed_position_;
+
+  /// The line number of the first byte of feed_buffer_.
+  size_t feed_line_number_;
+
+  /// The number of bytes of feed_buffer_ already scanned for the ends
+  /// of statements.
+  size_t feed_scanned_;
+
+  /// The lexical state after the bytes of feed_buffer_ scanned so far.
+  FeedState feed_state_;
+
+  /// Whether a statement fed to this interpreter caused an error.
+  bool feed_failed_;
 };
 
 }  // namespace infact
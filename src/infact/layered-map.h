@@ -0,0 +1,251 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::LayeredMap LayeredMap \endlink class, a
+/// copy-on-write map from names to values used to give every
+/// \link infact::Environment Environment \endlink copy its own scope
+/// without copying the bindings of the environment it was copied from.
+
+#ifndef INFACT_LAYERED_MAP_H_
+#define INFACT_LAYERED_MAP_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace infact {
+
+using std::shared_ptr;
+using std::string;
+using std::unordered_map;
+using std::unordered_set;
+
+/// A map from keys of type <tt>K</tt> to values of type <tt>V</tt> that
+/// can be copied in constant time.
+///
+/// Each instance holds a mutable map of its own bindings on top of a
+/// chain of immutable, shared layers.  Copying an instance first
+/// &ldquo;freezes&rdquo; the source, moving its own bindings into a new
+/// shared layer, after which both the source and the copy simply point
+/// to that layer and start out with no bindings of their own.
+/// Subsequent modifications to either instance are therefore invisible
+/// to the other, exactly as if the copy had been a deep copy.
+///
+/// To keep lookups cheap, a newly frozen layer is merged with the
+/// layer beneath it for as long as the layer beneath it is no more
+/// than twice its size.  As a result, the number of layers is
+/// logarithmic in the number of bindings, and each binding is copied
+/// a logarithmic number of times over the lifetime of all copies.
+///
+/// Copying an instance modifies the internal representation of the
+/// source (but not its observable contents), under a mutex, so that
+/// any number of threads may copy the same instance concurrently.
+/// Lookups made concurrently with copies are only safe after \link
+/// Freeze \endlink has been invoked and while no further modifications
+/// are made, since a copy of an instance that is not frozen moves its
+/// bindings.
+///
+/// \tparam V the type of values stored in this map
+/// \tparam K the type of keys of this map
+template <typename V, typename K = string>
+class LayeredMap {
+ public:
+  /// Constructs a new, empty map.
+  LayeredMap() { }
+
+  /// Constructs a copy of the specified map in constant time.
+  LayeredMap(const LayeredMap &other) {
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    other.FreezeLocked();
+    frozen_ = other.frozen_;
+  }
+
+  /// Makes this map a copy of the specified map in constant time.
+  LayeredMap &operator=(const LayeredMap &other) {
+    if (this != &other) {
+      std::lock_guard<std::mutex> lock(other.mutex_);
+      other.FreezeLocked();
+      local_.clear();
+      frozen_ = other.frozen_;
+    }
+    return *this;
+  }
+
+  /// Returns a pointer to the value bound to the specified key, or
+  /// <tt>nullptr</tt> if there is no such binding.  The returned pointer
+  /// is valid until this map is next modified, frozen or copied, since
+  /// freezing may merge the layer holding the binding into a new one
+  /// and release it.
+  const V *Find(const K &key) const {
+    typename unordered_map<K, V>::const_iterator it = local_.find(key);
+    if (it != local_.end()) {
+      return &(it->second);
+    }
+    for (const Layer *layer = frozen_.get(); layer != nullptr;
+         layer = layer->parent.get()) {
+      it = layer->vars.find(key);
+      if (it != layer->vars.end()) {
+        return &(it->second);
+      }
+    }
+    return nullptr;
+  }
+
+  /// Returns whether there is a binding for the specified key.
+  bool Contains(const K &key) const {
+    return Find(key) != nullptr;
+  }
+
+  /// Binds the specified key to the specified value, shadowing any binding
+  /// for the same key this map may share with other copies.
+  void Set(const K &key, const V &value) {
+    local_[key] = value;
+  }
+
+  /// Invokes the specified function with every visible (key, value) pair
+  /// in this map; shadowed bindings are not visited.
+  ///
+  /// \tparam F a function or function object with the signature
+  ///           <tt>void(const K &, const V &)</tt>
+  template <typename F>
+  void ForEach(F f) const {
+    unordered_set<K> seen;
+    Visit(local_, seen, f);
+    for (const Layer *layer = frozen_.get(); layer != nullptr;
+         layer = layer->parent.get()) {
+      Visit(layer->vars, seen, f);
+    }
+  }
+
+  /// Returns an estimate of the number of bytes used by the bindings of
+  /// this map, including shadowed bindings and those in layers shared
+  /// with other copies, but not counting any memory owned by the keys
+  /// and values themselves.
+  size_t BytesUsed() const {
+    size_t bytes = TableBytes(local_);
+    for (const Layer *layer = frozen_.get(); layer != nullptr;
+         layer = layer->parent.get()) {
+      bytes += sizeof(Layer) + TableBytes(layer->vars);
+    }
+    return bytes;
+  }
+
+  /// Replaces the layers beneath this map with bindings owned by this
+  /// map, one for each visible binding.  The layers, along with the
+  /// bindings they shadow, are released unless shared with other copies;
+  /// the observable contents of this map are unchanged.
+  void Compact() {
+    if (frozen_ == nullptr) {
+      return;
+    }
+    unordered_map<K, V> vars;
+    ForEach([&vars](const K &key, const V &value) {
+        vars.insert(std::make_pair(key, value));
+      });
+    local_.swap(vars);
+    frozen_.reset();
+  }
+
+  /// Moves all bindings owned by this map into a new immutable layer,
+  /// so that this map may be copied without further modification.
+  /// Although this method is <tt>const</tt>, it invalidates the
+  /// pointers returned by \link Find\endlink.
+  void Freeze() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FreezeLocked();
+  }
+
+ private:
+  /// An immutable set of bindings, possibly shared among many maps.
+  struct Layer {
+    /// The bindings of this layer.
+    unordered_map<K, V> vars;
+    /// The older layer beneath this one, or <tt>nullptr</tt>.
+    shared_ptr<const Layer> parent;
+  };
+
+  /// Does the work of \link Freeze\endlink; mutex_ must be held.
+  void FreezeLocked() const {
+    if (local_.empty()) {
+      return;
+    }
+    shared_ptr<Layer> layer(new Layer());
+    layer->vars.swap(local_);
+    layer->parent = frozen_;
+    while (layer->parent != nullptr &&
+           layer->parent->vars.size() <= 2 * layer->vars.size()) {
+      // Bindings in the newer layer shadow those in the older one, and
+      // insert never overwrites an existing key.
+      layer->vars.insert(layer->parent->vars.begin(),
+                         layer->parent->vars.end());
+      layer->parent = layer->parent->parent;
+    }
+    frozen_ = layer;
+  }
+
+  /// Returns an estimate of the number of bytes used by the specified
+  /// table: one node per binding, holding the binding and a link to the
+  /// next node, and one pointer per bucket.
+  static size_t TableBytes(const unordered_map<K, V> &vars) {
+    return vars.size() * (sizeof(typename unordered_map<K, V>::value_type) +
+                          2 * sizeof(void *)) +
+        vars.bucket_count() * sizeof(void *);
+  }
+
+  template <typename F>
+  static void Visit(const unordered_map<K, V> &vars,
+                    unordered_set<K> &seen, F &f) {
+    for (typename unordered_map<K, V>::const_iterator it = vars.begin();
+         it != vars.end(); ++it) {
+      if (seen.insert(it->first).second) {
+        f(it->first, it->second);
+      }
+    }
+  }
+
+  // data members
+
+  /// Guards the modifications made to local_ and frozen_ by \link
+  /// Freeze\endlink and by copying.
+  mutable std::mutex mutex_;
+  /// The bindings owned by this map.
+  mutable unordered_map<K, V> local_;
+  /// The chain of immutable layers shared with copies of this map.
+  mutable shared_ptr<const Layer> frozen_;
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,103 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::MappedFile MappedFile \endlink class.
+
+#ifndef INFACT_MAPPED_FILE_H_
+#define INFACT_MAPPED_FILE_H_
+
+#include <string>
+
+namespace infact {
+
+using std::string;
+
+/// A read-only view of the entire contents of a file, memory-mapped
+/// when possible.  If the file cannot be mapped (for example, because
+/// it is a pipe), its contents are instead read into memory.
+///
+/// Instances are typically used with the buffer-based constructor
+/// of \link infact::StreamTokenizer StreamTokenizer\endlink:
+/// \code
+/// MappedFile file("example.infact");
+/// if (file.good()) {
+///   StreamTokenizer st(file.data(), file.size());
+///   // ...
+/// }
+/// \endcode
+class MappedFile {
+ public:
+  /// Maps the file with the specified name.
+  ///
+  /// \param filename   the name of the file to be mapped
+  /// \param sequential whether the file will be read front to back,
+  ///                   rather than in no particular order
+  explicit MappedFile(const string &filename, bool sequential = true);
+
+  /// Unmaps the file.
+  virtual ~MappedFile();
+
+  /// Returns whether the file was successfully opened and mapped or read.
+  bool good() const { return good_; }
+
+  /// Returns the contents of the file.
+  const char *data() const { return data_; }
+
+  /// Returns the number of bytes in the file.
+  size_t size() const { return size_; }
+
+  /// Returns whether the contents of the file are memory-mapped, as
+  /// opposed to having been read into memory.
+  bool mapped() const { return mapped_; }
+
+ private:
+  // Disallow copy and assignment.
+  MappedFile(const MappedFile &);
+  void operator=(const MappedFile &);
+
+  /// Reads the contents of the specified open file descriptor into
+  /// contents_, when the file cannot be mapped.
+  bool Read(int fd);
+
+  // data members
+
+  const char *data_;
+  size_t size_;
+  bool mapped_;
+  bool good_;
+  /// The contents of the file, when it could not be mapped.
+  string contents_;
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,264 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Implementation of the ModuleCache class.
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "error.h"
+#include "interpreter.h"
+#include "mapped-file.h"
+#include "module-cache.h"
+#include "snapshot.h"
+
+namespace infact {
+
+namespace {
+
+/// Returns the canonical names of the files being evaluated by the
+/// calling thread, innermost last.
+vector<string> &LoadingFiles() {
+  static thread_local vector<string> loading;
+  return loading;
+}
+
+/// Records that a file is being evaluated by the calling thread for the
+/// lifetime of an instance.
+class LoadingGuard {
+ public:
+  LoadingGuard(const string &filename) {
+    LoadingFiles().push_back(filename);
+  }
+  ~LoadingGuard() {
+    LoadingFiles().pop_back();
+  }
+};
+
+}  // namespace
+
+Module::Module(const string &filename, uint64_t fingerprint,
+               EnvironmentImpl *env) :
+    filename_(filename), fingerprint_(fingerprint), env_(env) {
+  // Freezing makes the environment safe to read, and to import from,
+  // on several threads at once.
+  env_->Freeze();
+  env_->GetVariables(&variables_);
+}
+
+ModuleCache &
+ModuleCache::Global() {
+  static ModuleCache cache;
+  return cache;
+}
+
+shared_ptr<const Module>
+ModuleCache::Load(const string &filename) {
+  char *resolved = realpath(filename.c_str(), nullptr);
+  if (resolved == nullptr) {
+    Error("ModuleCache: error: could not open module " + filename);
+  }
+  string canonical(resolved);
+  free(resolved);
+
+  struct stat file_stat;
+  if (stat(canonical.c_str(), &file_stat) != 0) {
+    Error("ModuleCache: error: could not open module " + filename);
+  }
+  FileStamp stamp;
+  stamp.device = file_stat.st_dev;
+  stamp.inode = file_stat.st_ino;
+  stamp.size = file_stat.st_size;
+  stamp.mtime_sec = file_stat.st_mtime;
+#ifdef __APPLE__
+  stamp.mtime_nsec = file_stat.st_mtimespec.tv_nsec;
+#else
+  stamp.mtime_nsec = file_stat.st_mtim.tv_nsec;
+#endif
+  shared_ptr<const Module> module;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    module = FindLocked(canonical, stamp, nullptr);
+  }
+  if (module != nullptr) {
+    return module;
+  }
+
+  // The file may merely have been touched, so compare its contents
+  // before evaluating it.
+  MappedFile file(canonical);
+  if (!file.good()) {
+    Error("ModuleCache: error: could not read module " + filename);
+  }
+  uint64_t fingerprint = FingerprintBytes(file.data(), file.size());
+
+  const vector<string> &loading = LoadingFiles();
+  if (std::find(loading.begin(), loading.end(), canonical) != loading.end()) {
+    Error("ModuleCache: error: circular import of module " + canonical);
+  }
+
+  // Waits for any other thread evaluating the file, sharing its module
+  // if it evaluates the same contents.
+  shared_ptr<Evaluation> evaluation;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      module = FindLocked(canonical, stamp, &fingerprint);
+      if (module != nullptr) {
+        return module;
+      }
+      unordered_map<string, shared_ptr<Evaluation> >::iterator it =
+          evaluations_.find(canonical);
+      if (it == evaluations_.end()) {
+        break;
+      }
+      shared_ptr<Evaluation> other = it->second;
+      if (WaitWouldDeadlock(*other)) {
+        lock.unlock();
+        Error("ModuleCache: error: circular import of module " + canonical);
+      }
+      waiting_[std::this_thread::get_id()] = canonical;
+      evaluated_.wait(lock, [&other]() { return other->done; });
+      waiting_.erase(std::this_thread::get_id());
+      if (other->fingerprint == fingerprint && other->module == nullptr) {
+        string error = other->error;
+        lock.unlock();
+        Error(error);
+      }
+    }
+    evaluation.reset(new Evaluation(fingerprint));
+    evaluations_[canonical] = evaluation;
+  }
+
+  string error;
+  EnvironmentImpl *env = nullptr;
+  {
+    LoadingGuard guard(canonical);
+    Interpreter interpreter;
+    interpreter.filename_ = canonical;
+    StreamTokenizer st(file.data(), file.size());
+    interpreter.Eval(st);
+    if (interpreter.eval_failed_) {
+      error = "ModuleCache: error: could not evaluate module " + canonical;
+    } else {
+      env = interpreter.env_;
+      interpreter.env_ = nullptr;
+    }
+  }
+  if (env != nullptr) {
+    module.reset(new Module(canonical, fingerprint, env));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (module != nullptr) {
+      Entry &entry = entries_[canonical];
+      entry.stamp = stamp;
+      entry.module = module;
+    }
+    evaluation->done = true;
+    evaluation->module = module;
+    evaluation->error = error;
+    evaluations_.erase(canonical);
+  }
+  evaluated_.notify_all();
+  if (module == nullptr) {
+    Error(error);
+  }
+  return module;
+}
+
+string
+ModuleCache::Resolve(const string &filename, const string &importer) {
+  if (filename.empty() || filename[0] == '/') {
+    return filename;
+  }
+  size_t slash = importer.rfind('/');
+  return slash == string::npos ?
+      filename : importer.substr(0, slash + 1) + filename;
+}
+
+void
+ModuleCache::Clear() {
+  std::lock_guard<std::mutex> lock(mu_);
+  entries_.clear();
+}
+
+size_t
+ModuleCache::size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return entries_.size();
+}
+
+shared_ptr<const Module>
+ModuleCache::FindLocked(const string &filename, const FileStamp &stamp,
+                        const uint64_t *fingerprint) {
+  unordered_map<string, Entry>::iterator it = entries_.find(filename);
+  if (it == entries_.end()) {
+    return shared_ptr<const Module>();
+  }
+  Entry &entry = it->second;
+  if (entry.stamp == stamp) {
+    return entry.module;
+  }
+  if (fingerprint != nullptr && *fingerprint == entry.module->fingerprint()) {
+    entry.stamp = stamp;
+    return entry.module;
+  }
+  return shared_ptr<const Module>();
+}
+
+bool
+ModuleCache::WaitWouldDeadlock(const Evaluation &evaluation) const {
+  // Follows the chain of threads each waiting for the evaluation of the
+  // next, which is a cycle if it leads back to the calling thread.
+  std::thread::id owner = evaluation.owner;
+  for (size_t i = 0; i <= waiting_.size(); ++i) {
+    if (owner == std::this_thread::get_id()) {
+      return true;
+    }
+    unordered_map<std::thread::id, string>::const_iterator waiting_it =
+        waiting_.find(owner);
+    if (waiting_it == waiting_.end()) {
+      return false;
+    }
+    unordered_map<string, shared_ptr<Evaluation> >::const_iterator it =
+        evaluations_.find(waiting_it->second);
+    if (it == evaluations_.end()) {
+      return false;
+    }
+    owner = it->second->owner;
+  }
+  return false;
+}
+
+}  // namespace infact
@@ -0,0 +1,220 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Provides the \link infact::ModuleCache ModuleCache \endlink class,
+/// which evaluates each file imported by an \link infact::Interpreter
+/// Interpreter \endlink once per process.
+
+#ifndef INFACT_MODULE_CACHE_H_
+#define INFACT_MODULE_CACHE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "environment-impl.h"
+
+namespace infact {
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+/// The frozen environment resulting from evaluating an imported file,
+/// shared by every interpreter importing the file.  A module is never
+/// modified once it is loaded, and so may be used by several threads
+/// at once.
+class Module {
+ public:
+  /// Constructs a module taking ownership of the specified
+  /// environment, which is frozen.
+  ///
+  /// \param filename    the canonical name of the file evaluated
+  /// \param fingerprint the fingerprint of the contents of the file
+  /// \param env         the environment resulting from evaluating the file
+  Module(const string &filename, uint64_t fingerprint, EnvironmentImpl *env);
+
+  /// Returns the canonical name of the file evaluated.
+  const string &filename() const { return filename_; }
+
+  /// Returns the fingerprint of the contents of the file evaluated.
+  uint64_t fingerprint() const { return fingerprint_; }
+
+  /// Returns the environment resulting from evaluating the file.
+  const EnvironmentImpl &env() const { return *env_; }
+
+  /// Returns the interned names of the variables defined by the file.
+  const vector<Symbol> &variables() const { return variables_; }
+
+ private:
+  string filename_;
+  uint64_t fingerprint_;
+  unique_ptr<EnvironmentImpl> env_;
+  vector<Symbol> variables_;
+};
+
+/// A process-wide cache of the \link Module \endlink instances of
+/// the files imported with the <tt>import</tt> statement of the
+/// \link infact::Interpreter Interpreter\endlink, so that a file
+/// imported by many configurations is read, and its objects are
+/// constructed, only once.
+///
+/// A file is identified by its canonical name, and is evaluated again
+/// only once its contents have changed, as detected by its
+/// modification time, size and inode and, should any of these differ,
+/// by a fingerprint of its contents.  Every importer of an unchanged
+/// file therefore shares the same objects, which must not be modified
+/// by their users.
+///
+/// A file is evaluated in a new interpreter, without access to the
+/// variables of its importer, so that its module does not depend on
+/// who imported it first.  Objects are constructed on the heap, even
+/// if the importer allocates objects in an \link infact::Arena
+/// Arena\endlink.  Importing a file that is still being evaluated by
+/// the same thread, that is, a circular import, is an error.
+class ModuleCache {
+ public:
+  /// Returns the process-wide instance.
+  static ModuleCache &Global();
+
+  /// Returns the module of the specified file, evaluating the file if it
+  /// is not cached or has changed since it was evaluated.  Threads
+  /// loading the same file at once wait for a single one of them to
+  /// evaluate it, and share its module.
+  ///
+  /// It is an error if the file cannot be read or if evaluating it
+  /// causes an error, in which case nothing is cached, and every thread
+  /// waiting for the evaluation reports the same error.  It is also an
+  /// error if waiting would close a cycle of threads each waiting for
+  /// another to evaluate a file, which only circular imports cause.
+  ///
+  /// \param filename the name of the file to evaluate
+  shared_ptr<const Module> Load(const string &filename);
+
+  /// Returns the name of the specified imported file, resolving a
+  /// relative name against the directory of the importing file.
+  ///
+  /// \param filename the name of the imported file
+  /// \param importer the name of the importing file, or the empty
+  ///                 string to resolve against the current working
+  ///                 directory
+  static string Resolve(const string &filename, const string &importer);
+
+  /// Removes every module from this cache.  Modules still in use by
+  /// their holders remain valid.
+  void Clear();
+
+  /// Returns the number of modules in this cache.
+  size_t size() const;
+
+ private:
+  /// The attributes of a file identifying its contents without reading
+  /// them.
+  struct FileStamp {
+    bool operator==(const FileStamp &other) const {
+      return device == other.device && inode == other.inode &&
+          size == other.size && mtime_sec == other.mtime_sec &&
+          mtime_nsec == other.mtime_nsec;
+    }
+
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+  };
+
+  /// A cached module with the stamp of its file when last checked.
+  struct Entry {
+    FileStamp stamp;
+    shared_ptr<const Module> module;
+  };
+
+  /// A file being evaluated by a thread, for which other threads may
+  /// wait.
+  struct Evaluation {
+    Evaluation(uint64_t fingerprint) :
+        fingerprint(fingerprint), owner(std::this_thread::get_id()),
+        done(false) { }
+
+    /// The fingerprint of the contents being evaluated.
+    uint64_t fingerprint;
+    /// The thread evaluating the file.
+    std::thread::id owner;
+    /// Whether the evaluation is finished.
+    bool done;
+    /// The module evaluated, or <tt>nullptr</tt> if evaluation failed.
+    shared_ptr<const Module> module;
+    /// The error evaluating the file, if any.
+    string error;
+  };
+
+  /// Returns the cached module of the specified file if its stamp is
+  /// unchanged or, if its fingerprint is unchanged, updates its stamp
+  /// and returns it; otherwise, returns <tt>nullptr</tt>.  The caller
+  /// must hold mu_.
+  shared_ptr<const Module> FindLocked(const string &filename,
+                                      const FileStamp &stamp,
+                                      const uint64_t *fingerprint);
+
+  /// Returns whether the calling thread waiting for the specified
+  /// evaluation would close a cycle of waiting threads.  The caller
+  /// must hold mu_.
+  bool WaitWouldDeadlock(const Evaluation &evaluation) const;
+
+  /// Guards entries_, evaluations_ and waiting_.
+  mutable std::mutex mu_;
+
+  /// Signalled whenever an evaluation finishes.
+  std::condition_variable evaluated_;
+
+  /// The modules, keyed by the canonical names of their files.
+  unordered_map<string, Entry> entries_;
+
+  /// The evaluations in progress, keyed by the canonical names of their
+  /// files.
+  unordered_map<string, shared_ptr<Evaluation> > evaluations_;
+
+  /// The canonical name of the file each waiting thread waits for.
+  unordered_map<std::thread::id, string> waiting_;
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,192 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Implementation of the Nesting class.
+
+#include <pthread.h>
+
+#include <atomic>
+#include <exception>
+#include <sstream>
+
+#include "error.h"
+#include "nesting.h"
+#include "stats.h"
+
+namespace infact {
+
+using std::ostringstream;
+
+namespace {
+
+/// The number of bytes of stack that must remain before entering
+/// another level of nesting.
+const size_t kStackReserve = 64 * 1024;
+
+/// The size of each new stack segment.
+const size_t kSegmentStackSize = 8 * 1024 * 1024;
+
+std::atomic<size_t> max_nesting_depth(Nesting::kDefaultMaxDepth);
+
+/// The nesting depth of the calling thread.
+thread_local size_t nesting_depth = 0;
+
+/// The nesting depth at which the stack segment of the calling thread
+/// was entered.
+thread_local size_t segment_depth = 0;
+
+/// The number of stack segments, including that of the calling thread,
+/// on which its nesting continues.
+thread_local size_t num_segments = 1;
+
+/// Whether stack_limit has been determined for the calling thread.
+thread_local bool stack_limit_known = false;
+
+/// The lowest usable address of the stack of the calling thread, or
+/// nullptr if it is unknown.
+thread_local const char *stack_limit = nullptr;
+
+/// Determines the lowest usable address of the stack of the calling
+/// thread, assuming (as on all supported platforms) that the stack
+/// grows downward.
+void FindStackLimit() {
+  stack_limit_known = true;
+#if defined(__linux__)
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    void *addr;
+    size_t size;
+    if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+      stack_limit = static_cast<const char *>(addr);
+    }
+    pthread_attr_destroy(&attr);
+  }
+#elif defined(__APPLE__)
+  const char *top =
+      static_cast<const char *>(pthread_get_stackaddr_np(pthread_self()));
+  stack_limit = top - pthread_get_stacksize_np(pthread_self());
+#endif
+}
+
+/// The work to be done on a new stack segment.
+struct Segment {
+  const std::function<void()> *f;
+  size_t depth;
+  size_t num_segments;
+  Stats *stats;
+  std::exception_ptr error;
+};
+
+void *RunSegment(void *arg) {
+  Segment *segment = static_cast<Segment *>(arg);
+  nesting_depth = segment->depth;
+  segment_depth = segment->depth;
+  num_segments = segment->num_segments;
+  Stats::Scope stats_scope(segment->stats);
+  try {
+    (*segment->f)();
+  } catch (...) {
+    segment->error = std::current_exception();
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+Nesting::Scope::Scope() {
+  size_t max_depth = Nesting::max_depth();
+  if (nesting_depth >= max_depth) {
+    ostringstream err_ss;
+    err_ss << "Nesting: error: spec nested more than " << max_depth
+           << " levels deep";
+    Error(err_ss.str());
+  }
+  ++nesting_depth;
+}
+
+Nesting::Scope::~Scope() {
+  --nesting_depth;
+}
+
+size_t
+Nesting::max_depth() {
+  return max_nesting_depth.load(std::memory_order_relaxed);
+}
+
+void
+Nesting::set_max_depth(size_t max_depth) {
+  max_nesting_depth.store(max_depth, std::memory_order_relaxed);
+}
+
+size_t
+Nesting::depth() {
+  return nesting_depth;
+}
+
+bool
+Nesting::StackLow() {
+  if (!stack_limit_known) {
+    FindStackLimit();
+  }
+  if (stack_limit == nullptr) {
+    return nesting_depth - segment_depth >= kLevelsPerSegment;
+  }
+  char marker;
+  return static_cast<size_t>(&marker - stack_limit) < kStackReserve;
+}
+
+void
+Nesting::RunOnNewStack(const std::function<void()> &f) {
+  if (num_segments >= kMaxSegments) {
+    ostringstream err_ss;
+    err_ss << "Nesting: error: spec nested too deeply for " << kMaxSegments
+           << " stack segments";
+    Error(err_ss.str());
+  }
+  Segment segment = {
+    &f, nesting_depth, num_segments + 1, Stats::Current(), nullptr
+  };
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, kSegmentStackSize);
+  pthread_t thread;
+  int status = pthread_create(&thread, &attr, &RunSegment, &segment);
+  pthread_attr_destroy(&attr);
+  if (status != 0) {
+    Error("Nesting: error: could not create thread for nested spec");
+  }
+  pthread_join(thread, nullptr);
+  if (segment.error) {
+    std::rethrow_exception(segment.error);
+  }
+}
+
+}  // namespace infact
@@ -0,0 +1,116 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Provides the \link infact::Nesting Nesting \endlink class, which
+/// bounds how deeply specs may be nested and moves very deeply nested
+/// ones onto fresh stack segments.
+
+#ifndef INFACT_NESTING_H_
+#define INFACT_NESTING_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace infact {
+
+/// Keeps track of how deeply the spec currently being read, compiled,
+/// validated or instantiated by the calling thread is nested.
+///
+/// Specs are processed recursively, one level of recursion per level
+/// of nesting, so a spec such as
+/// <tt>Link(next(Link(next(Link(...)))))</tt> that is nested tens of
+/// thousands of levels deep would exhaust the stack of the calling
+/// thread.  To avoid this, whenever the calling thread is close to the
+/// end of its stack, \link infact::Factory::CreateOrDie
+/// Factory::CreateOrDie\endlink and the other recursive methods
+/// continue on a new thread with a fresh stack segment of its own,
+/// waiting for it to finish; the caller&rsquo;s stack therefore only
+/// needs to accommodate a small, constant number of levels.
+///
+/// To keep the memory used by a pathological (or malicious) input
+/// bounded, nesting deeper than \link max_depth \endlink levels is an
+/// error, as is nesting that would need more than \link kMaxSegments
+/// \endlink stack segments, each of which is a thread waiting on the
+/// next.
+class Nesting {
+ public:
+  /// The maximum number of stack segments on which the nesting of one
+  /// thread may continue at once.
+  static const size_t kMaxSegments = 64;
+
+  /// The number of levels of nesting per stack segment when the bounds
+  /// of the stack of the calling thread cannot be determined.
+  static const size_t kLevelsPerSegment = 256;
+
+  /// The default maximum nesting depth, which never needs more than
+  /// \link kMaxSegments \endlink stack segments, even when the bounds
+  /// of the stacks cannot be determined.
+  static const size_t kDefaultMaxDepth = kMaxSegments * kLevelsPerSegment;
+
+  /// Enters one more level of nesting for the lifetime of this object.
+  class Scope {
+   public:
+    /// Enters one more level of nesting, which is an error if the
+    /// calling thread is already \link max_depth \endlink levels deep.
+    Scope();
+    /// Leaves the level of nesting entered by this object.
+    ~Scope();
+  };
+
+  /// Returns the maximum nesting depth of specs, shared by all threads.
+  static size_t max_depth();
+
+  /// Sets the maximum nesting depth of specs, shared by all threads.
+  static void set_max_depth(size_t max_depth);
+
+  /// Returns the current nesting depth of the calling thread, including
+  /// the levels entered on behalf of the calling thread on other stack
+  /// segments.
+  static size_t depth();
+
+  /// Returns whether the calling thread is so close to the end of its
+  /// stack that it should not enter another level of nesting, but
+  /// should call \link RunOnNewStack \endlink instead.
+  static bool StackLow();
+
+  /// Invokes the specified function on a new thread with its own stack
+  /// segment, waiting for it to finish.  The new thread continues at
+  /// the nesting depth of the calling thread and records into its
+  /// current \link infact::Stats Stats\endlink, if any.  Any exception
+  /// thrown by the function is rethrown to the caller.  It is an error
+  /// if the calling thread is itself running on the last of \link
+  /// kMaxSegments \endlink stack segments.
+  static void RunOnNewStack(const std::function<void()> &f);
+};
+
+}  // namespace infact
+
+#endif
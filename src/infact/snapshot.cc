@@ -0,0 +1,83 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Implementation of the snapshot fingerprinting functions.
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "factory.h"
+#include "snapshot.h"
+
+namespace infact {
+
+using std::sort;
+using std::unordered_set;
+
+uint64_t
+FingerprintBytes(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t
+FingerprintFactories() {
+  // Collect "Base:Concrete" names and sort them, since neither the order
+  // of factories nor that of their registered types is deterministic.
+  vector<string> names;
+  shared_ptr<const vector<FactoryBase *> > factories =
+      FactoryContainer::factories();
+  for (FactoryContainer::iterator factory_it = factories->begin();
+       factory_it != factories->end(); ++factory_it) {
+    unordered_set<string> registered;
+    (*factory_it)->CollectRegistered(registered);
+    string base_name = (*factory_it)->BaseName();
+    for (unordered_set<string>::const_iterator it = registered.begin();
+         it != registered.end(); ++it) {
+      names.push_back(base_name + ":" + *it);
+    }
+  }
+  sort(names.begin(), names.end());
+  uint64_t hash = FingerprintBytes(nullptr, 0);
+  for (vector<string>::const_iterator it = names.begin(); it != names.end();
+       ++it) {
+    // Include the terminating null character as a separator.
+    hash = FingerprintBytes(it->c_str(), it->size() + 1, hash);
+  }
+  return hash;
+}
+
+}  // namespace infact
@@ -0,0 +1,275 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Provides utilities for reading and writing the binary snapshots of
+/// evaluated environments used by \link
+/// infact::Interpreter::EvalWithSnapshot Interpreter::EvalWithSnapshot
+/// \endlink.
+
+#ifndef INFACT_SNAPSHOT_H_
+#define INFACT_SNAPSHOT_H_
+
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace infact {
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+/// The version of the snapshot format, to be incremented whenever the
+/// format changes.
+static const uint32_t kSnapshotVersion = 1;
+
+/// Returns the 64-bit FNV-1a hash of the specified bytes.
+///
+/// \param data the bytes to be hashed
+/// \param size the number of bytes to be hashed
+/// \param hash the hash of any preceding bytes, for hashing incrementally
+uint64_t FingerprintBytes(const char *data, size_t size,
+                          uint64_t hash = 14695981039346656037ULL);
+
+/// Returns a hash of the names of all \link infact::Factory Factory
+/// \endlink base types and the concrete types registered with each,
+/// as held by the \link infact::FactoryContainer FactoryContainer
+/// \endlink.
+uint64_t FingerprintFactories();
+
+/// Writes the primitive binary values of a snapshot to a stream, in
+/// native byte order.
+class SnapshotWriter {
+ public:
+  /// Constructs a writer for the specified stream.
+  explicit SnapshotWriter(ostream &os) : os_(os) { }
+
+  /// Writes the specified bytes.
+  void WriteBytes(const void *data, size_t size) {
+    os_.write(static_cast<const char *>(data), size);
+  }
+  /// Writes a single byte.
+  void WriteUint8(uint8_t value) { WriteBytes(&value, sizeof(value)); }
+  /// Writes a 32-bit unsigned integer.
+  void WriteUint32(uint32_t value) { WriteBytes(&value, sizeof(value)); }
+  /// Writes a 64-bit unsigned integer.
+  void WriteUint64(uint64_t value) { WriteBytes(&value, sizeof(value)); }
+  /// Writes a length-prefixed string.
+  void WriteString(const string &value) {
+    WriteUint64(value.size());
+    WriteBytes(value.data(), value.size());
+  }
+
+  /// Returns whether all writes so far have succeeded.
+  bool good() const { return os_.good(); }
+
+ private:
+  ostream &os_;
+};
+
+/// Reads the primitive binary values of a snapshot from a buffer,
+/// typically a memory-mapped file.  Every method returns
+/// <tt>false</tt> if the buffer is exhausted, so that a truncated or
+/// corrupt snapshot is rejected rather than read past its end.
+class SnapshotReader {
+ public:
+  /// Constructs a reader of the specified buffer.
+  SnapshotReader(const char *data, size_t size) :
+      data_(data), size_(size), pos_(0) { }
+
+  /// Returns the number of bytes not yet read.
+  size_t remaining() const { return size_ - pos_; }
+
+  /// Reads the specified number of bytes.
+  bool ReadBytes(void *data, size_t size) {
+    if (size > remaining()) {
+      return false;
+    }
+    if (size > 0) {
+      memcpy(data, data_ + pos_, size);
+    }
+    pos_ += size;
+    return true;
+  }
+  /// Reads a single byte.
+  bool ReadUint8(uint8_t *value) { return ReadBytes(value, sizeof(*value)); }
+  /// Reads a 32-bit unsigned integer.
+  bool ReadUint32(uint32_t *value) { return ReadBytes(value, sizeof(*value)); }
+  /// Reads a 64-bit unsigned integer.
+  bool ReadUint64(uint64_t *value) { return ReadBytes(value, sizeof(*value)); }
+  /// Reads a length-prefixed string.
+  bool ReadString(string *value) {
+    uint64_t size;
+    if (!ReadUint64(&size) || size > remaining()) {
+      return false;
+    }
+    value->assign(data_ + pos_, size);
+    pos_ += size;
+    return true;
+  }
+  /// Reads the length prefix of an array whose elements each occupy at
+  /// least <tt>element_size</tt> bytes, failing if the remaining bytes
+  /// cannot possibly hold that many elements.
+  bool ReadLength(size_t element_size, uint64_t *length) {
+    return ReadUint64(length) && *length <= remaining() / element_size;
+  }
+
+ private:
+  const char *data_;
+  size_t size_;
+  size_t pos_;
+};
+
+/// Reads and writes values of a primitive type <tt>T</tt> whose
+/// representation may be copied byte for byte.
+///
+/// \tparam T <tt>int</tt> or <tt>double</tt>
+template <typename T>
+class SnapshotCodec {
+ public:
+  /// Writes the specified value.
+  static void Write(SnapshotWriter &writer, const T &value) {
+    writer.WriteBytes(&value, sizeof(value));
+  }
+  /// Reads a value.
+  static bool Read(SnapshotReader &reader, T *value) {
+    return reader.ReadBytes(value, sizeof(*value));
+  }
+};
+
+/// A specialization for <tt>bool</tt>, which is written as one byte.
+template <>
+class SnapshotCodec<bool> {
+ public:
+  /// Writes the specified value.
+  static void Write(SnapshotWriter &writer, const bool &value) {
+    writer.WriteUint8(value ? 1 : 0);
+  }
+  /// Reads a value.
+  static bool Read(SnapshotReader &reader, bool *value) {
+    uint8_t byte;
+    if (!reader.ReadUint8(&byte)) {
+      return false;
+    }
+    *value = byte != 0;
+    return true;
+  }
+};
+
+/// A specialization for <tt>string</tt>.
+template <>
+class SnapshotCodec<string> {
+ public:
+  /// Writes the specified value.
+  static void Write(SnapshotWriter &writer, const string &value) {
+    writer.WriteString(value);
+  }
+  /// Reads a value.
+  static bool Read(SnapshotReader &reader, string *value) {
+    return reader.ReadString(value);
+  }
+};
+
+/// A partial specialization for vectors.  Vectors of <tt>int</tt> and
+/// <tt>double</tt> are written as a length followed by the contiguous
+/// bytes of their elements, so that reading them is a single copy.
+///
+/// \tparam T the type of the elements of the vector
+template <typename T>
+class SnapshotCodec<vector<T> > {
+ public:
+  /// Writes the specified value.
+  static void Write(SnapshotWriter &writer, const vector<T> &value) {
+    writer.WriteUint64(value.size());
+    for (typename vector<T>::const_iterator it = value.begin();
+         it != value.end(); ++it) {
+      SnapshotCodec<T>::Write(writer, *it);
+    }
+  }
+  /// Reads a value.
+  static bool Read(SnapshotReader &reader, vector<T> *value) {
+    uint64_t size;
+    if (!reader.ReadLength(1, &size)) {
+      return false;
+    }
+    value->resize(size);
+    for (uint64_t i = 0; i < size; ++i) {
+      T element;
+      if (!SnapshotCodec<T>::Read(reader, &element)) {
+        return false;
+      }
+      (*value)[i] = element;
+    }
+    return true;
+  }
+};
+
+/// Reads and writes vectors of a primitive type whose elements may be
+/// copied as a single contiguous block of bytes.
+///
+/// \tparam T <tt>int</tt> or <tt>double</tt>
+template <typename T>
+class ContiguousSnapshotCodec {
+ public:
+  /// Writes the specified value.
+  static void Write(SnapshotWriter &writer, const vector<T> &value) {
+    writer.WriteUint64(value.size());
+    if (!value.empty()) {
+      writer.WriteBytes(&value[0], value.size() * sizeof(T));
+    }
+  }
+  /// Reads a value.
+  static bool Read(SnapshotReader &reader, vector<T> *value) {
+    uint64_t size;
+    if (!reader.ReadLength(sizeof(T), &size)) {
+      return false;
+    }
+    value->resize(size);
+    return size == 0 || reader.ReadBytes(&(*value)[0], size * sizeof(T));
+  }
+};
+
+/// A specialization for vectors of <tt>int</tt>.
+template <>
+class SnapshotCodec<vector<int> > : public ContiguousSnapshotCodec<int> { };
+
+/// A specialization for vectors of <tt>double</tt>.
+template <>
+class SnapshotCodec<vector<double> > : public ContiguousSnapshotCodec<double> {
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,211 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Implementation of the Stats class.
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "stats.h"
+
+namespace infact {
+
+using std::endl;
+
+namespace {
+
+const char *kCategoryNames[] = { "statement", "construct" };
+
+/// Returns a small integer identifying the calling thread.
+int ThreadIndex() {
+  static std::atomic<int> num_threads(0);
+  static thread_local int index = num_threads.fetch_add(1);
+  return index;
+}
+
+/// Writes the specified string as a JSON string literal.
+void WriteJsonString(const string &s, ostream &os) {
+  os << '"';
+  for (string::const_iterator it = s.begin(); it != s.end(); ++it) {
+    unsigned char c = static_cast<unsigned char>(*it);
+    if (c == '"' || c == '\\') {
+      os << '\\' << *it;
+    } else if (c < 0x20) {
+      const char *hex = "0123456789abcdef";
+      os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+    } else {
+      os << *it;
+    }
+  }
+  os << '"';
+}
+
+}  // namespace
+
+thread_local Stats *Stats::current_ = nullptr;
+thread_local Stats::Timer *Stats::current_timer_ = nullptr;
+
+Stats::Timer::~Timer() {
+  if (stats_ == nullptr) {
+    return;
+  }
+  int64_t nanos = Now() - start_;
+  current_timer_ = parent_;
+  if (parent_ != nullptr) {
+    parent_->child_nanos_ += nanos;
+  }
+  stats_->Record(category_, name_, line_number_, start_, nanos,
+                 nanos - child_nanos_);
+}
+
+Stats::Stats() :
+    record_trace_(true), bytes_read_(0), tokens_read_(0),
+    environment_copies_(0) {
+}
+
+int64_t
+Stats::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+Stats::Clear() {
+  std::lock_guard<std::mutex> lock(mu_);
+  statements_.clear();
+  constructions_.clear();
+  trace_.clear();
+  bytes_read_ = 0;
+  tokens_read_ = 0;
+  environment_copies_ = 0;
+}
+
+void
+Stats::Record(Category category, const string &name, size_t line_number,
+              int64_t start, int64_t nanos, int64_t self_nanos) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (category == STATEMENT) {
+    if (record_trace_) {
+      StatementStats statement = { name, line_number, nanos };
+      statements_.push_back(statement);
+    }
+  } else {
+    ConstructionStats &construction = constructions_[name];
+    ++construction.count;
+    construction.nanos += nanos;
+    construction.self_nanos += self_nanos;
+    construction.max_nanos = std::max(construction.max_nanos, nanos);
+  }
+  if (record_trace_) {
+    TraceEvent event = {
+      kCategoryNames[category], name, ThreadIndex(), start, nanos
+    };
+    trace_.push_back(event);
+  }
+}
+
+vector<StatementStats>
+Stats::statements() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return statements_;
+}
+
+unordered_map<string, ConstructionStats>
+Stats::constructions() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return constructions_;
+}
+
+vector<TraceEvent>
+Stats::trace() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return trace_;
+}
+
+void
+Stats::Print(ostream &os) const {
+  vector<StatementStats> statements = this->statements();
+  unordered_map<string, ConstructionStats> constructions =
+      this->constructions();
+
+  int64_t statement_nanos = 0;
+  for (vector<StatementStats>::const_iterator it = statements.begin();
+       it != statements.end(); ++it) {
+    statement_nanos += it->nanos;
+  }
+  os << "Statements: " << statements.size() << " in "
+     << (statement_nanos / 1e6) << " ms" << endl
+     << "Bytes read: " << bytes_read() << endl
+     << "Tokens read: " << tokens_read() << endl
+     << "Environment copies: " << environment_copies() << endl;
+
+  vector<std::pair<string, ConstructionStats> > types(constructions.begin(),
+                                                      constructions.end());
+  std::sort(types.begin(), types.end(),
+            [](const std::pair<string, ConstructionStats> &a,
+               const std::pair<string, ConstructionStats> &b) {
+              return a.second.nanos > b.second.nanos;
+            });
+  os << "Constructions (type, count, total ms, self ms, max ms):" << endl;
+  for (size_t i = 0; i < types.size(); ++i) {
+    const ConstructionStats &construction = types[i].second;
+    os << "  " << types[i].first << "\t" << construction.count
+       << "\t" << (construction.nanos / 1e6)
+       << "\t" << (construction.self_nanos / 1e6)
+       << "\t" << (construction.max_nanos / 1e6) << endl;
+  }
+}
+
+void
+Stats::WriteChromeTrace(ostream &os) const {
+  vector<TraceEvent> trace = this->trace();
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  os << "{\"traceEvents\":[";
+  for (size_t i = 0; i < trace.size(); ++i) {
+    const TraceEvent &event = trace[i];
+    os << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+    WriteJsonString(event.name, os);
+    // Times are in microseconds.
+    os << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\""
+       << ",\"ts\":" << (event.start / 1e3)
+       << ",\"dur\":" << (event.nanos / 1e3)
+       << ",\"pid\":1,\"tid\":" << event.thread << "}";
+  }
+  os << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+  os.flags(flags);
+  os.precision(precision);
+}
+
+}  // namespace infact
@@ -0,0 +1,260 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::Stats Stats \endlink class, which records
+/// the time spent evaluating statements and constructing objects.
+
+#ifndef INFACT_STATS_H_
+#define INFACT_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace infact {
+
+using std::ostream;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+/// The time spent evaluating one statement of a configuration.
+struct StatementStats {
+  /// The name of the variable assigned by the statement.
+  string varname;
+  /// The (zero-based) line on which the statement&rsquo;s value starts.
+  size_t line_number;
+  /// The wall time spent evaluating the statement, in nanoseconds.
+  int64_t nanos;
+};
+
+/// The objects of one concrete type constructed, and the time spent
+/// constructing them.
+struct ConstructionStats {
+  /// The number of objects constructed.
+  uint64_t count;
+  /// The wall time spent constructing the objects, including their
+  /// <tt>PostInit</tt> methods and the construction of their members,
+  /// in nanoseconds.
+  int64_t nanos;
+  /// The part of \link nanos \endlink not spent constructing other
+  /// objects, in nanoseconds.
+  int64_t self_nanos;
+  /// The longest time spent constructing a single object, in
+  /// nanoseconds.
+  int64_t max_nanos;
+};
+
+/// A single timed event, in the form of a Chrome trace event (see
+/// \link Stats::WriteChromeTrace\endlink).
+struct TraceEvent {
+  /// The category of the event: either <tt>"statement"</tt> or
+  /// <tt>"construct"</tt>.
+  const char *category;
+  /// The variable assigned, or the concrete type constructed.
+  string name;
+  /// The index of the thread on which the event occurred.
+  int thread;
+  /// The start time, in nanoseconds since \link Stats::Now\endlink&rsquo;s
+  /// epoch.
+  int64_t start;
+  /// The duration, in nanoseconds.
+  int64_t nanos;
+};
+
+/// Statistics gathered while evaluating configurations: the time spent
+/// on each statement, the number of objects constructed of each
+/// concrete type together with the time spent constructing them, the
+/// number of bytes and tokens read, and the number of copies made of
+/// \link infact::Environment Environment \endlink instances.  Every
+/// recorded event is also kept as a \link TraceEvent\endlink, so that
+/// the evaluation may be inspected on a timeline.
+///
+/// An instance collects statistics only while it is the current
+/// instance of the thread doing the work (see \link Scope\endlink), so
+/// that no time is spent on instrumentation otherwise, beyond checking
+/// for a current instance.  \link infact::Interpreter Interpreter
+/// \endlink does this for its own statistics (see \link
+/// infact::Interpreter::set_collect_stats
+/// Interpreter::set_collect_stats\endlink); a caller of \link
+/// infact::Factory::CreateOrDie Factory::CreateOrDie \endlink may do
+/// the same.
+///
+/// Recording methods are thread-safe.
+class Stats {
+ public:
+  /// The categories of timed events.
+  enum Category {
+    STATEMENT,
+    CONSTRUCTION
+  };
+
+  /// Makes an instance the current instance of the calling thread for
+  /// the lifetime of this object, restoring the previous one afterwards.
+  class Scope {
+   public:
+    /// Makes the specified instance, which may be <tt>nullptr</tt>, the
+    /// current instance of the calling thread.
+    explicit Scope(Stats *stats) : previous_(current_) { current_ = stats; }
+    /// Restores the previous current instance.
+    ~Scope() { current_ = previous_; }
+   private:
+    Stats *previous_;
+  };
+
+  /// Times an event from the construction of this object to its
+  /// destruction, recording it in the specified instance, if any.
+  /// Timers nest, so that the time an object spends constructing its
+  /// members can be told apart from its own.
+  class Timer {
+   public:
+    /// Starts timing an event.
+    ///
+    /// \param stats       the instance in which to record the event, or
+    ///                    <tt>nullptr</tt> to time nothing
+    /// \param category    the category of the event
+    /// \param name        the variable assigned or type constructed,
+    ///                    which must outlive this timer
+    /// \param line_number the line of a statement
+    Timer(Stats *stats, Category category, const string &name,
+          size_t line_number = 0) :
+        stats_(stats), category_(category), name_(name),
+        line_number_(line_number), child_nanos_(0), parent_(nullptr) {
+      if (stats_ != nullptr) {
+        parent_ = current_timer_;
+        current_timer_ = this;
+        start_ = Now();
+      }
+    }
+
+    /// Records the event.
+    ~Timer();
+
+   private:
+    Stats *stats_;
+    Category category_;
+    const string &name_;
+    size_t line_number_;
+    int64_t start_;
+    int64_t child_nanos_;
+    Timer *parent_;
+  };
+
+  /// Constructs a new instance with no statistics.
+  Stats();
+
+  /// Returns the current instance of the calling thread, or
+  /// <tt>nullptr</tt> if there is none.
+  static Stats *Current() { return current_; }
+
+  /// Returns the current time in nanoseconds since an arbitrary epoch.
+  static int64_t Now();
+
+  /// Sets whether to keep the statistics of every statement and every
+  /// event as a \link TraceEvent\endlink, which is the default.  When
+  /// not kept, only the totals for each concrete type and the counters
+  /// are recorded, in constant memory.
+  void set_record_trace(bool record_trace) { record_trace_ = record_trace; }
+
+  /// Discards all statistics recorded so far.
+  void Clear();
+
+  /// Records a timed event.
+  void Record(Category category, const string &name, size_t line_number,
+              int64_t start, int64_t nanos, int64_t self_nanos);
+
+  /// Records the specified numbers of bytes and tokens read.
+  void RecordTokens(uint64_t bytes, uint64_t tokens) {
+    bytes_read_.fetch_add(bytes, std::memory_order_relaxed);
+    tokens_read_.fetch_add(tokens, std::memory_order_relaxed);
+  }
+
+  /// Records a copy of an environment.
+  void RecordEnvironmentCopy() {
+    environment_copies_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Returns the statistics of every statement evaluated, in order of
+  /// completion.
+  vector<StatementStats> statements() const;
+
+  /// Returns the construction statistics of every concrete type, keyed
+  /// by type name.
+  unordered_map<string, ConstructionStats> constructions() const;
+
+  /// Returns the events recorded, in order of completion.
+  vector<TraceEvent> trace() const;
+
+  /// Returns the number of bytes read by tokenizers.
+  uint64_t bytes_read() const {
+    return bytes_read_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the number of tokens read by tokenizers.
+  uint64_t tokens_read() const {
+    return tokens_read_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the number of environments copied.
+  uint64_t environment_copies() const {
+    return environment_copies_.load(std::memory_order_relaxed);
+  }
+
+  /// Prints a human-readable summary of these statistics, including the
+  /// concrete types constructed in order of decreasing time spent.
+  void Print(ostream &os) const;
+
+  /// Writes the recorded events in the JSON format of the Chrome trace
+  /// viewer (<tt>chrome://tracing</tt>) and of compatible tools.
+  void WriteChromeTrace(ostream &os) const;
+
+ private:
+  static thread_local Stats *current_;
+  static thread_local Timer *current_timer_;
+
+  mutable std::mutex mu_;
+  bool record_trace_;
+  vector<StatementStats> statements_;
+  unordered_map<string, ConstructionStats> constructions_;
+  vector<TraceEvent> trace_;
+  std::atomic<uint64_t> bytes_read_;
+  std::atomic<uint64_t> tokens_read_;
+  std::atomic<uint64_t> environment_copies_;
+};
+
+}  // namespace infact
+
+#endif
@@ -36,7 +36,9 @@
 #ifndef INFACT_STREAM_INIT_H_
 #define INFACT_STREAM_INIT_H_
 
+#include <climits>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <memory>
@@ -57,6 +59,56 @@ using std::vector;
 
 class Environment;
 
+/// Returns the value of the specified number token, exactly as
+/// <tt>atoi</tt> would parse it, but without copying the token.  As
+/// for <tt>atoi</tt>, a value out of the range of <tt>long</tt> is
+/// clamped to that range before being converted to <tt>int</tt>.
+inline int ParseInt(StringPiece token) {
+  const char *p = token.begin();
+  const char *end = token.end();
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  // The magnitude is accumulated unsigned, so that it may reach that of
+  // LONG_MIN without overflowing.
+  unsigned long limit = static_cast<unsigned long>(LONG_MAX) +
+      (negative ? 1 : 0);
+  unsigned long magnitude = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    unsigned long digit = *p - '0';
+    if (magnitude > (limit - digit) / 10) {
+      magnitude = limit;
+      break;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+  long value;
+  if (!negative) {
+    value = static_cast<long>(magnitude);
+  } else if (magnitude == limit) {
+    value = LONG_MIN;
+  } else {
+    value = -static_cast<long>(magnitude);
+  }
+  return static_cast<int>(value);
+}
+
+/// Returns the value of the specified number token, exactly as
+/// <tt>atof</tt> would parse it.  Since the token need not be followed
+/// by a null character, it is copied, but only to the stack unless it
+/// is very long.
+inline double ParseDouble(StringPiece token) {
+  char buf[64];
+  if (token.size() < sizeof(buf)) {
+    memcpy(buf, token.data(), token.size());
+    buf[token.size()] = '\0';
+    return atof(buf);
+  }
+  return atof(token.ToString().c_str());
+}
+
 /// \class StreamInitializer
 ///
 /// An interface that allows for a primitive, \link infact::Factory
@@ -123,7 +175,8 @@ class Initializer<int> : public StreamInitializer {
              << st.Peek() << "\"";
       Error(err_ss.str());
     }
-    (*member_) = atoi(st.Next().c_str());
+    (*member_) = ParseInt(st.PeekView());
+    st.Skip();
   }
  private:
   int *member_;
@@ -145,7 +198,8 @@ class Initializer<double> : public StreamInitializer {
              << st.Peek() << "\"";
       Error(err_ss.str());
     }
-    (*member_) = atof(st.Next().c_str());
+    (*member_) = ParseDouble(st.PeekView());
+    st.Skip();
   }
  private:
   double *member_;
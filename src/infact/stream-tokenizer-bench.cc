@@ -0,0 +1,87 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Benchmark for the \link infact::StreamTokenizer StreamTokenizer
+/// \endlink class, reading synthetic workloads both from a buffer and
+/// from a stream.
+///
+/// Usage: <tt>stream-tokenizer-bench [scale [workload]]</tt>
+
+#include <iostream>
+#include <sstream>
+
+#include "bench-util.h"
+#include "stream-tokenizer.h"
+
+using namespace std;
+using namespace infact;
+
+// Reads every token of the specified tokenizer, returning the number of
+// tokens read.
+static size_t
+ReadAllTokens(StreamTokenizer &st) {
+  size_t num_tokens = 0;
+  while (st.HasNext()) {
+    st.Next();
+    ++num_tokens;
+  }
+  return num_tokens;
+}
+
+int
+main(int argc, char **argv) {
+  vector<BenchWorkload> workloads = StandardWorkloads(ParseScale(argc, argv));
+  cout << "buffer scanning: " << CharScanner::Implementation() << endl;
+  for (vector<BenchWorkload>::const_iterator it = workloads.begin();
+       it != workloads.end(); ++it) {
+    if (!SelectWorkload(argc, argv, it->name)) {
+      continue;
+    }
+    {
+      BenchTimer timer;
+      StreamTokenizer st(it->text.data(), it->text.size());
+      size_t num_tokens = ReadAllTokens(st);
+      ReportRate(cout, "tokenizer/buffer", it->name, num_tokens, "tokens",
+                 timer.Seconds());
+    }
+    {
+      istringstream is(it->text);
+      BenchTimer timer;
+      StreamTokenizer st(is);
+      st.set_max_history(4);
+      size_t num_tokens = ReadAllTokens(st);
+      ReportRate(cout, "tokenizer/stream", it->name, num_tokens, "tokens",
+                 timer.Seconds());
+    }
+  }
+}
@@ -34,7 +34,7 @@
 /// \endlink class.
 /// \author dbikel@google.com (Dan Bikel)
 
-#include <ctype.h>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 
@@ -42,9 +42,149 @@
 
 namespace infact {
 
+namespace {
+
+/// The maximum number of tokenizers kept for recycling by each thread.
+const size_t kMaxRecycledTokenizers = 8;
+
+/// The tokenizers kept for recycling by the calling thread.
+thread_local vector<std::unique_ptr<StreamTokenizer> > recycled_tokenizers;
+
+}  // namespace
+
+LexerConfig::LexerConfig(const char *reserved_chars,
+                         const set<string> &reserved_words) :
+    reserved_chars_(reserved_chars), reserved_words_(reserved_words),
+    default_reserved_words_(false) {
+  Init();
+}
+
+void
+LexerConfig::Init() {
+  memset(char_class_, 0, sizeof(char_class_));
+  for (int c = 0; c < 256; ++c) {
+    if (CharScanner::IsWhitespace(static_cast<char>(c))) {
+      char_class_[c] |= kWhitespace;
+    }
+  }
+  for (size_t i = 0; i < reserved_chars_.size(); ++i) {
+    char_class_[static_cast<unsigned char>(reserved_chars_[i])] |=
+        kReservedChar;
+  }
+  char_class_[static_cast<unsigned char>('"')] |= kQuote;
+  // Numbers, reserved words and identifiers end at any whitespace,
+  // reserved character or double quote.
+  string token_end(reserved_chars_);
+  token_end += '"';
+  token_end_ = CharScanner(token_end.data(), token_end.size(), true);
+}
+
+const shared_ptr<const LexerConfig> &
+LexerConfig::Default() {
+  static const shared_ptr<const LexerConfig> default_config =
+      std::make_shared<LexerConfig>();
+  return default_config;
+}
+
+shared_ptr<const LexerConfig>
+LexerConfig::Get(const char *reserved_chars) {
+  return strcmp(reserved_chars, DEFAULT_RESERVED_CHARS) == 0 ?
+      Default() : std::make_shared<LexerConfig>(reserved_chars);
+}
+
+void
+StreamTokenizer::Reset(const StringPiece &bytes, size_t position,
+                       size_t line_number) {
+  if (!marks_.empty()) {
+    Error("StreamTokenizer::Reset: error: bytes are still marked");
+  }
+  buffered_ = true;
+  buf_storage_.clear();
+  buf_ = bytes.data();
+  buf_size_ = bytes.size();
+  buf_start_ = position;
+  num_read_ = position;
+  line_number_ = line_number;
+  eof_reached_ = false;
+  bytes_.clear();
+  token_.clear();
+  next_token_idx_ = 0;
+  first_token_idx_ = 0;
+  bytes_start_ = position;
+  Token next;
+  if (GetNext(&next)) {
+    token_.push_back(next);
+  }
+}
+
+StreamTokenizer::Recycled::Recycled(const StringPiece &bytes) {
+  if (recycled_tokenizers.empty()) {
+    st_ = new StreamTokenizer(bytes.data(), bytes.size(),
+                              LexerConfig::Default());
+  } else {
+    st_ = recycled_tokenizers.back().release();
+    recycled_tokenizers.pop_back();
+    st_->Reset(bytes);
+  }
+}
+
+StreamTokenizer::Recycled::Recycled(const StringPiece &bytes,
+                                    size_t position, size_t line_number) {
+  if (recycled_tokenizers.empty()) {
+    st_ = new StreamTokenizer(LexerConfig::Default());
+  } else {
+    st_ = recycled_tokenizers.back().release();
+    recycled_tokenizers.pop_back();
+  }
+  st_->Reset(bytes, position, line_number);
+}
+
+StreamTokenizer::Recycled::~Recycled() {
+  if (recycled_tokenizers.size() < kMaxRecycledTokenizers &&
+      st_->marks_.empty()) {
+    // Release the tokens and the bytes of this tokenizer's stream, and
+    // undo any change to its reserved words.
+    st_->Reset(StringPiece());
+    st_->set_max_history(0);
+    st_->config_ = LexerConfig::Default();
+    recycled_tokenizers.push_back(std::unique_ptr<StreamTokenizer>(st_));
+  } else {
+    delete st_;
+  }
+}
+
+void
+StreamTokenizer::ReleaseHistory() {
+  if (max_history_ == 0) {
+    return;
+  }
+  while (token_.size() > 0 &&
+         next_token_idx_ - first_token_idx_ > max_history_) {
+    token_.pop_front();
+    ++first_token_idx_;
+  }
+  if (buffered_) {
+    // The bytes belong to the caller.
+    return;
+  }
+  size_t keep_start = token_.empty() ? num_read_ : token_.front().start;
+  if (!marks_.empty() && marks_.front() < keep_start) {
+    keep_start = marks_.front();
+  }
+  // Only erase once there is a reasonable amount to erase, so that the
+  // cost of erasing is amortized over the bytes erased.
+  size_t num_to_erase = keep_start - bytes_start_;
+  if (num_to_erase >= 4096 && num_to_erase >= bytes_.size() / 2) {
+    bytes_.erase(0, num_to_erase);
+    bytes_start_ = keep_start;
+  }
+}
+
 void
 StreamTokenizer::ConsumeChar(char c) {
-  oss_ << c;
+  if (!buffered_) {
+    bytes_ += c;
+  }
   ++num_read_;
   if (c == '\n') {
     ++line_number_;
@@ -53,6 +193,15 @@ StreamTokenizer::ConsumeChar(char c) {
 
 bool
 StreamTokenizer::ReadChar(char *c) {
+  if (buffered_) {
+    if (num_read_ >= BufferEnd()) {
+      eof_reached_ = true;
+      return false;
+    }
+    (*c) = *BufferAt(num_read_);
+    ConsumeChar(*c);
+    return true;
+  }
   (*c) = is_.get();
   if (!is_.good()) {
     eof_reached_ = true;
@@ -63,9 +212,26 @@ StreamTokenizer::ReadChar(char *c) {
   }
 }
 
+void
+StreamTokenizer::SkipBufferedWhitespace() {
+  static const CharScanner newline("\n", 1, false);
+  const char *begin = BufferAt(num_read_);
+  const char *end = buf_ + buf_size_;
+  const char *p = begin;
+  while (true) {
+    p = CharScanner::SkipWhitespace(p, end);
+    if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+      p = newline.Find(p + 2, end);
+    } else {
+      break;
+    }
+  }
+  ConsumeBuffered(p - begin);
+}
+
 bool
 StreamTokenizer::GetNext(Token *next) {
-  if (!is_.good()) {
+  if (!Good()) {
     eof_reached_ = true;
     return false;
   }
@@ -73,13 +239,16 @@ StreamTokenizer::GetNext(Token *next) {
   char c;
   bool is_whitespace = true;
   while (is_whitespace) {
+    if (buffered_) {
+      SkipBufferedWhitespace();
+    }
     if (!ReadChar(&c)) {
       return false;
     }
-    is_whitespace = isspace(c);
+    is_whitespace = Whitespace(c);
 
     // If we find a comment character, then read to the end of the line.
-    if (!is_whitespace && c == '/' && is_.peek() == '/') {
+    if (!is_whitespace && c == '/' && PeekChar() == '/') {
       while (c != '\n') {
         if (!ReadChar(&c)) {
           return false;
@@ -96,8 +265,12 @@ StreamTokenizer::GetNext(Token *next) {
 
   bool next_tok_complete = false;
   next->tok.clear();
+  next->in_buffer = buffered_;
+  next->text_start = next->start;
+  next->text_length = 0;
+  next->symbol = SymbolTable::kNoSymbol;
   if (ReservedChar(c)) {
-    next->tok += c;
+    AppendChar(next, c);
     next_tok_complete = true;
     next->type = RESERVED_CHAR;
   } else if (c == '"') {
@@ -105,18 +278,34 @@ StreamTokenizer::GetNext(Token *next) {
     // until hitting a non-escaped double quote.
     streampos string_literal_start_pos = num_read_ - 1;
     bool found_closing_quote = false;
-    while (is_.good()) {
+    next->text_start = num_read_;
+    while (Good()) {
+      if (buffered_) {
+        // Take everything up to the next double quote or backslash at once.
+        static const CharScanner string_end("\"\\", 2, false);
+        const char *begin = BufferAt(num_read_);
+        AppendBuffered(next, string_end.Find(begin, buf_ + buf_size_) - begin);
+        if (!Good()) {
+          break;
+        }
+      }
       bool success = ReadChar(&c);
       if (success) {
         if (c == '"') {
           found_closing_quote = true;
           break;
         } else if (c == '\\') {
+          // An escaped character means the token's text is no longer a
+          // span of the underlying buffer.
+          if (next->in_buffer) {
+            next->tok.assign(BufferAt(next->text_start), next->text_length);
+            next->in_buffer = false;
+          }
           success = ReadChar(&c);
         }
       }
       if (success) {
-        next->tok += c;
+        AppendChar(next, c);
       }
     }
     if (!found_closing_quote) {
@@ -125,7 +314,7 @@ StreamTokenizer::GetNext(Token *next) {
              << "double quote for string literal beginning at stream index "
              << string_literal_start_pos
              << "; partial string literal read: \""
-             << next->tok;
+             << Text(*next);
       Error(err_ss.str());
     }
     next_tok_complete = true;
@@ -134,38 +323,49 @@ StreamTokenizer::GetNext(Token *next) {
     // This is a number, a reserved word or C++ identifier token, so
     // add first character; the remainder of the token will be handled
     // in the next block.
-    next->tok += c;
+    AppendChar(next, c);
     next->type = (c == '-' || (c >= '0' && c <= '9')) ? NUMBER : IDENTIFIER;
   }
   if (!next_tok_complete) {
     // The current token is a number, a reserved word or C++
     // identifier, so we keep reading characters until hitting a
     // "reserved character", a whitespace character or EOF.
+    if (buffered_) {
+      const char *begin = BufferAt(num_read_);
+      AppendBuffered(next,
+                     config_->token_end().Find(begin, buf_ + buf_size_) -
+                     begin);
+    }
     bool done = false;
-    while (!done && is_.good()) {
+    while (!done && Good()) {
       // We don't call ReadChar below because the next character might
       // tell us that the current token has ended (i.e., if it's a
       // reserved character, a double quote or a whitespace
       // character).
-      int peek = is_.peek();
+      int peek = PeekChar();
       if (peek != EOF) {
         char next_char = static_cast<char>(peek);
-        if (ReservedChar(next_char) || next_char == '"' || isspace(next_char)) {
-          // Now that we've finished reading something that is not a
-          // string literal, change its type to be RESERVED_WORD if it
-          // exactly matches something in the set of reserved words.
-          if (reserved_words_.count(next->tok) != 0) {
-            next->type = RESERVED_WORD;
-          }
+        if (TokenEnd(next_char)) {
           done = true;
         } else {
           ReadChar(&c);
-          next->tok += c;
+          AppendChar(next, c);
         }
       } else {
 	eof_reached_ = true;
       }
     }
+    // Now that we've finished reading something that is not a string
+    // literal, change its type to be RESERVED_WORD if it exactly matches
+    // something in the set of reserved words.
+    if (config_->default_reserved_words()) {
+      next->symbol = SymbolTable::FindReservedWord(TextView(*next));
+      if (next->symbol != SymbolTable::kNoSymbol) {
+        next->type = RESERVED_WORD;
+      }
+    } else if (config_->reserved_words().count(Text(*next)) != 0) {
+      next->type = RESERVED_WORD;
+    }
   }
   // We're about to return a successfully read token, so we make sure to record
   // the stream position at this point in the Token object.
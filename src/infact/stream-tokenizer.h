@@ -36,7 +36,9 @@
 #ifndef INFACT_STREAM_TOKENIZER_H_
 #define INFACT_STREAM_TOKENIZER_H_
 
+#include <deque>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <stdexcept>
@@ -44,7 +46,10 @@
 #include <string.h>
 #include <vector>
 
+#include "char-scanner.h"
 #include "error.h"
+#include "string-piece.h"
+#include "symbol-table.h"
 
 namespace infact {
 
@@ -52,16 +57,19 @@ using std::istream;
 using std::istringstream;
 using std::ostringstream;
 using std::set;
+using std::shared_ptr;
 using std::streampos;
 using std::string;
 using std::vector;
 using std::cerr;
+using std::deque;
 using std::endl;
 
 /// Default set of reserved words for the StreamTokenizer class.
 /// Use the \link infact::StreamTokenizer::set_reserved_words
 /// StreamTokenizer::set_reserved_words \endlink
-/// to customize this set.
+/// to customize this set.  The \link infact::SymbolTable SymbolTable
+/// \endlink recognizes these words with a perfect hash.
 static const char *default_reserved_words[] = {
   "-",
   "nullptr",
@@ -81,6 +89,103 @@ static const char *default_reserved_words[] = {
 /// Default set of reserved characters for the StreamTokenizer class.
 #define DEFAULT_RESERVED_CHARS "(){},=;/"
 
+/// The lexical configuration of a \link infact::StreamTokenizer
+/// StreamTokenizer\endlink: its reserved characters and reserved words,
+/// along with the tables derived from them for classifying bytes.
+///
+/// A configuration is immutable once constructed, and so may be shared
+/// by any number of tokenizers, in any number of threads.  Tokenizers
+/// with the default configuration all share a single instance, built
+/// the first time it is needed (see \link Default\endlink), so that
+/// constructing a tokenizer does no work proportional to the number of
+/// reserved characters or words.
+class LexerConfig {
+ public:
+  /// Constructs a configuration with the specified reserved characters
+  /// and the default reserved words.
+  ///
+  /// \param reserved_chars the set of single characters serving as
+  ///                       &ldquo;reserved characters&rdquo;
+  explicit LexerConfig(const char *reserved_chars = DEFAULT_RESERVED_CHARS) :
+      reserved_chars_(reserved_chars),
+      reserved_words_(infact::default_reserved_words,
+                      infact::default_reserved_words +
+                      sizeof(infact::default_reserved_words) /
+                      sizeof(const char *)),
+      default_reserved_words_(true) {
+    Init();
+  }
+
+  /// Constructs a configuration with the specified reserved characters
+  /// and reserved words.
+  ///
+  /// \param reserved_chars the set of single characters serving as
+  ///                       &ldquo;reserved characters&rdquo;
+  /// \param reserved_words the set of &ldquo;reserved words&rdquo;
+  LexerConfig(const char *reserved_chars, const set<string> &reserved_words);
+
+  /// Returns the configuration with the default reserved characters and
+  /// words, shared by every tokenizer using it.
+  static const shared_ptr<const LexerConfig> &Default();
+
+  /// Returns a configuration with the specified reserved characters and
+  /// the default reserved words, which is the \link Default \endlink
+  /// configuration if the reserved characters are the default ones.
+  static shared_ptr<const LexerConfig> Get(const char *reserved_chars);
+
+  /// Returns the reserved characters of this configuration.
+  const string &reserved_chars() const { return reserved_chars_; }
+
+  /// Returns the reserved words of this configuration.
+  const set<string> &reserved_words() const { return reserved_words_; }
+
+  /// Returns whether the reserved words are the default set, in which
+  /// case the perfect hash of the \link infact::SymbolTable SymbolTable
+  /// \endlink is used to recognize them.
+  bool default_reserved_words() const { return default_reserved_words_; }
+
+  /// Returns whether the specified character represents a
+  /// &ldquo;reserved character&rdquo;.
+  bool ReservedChar(char c) const {
+    return (char_class_[static_cast<unsigned char>(c)] & kReservedChar) != 0;
+  }
+
+  /// Returns whether the specified character is whitespace.
+  bool Whitespace(char c) const {
+    return (char_class_[static_cast<unsigned char>(c)] & kWhitespace) != 0;
+  }
+
+  /// Returns whether the specified character ends a number, reserved
+  /// word or identifier.
+  bool TokenEnd(char c) const {
+    return (char_class_[static_cast<unsigned char>(c)] &
+            (kReservedChar | kWhitespace | kQuote)) != 0;
+  }
+
+  /// Returns a scanner that finds the ends of numbers, reserved words
+  /// and identifiers.
+  const CharScanner &token_end() const { return token_end_; }
+
+ private:
+  /// Builds the tables derived from reserved_chars_.
+  void Init();
+
+  /// Bits of the entries of \link char_class_ \endlink.
+  enum CharClass {
+    kReservedChar = 1,
+    kWhitespace = 2,
+    kQuote = 4
+  };
+
+  string reserved_chars_;
+  set<string> reserved_words_;
+  bool default_reserved_words_;
+  /// The \link CharClass \endlink bits of every character.
+  unsigned char char_class_[256];
+  /// Finds the ends of numbers, reserved words and identifiers.
+  CharScanner token_end_;
+};
+
 /// \class StreamTokenizer
 ///
 /// A simple class for tokenizing a stream of tokens for the formally
@@ -110,11 +215,29 @@ class StreamTokenizer {
 
   /// Information about a token read from the underlying stream.
   struct Token {
-    /// The token itself.
+    /// The token itself, unless the token is a span of the underlying
+    /// buffer (see \link in_buffer \endlink).
     string tok;
     /// The token&rsquo;s type.
     TokenType type;
 
+    // When reading from a contiguous buffer, most tokens are simply
+    // spans of that buffer and have no string of their own.
+
+    /// Whether the token is the span\code
+    /// [text_start, text_start + text_length) \endcode
+    /// of the underlying buffer rather than the contents of \link tok
+    /// \endlink.
+    bool in_buffer;
+    /// The starting byte of the token&rsquo;s text in the underlying buffer.
+    size_t text_start;
+    /// The length of the token&rsquo;s text in the underlying buffer.
+    size_t text_length;
+    /// The interned symbol of the token&rsquo;s text, if the token is a
+    /// reserved word or an identifier that has been interned, or else
+    /// \link infact::SymbolTable::kNoSymbol SymbolTable::kNoSymbol\endlink.
+    Symbol symbol;
+
     // The following three fields capture information about the underlying
     // byte stream at the time this token was read from it.
 
@@ -135,12 +258,14 @@ class StreamTokenizer {
   ///                       &ldquo;reserved characters&rdquo;
   StreamTokenizer(istream &is,
                   const char *reserved_chars = DEFAULT_RESERVED_CHARS) :
-      is_(is), num_read_(0), line_number_(0), eof_reached_(false),
-      next_token_idx_(0) {
-    Init(reserved_chars);
+      is_(is), buffered_(false), buf_(nullptr), buf_size_(0),
+      num_read_(0), line_number_(0), eof_reached_(false),
+      next_token_idx_(0), max_history_(0), first_token_idx_(0),
+      bytes_start_(0), buf_start_(0) {
+    Init(LexerConfig::Get(reserved_chars));
   }
 
-  /// Constructs a new instance around the specified string.
+  /// Constructs a new instance around a copy of the specified string.
   ///
   /// \param s              the string providing the stream of characters
   ///                       for this stream tokenizer to use
@@ -148,55 +273,227 @@ class StreamTokenizer {
   ///                       &ldquo;reserved characters&rdquo;
   StreamTokenizer(const string &s,
                   const char *reserved_chars = DEFAULT_RESERVED_CHARS) :
-      sstream_(s), is_(sstream_), num_read_(0), line_number_(0),
-      eof_reached_(false), next_token_idx_(0) {
-    Init(reserved_chars);
+      is_(sstream_), buffered_(true), buf_storage_(s),
+      buf_(buf_storage_.data()), buf_size_(buf_storage_.size()),
+      num_read_(0), line_number_(0), eof_reached_(false),
+      next_token_idx_(0), max_history_(0), first_token_idx_(0),
+      bytes_start_(0), buf_start_(0) {
+    Init(LexerConfig::Get(reserved_chars));
+  }
+
+  /// Constructs a new instance that reads directly from the specified
+  /// contiguous buffer of bytes, such as a memory-mapped file (see \link
+  /// infact::MappedFile MappedFile\endlink).  Tokens are kept as spans
+  /// of the buffer rather than as copies, and the buffer itself is not
+  /// copied, so it must outlive this instance.
+  ///
+  /// \param data           the bytes for this stream tokenizer to use
+  /// \param size           the number of bytes in <tt>data</tt>
+  /// \param reserved_chars the set of single characters serving as
+  ///                       &ldquo;reserved characters&rdquo;
+  StreamTokenizer(const char *data, size_t size,
+                  const char *reserved_chars = DEFAULT_RESERVED_CHARS) :
+      is_(sstream_), buffered_(true), buf_(data), buf_size_(size),
+      num_read_(0), line_number_(0), eof_reached_(false),
+      next_token_idx_(0), max_history_(0), first_token_idx_(0),
+      bytes_start_(0), buf_start_(0) {
+    Init(LexerConfig::Get(reserved_chars));
+  }
+
+  /// Constructs a new instance that reads directly from the specified
+  /// contiguous buffer of bytes, exactly as \link
+  /// StreamTokenizer(const char*,size_t,const char*) \endlink does,
+  /// but with the specified lexical configuration.
+  StreamTokenizer(const char *data, size_t size,
+                  const shared_ptr<const LexerConfig> &config) :
+      is_(sstream_), buffered_(true), buf_(data), buf_size_(size),
+      num_read_(0), line_number_(0), eof_reached_(false),
+      next_token_idx_(0), max_history_(0), first_token_idx_(0),
+      bytes_start_(0), buf_start_(0) {
+    Init(config);
+  }
+
+  /// Constructs a new instance with no bytes to read, to be given some
+  /// with \link Reset\endlink.
+  ///
+  /// \param config the lexical configuration of this instance
+  explicit StreamTokenizer(const shared_ptr<const LexerConfig> &config =
+                           LexerConfig::Default()) :
+      is_(sstream_), buffered_(true), buf_(nullptr), buf_size_(0),
+      num_read_(0), line_number_(0), eof_reached_(false),
+      next_token_idx_(0), max_history_(0), first_token_idx_(0),
+      bytes_start_(0), buf_start_(0) {
+    Init(config);
   }
 
   /// Sets the set of &ldquo;reserved words&rdquo; used by this stream
   /// tokenizer.  Should be invoked just after construction time.
   void set_reserved_words(set<string> &reserved_words) {
-    reserved_words_ = reserved_words;
+    config_ = std::make_shared<LexerConfig>(config_->reserved_chars().c_str(),
+                                            reserved_words);
   }
 
-  /// Destroys this instance.
-  virtual ~StreamTokenizer() {
-    delete[] reserved_chars_;
+  /// Returns the lexical configuration of this instance.
+  const shared_ptr<const LexerConfig> &config() const { return config_; }
+
+  /// Makes this instance read directly from the specified contiguous
+  /// buffer of bytes from its beginning, exactly as if it had just been
+  /// constructed around it, but reusing the storage and the lexical
+  /// configuration of this instance.  As when constructed around a
+  /// buffer, the bytes are not copied, so they must outlive this
+  /// instance or the next invocation of this method.  The maximum
+  /// history (see \link set_max_history\endlink) is unchanged.  It is
+  /// an error to invoke this method while any \link ScopedMark
+  /// ScopedMark \endlink of this instance exists.
+  ///
+  /// \param bytes the bytes for this stream tokenizer to use
+  void Reset(const StringPiece &bytes) { Reset(bytes, 0, 0); }
+
+  /// Makes this instance read directly from the specified contiguous
+  /// buffer of bytes, exactly as \link Reset(const StringPiece&) Reset
+  /// \endlink does, except that the bytes are a part of some larger
+  /// stream, starting at the specified stream position and line number.
+  /// Every stream position and line number of this instance, such as
+  /// those reported by \link tellg \endlink and \link
+  /// PeekTokenStart\endlink, and those expected by \link View\endlink,
+  /// is then one of the larger stream, so that errors in the bytes are
+  /// reported just as if they had been read as part of it.
+  ///
+  /// \param bytes       the bytes for this stream tokenizer to use
+  /// \param position    the stream position of the first of the bytes
+  /// \param line_number the line number of the first of the bytes
+  void Reset(const StringPiece &bytes, size_t position, size_t line_number);
+
+  /// A tokenizer reading from a contiguous buffer of bytes, recycled
+  /// from a small pool kept by the calling thread (see \link Reset
+  /// \endlink), and returned to it when this object is destroyed.
+  /// Tokenizing many short strings, such as specs, thus does not
+  /// construct a tokenizer for each.  Nested instances within the same
+  /// thread each have their own tokenizer.
+  class Recycled {
+   public:
+    /// Provides a tokenizer for the specified bytes, which must outlive
+    /// this object, with the default lexical configuration.
+    explicit Recycled(const StringPiece &bytes);
+    /// Provides a tokenizer for the specified bytes, which must outlive
+    /// this object, as a part of some larger stream starting at the
+    /// specified stream position and line number (see \link
+    /// Reset(const StringPiece&,size_t,size_t) Reset\endlink).
+    Recycled(const StringPiece &bytes, size_t position, size_t line_number);
+    /// Returns the tokenizer to the pool of the calling thread.
+    ~Recycled();
+
+    StreamTokenizer &operator*() const { return *st_; }
+    StreamTokenizer *operator->() const { return st_; }
+
+   private:
+    StreamTokenizer *st_;
+  };
+
+  /// Puts this stream tokenizer into <i>bounded history</i> mode, where
+  /// at most the specified number of already-consumed tokens are kept
+  /// for rewinding, and the bytes preceding the oldest kept token are
+  /// released (unless retained by a \link ScopedMark ScopedMark\endlink).
+  /// In this mode, memory use is independent of the length of the
+  /// underlying stream, but \link Rewind \endlink can only go back as
+  /// far as the oldest kept token, and \link str \endlink only returns
+  /// the bytes that have not yet been released.
+  ///
+  /// \param num_tokens the maximum number of consumed tokens to keep, or
+  ///                   0 to keep all tokens (the default)
+  void set_max_history(size_t num_tokens) {
+    max_history_ = num_tokens;
+    ReleaseHistory();
   }
 
+  /// Returns the maximum number of consumed tokens kept by this
+  /// instance, or 0 if all tokens are kept.
+  size_t max_history() const { return max_history_; }
+
+  /// Ensures that the bytes of the underlying stream starting at the
+  /// beginning of the next token are retained for as long as this object
+  /// exists, even in bounded history mode, so that they may be retrieved
+  /// with \link str(size_t,size_t) const str(start, end)\endlink or
+  /// \link View \endlink.
+  class ScopedMark {
+   public:
+    /// Marks the start of the next token of the specified tokenizer.
+    ScopedMark(StreamTokenizer &st) : st_(st) {
+      st_.marks_.push_back(st_.PeekTokenStart());
+    }
+    /// Removes the mark, allowing its bytes to be released.
+    ~ScopedMark() {
+      st_.marks_.pop_back();
+    }
+   private:
+    StreamTokenizer &st_;
+  };
+
+  /// Destroys this instance.
+  virtual ~StreamTokenizer() { }
+
   /// Returns the entire sequence of characters read so far by this
-  /// stream tokenizer as a newly constructed string object.
-  string str() { return oss_.str(); }
+  /// stream tokenizer as a newly constructed string object.  In bounded
+  /// history mode, the bytes that have been released are omitted.
+  string str() {
+    return buffered_ ? string(buf_, num_read_ - buf_start_) : bytes_;
+  }
+
+  /// Returns the characters of the underlying stream in the byte range
+  /// [start, end) as a newly constructed string object.  It is an error
+  /// if some of these bytes have not yet been read or have been released.
+  string str(size_t start, size_t end) const {
+    return View(start, end).ToString();
+  }
+
+  /// Returns a view of the characters of the underlying stream in the
+  /// byte range [start, end), without copying them.  It is an error if
+  /// some of these bytes have not yet been read or have been released.
+  /// When reading from a buffer, the view remains valid for the lifetime
+  /// of the buffer; otherwise, it is only valid until the next token is
+  /// read.
+  StringPiece View(size_t start, size_t end) const {
+    if (start < bytes_start_ || end > num_read_ || start > end) {
+      ostringstream err_ss;
+      err_ss << "StreamTokenizer::View: error: bytes [" << start << ", "
+             << end << ") not available; available bytes are ["
+             << bytes_start_ << ", " << num_read_ << ")";
+      Error(err_ss.str());
+    }
+    return buffered_ ?
+        StringPiece(BufferAt(start), end - start) :
+        StringPiece(bytes_.data() + (start - bytes_start_), end - start);
+  }
 
   /// Returns the number of bytes read from the underlying byte
   /// stream just after scanning the most recent token, or 0 if this stream
   /// is just about to return the first token.
   size_t tellg() const {
-    return HasPrev() ? token_[next_token_idx_ - 1].curr_pos : 0;
+    return HasPrev() ? TokenAt(next_token_idx_ - 1).curr_pos : buf_start_;
   }
 
   /// Returns the number of lines read from the underlying byte stream,
   /// where a line is any number of bytes followed by a newline character
   /// (i.e., this is ASCII-centric).
   size_t line_number() const {
-    return HasNext() ? token_[next_token_idx_].line_number : line_number_;
+    return HasNext() ? TokenAt(next_token_idx_).line_number : line_number_;
   }
 
   /// Returns whether there is another token in the token stream.
-  bool HasNext() const { return next_token_idx_ < token_.size(); }
+  bool HasNext() const { return next_token_idx_ < NumTokens(); }
 
-  bool HasPrev() const { return next_token_idx_ > 0; }
+  bool HasPrev() const { return next_token_idx_ > first_token_idx_; }
 
   string PeekPrev() const {
-    return HasPrev() ? token_[next_token_idx_ - 1].tok : "";
+    return HasPrev() ? Text(TokenAt(next_token_idx_ - 1)) : "";
   }
 
   size_t PeekPrevTokenStart() const {
-    return HasPrev() ? token_[next_token_idx_ - 1].start : 0;
+    return HasPrev() ? TokenAt(next_token_idx_ - 1).start : 0;
   }
 
   TokenType PeekPrevTokenType() const {
-    return HasPrev() ? token_[next_token_idx_ - 1].type : EOF_TYPE;
+    return HasPrev() ? TokenAt(next_token_idx_ - 1).type : EOF_TYPE;
   }
 
   /// Returns the next token in the token stream.
@@ -204,29 +501,42 @@ class StreamTokenizer {
     if (!HasNext()) {
       Error("invoking StreamTokenizer::Next when HasNext returns false");
     }
+    string curr_token = Text(TokenAt(next_token_idx_));
+    Skip();
+    return curr_token;
+  }
 
-    size_t curr_token_idx = next_token_idx_;
+  /// Advances past the next token in the token stream exactly as \link
+  /// Next \endlink does, but without copying it, for a caller that has
+  /// already examined it (see \link PeekView\endlink).
+  void Skip() {
+    if (!HasNext()) {
+      Error("invoking StreamTokenizer::Skip when HasNext returns false");
+    }
 
     // Try to get the next token of the stream if we're about to run out of
     // tokens.
-    if (!eof_reached_ && next_token_idx_ + 1 == token_.size()) {
+    if (!eof_reached_ && next_token_idx_ + 1 == NumTokens()) {
       Token next;
       if (GetNext(&next)) {
 	token_.push_back(next);
       }
     }
-    // Ensure that we only advance if we haven't already reached token_.size().
-    if (next_token_idx_ < token_.size()) {
+    // Ensure that we only advance if we haven't already reached the end
+    // of token_.
+    if (next_token_idx_ < NumTokens()) {
       ++next_token_idx_;
     }
-
-    return token_[curr_token_idx].tok;
+    if (max_history_ > 0) {
+      ReleaseHistory();
+    }
   }
 
-  /// Rewinds this token stream to the beginning.  If the underlying stream
+  /// Rewinds this token stream to the beginning (or, in bounded history
+  /// mode, to the oldest token kept).  If the underlying stream
   /// has no tokens, this is a no-op.
   void Rewind() {
-    next_token_idx_ = 0;
+    next_token_idx_ = first_token_idx_;
   }
 
   /// Rewinds this token stream by the specified number of tokens.  If the
@@ -235,8 +545,8 @@ class StreamTokenizer {
   /// the no-argument Rewind() method.
   void Rewind(size_t num_tokens) {
     // Cannot rewind more than the number of tokens read so far.
-    if (num_tokens > next_token_idx_) {
-      num_tokens = next_token_idx_;
+    if (num_tokens > next_token_idx_ - first_token_idx_) {
+      num_tokens = next_token_idx_ - first_token_idx_;
     }
     next_token_idx_ -= num_tokens;
   }
@@ -246,49 +556,158 @@ class StreamTokenizer {
     Rewind(1);
   }
 
+  /// Returns the number of tokens read so far from the underlying
+  /// stream, including the next token, if any.
+  size_t num_tokens() const { return NumTokens(); }
+
   /// Returns the next token&rsquo;s start position, or the byte position
   /// of the underlying byte stream if there is no next token.
   size_t PeekTokenStart() const {
-    return HasNext() ? token_[next_token_idx_].start : num_read_;
+    return HasNext() ? TokenAt(next_token_idx_).start : num_read_;
   }
 
   /// Returns the type of the next token, or EOF_TYPE if there is no next
   /// token.
   TokenType PeekTokenType() const {
-    return HasNext() ? token_[next_token_idx_].type : EOF_TYPE;
+    return HasNext() ? TokenAt(next_token_idx_).type : EOF_TYPE;
   }
 
   /// Returns the line number of the first byte of the next token, or
   /// the current line number of the underlying stream if there is no
   /// next token.
   size_t PeekTokenLineNumber() const {
-    return HasNext() ? token_[next_token_idx_].line_number : line_number_;
+    return HasNext() ? TokenAt(next_token_idx_).line_number : line_number_;
   }
 
   /// Returns the next token that would be returned by the \link Next
   /// \endlink method.  The return value of this method is only valid
   /// when \link HasNext \endlink returns <tt>true</tt>.
-  string Peek() const { return HasNext() ? token_[next_token_idx_].tok : ""; }
+  string Peek() const {
+    return HasNext() ? Text(TokenAt(next_token_idx_)) : "";
+  }
 
- private:
-  void Init(const char *reserved_chars) {
-    num_reserved_chars_ = strlen(reserved_chars);
-    reserved_chars_ = new char[num_reserved_chars_ + 1];
-    strcpy(reserved_chars_, reserved_chars);
-    int num_reserved_words = sizeof(default_reserved_words)/sizeof(const char*);
-    for (int i = 0; i < num_reserved_words; ++i) {
-      reserved_words_.insert(string(default_reserved_words[i]));
+  /// Returns a view of the next token that would be returned by the
+  /// \link Next \endlink method, without copying it.  The view is
+  /// valid until the token is released (see \link set_max_history
+  /// \endlink) or this tokenizer is destroyed.
+  StringPiece PeekView() const {
+    return HasNext() ? TextView(TokenAt(next_token_idx_)) : StringPiece();
+  }
+
+  /// Returns the interned symbol of the next token if it is an
+  /// identifier or a reserved word, interning it if necessary, or else
+  /// \link infact::SymbolTable::kNoSymbol SymbolTable::kNoSymbol\endlink.
+  /// Each token is interned at most once.
+  Symbol PeekSymbol() {
+    if (!HasNext()) {
+      return SymbolTable::kNoSymbol;
     }
+    Token &token = token_[next_token_idx_ - first_token_idx_];
+    if (token.symbol == SymbolTable::kNoSymbol &&
+        (token.type == IDENTIFIER || token.type == RESERVED_WORD)) {
+      token.symbol = SymbolTable::Intern(TextView(token));
+    }
+    return token.symbol;
+  }
+
+ private:
+  void Init(const shared_ptr<const LexerConfig> &config) {
+    config_ = config;
     Token next;
     if (GetNext(&next)) {
       token_.push_back(next);
     }
   }
 
+  /// Returns the token with the specified index, which must not have
+  /// been released.
+  const Token &TokenAt(size_t idx) const {
+    return token_[idx - first_token_idx_];
+  }
+
+  /// Returns the number of tokens read so far, including any released.
+  size_t NumTokens() const { return first_token_idx_ + token_.size(); }
+
+  /// Releases the tokens beyond the rewind horizon and the bytes preceding
+  /// both the oldest kept token and the oldest mark.
+  void ReleaseHistory();
+
+  /// Returns the text of the specified token.
+  string Text(const Token &token) const {
+    return token.in_buffer ?
+        string(BufferAt(token.text_start), token.text_length) : token.tok;
+  }
+
+  /// Returns a view of the text of the specified token.
+  StringPiece TextView(const Token &token) const {
+    return token.in_buffer ?
+        StringPiece(BufferAt(token.text_start), token.text_length) :
+        StringPiece(token.tok);
+  }
+
+  /// Appends the specified character to the text of the specified token.
+  void AppendChar(Token *token, char c) {
+    if (token->in_buffer) {
+      ++token->text_length;
+    } else {
+      token->tok += c;
+    }
+  }
+
+  /// Returns the byte of the underlying buffer at the specified stream
+  /// position.
+  const char *BufferAt(size_t position) const {
+    return buf_ + (position - buf_start_);
+  }
+
+  /// Returns the stream position just past the end of the underlying
+  /// buffer.
+  size_t BufferEnd() const { return buf_start_ + buf_size_; }
+
+  /// Returns whether there may be more bytes to read from the underlying
+  /// buffer or stream.
+  bool Good() const {
+    return buffered_ ? num_read_ < BufferEnd() : is_.good();
+  }
+
+  /// Returns the next byte of the underlying buffer or stream without
+  /// consuming it, or <tt>EOF</tt> if there are no more bytes.
+  int PeekChar() {
+    if (buffered_) {
+      return num_read_ < BufferEnd() ?
+          static_cast<unsigned char>(*BufferAt(num_read_)) : EOF;
+    }
+    return is_.peek();
+  }
+
   void ConsumeChar(char c);
 
   bool ReadChar(char *c);
 
+  /// Consumes the specified number of bytes of the underlying buffer,
+  /// a block at a time.
+  void ConsumeBuffered(size_t num_bytes) {
+    const char *begin = BufferAt(num_read_);
+    line_number_ += CharScanner::Count(begin, begin + num_bytes, '\n');
+    num_read_ += num_bytes;
+  }
+
+  /// Consumes all whitespace and comments starting at the current
+  /// position of the underlying buffer.
+  void SkipBufferedWhitespace();
+
+  /// Appends the specified number of bytes of the underlying buffer,
+  /// starting at the current position, to the specified token and
+  /// consumes them.
+  void AppendBuffered(Token *token, size_t num_bytes) {
+    if (token->in_buffer) {
+      token->text_length += num_bytes;
+    } else {
+      token->tok.append(BufferAt(num_read_), num_bytes);
+    }
+    ConsumeBuffered(num_bytes);
+  }
+
   /// Retrieves the next token from the <tt>istream</tt> wrapped by this
   /// stream tokenizer.
   ///
@@ -300,14 +719,14 @@ class StreamTokenizer {
 
   /// Returns whether the specified character represents a
   /// &ldquo;reserved character&rdquo;.
-  bool ReservedChar(char c) const {
-    for (size_t i = 0; i < num_reserved_chars_; ++i) {
-      if (c == reserved_chars_[i]) {
-        return true;
-      }
-    }
-    return false;
-  }
+  bool ReservedChar(char c) const { return config_->ReservedChar(c); }
+
+  /// Returns whether the specified character is whitespace.
+  bool Whitespace(char c) const { return config_->Whitespace(c); }
+
+  /// Returns whether the specified character ends a number, reserved
+  /// word or identifier.
+  bool TokenEnd(char c) const { return config_->TokenEnd(c); }
 
   // data members
 
@@ -318,24 +737,49 @@ class StreamTokenizer {
   /// The underlying byte stream of this token stream.
   istream &is_;
 
-  // Information about special tokens.
-  char *reserved_chars_;
-  size_t num_reserved_chars_;
-  set<string> reserved_words_;
+  /// Whether this instance reads from the contiguous buffer buf_ instead
+  /// of from is_.
+  bool buffered_;
+  /// Storage for a copy of the buffer, when constructed from a string.
+  string buf_storage_;
+  /// The underlying buffer, when buffered_ is true.
+  const char *buf_;
+  /// The size of the underlying buffer, when buffered_ is true.
+  size_t buf_size_;
+
+  /// The reserved characters and words of this instance.
+  shared_ptr<const LexerConfig> config_;
 
   // Information about the current state of the underlying byte stream.
   size_t num_read_;
   size_t line_number_;
   bool eof_reached_;
-  ostringstream oss_;
+  /// The bytes read so far, when not reading from a buffer, starting at
+  /// byte bytes_start_ of the stream.
+  string bytes_;
 
-  // The sequence of tokens read so far.
-  vector<Token> token_;
+  // The sequence of tokens read so far, starting with the token whose
+  // index is first_token_idx_.
+  deque<Token> token_;
 
   // The index of the next token in this stream in token_, or token_.size()
   // if there are no more tokens left in this stream.  Note that invocations
   // of the Rewind and Putback methods alter this data member.
   size_t next_token_idx_;
+
+  // Information for bounded history mode.
+
+  /// The maximum number of consumed tokens to keep, or 0 for all.
+  size_t max_history_;
+  /// The index of the first token in token_.
+  size_t first_token_idx_;
+  /// The stream position of the first byte in bytes_.
+  size_t bytes_start_;
+  /// The stream position of the first byte of the underlying buffer, when
+  /// buffered_ is true.
+  size_t buf_start_;
+  /// The byte positions marked by ScopedMark instances, in increasing order.
+  vector<size_t> marks_;
 };
 
 }  // namespace infact
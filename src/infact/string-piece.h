@@ -0,0 +1,119 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::StringPiece StringPiece \endlink class.
+
+#ifndef INFACT_STRING_PIECE_H_
+#define INFACT_STRING_PIECE_H_
+
+#include <iostream>
+#include <string>
+#include <string.h>
+
+namespace infact {
+
+using std::ostream;
+using std::string;
+
+/// A non-owning view of a contiguous sequence of characters, such as
+/// a span of the buffer of a \link infact::StreamTokenizer
+/// StreamTokenizer\endlink.  The characters viewed must outlive the
+/// view.
+class StringPiece {
+ public:
+  /// Constructs an empty view.
+  StringPiece() : data_(nullptr), size_(0) { }
+
+  /// Constructs a view of the specified characters.
+  StringPiece(const char *data, size_t size) : data_(data), size_(size) { }
+
+  /// Constructs a view of the specified string.
+  StringPiece(const string &s) : data_(s.data()), size_(s.size()) { }
+
+  /// Constructs a view of the specified null-terminated string.
+  StringPiece(const char *s) : data_(s), size_(s == nullptr ? 0 : strlen(s)) {
+  }
+
+  /// Returns a pointer to the first character viewed.
+  const char *data() const { return data_; }
+  /// Returns the number of characters viewed.
+  size_t size() const { return size_; }
+  /// Returns whether this view has no characters.
+  bool empty() const { return size_ == 0; }
+
+  /// Returns a pointer to the first character viewed.
+  const char *begin() const { return data_; }
+  /// Returns a pointer just past the last character viewed.
+  const char *end() const { return data_ + size_; }
+
+  /// Returns the character at the specified index.
+  char operator[](size_t i) const { return data_[i]; }
+
+  /// Returns a newly constructed string containing the characters viewed.
+  string ToString() const { return data_ == nullptr ? string() :
+                                   string(data_, size_); }
+
+  /// Returns a lexicographic comparison of this view with the specified
+  /// one, with the same meaning as <tt>std::string::compare</tt>.
+  int compare(const StringPiece &other) const {
+    size_t min_size = size_ < other.size_ ? size_ : other.size_;
+    int result = min_size == 0 ? 0 : memcmp(data_, other.data_, min_size);
+    if (result == 0) {
+      result = size_ < other.size_ ? -1 : (size_ > other.size_ ? 1 : 0);
+    }
+    return result;
+  }
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+inline bool operator==(const StringPiece &x, const StringPiece &y) {
+  return x.size() == y.size() && x.compare(y) == 0;
+}
+
+inline bool operator!=(const StringPiece &x, const StringPiece &y) {
+  return !(x == y);
+}
+
+inline bool operator<(const StringPiece &x, const StringPiece &y) {
+  return x.compare(y) < 0;
+}
+
+inline ostream &operator<<(ostream &os, const StringPiece &piece) {
+  return os.write(piece.data(), piece.size());
+}
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,240 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Implementation of the Sweep class.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "error.h"
+#include "stats.h"
+#include "sweep.h"
+
+namespace infact {
+
+using std::ostringstream;
+
+Sweep::Sweep(const Environment *env) {
+  Environment *copy = env == nullptr ? Environment::CreateEmpty() : env->Copy();
+  copy->Freeze();
+  environments_.push_back(shared_ptr<const Environment>(copy));
+}
+
+void
+Sweep::Add(const string &varname, const vector<string> &values) {
+  vector<shared_ptr<const Environment> > environments;
+  environments.reserve(environments_.size() * values.size());
+  for (size_t i = 0; i < environments_.size(); ++i) {
+    for (size_t j = 0; j < values.size(); ++j) {
+      shared_ptr<Environment> env(environments_[i]->Copy());
+      StreamTokenizer::Recycled st(values[j]);
+      env->ReadAndSet(varname, *st, "");
+      if (st->PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+        ostringstream err_ss;
+        err_ss << "Sweep: error: unexpected token \"" << st->Peek()
+               << "\" after value " << j << " of variable " << varname;
+        Error(err_ss.str());
+      }
+      env->Freeze();
+      environments.push_back(env);
+    }
+  }
+  environments_.swap(environments);
+}
+
+void
+Sweep::AddRange(const string &varname, int start, int end, int step) {
+  Add(varname, RangeValues(varname, start, end, step));
+}
+
+void
+Sweep::Read(StreamTokenizer &st) {
+  string varname;
+  vector<string> values;
+  ReadClause(st, &varname, &values);
+  Add(varname, values);
+}
+
+void
+Sweep::ReadClause(StreamTokenizer &st, string *varname,
+                  vector<string> *values) {
+  Expect(st, "for");
+  if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER) {
+    ostringstream err_ss;
+    err_ss << "Sweep: error: expected variable name at stream position "
+           << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+    Error(err_ss.str());
+  }
+  *varname = st.Next();
+  Expect(st, "in");
+  if (st.PeekView() == "range") {
+    st.Skip();
+    Expect(st, "(");
+    int start = ReadInt(st);
+    Expect(st, ",");
+    int end = ReadInt(st);
+    int step = 1;
+    if (st.PeekView() == ",") {
+      st.Skip();
+      step = ReadInt(st);
+    }
+    Expect(st, ")");
+    *values = RangeValues(*varname, start, end, step);
+    return;
+  }
+
+  // Read the text of each value, up to the next comma or closing brace
+  // that is not nested within it.
+  Expect(st, "{");
+  values->clear();
+  while (st.PeekView() != "}") {
+    if (st.PeekTokenType() == StreamTokenizer::EOF_TYPE) {
+      Error("Sweep: error: unexpected EOF in values of variable " + *varname);
+    }
+    StreamTokenizer::ScopedMark mark(st);
+    size_t start = st.PeekTokenStart();
+    int depth = 0;
+    while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE &&
+           (depth > 0 || (st.PeekView() != "," && st.PeekView() != "}"))) {
+      StringPiece token = st.PeekView();
+      if (st.PeekTokenType() == StreamTokenizer::RESERVED_CHAR) {
+        if (token == "(" || token == "{") {
+          ++depth;
+        } else if (token == ")" || token == "}") {
+          --depth;
+        }
+      }
+      st.Skip();
+    }
+    values->push_back(st.str(start, st.tellg()));
+    if (st.PeekView() == ",") {
+      st.Skip();
+    }
+  }
+  st.Skip();
+  if (values->empty()) {
+    Error("Sweep: error: no values for variable " + *varname);
+  }
+}
+
+void
+Sweep::ForEach(size_t num_threads,
+               const std::function<void(size_t)> &f) const {
+  size_t size = environments_.size();
+  num_threads = std::min(num_threads, size);
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < size; ++i) {
+      f(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::atomic<bool> failed(false);
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  Stats *stats = Stats::Current();
+  auto worker = [&]() {
+    Stats::Scope stats_scope(stats);
+    for (size_t i = next++; i < size && !failed; i = next++) {
+      try {
+        f(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!failed) {
+          error = std::current_exception();
+          failed = true;
+        }
+      }
+    }
+  };
+  // The calling thread is one of the threads.
+  vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i].join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+vector<string>
+Sweep::RangeValues(const string &varname, int start, int end, int step) {
+  if (step == 0) {
+    Error("Sweep: error: range of variable " + varname + " has step 0");
+  }
+  vector<string> values;
+  for (long long value = start; step > 0 ? value < end : value > end;
+       value += step) {
+    ostringstream oss;
+    oss << value;
+    values.push_back(oss.str());
+  }
+  return values;
+}
+
+int
+Sweep::ReadInt(StreamTokenizer &st) {
+  bool negative = st.PeekView() == "-";
+  if (negative) {
+    st.Skip();
+  }
+  if (st.PeekTokenType() != StreamTokenizer::NUMBER) {
+    ostringstream err_ss;
+    err_ss << "Sweep: error: expected int at stream position "
+           << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+    Error(err_ss.str());
+  }
+  int value = atoi(st.Next().c_str());
+  return negative ? -value : value;
+}
+
+void
+Sweep::Expect(StreamTokenizer &st, const char *token) {
+  if (st.PeekView() != token) {
+    ostringstream err_ss;
+    err_ss << "Sweep: error: expected \"" << token << "\" at stream position "
+           << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+    Error(err_ss.str());
+  }
+  st.Skip();
+}
+
+}  // namespace infact
@@ -0,0 +1,160 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+/// \file
+/// Provides the \link infact::Sweep Sweep \endlink class, the bindings
+/// of variables for constructing many similar objects from one spec.
+
+#ifndef INFACT_SWEEP_H_
+#define INFACT_SWEEP_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "environment.h"
+#include "stream-tokenizer.h"
+
+namespace infact {
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+/// Every combination of the values of a set of variables, each bound in
+/// its own environment, in which a single compiled spec referring to
+/// the variables may construct one object per combination (see \link
+/// infact::Factory::CreateMany Factory::CreateMany\endlink).
+///
+/// In the language of the \link infact::Interpreter Interpreter\endlink,
+/// a sweep specifies all the elements of a vector of objects at once,
+/// for example
+/// \code
+/// Model[] models = {
+///   for lr in {0.1, 0.01, 0.001}
+///   for seed in range(0, 10)
+///   PerceptronModel(learning_rate(lr), seed(seed))
+/// };
+/// \endcode
+/// which holds 30 models, in the order in which they would be listed by
+/// nested loops, the last variable varying fastest.  The spec is
+/// compiled only once, and the values of the variables are looked up
+/// whenever an object is constructed.
+class Sweep {
+ public:
+  /// Constructs a sweep with a single combination, of no variables, in
+  /// a copy of the specified environment, so that the variables it
+  /// defines may also be referred to.
+  ///
+  /// \param env the environment in which to bind the variables of this
+  ///            sweep, or <tt>nullptr</tt> for an empty one
+  explicit Sweep(const Environment *env = nullptr);
+
+  /// Makes the specified variable take each of the specified values in
+  /// turn, for each combination of the values of the variables added
+  /// before it, multiplying the number of combinations by the number of
+  /// values.
+  ///
+  /// \param varname the name of the variable
+  /// \param values  the text of each value, exactly as it would appear
+  ///                on the right-hand side of an assignment, for example
+  ///                <tt>0.1</tt>, <tt>"m0"</tt> or
+  ///                <tt>Cow(name("Bessie"))</tt>
+  void Add(const string &varname, const vector<string> &values);
+
+  /// Makes the specified variable take each <tt>int</tt> value in the
+  /// range [start, end) in steps of the specified size, exactly as \link
+  /// Add \endlink does.
+  void AddRange(const string &varname, int start, int end, int step = 1);
+
+  /// Reads a clause of a sweep from the specified tokenizer, and adds
+  /// its variable to this sweep.  A clause has the form
+  /// \code
+  /// for <variable_name> in { <value>, <value>, ... }
+  /// \endcode
+  /// or
+  /// \code
+  /// for <variable_name> in range(<start>, <end> [, <step>])
+  /// \endcode
+  void Read(StreamTokenizer &st);
+
+  /// Reads a clause of a sweep from the specified tokenizer, exactly as
+  /// \link Read \endlink does, without adding its variable to any
+  /// sweep, so that it may be added to many sweeps via \link Add
+  /// \endlink.  The values of a range are produced as text.
+  ///
+  /// \param      st      the tokenizer from which to read the clause
+  /// \param[out] varname the name of the variable of the clause
+  /// \param[out] values  the text of each value of the variable
+  static void ReadClause(StreamTokenizer &st, string *varname,
+                         vector<string> *values);
+
+  /// Returns the number of combinations of values of this sweep.
+  size_t size() const { return environments_.size(); }
+
+  /// Returns the frozen environment binding each combination of values,
+  /// in order.
+  const vector<shared_ptr<const Environment> > &environments() const {
+    return environments_;
+  }
+
+  /// Invokes the specified function with the index of each combination
+  /// of values of this sweep, using the specified number of threads,
+  /// and waits for every invocation to finish.  The threads record into
+  /// the current \link infact::Stats Stats \endlink of the calling
+  /// thread, if any.  If any invocation throws an exception, the
+  /// remaining combinations are skipped, and the first such exception
+  /// is rethrown.
+  ///
+  /// \param num_threads the number of threads, or 0 or 1 to invoke the
+  ///                    function for one combination after another
+  /// \param f           the function to invoke
+  void ForEach(size_t num_threads,
+               const std::function<void(size_t)> &f) const;
+
+ private:
+  /// Returns the text of each <tt>int</tt> value of the specified range.
+  static vector<string> RangeValues(const string &varname, int start, int end,
+                                    int step);
+
+  /// Reads an <tt>int</tt> literal from the specified tokenizer.
+  static int ReadInt(StreamTokenizer &st);
+
+  /// Consumes the specified token, which is an error if it is not next.
+  static void Expect(StreamTokenizer &st, const char *token);
+
+  /// The environment of each combination of values.
+  vector<shared_ptr<const Environment> > environments_;
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,220 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Implementation of the \link infact::SymbolTable SymbolTable \endlink
+/// class.
+
+#include <pthread.h>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "error.h"
+#include "stream-tokenizer.h"
+#include "symbol-table.h"
+
+namespace infact {
+
+using std::ostringstream;
+using std::unordered_map;
+using std::vector;
+
+namespace {
+
+/// A hash function for string pieces (64-bit FNV-1a).
+struct StringPieceHash {
+  size_t operator()(const StringPiece &piece) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = piece.begin(); c != piece.end(); ++c) {
+      hash ^= static_cast<unsigned char>(*c);
+      hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+  }
+};
+
+/// The hash of a reserved word used for the perfect hash, which need
+/// only be able to tell apart the few default reserved words.
+inline size_t ReservedWordHash(const StringPiece &word) {
+  return word.size() * 31 +
+      static_cast<unsigned char>(word[0]) * 7 +
+      static_cast<unsigned char>(word[word.size() - 1]);
+}
+
+/// The storage behind the static methods of SymbolTable.  Names are
+/// stored in fixed-size chunks that never move, so that looking up the
+/// name of a symbol requires no locking.
+class Table {
+ public:
+  Table() : size_(0) {
+    pthread_rwlock_init(&lock_, nullptr);
+    for (size_t i = 0; i < kMaxChunks; ++i) {
+      chunks_[i] = nullptr;
+    }
+    size_t num_reserved_words =
+        sizeof(default_reserved_words) / sizeof(const char *);
+    for (size_t i = 0; i < num_reserved_words; ++i) {
+      Intern(default_reserved_words[i]);
+    }
+    BuildReservedWordHash(num_reserved_words);
+  }
+
+  Symbol Find(const StringPiece &name) {
+    pthread_rwlock_rdlock(&lock_);
+    Symbol symbol = FindLocked(name);
+    pthread_rwlock_unlock(&lock_);
+    return symbol;
+  }
+
+  Symbol Intern(const StringPiece &name) {
+    Symbol symbol = Find(name);
+    if (symbol != SymbolTable::kNoSymbol) {
+      return symbol;
+    }
+    pthread_rwlock_wrlock(&lock_);
+    // Another thread may have interned the name in the meantime.
+    symbol = FindLocked(name);
+    if (symbol == SymbolTable::kNoSymbol) {
+      if (size_ == kMaxChunks * kChunkSize) {
+        pthread_rwlock_unlock(&lock_);
+        Error("SymbolTable: error: too many symbols");
+      }
+      size_t chunk = size_ >> kChunkBits;
+      if (chunks_[chunk] == nullptr) {
+        chunks_[chunk] = new string[kChunkSize];
+      }
+      string &stored_name = chunks_[chunk][size_ & (kChunkSize - 1)];
+      stored_name = name.ToString();
+      symbol = static_cast<Symbol>(size_++);
+      symbols_[StringPiece(stored_name)] = symbol;
+    }
+    pthread_rwlock_unlock(&lock_);
+    return symbol;
+  }
+
+  Symbol FindReservedWord(const StringPiece &word) const {
+    if (word.empty()) {
+      return SymbolTable::kNoSymbol;
+    }
+    Symbol symbol = reserved_word_slots_[ReservedWordHash(word) %
+                                         reserved_word_slots_.size()];
+    return symbol != SymbolTable::kNoSymbol && Name(symbol) == word ?
+        symbol : SymbolTable::kNoSymbol;
+  }
+
+  const string &Name(Symbol symbol) const {
+    return chunks_[symbol >> kChunkBits][symbol & (kChunkSize - 1)];
+  }
+
+  size_t size() {
+    pthread_rwlock_rdlock(&lock_);
+    size_t size = size_;
+    pthread_rwlock_unlock(&lock_);
+    return size;
+  }
+
+ private:
+  static const size_t kChunkBits = 12;
+  static const size_t kChunkSize = 1 << kChunkBits;
+  static const size_t kMaxChunks = 1 << 14;
+
+  Symbol FindLocked(const StringPiece &name) const {
+    unordered_map<StringPiece, Symbol, StringPieceHash>::const_iterator it =
+        symbols_.find(name);
+    return it == symbols_.end() ? SymbolTable::kNoSymbol : it->second;
+  }
+
+  /// Finds the smallest table size for which ReservedWordHash has no
+  /// collisions among the default reserved words, whose symbols are
+  /// 0 through num_reserved_words - 1.
+  void BuildReservedWordHash(size_t num_reserved_words) {
+    for (size_t num_slots = num_reserved_words; num_slots <= 1024;
+         ++num_slots) {
+      reserved_word_slots_.assign(num_slots, SymbolTable::kNoSymbol);
+      bool collision = false;
+      for (size_t i = 0; i < num_reserved_words && !collision; ++i) {
+        Symbol &slot = reserved_word_slots_[
+            ReservedWordHash(Name(i)) % num_slots];
+        collision = slot != SymbolTable::kNoSymbol;
+        slot = static_cast<Symbol>(i);
+      }
+      if (!collision) {
+        return;
+      }
+    }
+    Error("SymbolTable: error: no perfect hash for default reserved words");
+  }
+
+  pthread_rwlock_t lock_;
+  unordered_map<StringPiece, Symbol, StringPieceHash> symbols_;
+  string *chunks_[kMaxChunks];
+  size_t size_;
+  vector<Symbol> reserved_word_slots_;
+};
+
+Table &GetTable() {
+  // Never destroyed, so that names remain valid during static destruction.
+  static Table *table = new Table();
+  return *table;
+}
+
+}  // namespace
+
+const Symbol SymbolTable::kNoSymbol;
+
+Symbol
+SymbolTable::Intern(const StringPiece &name) {
+  return GetTable().Intern(name);
+}
+
+Symbol
+SymbolTable::Find(const StringPiece &name) {
+  return GetTable().Find(name);
+}
+
+Symbol
+SymbolTable::FindReservedWord(const StringPiece &word) {
+  return GetTable().FindReservedWord(word);
+}
+
+const string &
+SymbolTable::Name(Symbol symbol) {
+  return GetTable().Name(symbol);
+}
+
+size_t
+SymbolTable::size() {
+  return GetTable().size();
+}
+
+}  // namespace infact
@@ -0,0 +1,94 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Provides the \link infact::SymbolTable SymbolTable \endlink class,
+/// a process-wide table of interned names.
+
+#ifndef INFACT_SYMBOL_TABLE_H_
+#define INFACT_SYMBOL_TABLE_H_
+
+#include <string>
+
+#include "string-piece.h"
+
+namespace infact {
+
+using std::string;
+
+/// A small integer identifying an interned name.
+typedef int Symbol;
+
+/// A process-wide table mapping names&mdash;type names, variable names
+/// and reserved words&mdash;to small integer \link infact::Symbol
+/// Symbol \endlink identifiers and back, so that names may be compared
+/// and used as keys without hashing or copying strings.
+///
+/// The default reserved words of the \link infact::StreamTokenizer
+/// StreamTokenizer \endlink are interned before any other name, so
+/// that the symbol of each is its index in
+/// <tt>default_reserved_words</tt>, and they may be recognized with a
+/// perfect hash via \link FindReservedWord\endlink.
+///
+/// All methods are safe to invoke concurrently.
+class SymbolTable {
+ public:
+  /// The symbol returned for names that are not interned.
+  static const Symbol kNoSymbol = -1;
+
+  /// Returns the symbol for the specified name, interning it if it has
+  /// not already been interned.
+  static Symbol Intern(const StringPiece &name);
+
+  /// Returns the symbol for the specified name, or \link kNoSymbol
+  /// \endlink if it has never been interned.  Since such a name
+  /// cannot be a key of anything keyed by symbol, lookups of arbitrary
+  /// names should use this method rather than \link Intern\endlink.
+  static Symbol Find(const StringPiece &name);
+
+  /// Returns the symbol of the specified default reserved word of the
+  /// \link infact::StreamTokenizer StreamTokenizer\endlink, or \link
+  /// kNoSymbol \endlink if it is not one, using a perfect hash.
+  static Symbol FindReservedWord(const StringPiece &word);
+
+  /// Returns the name of the specified symbol, which must have been
+  /// returned by \link Intern\endlink.  The returned reference remains
+  /// valid for the lifetime of the process.
+  static const string &Name(Symbol symbol);
+
+  /// Returns the number of interned names.
+  static size_t size();
+};
+
+}  // namespace infact
+
+#endif
@@ -0,0 +1,715 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Implementation of the Validator class.
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "environment-impl.h"
+#include "array-view.h"
+#include "factory.h"
+#include "mapped-file.h"
+#include "module-cache.h"
+#include "nesting.h"
+#include "validator.h"
+
+namespace infact {
+
+using std::ostringstream;
+
+const Symbol Validator::kAnyType;
+
+Validator::Validator(const EnvironmentImpl *env) :
+    env_(env), diagnostics_(nullptr), num_errors_(0) {
+  bool_type_ = SymbolTable::Intern("bool");
+  int_type_ = SymbolTable::Intern("int");
+  double_type_ = SymbolTable::Intern("double");
+  string_type_ = SymbolTable::Intern("string");
+  Symbol primitive_types[] = { bool_type_, int_type_, double_type_,
+                               string_type_ };
+  for (Symbol type : primitive_types) {
+    Symbol vector_type = SymbolTable::Intern(SymbolTable::Name(type) + "[]");
+    vector_type_[type] = vector_type;
+    element_type_[vector_type] = type;
+  }
+  view_types_.insert(SymbolTable::Intern("int_view"));
+  view_types_.insert(SymbolTable::Intern("double_view"));
+
+  shared_ptr<const vector<FactoryBase *> > factories =
+      FactoryContainer::factories();
+  for (FactoryContainer::iterator factory_it = factories->begin();
+       factory_it != factories->end(); ++factory_it) {
+    const FactoryBase *factory = *factory_it;
+    string base_name = factory->BaseName();
+    Symbol base_type = SymbolTable::Intern(base_name);
+    Symbol base_vector_type = SymbolTable::Intern(base_name + "[]");
+    vector_type_[base_type] = base_vector_type;
+    element_type_[base_vector_type] = base_type;
+    object_types_.insert(base_type);
+
+    unordered_set<string> registered;
+    factory->CollectRegistered(registered);
+    for (unordered_set<string>::const_iterator it = registered.begin();
+         it != registered.end(); ++it) {
+      ConcreteType &concrete_type =
+          concrete_types_[SymbolTable::Intern(*it)];
+      concrete_type.factory = factory;
+      concrete_type.type = base_type;
+    }
+  }
+}
+
+bool
+Validator::Validate(istream &is, vector<Diagnostic> *diagnostics) {
+  StreamTokenizer st(is);
+  return Validate(st, diagnostics);
+}
+
+bool
+Validator::ValidateString(const string &input,
+                          vector<Diagnostic> *diagnostics) {
+  StreamTokenizer st(input.data(), input.size());
+  return Validate(st, diagnostics);
+}
+
+bool
+Validator::Validate(StreamTokenizer &st, vector<Diagnostic> *diagnostics) {
+  diagnostics_ = diagnostics;
+  num_errors_ = 0;
+  variable_types_.clear();
+  ValidateStatements(st);
+  diagnostics_ = nullptr;
+  return num_errors_ == 0;
+}
+
+void
+Validator::ValidateStatements(StreamTokenizer &st) {
+  // The tokenizer itself reports malformed input (such as an
+  // unterminated string literal) by throwing, but such an error ends
+  // the input anyway.
+  try {
+    while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+      if (!ValidateStatement(st)) {
+        // Resynchronize just after the next semicolon.
+        while (st.PeekTokenType() != StreamTokenizer::EOF_TYPE &&
+               st.PeekView() != ";") {
+          st.Next();
+        }
+        if (st.PeekTokenType() != StreamTokenizer::EOF_TYPE) {
+          st.Next();
+        }
+      }
+    }
+  } catch (const std::runtime_error &e) {
+    Fail(st, e.what());
+  }
+}
+
+bool
+Validator::ValidateStatement(StreamTokenizer &st) {
+  member_scope_.clear();
+
+  // An identifier "import" followed by a string literal begins an
+  // import statement rather than an assignment.
+  if (st.PeekTokenType() == StreamTokenizer::IDENTIFIER &&
+      st.PeekView() == "import") {
+    st.Next();
+    bool is_import = st.PeekTokenType() == StreamTokenizer::STRING;
+    st.Putback();
+    if (is_import) {
+      return ValidateImport(st);
+    }
+  }
+
+  // Read optional type specifier.
+  Symbol explicit_type = SymbolTable::kNoSymbol;
+  StreamTokenizer::TokenType token_type = st.PeekTokenType();
+  if (token_type == StreamTokenizer::IDENTIFIER ||
+      token_type == StreamTokenizer::RESERVED_WORD) {
+    // Only a name already interned can name a type.
+    explicit_type = SpecifiedType(SymbolTable::Find(st.PeekView()));
+    if (explicit_type != SymbolTable::kNoSymbol) {
+      st.Next();
+    }
+  }
+
+  // Read variable name.
+  if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER) {
+    ostringstream err_ss;
+    err_ss << "expected variable name but found "
+           << StreamTokenizer::TypeName(st.PeekTokenType()) << ": \""
+           << st.Peek() << "\"";
+    return Fail(st, err_ss.str());
+  }
+  string name = st.Next();
+
+  // Read equals sign.
+  if (st.PeekView() != "=") {
+    ostringstream err_ss;
+    err_ss << "expected '=' after variable " << name << " but found \""
+           << st.Peek() << "\"";
+    return Fail(st, err_ss.str());
+  }
+  st.Next();
+
+  // Read the value, recording the variable's type even if the value is
+  // invalid, so that later uses of the variable are still checked
+  // sensibly.
+  Symbol type = kAnyType;
+  bool valid = ValidateValue(st, explicit_type, &type);
+  if (!valid) {
+    type = explicit_type == SymbolTable::kNoSymbol ? kAnyType : explicit_type;
+  }
+  variable_types_[name] = type;
+  if (!valid) {
+    return false;
+  }
+
+  // Read semicolon.
+  if (st.PeekView() != ";") {
+    ostringstream err_ss;
+    err_ss << "expected ';' after value of variable " << name
+           << " but found \"" << st.Peek() << "\"";
+    return Fail(st, err_ss.str());
+  }
+  st.Next();
+  return true;
+}
+
+bool
+Validator::ValidateImport(StreamTokenizer &st) {
+  size_t line_number = st.PeekTokenLineNumber();
+  size_t position = st.PeekTokenStart();
+  st.Next();
+  string filename = ModuleCache::Resolve(
+      st.Next(), importing_.empty() ? filename_ : importing_.back());
+  if (st.PeekView() != ";") {
+    return Fail(st, "expected ';' after imported filename but found \"" +
+                st.Peek() + "\"");
+  }
+  st.Next();
+  if (std::find(importing_.begin(), importing_.end(), filename) !=
+      importing_.end()) {
+    return Fail(line_number, position, "circular import of " + filename);
+  }
+  MappedFile file(filename);
+  if (!file.good()) {
+    return Fail(line_number, position, "could not read imported file " +
+                filename);
+  }
+
+  // The imported file is validated on its own, as it is evaluated, and
+  // then defines its variables here.
+  vector<Diagnostic> *diagnostics = diagnostics_;
+  size_t num_errors = num_errors_;
+  const EnvironmentImpl *env = env_;
+  vector<Diagnostic> imported_diagnostics;
+  unordered_map<string, Symbol> variable_types;
+  diagnostics_ = &imported_diagnostics;
+  env_ = nullptr;
+  variable_types_.swap(variable_types);
+  importing_.push_back(filename);
+  StreamTokenizer file_st(file.data(), file.size());
+  ValidateStatements(file_st);
+  importing_.pop_back();
+  variable_types_.swap(variable_types);
+  env_ = env;
+  diagnostics_ = diagnostics;
+  num_errors_ = num_errors;
+  for (unordered_map<string, Symbol>::const_iterator it =
+           variable_types.begin(); it != variable_types.end(); ++it) {
+    variable_types_[it->first] = it->second;
+  }
+  for (vector<Diagnostic>::const_iterator it = imported_diagnostics.begin();
+       it != imported_diagnostics.end(); ++it) {
+    ostringstream err_ss;
+    err_ss << "in file " << filename << " imported here, at line "
+           << it->line_number << ": " << it->message;
+    Fail(line_number, position, err_ss.str());
+  }
+  return imported_diagnostics.empty();
+}
+
+bool
+Validator::ValidateValue(StreamTokenizer &st, Symbol explicit_type,
+                         Symbol *type) {
+  size_t line_number = st.PeekTokenLineNumber();
+  size_t position = st.PeekTokenStart();
+  StreamTokenizer::TokenType token_type = st.PeekTokenType();
+  StringPiece token = st.PeekView();
+  switch (token_type) {
+    case StreamTokenizer::EOF_TYPE:
+      return Fail(st, "unexpected EOF");
+    case StreamTokenizer::STRING:
+      *type = string_type_;
+      st.Next();
+      break;
+    case StreamTokenizer::NUMBER:
+      // A number is a double iff it contains a decimal point.
+      *type = std::find(token.begin(), token.end(), '.') == token.end() ?
+          int_type_ : double_type_;
+      st.Next();
+      break;
+    case StreamTokenizer::RESERVED_WORD:
+      if (token == "true" || token == "false") {
+        *type = bool_type_;
+      } else if (token == "nullptr" || token == "NULL") {
+        // A null pointer has whatever object type is expected of it.
+        if (explicit_type == SymbolTable::kNoSymbol) {
+          return Fail(st, "cannot infer type of " + st.Peek() +
+                      "; specify the type explicitly");
+        }
+        if (explicit_type != kAnyType &&
+            object_types_.count(explicit_type) == 0) {
+          return Fail(st, st.Peek() + " is not a value of type " +
+                      SymbolTable::Name(explicit_type));
+        }
+        *type = explicit_type;
+      } else {
+        return Fail(st, "expected a value but found reserved word \"" +
+                    st.Peek() + "\"");
+      }
+      st.Next();
+      break;
+    case StreamTokenizer::RESERVED_CHAR:
+      if (token != "{") {
+        return Fail(st, "expected a value but found \"" + st.Peek() + "\"");
+      }
+      if (!ValidateVector(st, explicit_type, type)) {
+        return false;
+      }
+      break;
+    case StreamTokenizer::IDENTIFIER:
+      {
+        unordered_map<Symbol, ConcreteType>::const_iterator concrete_it =
+            concrete_types_.find(SymbolTable::Find(token));
+        if (token == INFACT_MMAP_KEYWORD) {
+          if (!ValidateMappedArray(st, explicit_type, type)) {
+            return false;
+          }
+        } else if (concrete_it != concrete_types_.end()) {
+          if (!ValidateSpec(st, concrete_it->second, type)) {
+            return false;
+          }
+        } else {
+          *type = VariableType(token);
+          if (*type == SymbolTable::kNoSymbol) {
+            return Fail(st, "\"" + st.Peek() + "\" is neither a variable "
+                        "nor a concrete object typename");
+          }
+          st.Next();
+        }
+      }
+      break;
+  }
+
+  if (explicit_type != SymbolTable::kNoSymbol && explicit_type != kAnyType &&
+      *type != kAnyType && *type != explicit_type) {
+    return Fail(line_number, position,
+                "explicit type " + SymbolTable::Name(explicit_type) +
+                " and inferred type " + SymbolTable::Name(*type) +
+                " disagree");
+  }
+  return true;
+}
+
+bool
+Validator::ValidateVector(StreamTokenizer &st, Symbol explicit_type,
+                          Symbol *type) {
+  size_t line_number = st.PeekTokenLineNumber();
+  size_t position = st.PeekTokenStart();
+  st.Next();  // Consume open brace.
+
+  // Elements of an explicitly-typed vector have its element type, and
+  // otherwise the type of the first element.  A vector whose explicit
+  // type is not a vector type is validated as though it had no explicit
+  // type, so that, just as when evaluating it, the disagreement is
+  // reported between the explicit type and the inferred vector type.
+  Symbol element_type = SymbolTable::kNoSymbol;
+  if (explicit_type == kAnyType) {
+    element_type = kAnyType;
+  } else if (explicit_type != SymbolTable::kNoSymbol) {
+    element_type = ElementType(explicit_type);
+    if (element_type == SymbolTable::kNoSymbol && st.PeekView() == "for") {
+      return Fail(st, "explicit type " + SymbolTable::Name(explicit_type) +
+                  " is not a vector type");
+    }
+  }
+
+  if (st.PeekView() == "for") {
+    return ValidateSweep(st, element_type, type);
+  }
+
+  bool first_element = true;
+  while (st.PeekView() != "}") {
+    // The type of an explicitly-typed vector is checked against the type
+    // of its first element, as when evaluating it, and only the types of
+    // the remaining elements are checked against its element type.
+    Symbol type_of_element = kAnyType;
+    if (!ValidateValue(st, first_element ? kAnyType : element_type,
+                       &type_of_element)) {
+      return false;
+    }
+    if (first_element && element_type != SymbolTable::kNoSymbol &&
+        element_type != kAnyType && type_of_element != kAnyType &&
+        type_of_element != element_type) {
+      return Fail(line_number, position,
+                  "explicit type " + SymbolTable::Name(explicit_type) +
+                  " and inferred type " +
+                  SymbolTable::Name(VectorType(type_of_element)) +
+                  " disagree");
+    }
+    first_element = false;
+    if (element_type == SymbolTable::kNoSymbol) {
+      element_type = type_of_element;
+    }
+    if (st.PeekView() != "," && st.PeekView() != "}") {
+      return Fail(st, "expected ',' or '}' in vector but found \"" +
+                  st.Peek() + "\"");
+    }
+    if (st.PeekView() == ",") {
+      st.Next();
+    }
+  }
+  st.Next();  // Consume close brace.
+
+  if (element_type == SymbolTable::kNoSymbol) {
+    return Fail(st, "cannot infer type of empty vector; specify the type "
+                "explicitly");
+  }
+  *type = element_type == kAnyType ? kAnyType : VectorType(element_type);
+  return true;
+}
+
+bool
+Validator::ValidateSweep(StreamTokenizer &st, Symbol element_type,
+                         Symbol *type) {
+  if (element_type == SymbolTable::kNoSymbol) {
+    return Fail(st, "cannot infer type of sweep; specify the type "
+                "explicitly");
+  }
+  if (element_type != kAnyType && object_types_.count(element_type) == 0) {
+    return Fail(st, "cannot sweep elements of type " +
+                SymbolTable::Name(element_type));
+  }
+
+  // Each variable of the sweep is in scope for the rest of the sweep.
+  size_t scope_size = member_scope_.size();
+  while (st.PeekView() == "for") {
+    st.Next();
+    if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER) {
+      return Fail(st, "expected variable name but found \"" + st.Peek() +
+                  "\"");
+    }
+    string varname = st.Next();
+    if (st.PeekView() != "in") {
+      return Fail(st, "expected \"in\" but found \"" + st.Peek() + "\"");
+    }
+    st.Next();
+
+    Symbol var_type = SymbolTable::kNoSymbol;
+    if (st.PeekView() == "range") {
+      st.Next();
+      // A range is range(<start>, <end> [, <step>]), of int literals.
+      auto read_int = [&](const char *preceding) {
+        if (st.PeekView() != preceding) {
+          return Fail(st, "expected \"" + string(preceding) + "\" in range "
+                      "but found \"" + st.Peek() + "\"");
+        }
+        st.Next();
+        if (st.PeekView() == "-") {
+          st.Next();
+        }
+        StringPiece token = st.PeekView();
+        if (st.PeekTokenType() != StreamTokenizer::NUMBER ||
+            std::find(token.begin(), token.end(), '.') != token.end()) {
+          return Fail(st, "expected int in range but found \"" + st.Peek() +
+                      "\"");
+        }
+        st.Next();
+        return true;
+      };
+      if (!read_int("(") || !read_int(",") ||
+          (st.PeekView() == "," && !read_int(","))) {
+        return false;
+      }
+      if (st.PeekView() != ")") {
+        return Fail(st, "expected \")\" in range but found \"" + st.Peek() +
+                    "\"");
+      }
+      st.Next();
+      var_type = int_type_;
+    } else {
+      if (st.PeekView() != "{") {
+        return Fail(st, "expected '{' or \"range\" but found \"" +
+                    st.Peek() + "\"");
+      }
+      st.Next();
+      if (st.PeekView() == "}") {
+        return Fail(st, "no values for sweep variable " + varname);
+      }
+      // Every value must have the same type.
+      while (st.PeekView() != "}") {
+        Symbol value_type = kAnyType;
+        if (!ValidateValue(st, SymbolTable::kNoSymbol, &value_type)) {
+          return false;
+        }
+        if (var_type == SymbolTable::kNoSymbol || var_type == kAnyType) {
+          var_type = value_type;
+        } else if (value_type != kAnyType && value_type != var_type) {
+          return Fail(st, "values of sweep variable " + varname +
+                      " have types " +
+                      SymbolTable::Name(var_type) + " and " +
+                      SymbolTable::Name(value_type));
+        }
+        if (st.PeekView() != "," && st.PeekView() != "}") {
+          return Fail(st, "expected ',' or '}' in sweep values but found \"" +
+                      st.Peek() + "\"");
+        }
+        if (st.PeekView() == ",") {
+          st.Next();
+        }
+      }
+      st.Next();  // Consume close brace.
+    }
+    member_scope_.push_back(std::make_pair(varname, var_type));
+  }
+
+  Symbol spec_type = kAnyType;
+  bool valid = ValidateValue(st, element_type, &spec_type);
+  member_scope_.resize(scope_size);
+  if (!valid) {
+    return false;
+  }
+  if (st.PeekView() != "}") {
+    return Fail(st, "expected '}' after spec of sweep but found \"" +
+                st.Peek() + "\"");
+  }
+  st.Next();  // Consume close brace.
+  *type = element_type == kAnyType ? kAnyType : VectorType(element_type);
+  return true;
+}
+
+bool
+Validator::ValidateSpec(StreamTokenizer &st,
+                        const ConcreteType &concrete_type, Symbol *type) {
+  if (Nesting::depth() >= Nesting::max_depth()) {
+    ostringstream err_ss;
+    err_ss << "spec nested more than " << Nesting::max_depth()
+           << " levels deep";
+    return Fail(st, err_ss.str());
+  }
+  if (Nesting::StackLow()) {
+    bool valid = false;
+    Nesting::RunOnNewStack([&]() {
+        valid = ValidateSpec(st, concrete_type, type);
+      });
+    return valid;
+  }
+  Nesting::Scope nesting;
+  string type_name = st.Next();
+  const MemberSchema *schema =
+      concrete_type.factory->GetMemberSchema(type_name);
+  if (schema == nullptr) {
+    return Fail(st, "no schema for concrete type " + type_name);
+  }
+
+  if (st.PeekView() != "(") {
+    return Fail(st, "expected '(' after type " + type_name + " but found \"" +
+                st.Peek() + "\"");
+  }
+  st.Next();
+
+  // Members initialized so far may be referred to by later initializers
+  // in this list only.
+  size_t scope_size = member_scope_.size();
+  MemberSet initialized(schema->size());
+  while (st.PeekView() != ")") {
+    if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER) {
+      ostringstream err_ss;
+      err_ss << "expected member name in initializer list for type "
+             << type_name << " but found "
+             << StreamTokenizer::TypeName(st.PeekTokenType()) << ": \""
+             << st.Peek() << "\"";
+      return Fail(st, err_ss.str());
+    }
+    size_t member_index = schema->Find(st.PeekView());
+    if (member_index == MemberSchema::kNoMember) {
+      return Fail(st, "unknown member name \"" + st.Peek() +
+                  "\" in initializer list for type " + type_name);
+    }
+    st.Next();
+    const string &member_name = schema->name(member_index);
+
+    bool saw_open_paren = st.PeekView() == "(";
+    if (!saw_open_paren && st.PeekView() != "=") {
+      return Fail(st, "expected '(' or '=' after member " + member_name +
+                  " but found \"" + st.Peek() + "\"");
+    }
+    st.Next();
+
+    Symbol member_type = SymbolTable::Intern(
+        schema->type_name(member_index));
+    Symbol value_type = kAnyType;
+    if (!ValidateValue(st, member_type, &value_type)) {
+      return false;
+    }
+    member_scope_.push_back(std::make_pair(member_name, member_type));
+    initialized.Insert(member_index);
+
+    if (saw_open_paren) {
+      if (st.PeekView() != ")") {
+        return Fail(st, "expected ')' after value of member " + member_name +
+                    " but found \"" + st.Peek() + "\"");
+      }
+      st.Next();
+    }
+    if (st.PeekView() != "," && st.PeekView() != ")") {
+      return Fail(st, "expected ',' or ')' after member " + member_name +
+                  " but found \"" + st.Peek() + "\"");
+    }
+    if (st.PeekView() == ",") {
+      st.Next();
+    }
+  }
+  st.Next();  // Consume close parenthesis.
+  member_scope_.resize(scope_size);
+
+  for (size_t i = 0; i < schema->size(); ++i) {
+    if (schema->required(i) && !initialized.Contains(i)) {
+      // Keep checking the rest of the statement: a missing member
+      // does not affect how the remaining tokens are read.
+      Fail(st, "initialization for member with name \"" + schema->name(i) +
+           "\" of type " + type_name + " required but not found");
+    }
+  }
+  *type = concrete_type.type;
+  return true;
+}
+
+bool
+Validator::ValidateMappedArray(StreamTokenizer &st, Symbol explicit_type,
+                                Symbol *type) {
+  // A mapped array has whatever view type is expected of it.
+  if (explicit_type == SymbolTable::kNoSymbol) {
+    return Fail(st, "cannot infer type of mapped array; specify the type "
+                "explicitly");
+  }
+  if (explicit_type != kAnyType && view_types_.count(explicit_type) == 0) {
+    return Fail(st, string("mapped array is not a value of type ") +
+                SymbolTable::Name(explicit_type));
+  }
+  st.Next();
+  if (st.PeekView() != "(") {
+    return Fail(st, "expected '(' after " INFACT_MMAP_KEYWORD " but found \"" +
+                st.Peek() + "\"");
+  }
+  st.Next();
+  if (st.PeekTokenType() != StreamTokenizer::STRING) {
+    return Fail(st, "expected filename string but found \"" + st.Peek() +
+                "\"");
+  }
+  st.Next();
+  if (st.PeekView() != ")") {
+    return Fail(st, "expected ')' after filename but found \"" + st.Peek() +
+                "\"");
+  }
+  st.Next();
+  *type = explicit_type;
+  return true;
+}
+
+Symbol
+Validator::VariableType(const StringPiece &varname) const {
+  for (vector<pair<string, Symbol> >::const_reverse_iterator it =
+           member_scope_.rbegin(); it != member_scope_.rend(); ++it) {
+    if (StringPiece(it->first) == varname) {
+      return it->second;
+    }
+  }
+  unordered_map<string, Symbol>::const_iterator it =
+      variable_types_.find(varname.ToString());
+  if (it != variable_types_.end()) {
+    return it->second;
+  }
+  // Every variable of the environment has an interned name.
+  return env_ == nullptr ? SymbolTable::kNoSymbol :
+      env_->GetTypeSymbol(SymbolTable::Find(varname));
+}
+
+Symbol
+Validator::SpecifiedType(Symbol specifier) const {
+  if (vector_type_.find(specifier) != vector_type_.end() ||
+      element_type_.find(specifier) != element_type_.end() ||
+      view_types_.count(specifier) != 0) {
+    return specifier;
+  }
+  unordered_map<Symbol, ConcreteType>::const_iterator it =
+      concrete_types_.find(specifier);
+  return it == concrete_types_.end() ? SymbolTable::kNoSymbol :
+      it->second.type;
+}
+
+Symbol
+Validator::ElementType(Symbol type) const {
+  unordered_map<Symbol, Symbol>::const_iterator it = element_type_.find(type);
+  return it == element_type_.end() ? SymbolTable::kNoSymbol : it->second;
+}
+
+Symbol
+Validator::VectorType(Symbol type) const {
+  unordered_map<Symbol, Symbol>::const_iterator it = vector_type_.find(type);
+  return it == vector_type_.end() ?
+      SymbolTable::Intern(SymbolTable::Name(type) + "[]") : it->second;
+}
+
+bool
+Validator::Fail(StreamTokenizer &st, const string &message) {
+  return Fail(st.PeekTokenLineNumber(), st.PeekTokenStart(), message);
+}
+
+bool
+Validator::Fail(size_t line_number, size_t position, const string &message) {
+  ++num_errors_;
+  if (diagnostics_ != nullptr) {
+    Diagnostic diagnostic;
+    diagnostic.line_number = line_number + 1;
+    diagnostic.position = position;
+    diagnostic.message = message;
+    diagnostics_->push_back(diagnostic);
+  }
+  return false;
+}
+
+}  // namespace infact
@@ -0,0 +1,209 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+/// \file
+/// Provides the \link infact::Validator Validator \endlink class, which
+/// checks configurations in the interpreter&rsquo;s language without
+/// constructing any objects or throwing exceptions.
+
+#ifndef INFACT_VALIDATOR_H_
+#define INFACT_VALIDATOR_H_
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "stream-tokenizer.h"
+#include "symbol-table.h"
+
+namespace infact {
+
+using std::istream;
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+class EnvironmentImpl;
+class FactoryBase;
+
+/// A single problem found while validating a configuration.
+struct Diagnostic {
+  /// The (one-based) line number at which the problem was found.
+  size_t line_number;
+  /// The byte position in the input at which the problem was found.
+  size_t position;
+  /// A human-readable description of the problem.
+  string message;
+};
+
+/// Checks configurations written in the language of the \link
+/// infact::Interpreter Interpreter\endlink, reporting every problem
+/// found as a \link Diagnostic \endlink instead of throwing an exception
+/// at the first one.  After a problem, checking resumes at the next
+/// statement, i.e., just after the next <tt>;</tt> token.
+///
+/// Validation checks the syntax of each statement, that explicit and
+/// inferred types agree, that every concrete type is registered with a
+/// \link infact::Factory Factory\endlink, that every member named in an
+/// initializer list exists, has a value of the right type and that all
+/// required members are initialized, and that every variable referred
+/// to has been defined.  No objects are constructed, so that errors
+/// only detectable by an object&rsquo;s own initialization code (such
+/// as in its <tt>PostInit</tt> method) are not found.  An imported file
+/// is validated in turn, and its problems are reported at the
+/// <tt>import</tt> statement.
+///
+/// Constructing a validator gathers the types known to all factories,
+/// so a single instance should be reused to validate many
+/// configurations.  A validator may not be used by several threads at
+/// once.
+class Validator {
+ public:
+  /// Constructs a new validator.
+  ///
+  /// \param env an optional environment whose variables may be referred
+  ///            to by the configurations validated; if non-null, it must
+  ///            outlive this validator
+  explicit Validator(const EnvironmentImpl *env = nullptr);
+
+  /// Sets the name of the file whose configuration is validated, against
+  /// whose directory the names of imported files are resolved; by
+  /// default, they are resolved against the current working directory.
+  void set_filename(const string &filename) { filename_ = filename; }
+
+  /// Validates the configuration read from the specified stream.
+  ///
+  /// \param is          the stream from which to read a configuration
+  /// \param diagnostics if non-null, the vector to which to append a
+  ///                    diagnostic for each problem found
+  /// \return whether the configuration is free of problems
+  bool Validate(istream &is, vector<Diagnostic> *diagnostics);
+
+  /// Validates the configuration contained in the specified string.
+  /// \see Validate(istream&, vector<Diagnostic>*)
+  bool ValidateString(const string &input, vector<Diagnostic> *diagnostics);
+
+  /// Validates the configuration read from the specified tokenizer.
+  /// \see Validate(istream&, vector<Diagnostic>*)
+  bool Validate(StreamTokenizer &st, vector<Diagnostic> *diagnostics);
+
+ private:
+  /// Information about a concrete type that a factory can construct.
+  struct ConcreteType {
+    const FactoryBase *factory;
+    /// The abstract type of the factory.
+    Symbol type;
+  };
+
+  // Each of the following Validate methods consumes the tokens of
+  // one construct, returning false after adding a diagnostic if there
+  // is a problem.  A value's type is kAnyType when it cannot be known,
+  // for example because it refers to a variable whose definition was
+  // invalid.
+
+  bool ValidateStatement(StreamTokenizer &st);
+  bool ValidateImport(StreamTokenizer &st);
+  bool ValidateValue(StreamTokenizer &st, Symbol explicit_type, Symbol *type);
+  bool ValidateVector(StreamTokenizer &st, Symbol explicit_type,
+                      Symbol *type);
+  bool ValidateSweep(StreamTokenizer &st, Symbol element_type, Symbol *type);
+  bool ValidateSpec(StreamTokenizer &st, const ConcreteType &concrete_type,
+                    Symbol *type);
+  bool ValidateMappedArray(StreamTokenizer &st, Symbol explicit_type,
+                           Symbol *type);
+
+  /// Validates every statement read from the specified tokenizer.
+  void ValidateStatements(StreamTokenizer &st);
+
+  /// Returns the type of the specified variable, or kNoSymbol if it is
+  /// undefined.
+  Symbol VariableType(const StringPiece &varname) const;
+
+  /// Returns the type named by the specified type specifier, or
+  /// kNoSymbol if it does not name a type.
+  Symbol SpecifiedType(Symbol specifier) const;
+
+  /// Returns the element type of the specified vector type, or kNoSymbol
+  /// if it is not a vector type.
+  Symbol ElementType(Symbol type) const;
+
+  /// Returns the type of vectors of the specified type.
+  Symbol VectorType(Symbol type) const;
+
+  /// Adds a diagnostic for the next token and returns false.
+  bool Fail(StreamTokenizer &st, const string &message);
+
+  /// Adds a diagnostic for the specified position and returns false.
+  bool Fail(size_t line_number, size_t position, const string &message);
+
+  /// A (non-symbol) type compatible with every other type.
+  static const Symbol kAnyType = SymbolTable::kNoSymbol - 1;
+
+  // Type information gathered at construction.
+  unordered_map<Symbol, ConcreteType> concrete_types_;
+  unordered_map<Symbol, Symbol> vector_type_;
+  unordered_map<Symbol, Symbol> element_type_;
+  /// The abstract types of all factories.
+  unordered_set<Symbol> object_types_;
+  /// The types of array views (see \link infact::ArrayView
+  /// ArrayView\endlink).
+  unordered_set<Symbol> view_types_;
+  Symbol bool_type_;
+  Symbol int_type_;
+  Symbol double_type_;
+  Symbol string_type_;
+
+  const EnvironmentImpl *env_;
+  string filename_;
+
+  // State for the current validation.
+  vector<Diagnostic> *diagnostics_;
+  size_t num_errors_;
+  /// The types of the variables defined so far.  Variables are named by
+  /// strings rather than symbols, so that validating untrusted input
+  /// interns none of its names.
+  unordered_map<string, Symbol> variable_types_;
+  /// The members, with their types, of the initializer lists being
+  /// validated, which may be referred to as variables later in the
+  /// same initializer list.
+  vector<pair<string, Symbol> > member_scope_;
+  /// The names of the imported files being validated, innermost last.
+  vector<string> importing_;
+};
+
+}  // namespace infact
+
+#endif
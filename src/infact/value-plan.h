@@ -0,0 +1,526 @@
+// Copyright 2014, Google Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following disclaimer
+//     in the documentation and/or other materials provided with the
+//     distribution.
+//   * Neither the name of Google Inc. nor the names of its
+//     contributors may be used to endorse or promote products derived from
+//     this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// -----------------------------------------------------------------------------
+//
+//
+//
+/// \file
+/// Provides compiled plans for the values of data members of \link
+/// infact::Factory Factory\endlink-constructible objects, used by
+/// \link infact::CompiledSpec CompiledSpec \endlink instances to
+/// initialize data members without reading any tokens.
+
+#ifndef INFACT_VALUE_PLAN_H_
+#define INFACT_VALUE_PLAN_H_
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "array-view.h"
+#include "environment.h"
+#include "error.h"
+#include "stream-init.h"
+#include "stream-tokenizer.h"
+#include "sweep.h"
+
+namespace infact {
+
+using std::ostringstream;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+template <typename T> class CompiledSpec;
+template <typename T> class Factory;
+template <typename T> class TypeName;
+
+/// An immutable plan for producing a value of type <tt>T</tt>, obtained
+/// by parsing tokens once so that the value may be produced many times.
+///
+/// \tparam T the type of value produced by this plan
+template <typename T>
+class ValuePlan {
+ public:
+  virtual ~ValuePlan() { }
+
+  /// Returns the value described by this plan.
+  ///
+  /// \param env the environment in which to look up any variables
+  ///            referred to by this plan
+  virtual T Evaluate(Environment *env) const = 0;
+};
+
+/// A plan for a value that was fully determined when it was parsed,
+/// such as a literal or <tt>nullptr</tt>.
+template <typename T>
+class LiteralValuePlan : public ValuePlan<T> {
+ public:
+  /// Constructs a plan that always produces the specified value.
+  LiteralValuePlan(const T &value) : value_(value) { }
+  virtual ~LiteralValuePlan() { }
+
+  /// \copydoc ValuePlan::Evaluate
+  virtual T Evaluate(Environment *env) const { return value_; }
+ private:
+  T value_;
+};
+
+/// A plan for a value that is the value of a variable, looked up each
+/// time the plan is evaluated.
+template <typename T>
+class VariableValuePlan : public ValuePlan<T> {
+ public:
+  /// Constructs a plan that produces the value of the specified variable.
+  VariableValuePlan(const string &varname) : varname_(varname) { }
+  virtual ~VariableValuePlan() { }
+
+  /// \copydoc ValuePlan::Evaluate
+  virtual T Evaluate(Environment *env) const {
+    VarMap<T> *var_map = env == nullptr ? nullptr :
+        dynamic_cast<VarMap<T> *>(env->GetVarMap(varname_));
+    T value = T();
+    if (var_map == nullptr || !var_map->Get(varname_, &value)) {
+      ostringstream err_ss;
+      err_ss << "ValuePlan: error: no variable " << varname_ << " of type "
+             << TypeName<T>().ToString();
+      Error(err_ss.str());
+    }
+    return value;
+  }
+ private:
+  string varname_;
+};
+
+/// A plan for a \link infact::Factory Factory\endlink-constructible
+/// object, constructed anew each time the plan is evaluated.
+///
+/// \tparam T the abstract base type of the object
+template <typename T>
+class ObjectValuePlan : public ValuePlan<shared_ptr<T> > {
+ public:
+  /// Constructs a plan that instantiates the specified compiled spec.
+  ObjectValuePlan(shared_ptr<const CompiledSpec<T> > spec) : spec_(spec) { }
+  virtual ~ObjectValuePlan() { }
+
+  /// \copydoc ValuePlan::Evaluate
+  virtual shared_ptr<T> Evaluate(Environment *env) const {
+    return spec_->Instantiate(env);
+  }
+ private:
+  shared_ptr<const CompiledSpec<T> > spec_;
+};
+
+/// A plan for a vector, whose elements are each described by a plan.
+///
+/// \tparam T the type of elements of the vector
+template <typename T>
+class VectorValuePlan : public ValuePlan<vector<T> > {
+ public:
+  /// Constructs a plan for an empty vector.
+  VectorValuePlan() { }
+  virtual ~VectorValuePlan() { }
+
+  /// Appends a plan for another element.
+  void Add(shared_ptr<const ValuePlan<T> > element) {
+    elements_.push_back(element);
+  }
+
+  /// \copydoc ValuePlan::Evaluate
+  virtual vector<T> Evaluate(Environment *env) const {
+    vector<T> value;
+    value.reserve(elements_.size());
+    for (typename vector<shared_ptr<const ValuePlan<T> > >::const_iterator it =
+             elements_.begin();
+         it != elements_.end();
+         ++it) {
+      value.push_back((*it)->Evaluate(env));
+    }
+    return value;
+  }
+ private:
+  vector<shared_ptr<const ValuePlan<T> > > elements_;
+};
+
+/// A plan for a vector of \link infact::Factory
+/// Factory\endlink-constructible objects specified by a sweep (see
+/// \link infact::Sweep Sweep\endlink), which constructs one object per
+/// combination of values of the sweep&rsquo;s variables each time the
+/// plan is evaluated.
+///
+/// \tparam T the abstract base type of the objects
+template <typename T>
+class SweepValuePlan : public ValuePlan<vector<shared_ptr<T> > > {
+ public:
+  /// The name of a variable of a sweep and the text of each of its values.
+  typedef std::pair<string, vector<string> > Clause;
+
+  /// Constructs a plan for the objects of the specified sweep.
+  ///
+  /// \param clauses the clauses of the sweep, in order
+  /// \param spec    the spec from which to construct each object
+  SweepValuePlan(const vector<Clause> &clauses,
+                 shared_ptr<const CompiledSpec<T> > spec) :
+      clauses_(clauses), spec_(spec) { }
+  virtual ~SweepValuePlan() { }
+
+  /// \copydoc ValuePlan::Evaluate
+  ///
+  /// The values of the variables of the sweep are read in the specified
+  /// environment, in which the objects are constructed using its number
+  /// of threads (see \link infact::Environment::sweep_threads
+  /// Environment::sweep_threads\endlink).
+  virtual vector<shared_ptr<T> > Evaluate(Environment *env) const {
+    Sweep sweep(env);
+    for (typename vector<Clause>::const_iterator it = clauses_.begin();
+         it != clauses_.end();
+         ++it) {
+      sweep.Add(it->first, it->second);
+    }
+    Factory<T> factory;
+    return factory.CreateMany(*spec_, sweep,
+                              env == nullptr ? 1 : env->sweep_threads());
+  }
+ private:
+  vector<Clause> clauses_;
+  shared_ptr<const CompiledSpec<T> > spec_;
+};
+
+/// Compiles a sweep specifying every element of a vector at once (see
+/// \link infact::Sweep Sweep\endlink).  This implementation is for
+/// element types that cannot be swept; the partial specialization for
+/// <tt>shared_ptr</tt> to a \link infact::Factory
+/// Factory\endlink-constructible type compiles a \link SweepValuePlan
+/// \endlink.
+///
+/// \tparam T the element type
+template <typename T>
+struct SweepPlanCompiler {
+  /// Reads a sweep and its spec from the specified tokenizer, just
+  /// after the open brace of a vector, up to but not including the
+  /// close brace, returning a plan for the vector, or <tt>nullptr</tt>
+  /// if there was no sweep to read.
+  static shared_ptr<const ValuePlan<vector<T> > > Compile(StreamTokenizer &st) {
+    return shared_ptr<const ValuePlan<vector<T> > >();
+  }
+};
+
+/// Compiles the tokens for a value of a primitive type into a plan:
+/// an identifier is a variable reference and anything else must be a
+/// literal.
+///
+/// \tparam T a primitive type
+template <typename T>
+class PrimitiveValuePlanCompiler {
+ public:
+  /// Reads the tokens for a value of type <tt>T</tt> from the
+  /// specified tokenizer and returns a plan for that value.
+  static shared_ptr<const ValuePlan<T> > Compile(StreamTokenizer &st) {
+    if (st.PeekTokenType() == StreamTokenizer::IDENTIFIER) {
+      return shared_ptr<const ValuePlan<T> >(
+          new VariableValuePlan<T>(st.Next()));
+    }
+    T value;
+    Initializer<T> initializer(&value);
+    initializer.Init(st);
+    return shared_ptr<const ValuePlan<T> >(new LiteralValuePlan<T>(value));
+  }
+
+  /// Raises an error unless the next token is a number whose type,
+  /// inferred by the presence of a decimal point, is the one expected.
+  /// This is the same constraint imposed when reading a number into a
+  /// variable with an explicit type via \link
+  /// infact::Environment::ReadAndSet Environment::ReadAndSet\endlink.
+  static void CheckNumber(const StreamTokenizer &st, bool expect_double) {
+    if (st.PeekTokenType() != StreamTokenizer::NUMBER) {
+      return;
+    }
+    bool is_double = st.Peek().find('.') != string::npos;
+    if (is_double != expect_double) {
+      ostringstream err_ss;
+      err_ss << "ValuePlan: error: expected " << TypeName<T>().ToString()
+             << " literal at stream position " << st.PeekTokenStart()
+             << " but found " << (is_double ? "double" : "int")
+             << " literal \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+  }
+};
+
+/// Compiles the tokens for a value of type <tt>T</tt> into a plan.  This
+/// implementation is for a <tt>shared_ptr</tt> to a
+/// \link infact::Factory Factory\endlink-constructible type.
+///
+/// \tparam T a <tt>shared_ptr</tt> to any type constructible by a Factory
+template <typename T>
+class ValuePlanCompiler {
+ public:
+  /// \copydoc PrimitiveValuePlanCompiler::Compile
+  static shared_ptr<const ValuePlan<T> > Compile(StreamTokenizer &st) {
+    typedef typename T::element_type Element;
+    StreamTokenizer::TokenType token_type = st.PeekTokenType();
+    if (token_type == StreamTokenizer::RESERVED_WORD &&
+        (st.Peek() == "nullptr" || st.Peek() == "NULL")) {
+      st.Next();
+      return shared_ptr<const ValuePlan<T> >(new LiteralValuePlan<T>(T()));
+    }
+    if (token_type == StreamTokenizer::IDENTIFIER &&
+        !Factory<Element>::IsRegistered(st.Peek())) {
+      return shared_ptr<const ValuePlan<T> >(
+          new VariableValuePlan<T>(st.Next()));
+    }
+    Factory<Element> factory;
+    return shared_ptr<const ValuePlan<T> >(
+        new ObjectValuePlan<Element>(factory.Compile(st)));
+  }
+};
+
+/// Defers the construction of a \link infact::Factory
+/// Factory\endlink-constructible object specified by a spec.
+///
+/// \tparam T the abstract base type of the object
+template <typename T>
+struct DeferredReader<shared_ptr<T> > {
+  /// \copydoc DeferredReader::Read
+  ///
+  /// Only a spec is deferred: <tt>nullptr</tt> and references to
+  /// variables are cheap to read right away.  The spec is compiled now,
+  /// and instantiated in a copy of the specified environment, made in
+  /// constant time, so that the variables it refers to have the values
+  /// they have now.
+  static shared_ptr<const LazyValue<shared_ptr<T> > > Read(
+      StreamTokenizer &st, Environment *env) {
+    if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER ||
+        !Factory<T>::IsRegistered(st.Peek())) {
+      return shared_ptr<const LazyValue<shared_ptr<T> > >();
+    }
+    Factory<T> factory;
+    shared_ptr<const CompiledSpec<T> > spec = factory.Compile(st);
+    shared_ptr<const Environment> spec_env(env->Copy());
+    return std::make_shared<LazyValue<shared_ptr<T> > >(
+        [spec, spec_env]() { return spec->Instantiate(spec_env.get()); });
+  }
+};
+
+/// Reads a sweep of \link infact::Factory Factory\endlink-constructible
+/// objects, constructing one object per combination of values of the
+/// sweep's variables from a single compiled spec.
+///
+/// \tparam T the abstract base type of the objects
+template <typename T>
+struct SweepReader<shared_ptr<T> > {
+  /// \copydoc SweepReader::Read
+  ///
+  /// The objects are constructed using the number of threads of the
+  /// specified environment (see \link
+  /// infact::Environment::sweep_threads Environment::sweep_threads\endlink).
+  static bool Read(StreamTokenizer &st, Environment *env,
+                   vector<shared_ptr<T> > *values) {
+    if (st.PeekView() != "for") {
+      return false;
+    }
+    Sweep sweep(env);
+    while (st.PeekView() == "for") {
+      sweep.Read(st);
+    }
+    if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER ||
+        !Factory<T>::IsRegistered(st.Peek())) {
+      ostringstream err_ss;
+      err_ss << "Sweep: error: expected spec of " << TypeName<T>().ToString()
+             << " at stream position " << st.PeekTokenStart()
+             << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    Factory<T> factory;
+    shared_ptr<const CompiledSpec<T> > spec = factory.Compile(st);
+    vector<shared_ptr<T> > objects =
+        factory.CreateMany(*spec, sweep, env->sweep_threads());
+    values->insert(values->end(), objects.begin(), objects.end());
+    if (st.PeekView() != "}") {
+      ostringstream err_ss;
+      err_ss << "Sweep: error: expected '}' at stream position "
+             << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    return true;
+  }
+};
+
+/// Compiles a sweep of \link infact::Factory Factory\endlink-constructible
+/// objects, exactly as \link SweepReader \endlink reads one.
+///
+/// \tparam T the abstract base type of the objects
+template <typename T>
+struct SweepPlanCompiler<shared_ptr<T> > {
+  /// \copydoc SweepPlanCompiler::Compile
+  static shared_ptr<const ValuePlan<vector<shared_ptr<T> > > > Compile(
+      StreamTokenizer &st) {
+    if (st.PeekView() != "for") {
+      return shared_ptr<const ValuePlan<vector<shared_ptr<T> > > >();
+    }
+    vector<typename SweepValuePlan<T>::Clause> clauses;
+    while (st.PeekView() == "for") {
+      clauses.push_back(typename SweepValuePlan<T>::Clause());
+      Sweep::ReadClause(st, &clauses.back().first, &clauses.back().second);
+    }
+    if (st.PeekTokenType() != StreamTokenizer::IDENTIFIER ||
+        !Factory<T>::IsRegistered(st.Peek())) {
+      ostringstream err_ss;
+      err_ss << "Sweep: error: expected spec of " << TypeName<T>().ToString()
+             << " at stream position " << st.PeekTokenStart()
+             << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    Factory<T> factory;
+    shared_ptr<const CompiledSpec<T> > spec = factory.Compile(st);
+    if (st.PeekView() != "}") {
+      ostringstream err_ss;
+      err_ss << "Sweep: error: expected '}' at stream position "
+             << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    return shared_ptr<const ValuePlan<vector<shared_ptr<T> > > >(
+        new SweepValuePlan<T>(clauses, spec));
+  }
+};
+
+/// A specialization to compile <tt>bool</tt> values.
+template <>
+class ValuePlanCompiler<bool> : public PrimitiveValuePlanCompiler<bool> { };
+
+/// A specialization to compile <tt>string</tt> values.
+template <>
+class ValuePlanCompiler<string> : public PrimitiveValuePlanCompiler<string> { };
+
+/// A specialization to compile <tt>int</tt> values.
+template <>
+class ValuePlanCompiler<int> : public PrimitiveValuePlanCompiler<int> {
+ public:
+  /// \copydoc PrimitiveValuePlanCompiler::Compile
+  static shared_ptr<const ValuePlan<int> > Compile(StreamTokenizer &st) {
+    CheckNumber(st, false);
+    return PrimitiveValuePlanCompiler<int>::Compile(st);
+  }
+};
+
+/// A specialization to compile <tt>double</tt> values.
+template <>
+class ValuePlanCompiler<double> : public PrimitiveValuePlanCompiler<double> {
+ public:
+  /// \copydoc PrimitiveValuePlanCompiler::Compile
+  static shared_ptr<const ValuePlan<double> > Compile(StreamTokenizer &st) {
+    CheckNumber(st, true);
+    return PrimitiveValuePlanCompiler<double>::Compile(st);
+  }
+};
+
+/// A partial specialization to compile array views, either as a
+/// reference to a variable or as a literal mapping a file, which is
+/// mapped once, when compiling, and shared by every value.
+///
+/// \tparam T the type of elements of the array
+template <typename T>
+class ValuePlanCompiler<ArrayView<T> > {
+ public:
+  /// \copydoc PrimitiveValuePlanCompiler::Compile
+  static shared_ptr<const ValuePlan<ArrayView<T> > > Compile(
+      StreamTokenizer &st) {
+    if (st.PeekTokenType() == StreamTokenizer::IDENTIFIER &&
+        st.PeekView() != INFACT_MMAP_KEYWORD) {
+      return shared_ptr<const ValuePlan<ArrayView<T> > >(
+          new VariableValuePlan<ArrayView<T> >(st.Next()));
+    }
+    ArrayView<T> value;
+    Initializer<ArrayView<T> > initializer(&value);
+    initializer.Init(st);
+    return shared_ptr<const ValuePlan<ArrayView<T> > >(
+        new LiteralValuePlan<ArrayView<T> >(value));
+  }
+};
+
+/// A partial specialization to compile vectors, either as a reference
+/// to a vector variable or as a brace-enclosed list of element values.
+///
+/// \tparam T the type of elements of the vector
+template <typename T>
+class ValuePlanCompiler<vector<T> > {
+ public:
+  /// \copydoc PrimitiveValuePlanCompiler::Compile
+  static shared_ptr<const ValuePlan<vector<T> > > Compile(StreamTokenizer &st) {
+    if (st.PeekTokenType() == StreamTokenizer::IDENTIFIER) {
+      return shared_ptr<const ValuePlan<vector<T> > >(
+          new VariableValuePlan<vector<T> >(st.Next()));
+    }
+    if (st.Peek() != "{") {
+      ostringstream err_ss;
+      err_ss << "ValuePlan<vector<T>>: "
+             << "error: expected '{' at stream position "
+             << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+      Error(err_ss.str());
+    }
+    // Consume open brace.
+    st.Next();
+
+    // A sweep specifies every element at once (see infact::Sweep).
+    shared_ptr<const ValuePlan<vector<T> > > sweep =
+        SweepPlanCompiler<T>::Compile(st);
+    if (sweep != nullptr) {
+      // Consume close brace.
+      st.Next();
+      return sweep;
+    }
+
+    shared_ptr<VectorValuePlan<T> > plan(new VectorValuePlan<T>());
+    while (st.Peek() != "}") {
+      plan->Add(ValuePlanCompiler<T>::Compile(st));
+      // Each vector element must be followed by a comma or the final
+      // closing brace.
+      if (st.Peek() != ","  && st.Peek() != "}") {
+        ostringstream err_ss;
+        err_ss << "ValuePlan<vector<T>>: "
+               << "error: expected ',' or '}' at stream position "
+               << st.PeekTokenStart() << " but found \"" << st.Peek() << "\"";
+        Error(err_ss.str());
+      }
+      // Read comma, if present.
+      if (st.Peek() == ",") {
+        st.Next();
+      }
+    }
+    // Consume close brace.
+    st.Next();
+    return plan;
+  }
+};
+
+}  // namespace infact
+
+#endif